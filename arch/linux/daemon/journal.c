@@ -32,7 +32,7 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
  * NOTE:
  *
  * the journal format is like this:
- * Mar  9 14:31:43 joebar armadito-journal[1339]: type="detection", context="on-demand", scan_id=316020368, path="/home/joebar/EICAR/eicar.com", scan_status="malware", scan_action="none", module_name="clamav", module_report="Eicar-Test-Signature"
+ * Mar  9 14:31:43 joebar armadito-journal[1339]: type="detection", context="on-demand", scan_id=316020368, path="/home/joebar/EICAR/eicar.com", scan_status="malware", scan_action="none", module_name="clamav", module_report="Eicar-Test-Signature", digest="131f95c51cc819465fa1797f6ccacf9d494aaaff46fa3eac73ae63ffbdfd8267"
  *
  * be carefull:
  * - to add new fields AT THE END of the format in order not to break log file parsing
@@ -44,14 +44,15 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 static void detection_event_journal(struct a6o_event *ev)
 {
 	syslog(LOG_INFO,
-		"type=\"detection\", context=\"%s\", scan_id=%ld, path=\"%s\", scan_status=\"%s\", scan_action=\"%s\", module_name=\"%s\", module_report=\"%s\"",
+		"type=\"detection\", context=\"%s\", scan_id=%ld, path=\"%s\", scan_status=\"%s\", scan_action=\"%s\", module_name=\"%s\", module_report=\"%s\", digest=\"%s\"",
 		ev->u.ev_detection.context == CONTEXT_REAL_TIME ? "real-time" : "on-demand",
 		ev->u.ev_detection.scan_id,
 		ev->u.ev_detection.path,
 		a6o_file_status_pretty_str(ev->u.ev_detection.scan_status),
 		a6o_action_pretty_str(ev->u.ev_detection.scan_action),
 		ev->u.ev_detection.module_name,
-		ev->u.ev_detection.module_report);
+		ev->u.ev_detection.module_report,
+		ev->u.ev_detection.digest);
 }
 
 static void on_demand_start_event_journal(struct a6o_event *ev)
@@ -65,13 +66,15 @@ static void on_demand_start_event_journal(struct a6o_event *ev)
 static void on_demand_completed_event_journal(struct a6o_event *ev)
 {
 	syslog(LOG_INFO,
-		"type=\"on_demand_completed\", scan_id=%ld, cancelled=%d, total_malware_count=%ld, total_suspicious_count=%ld, total_scanned_count=%ld, duration=%ld",
+		"type=\"on_demand_completed\", scan_id=%ld, cancelled=%d, total_malware_count=%ld, total_suspicious_count=%ld, total_scanned_count=%ld, duration=%ld, budget_exhausted=%d, coverage=%d",
 		ev->u.ev_on_demand_completed.scan_id,
 		ev->u.ev_on_demand_completed.cancelled,
 		ev->u.ev_on_demand_completed.total_malware_count,
 		ev->u.ev_on_demand_completed.total_suspicious_count,
 		ev->u.ev_on_demand_completed.total_scanned_count,
-		ev->u.ev_on_demand_completed.duration);
+		ev->u.ev_on_demand_completed.duration,
+		ev->u.ev_on_demand_completed.budget_exhausted,
+		ev->u.ev_on_demand_completed.coverage);
 }
 
 static void quarantine_event_journal(struct a6o_event *ev)
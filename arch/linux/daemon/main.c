@@ -40,12 +40,13 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #include <errno.h>
 #include <getopt.h>
 #include <glib.h>
+#include <glib-unix.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
-#include <dirent.h>
 
 #define DEFAULT_LOG_LEVEL     "error"
 #define DEFAULT_PID_FILE      LOCALSTATEDIR "/run/armadito-scand.pid"
@@ -192,65 +193,16 @@ static int create_server_socket(const char *unix_path)
 	return server_sock;
 }
 
-static void load_conf(struct a6o_conf *conf)
+/* new on-demand scans use the reloaded configuration, running scans keep theirs */
+static gboolean reload_conf_cb(gpointer data)
 {
-	const char *conf_file;
+	struct armadito *armadito = (struct armadito *)data;
 
-	conf_file = a6o_std_path(A6O_LOCATION_CONFIG_FILE);
+	a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_INFO, "SIGHUP received, reloading configuration");
 
-	a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_INFO, "loading configuration file %s", conf_file);
+	a6o_reload_conf(armadito);
 
-	if (a6o_conf_load_file(conf, conf_file)) {
-		a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_WARNING, "loading configuration failed");
-		exit(EXIT_FAILURE);
-	}
-
-	free((void *)conf_file);
-}
-
-static void load_conf_dir(struct a6o_conf *conf)
-{
-	const char *conf_dir;
-	DIR *dir;
-	struct dirent *dp;
-
-	conf_dir = a6o_std_path(A6O_LOCATION_CONFIG_DIR);
-
-	a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_INFO, "loading configuration directory %s", conf_dir);
-
-	dir = opendir(conf_dir);
-	if (dir == NULL) {
-		a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_WARNING, "error opening configuration directory %s (%s)", conf_dir, strerror(errno));
-		return;
-	}
-
-	while ((dp = readdir(dir)) != NULL) {
-		const char *file_name = dp->d_name;
-		size_t len;
-		char *full_path;
-
-		if ( !strcmp(file_name, ".") || !strcmp(file_name, ".."))
-			continue;
-
-		len = strlen(file_name);
-		if (len > 5 && !strcmp(file_name + len - 5, ".conf")) {
-			if (asprintf(&full_path, "%s/%s", conf_dir, file_name) == -1)
-				break;
-
-			a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_INFO, "loading configuration file %s", full_path);
-
-			if (a6o_conf_load_file(conf, full_path)) {
-				a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_WARNING, "loading configuration failed");
-				exit(EXIT_FAILURE);
-			}
-
-			free((void *)full_path);
-		}
-	}
-
-	closedir(dir);
-
-	free((void *)conf_dir);
+	return TRUE;
 }
 
 static void start_daemon(const char *progname, struct a6o_daemon_options *opts)
@@ -272,8 +224,10 @@ static void start_daemon(const char *progname, struct a6o_daemon_options *opts)
 	a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_NONE, "starting %s%s", progname, opts->no_daemon ? "" : " in daemon mode");
 
 	conf = a6o_conf_new();
-	load_conf(conf);
-	load_conf_dir(conf);
+	if (a6o_conf_load_std(conf)) {
+		a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_WARNING, "loading configuration failed");
+		exit(EXIT_FAILURE);
+	}
 
 	armadito = a6o_open(conf);
 	if (armadito == NULL) {
@@ -286,6 +240,8 @@ static void start_daemon(const char *progname, struct a6o_daemon_options *opts)
 	server = server_new(armadito, server_sock);
 	a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_INFO, "listening on %s", opts->unix_path);
 
+	g_unix_signal_add(SIGHUP, reload_conf_cb, armadito);
+
 	loop = g_main_loop_new(NULL, FALSE);
 	g_main_loop_run(loop);
 }
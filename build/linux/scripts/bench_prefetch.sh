@@ -0,0 +1,113 @@
+#!/bin/bash
+#
+# Compares on-demand scan throughput on a corpus of small files without
+# prefetch and with the different prefetch engines (see prefetch-engine in
+# armadito.conf), each run starting with a cold page cache.
+#
+# Usage: bench_prefetch.sh DIRECTORY [FILES [ENGINE...]]
+# If DIRECTORY does not exist, it is filled with FILES small files (default
+# 1000000), from 1 to 8 KB, in sub-directories of 1000 files.
+# ENGINE is none, fadvise or io_uring, default is all of them.
+#
+# Must be run as root, to drop the page cache. The daemon installed in
+# ../out/install is started for each engine, with a configuration file in
+# its conf.d directory that sets the engine, and stopped after the scan.
+#
+
+DIR=$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )
+OUT_DIR=$DIR/../out
+set -e
+
+PREFIX=$OUT_DIR/install/armadito-av
+CONF_FILE=$PREFIX/etc/armadito/conf.d/zz-bench-prefetch.conf
+SOCKET_PATH=@/org/armadito-bench-prefetch
+
+SCAN_DIR=$1
+FILES=${2:-1000000}
+shift 2 || shift || true
+ENGINES=${@:-none fadvise io_uring}
+
+if [[ -z "$SCAN_DIR" ]];
+then
+	echo "usage: $0 DIRECTORY [FILES [ENGINE...]]" >&2
+	exit 1
+fi
+
+if [[ $(id -u) != 0 ]];
+then
+	echo "$0: must be run as root to drop the page cache" >&2
+	exit 1
+fi
+
+if [[ ! -d "$SCAN_DIR" ]];
+then
+	echo "creating $FILES files in $SCAN_DIR"
+	for (( i = 0; i < FILES; i++ ));
+	do
+		if (( i % 1000 == 0 ));
+		then
+			SUB_DIR=$SCAN_DIR/$(( i / 1000 ))
+			mkdir -p $SUB_DIR
+		fi
+		head -c $(( (RANDOM % 8 + 1) * 1024 )) /dev/urandom > $SUB_DIR/$i
+	done
+fi
+
+BYTES=$(du -s -b "$SCAN_DIR" | cut -f1)
+COUNT=$(find "$SCAN_DIR" -type f | wc -l)
+
+DAEMON_PID=
+trap 'rm -f $CONF_FILE; [[ -n "$DAEMON_PID" ]] && kill $DAEMON_PID 2> /dev/null' EXIT
+
+# waits until the daemon listens on its socket, fails if it exits before
+wait_daemon()
+{
+	for (( i = 0; i < 100; i++ ));
+	do
+		if ! kill -0 $DAEMON_PID 2> /dev/null;
+		then
+			echo "$0: daemon exited at startup with engine $ENGINE" >&2
+			exit 1
+		fi
+		grep -q " ${SOCKET_PATH}\$" /proc/net/unix && return
+		sleep 0.1
+	done
+
+	echo "$0: daemon not listening on $SOCKET_PATH after 10 seconds" >&2
+	exit 1
+}
+
+printf "%-10s %10s %10s %10s\n" "engine" "seconds" "files/s" "MB/s"
+
+for ENGINE in $ENGINES;
+do
+	mkdir -p $(dirname $CONF_FILE)
+	if [[ "$ENGINE" == "none" ]];
+	then
+		printf '[on-demand]\nprefetch-depth = 0\n' > $CONF_FILE
+	else
+		printf '[on-demand]\nprefetch-engine = "%s"\n' $ENGINE > $CONF_FILE
+	fi
+
+	LD_LIBRARY_PATH=$PREFIX/lib $PREFIX/sbin/armadito-scand --no-daemon --socket-path=$SOCKET_PATH > /dev/null 2>&1 &
+	DAEMON_PID=$!
+	wait_daemon
+
+	sync
+	echo 3 > /proc/sys/vm/drop_caches
+
+	START=$(date +%s.%N)
+	if ! LD_LIBRARY_PATH=$PREFIX/lib $PREFIX/bin/armadito-scan --socket-path=$SOCKET_PATH --recursive --threaded --no-summary "$SCAN_DIR" > /dev/null;
+	then
+		echo "$0: scan failed with engine $ENGINE" >&2
+		exit 1
+	fi
+	END=$(date +%s.%N)
+
+	kill $DAEMON_PID
+	wait $DAEMON_PID || true
+	DAEMON_PID=
+
+	awk -v engine=$ENGINE -v start=$START -v end=$END -v bytes=$BYTES -v count=$COUNT \
+		'BEGIN { s = end - start; printf "%-10s %10.1f %10.1f %10.1f\n", engine, s, s > 0 ? count / s : 0, s > 0 ? bytes / s / 1048576 : 0 }'
+done
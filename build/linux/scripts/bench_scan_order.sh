@@ -0,0 +1,65 @@
+#!/bin/bash
+#
+# Compares on-demand scan throughput with the different scan orders (see
+# scan-order in armadito.conf), each run starting with a cold page cache.
+#
+# Usage: bench_scan_order.sh DIRECTORY [ORDER...]
+# ORDER is discovery, inode or extent, default is all of them.
+#
+# Must be run as root, to drop the page cache. The daemon installed in
+# ../out/install is started for each order, with a configuration file in
+# its conf.d directory that sets the order, and stopped after the scan.
+#
+
+DIR=$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )
+OUT_DIR=$DIR/../out
+set -e
+
+PREFIX=$OUT_DIR/install/armadito-av
+CONF_FILE=$PREFIX/etc/armadito/conf.d/zz-bench-scan-order.conf
+SOCKET_PATH=@/org/armadito-bench-scan-order
+
+SCAN_DIR=$1
+shift || true
+ORDERS=${@:-discovery inode extent}
+
+if [[ -z "$SCAN_DIR" || ! -d "$SCAN_DIR" ]];
+then
+	echo "usage: $0 DIRECTORY [ORDER...]" >&2
+	exit 1
+fi
+
+if [[ $(id -u) != 0 ]];
+then
+	echo "$0: must be run as root to drop the page cache" >&2
+	exit 1
+fi
+
+BYTES=$(du -s -b "$SCAN_DIR" | cut -f1)
+
+trap 'rm -f $CONF_FILE' EXIT
+
+printf "%-10s %10s %10s\n" "order" "seconds" "MB/s"
+
+for ORDER in $ORDERS;
+do
+	mkdir -p $(dirname $CONF_FILE)
+	printf '[on-demand]\nscan-order = "%s"\n' $ORDER > $CONF_FILE
+
+	LD_LIBRARY_PATH=$PREFIX/lib $PREFIX/sbin/armadito-scand --no-daemon --socket-path=$SOCKET_PATH > /dev/null 2>&1 &
+	DAEMON_PID=$!
+	sleep 2
+
+	sync
+	echo 3 > /proc/sys/vm/drop_caches
+
+	START=$(date +%s.%N)
+	LD_LIBRARY_PATH=$PREFIX/lib $PREFIX/bin/armadito-scan --socket-path=$SOCKET_PATH --recursive --threaded --no-summary "$SCAN_DIR" > /dev/null || true
+	END=$(date +%s.%N)
+
+	kill $DAEMON_PID
+	wait $DAEMON_PID || true
+
+	awk -v order=$ORDER -v start=$START -v end=$END -v bytes=$BYTES \
+		'BEGIN { s = end - start; printf "%-10s %10.1f %10.1f\n", order, s, s > 0 ? bytes / s / 1048576 : 0 }'
+done
@@ -24,8 +24,10 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #include <libarmadito/armadito.h>
 #include <armadito-config.h>
 
+#include "core/concurrency.h"
 #include "core/event.h"
 #include "core/handle.h"
+#include "core/priority.h"
 #include "core/scanconf.h"
 #include "core/scanctx.h"
 
@@ -52,13 +54,12 @@ struct fanotify_monitor {
 	struct access_monitor *monitor;
 	struct armadito *armadito;
 
-	struct a6o_scan_conf *scan_conf;
-
 	pid_t my_pid;
 
 	int fanotify_fd;
 
 	GThreadPool *thread_pool;
+	struct a6o_concurrency *concurrency;  /* adjusts the number of threads of the pool, NULL if configured */
 
 	struct watchdog *watchdog;
 };
@@ -74,9 +75,10 @@ struct fanotify_monitor *fanotify_monitor_new(struct access_monitor *m, struct a
 	f->monitor = m;
 	f->armadito = u;
 
-	f->scan_conf = a6o_scan_conf_on_access();
 	f->my_pid = getpid();
 
+	f->concurrency = NULL;
+
 	return f;
 }
 
@@ -113,6 +115,8 @@ int fanotify_monitor_start(struct fanotify_monitor *f)
 	unsigned int flags;
 	GIOChannel *fanotify_channel;
 	GSource *source;
+	int n_threads;
+	struct a6o_scan_conf *scan_conf;
 
 	flags = ((f->enable_permission) ? FAN_CLASS_CONTENT : FAN_CLASS_NOTIF) | FAN_UNLIMITED_QUEUE | FAN_UNLIMITED_MARKS;
 	f->fanotify_fd = fanotify_init(flags, O_LARGEFILE | O_RDONLY);
@@ -125,7 +129,16 @@ int fanotify_monitor_start(struct fanotify_monitor *f)
 
 	f->watchdog = watchdog_new(f->fanotify_fd);
 
-	f->thread_pool = g_thread_pool_new(scan_file_thread_fun, f, -1, FALSE, NULL);
+	/* the pool is bounded, so that a burst of file accesses cannot create threads without limit */
+	scan_conf = a6o_scan_conf_acquire_on_access();
+	n_threads = a6o_scan_conf_get_scan_threads(scan_conf);
+	a6o_scan_conf_release(scan_conf);
+	if (n_threads <= 0) {
+		f->concurrency = a6o_concurrency_new(MODULE_LOG_NAME, os_cpu_count(), 1, A6O_MAX_THREADS_PER_CPU * os_cpu_count());
+		n_threads = a6o_concurrency_get_limit(f->concurrency);
+	}
+
+	f->thread_pool = g_thread_pool_new(scan_file_thread_fun, f, n_threads, FALSE, NULL);
 
 	/* add the fanotify file desc to the thread loop */
 	fanotify_channel = g_io_channel_unix_new(f->fanotify_fd);
@@ -169,6 +182,7 @@ static void fire_detection_event(struct fanotify_monitor *f, struct a6o_report *
 	detection_ev.scan_action = report->action;
 	detection_ev.module_name = report->module_name;
 	detection_ev.module_report = report->module_report;
+	detection_ev.digest = report->digest != NULL ? report->digest : "";
 
 	ev = a6o_event_new(EVENT_DETECTION, &detection_ev);
 
@@ -182,11 +196,16 @@ static void scan_file_thread_fun(gpointer data, gpointer user_data)
 	struct a6o_scan_context *file_context = (struct a6o_scan_context *)data;
 	struct a6o_report report;
 	enum a6o_file_status status;
+	gint64 start_time = g_get_monotonic_time();
+	size_t scanned_bytes;
+	int limit;
 
 	a6o_report_init(&report, file_context->path);
 
 	status = a6o_scan_context_scan(file_context, &report);
 
+	scanned_bytes = (file_context->file_stat.flags & FILE_FLAG_IS_ERROR) ? 0 : file_context->file_stat.file_size;
+
 	if (fanotify_monitor_is_enable_permission(f)) {
 		__u32 fan_response = (status == A6O_FILE_MALWARE) ? FAN_DENY : FAN_ALLOW;
 		if (watchdog_remove(f->watchdog, file_context->fd, NULL))
@@ -204,6 +223,7 @@ static void scan_file_thread_fun(gpointer data, gpointer user_data)
 	}
 
 	a6o_scan_context_destroy(file_context);
+	a6o_scan_conf_release(file_context->conf);
 	free(file_context);
 
 	if ((status == A6O_FILE_MALWARE || status == A6O_FILE_SUSPICIOUS)
@@ -211,6 +231,12 @@ static void scan_file_thread_fun(gpointer data, gpointer user_data)
 		fire_detection_event(f, &report);
 
 	a6o_report_destroy(&report);
+
+	/* all the threads are busy if accesses are waiting in the pool queue */
+	if (f->concurrency != NULL
+		&& (limit = a6o_concurrency_account(f->concurrency, g_get_monotonic_time() - start_time, scanned_bytes,
+							g_thread_pool_unprocessed(f->thread_pool) > 0)) > 0)
+		g_thread_pool_set_max_threads(f->thread_pool, limit, NULL);
 }
 
 static int stat_check(int fd)
@@ -236,6 +262,7 @@ static int stat_check(int fd)
 static void fanotify_perm_event_process(struct fanotify_monitor *f, struct fanotify_event_metadata *event, const char *path)
 {
 	struct a6o_scan_context *file_context;
+	struct a6o_scan_conf *scan_conf;
 
 	if (stat_check(event->fd)) {
 		if (watchdog_remove(f->watchdog, event->fd, NULL))
@@ -245,7 +272,10 @@ static void fanotify_perm_event_process(struct fanotify_monitor *f, struct fanot
 
 	file_context = malloc(sizeof(struct a6o_scan_context));
 
-	if (a6o_scan_context_get(file_context, event->fd, path, f->scan_conf, NULL)) {   /* means file must not be scanned */
+	/* each access uses the configuration current when it happens, released once the file is handled */
+	scan_conf = a6o_scan_conf_acquire_on_access();
+
+	if (a6o_scan_context_get(file_context, event->fd, path, scan_conf, NULL)) {   /* means file must not be scanned */
 		if (watchdog_remove(f->watchdog, event->fd, NULL))
 			response_write(f->fanotify_fd, event->fd, FAN_ALLOW, path, "not scanned");
 
@@ -254,6 +284,7 @@ static void fanotify_perm_event_process(struct fanotify_monitor *f, struct fanot
 		/* as response_write closes the file descriptor */
 		file_context->fd = -1; /* this will prevent a6o_scan_context_destroy from closing the file descriptor twice :( */
 		a6o_scan_context_destroy(file_context);
+		a6o_scan_conf_release(scan_conf);
 		free(file_context);
 
 		return;
@@ -266,6 +297,7 @@ static void fanotify_perm_event_process(struct fanotify_monitor *f, struct fanot
 static void fanotify_notify_event_process(struct fanotify_monitor *f, struct fanotify_event_metadata *event, const char *path)
 {
 	struct a6o_scan_context *file_context;
+	struct a6o_scan_conf *scan_conf;
 
 	if (stat_check(event->fd)) {
 		/* log? */
@@ -274,11 +306,14 @@ static void fanotify_notify_event_process(struct fanotify_monitor *f, struct fan
 
 	file_context = malloc(sizeof(struct a6o_scan_context));
 
-	if (a6o_scan_context_get(file_context, event->fd, path, f->scan_conf, NULL)) {   /* means file must not be scanned */
+	scan_conf = a6o_scan_conf_acquire_on_access();
+
+	if (a6o_scan_context_get(file_context, event->fd, path, scan_conf, NULL)) {   /* means file must not be scanned */
 		/* log? */
 		/* response_write(f->fanotify_fd, event->fd, FAN_ALLOW, path, "not scanned"); */
 
 		a6o_scan_context_destroy(file_context);
+		a6o_scan_conf_release(scan_conf);
 		free(file_context);
 
 		return;
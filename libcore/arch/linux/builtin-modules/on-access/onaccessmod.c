@@ -183,6 +183,15 @@ static enum a6o_mod_status mod_oal_conf_max_size(struct a6o_module *module, cons
 	return A6O_MOD_OK;
 }
 
+static enum a6o_mod_status mod_oal_conf_scan_threads(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_access_conf = a6o_scan_conf_on_access();
+
+	a6o_scan_conf_scan_threads(on_access_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
 static enum a6o_mod_status mod_oal_post_init(struct a6o_module *module)
 {
 	struct mod_oal_data *data = (struct mod_oal_data *)module->data;
@@ -218,6 +227,7 @@ struct a6o_conf_entry mod_oal_conf_table[] = {
 	{ "mime-types", CONF_TYPE_STRING | CONF_TYPE_LIST, &mod_oal_conf_mime_types},
 	{ "modules", CONF_TYPE_STRING | CONF_TYPE_LIST, &mod_oal_conf_modules},
 	{ "max-size", CONF_TYPE_INT, &mod_oal_conf_max_size},
+	{ "scan-threads", CONF_TYPE_INT, &mod_oal_conf_scan_threads},
 	{ NULL, 0, NULL},
 };
 
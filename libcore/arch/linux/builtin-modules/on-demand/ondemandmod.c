@@ -86,11 +86,399 @@ static enum a6o_mod_status mod_on_demand_conf_max_size(struct a6o_module *module
 	return A6O_MOD_OK;
 }
 
+static enum a6o_mod_status mod_on_demand_conf_scan_threads(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_scan_threads(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_queue_depth(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_queue_depth(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_queue_memory(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_queue_memory(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_large_file_size(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_large_file_size(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_large_file_threads(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_large_file_threads(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_scan_order(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+	const char *order = a6o_conf_value_get_string(value);
+
+	if (!strcmp(order, "discovery"))
+		a6o_scan_conf_scan_order(on_demand_conf, A6O_SCAN_ORDER_DISCOVERY);
+	else if (!strcmp(order, "inode"))
+		a6o_scan_conf_scan_order(on_demand_conf, A6O_SCAN_ORDER_INODE);
+	else if (!strcmp(order, "extent"))
+		a6o_scan_conf_scan_order(on_demand_conf, A6O_SCAN_ORDER_EXTENT);
+	else if (!strcmp(order, "risk"))
+		a6o_scan_conf_scan_order(on_demand_conf, A6O_SCAN_ORDER_RISK);
+	else {
+		a6o_log(A6O_LOG_MODULE, A6O_LOG_LEVEL_WARNING, "on-demand: invalid scan-order %s, must be discovery, inode, extent or risk", order);
+		return A6O_MOD_CONF_ERROR;
+	}
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_scan_order_batch(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_scan_order_batch(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_time_budget(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_time_budget(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_prefetch_depth(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_prefetch_depth(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_prefetch_memory(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_prefetch_memory(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_prefetch_engine(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+	const char *engine = a6o_conf_value_get_string(value);
+
+	if (!strcmp(engine, "fadvise"))
+		a6o_scan_conf_prefetch_engine(on_demand_conf, A6O_PREFETCH_FADVISE);
+	else if (!strcmp(engine, "io_uring"))
+		a6o_scan_conf_prefetch_engine(on_demand_conf, A6O_PREFETCH_IO_URING);
+	else {
+		a6o_log(A6O_LOG_MODULE, A6O_LOG_LEVEL_WARNING, "on-demand: invalid prefetch-engine %s, must be fadvise or io_uring", engine);
+		return A6O_MOD_CONF_ERROR;
+	}
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_cache_neutral(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+	const char *mode = a6o_conf_value_get_string(value);
+
+	if (!strcmp(mode, "off"))
+		a6o_scan_conf_cache_neutral(on_demand_conf, A6O_CACHE_NEUTRAL_OFF);
+	else if (!strcmp(mode, "drop"))
+		a6o_scan_conf_cache_neutral(on_demand_conf, A6O_CACHE_NEUTRAL_DROP);
+	else if (!strcmp(mode, "keep-resident"))
+		a6o_scan_conf_cache_neutral(on_demand_conf, A6O_CACHE_NEUTRAL_KEEP_RESIDENT);
+	else {
+		a6o_log(A6O_LOG_MODULE, A6O_LOG_LEVEL_WARNING, "on-demand: invalid cache-neutral %s, must be off, drop or keep-resident", mode);
+		return A6O_MOD_CONF_ERROR;
+	}
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_one_file_system(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_one_file_system(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static int parse_fs_policy(const char *s, enum a6o_fs_policy *policy)
+{
+	if (!strcmp(s, "scan"))
+		*policy = A6O_FS_POLICY_SCAN;
+	else if (!strcmp(s, "reduced"))
+		*policy = A6O_FS_POLICY_REDUCED;
+	else if (!strcmp(s, "small-files-only"))
+		*policy = A6O_FS_POLICY_SMALL_FILES_ONLY;
+	else if (!strcmp(s, "skip"))
+		*policy = A6O_FS_POLICY_SKIP;
+	else
+		return -1;
+
+	return 0;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_network_fs(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+	enum a6o_fs_policy policy;
+
+	if (parse_fs_policy(a6o_conf_value_get_string(value), &policy) != 0) {
+		a6o_log(A6O_LOG_MODULE, A6O_LOG_LEVEL_WARNING, "on-demand: invalid %s %s, must be scan, reduced, small-files-only or skip", key, a6o_conf_value_get_string(value));
+		return A6O_MOD_CONF_ERROR;
+	}
+
+	a6o_scan_conf_network_fs_policy(on_demand_conf, policy);
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_fuse_fs(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+	enum a6o_fs_policy policy;
+
+	if (parse_fs_policy(a6o_conf_value_get_string(value), &policy) != 0) {
+		a6o_log(A6O_LOG_MODULE, A6O_LOG_LEVEL_WARNING, "on-demand: invalid %s %s, must be scan, reduced, small-files-only or skip", key, a6o_conf_value_get_string(value));
+		return A6O_MOD_CONF_ERROR;
+	}
+
+	a6o_scan_conf_fuse_fs_policy(on_demand_conf, policy);
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_remote_fs_threads(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_remote_fs_threads(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_module_threads(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_module_threads(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_report_threads(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_report_threads(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_stage_queue_depth(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_stage_queue_depth(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_checkpoint_dir(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_checkpoint_dir(on_demand_conf, a6o_conf_value_get_string(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_checkpoint_interval(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_checkpoint_interval(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_verdict_cache(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_verdict_cache(on_demand_conf, a6o_conf_value_get_string(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_verdict_cache_size(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_verdict_cache_size(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_content_digest(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_content_digest(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_digest_cache_size(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_digest_cache_size(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_max_bytes_per_second(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_max_bytes_per_second(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_max_files_per_second(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_max_files_per_second(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_io_class(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+	const char *io_class = a6o_conf_value_get_string(value);
+
+	if (!strcmp(io_class, "normal"))
+		a6o_scan_conf_io_class(on_demand_conf, OS_IO_CLASS_NORMAL);
+	else if (!strcmp(io_class, "background"))
+		a6o_scan_conf_io_class(on_demand_conf, OS_IO_CLASS_BACKGROUND);
+	else if (!strcmp(io_class, "idle"))
+		a6o_scan_conf_io_class(on_demand_conf, OS_IO_CLASS_IDLE);
+	else {
+		a6o_log(A6O_LOG_MODULE, A6O_LOG_LEVEL_WARNING, "on-demand: invalid io-class %s, must be normal, background or idle", io_class);
+		return A6O_MOD_CONF_ERROR;
+	}
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_nice(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_nice(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_idle_only(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_idle_only(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_idle_max_load(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_idle_max_load(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
+static enum a6o_mod_status mod_on_demand_conf_idle_max_disk_busy(struct a6o_module *module, const char *key, struct a6o_conf_value *value)
+{
+	struct a6o_scan_conf *on_demand_conf = a6o_scan_conf_on_demand();
+
+	a6o_scan_conf_idle_max_disk_busy(on_demand_conf, a6o_conf_value_get_int(value));
+
+	return A6O_MOD_OK;
+}
+
 struct a6o_conf_entry on_demand_conf_table[] = {
 	{ "white-list-dir", CONF_TYPE_STRING | CONF_TYPE_LIST, &mod_on_demand_conf_white_list_dir},
 	{ "modules", CONF_TYPE_STRING | CONF_TYPE_LIST, &mod_on_demand_conf_modules},
 	{ "mime-types", CONF_TYPE_STRING | CONF_TYPE_LIST, &mod_on_demand_conf_mime_types},
 	{ "max-size", CONF_TYPE_INT, &mod_on_demand_conf_max_size},
+	{ "scan-threads", CONF_TYPE_INT, &mod_on_demand_conf_scan_threads},
+	{ "queue-depth", CONF_TYPE_INT, &mod_on_demand_conf_queue_depth},
+	{ "queue-memory", CONF_TYPE_INT, &mod_on_demand_conf_queue_memory},
+	{ "large-file-size", CONF_TYPE_INT, &mod_on_demand_conf_large_file_size},
+	{ "large-file-threads", CONF_TYPE_INT, &mod_on_demand_conf_large_file_threads},
+	{ "scan-order", CONF_TYPE_STRING, &mod_on_demand_conf_scan_order},
+	{ "scan-order-batch", CONF_TYPE_INT, &mod_on_demand_conf_scan_order_batch},
+	{ "time-budget", CONF_TYPE_INT, &mod_on_demand_conf_time_budget},
+	{ "prefetch-depth", CONF_TYPE_INT, &mod_on_demand_conf_prefetch_depth},
+	{ "prefetch-memory", CONF_TYPE_INT, &mod_on_demand_conf_prefetch_memory},
+	{ "prefetch-engine", CONF_TYPE_STRING, &mod_on_demand_conf_prefetch_engine},
+	{ "cache-neutral", CONF_TYPE_STRING, &mod_on_demand_conf_cache_neutral},
+	{ "one-file-system", CONF_TYPE_INT, &mod_on_demand_conf_one_file_system},
+	{ "network-fs", CONF_TYPE_STRING, &mod_on_demand_conf_network_fs},
+	{ "fuse-fs", CONF_TYPE_STRING, &mod_on_demand_conf_fuse_fs},
+	{ "remote-fs-threads", CONF_TYPE_INT, &mod_on_demand_conf_remote_fs_threads},
+	{ "module-threads", CONF_TYPE_INT, &mod_on_demand_conf_module_threads},
+	{ "report-threads", CONF_TYPE_INT, &mod_on_demand_conf_report_threads},
+	{ "stage-queue-depth", CONF_TYPE_INT, &mod_on_demand_conf_stage_queue_depth},
+	{ "checkpoint-dir", CONF_TYPE_STRING, &mod_on_demand_conf_checkpoint_dir},
+	{ "checkpoint-interval", CONF_TYPE_INT, &mod_on_demand_conf_checkpoint_interval},
+	{ "verdict-cache", CONF_TYPE_STRING, &mod_on_demand_conf_verdict_cache},
+	{ "verdict-cache-size", CONF_TYPE_INT, &mod_on_demand_conf_verdict_cache_size},
+	{ "content-digest", CONF_TYPE_INT, &mod_on_demand_conf_content_digest},
+	{ "digest-cache-size", CONF_TYPE_INT, &mod_on_demand_conf_digest_cache_size},
+	{ "max-bytes-per-second", CONF_TYPE_INT, &mod_on_demand_conf_max_bytes_per_second},
+	{ "max-files-per-second", CONF_TYPE_INT, &mod_on_demand_conf_max_files_per_second},
+	{ "io-class", CONF_TYPE_STRING, &mod_on_demand_conf_io_class},
+	{ "nice", CONF_TYPE_INT, &mod_on_demand_conf_nice},
+	{ "idle-only", CONF_TYPE_INT, &mod_on_demand_conf_idle_only},
+	{ "idle-max-load", CONF_TYPE_INT, &mod_on_demand_conf_idle_max_load},
+	{ "idle-max-disk-busy", CONF_TYPE_INT, &mod_on_demand_conf_idle_max_disk_busy},
 	{ NULL, 0, NULL},
 };
 
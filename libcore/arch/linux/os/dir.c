@@ -28,19 +28,66 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <dirent.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <fcntl.h>
 
-static enum os_file_flag dirent_flags(struct dirent *entry)
+/* large enough to read most directories in one system call */
+#define DIRENT_BUFFER_SIZE (64 * 1024)
+
+/* the record returned by getdents64, which glibc does not always declare */
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/* state of the listing of a directory */
+/* path holds the path of the current entry, the path of the directory being a prefix of it */
+struct dir_map {
+	dirent_cb_t dirent_cb;
+	void *data;
+	char *path;
+	size_t path_alloc;
+};
+
+static enum os_file_flag mode_flags(mode_t mode)
 {
+	switch(mode & S_IFMT) {
+	case S_IFDIR:
+		return FILE_FLAG_IS_DIRECTORY;
+	case S_IFBLK:
+	case S_IFCHR:
+		return FILE_FLAG_IS_DEVICE;
+	case S_IFSOCK:
+	case S_IFIFO:
+		return FILE_FLAG_IS_IPC;
+	case S_IFLNK:
+		return FILE_FLAG_IS_LINK;
+	case S_IFREG:
+		return FILE_FLAG_IS_PLAIN_FILE;
+	}
+
+	return FILE_FLAG_IS_UNKNOWN;
+}
+
+static enum os_file_flag dirent_flags(int dir_fd, struct linux_dirent64 *entry, int *pentry_errno)
+{
+	struct stat st;
+
 	switch(entry->d_type) {
 	case DT_DIR:
 		return FILE_FLAG_IS_DIRECTORY;
@@ -54,85 +101,171 @@ static enum os_file_flag dirent_flags(struct dirent *entry)
 		return FILE_FLAG_IS_LINK;
 	case DT_REG:
 		return FILE_FLAG_IS_PLAIN_FILE;
-	default:
-		return FILE_FLAG_IS_UNKNOWN;
 	}
 
-	return FILE_FLAG_IS_UNKNOWN;
+	/* some file systems (xfs without ftype, some network file systems) do not fill d_type */
+	if (fstatat(dir_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+		*pentry_errno = errno;
+		return FILE_FLAG_IS_ERROR;
+	}
+
+	return mode_flags(st.st_mode);
 }
 
-int os_dir_map(const char *path, int recurse, dirent_cb_t dirent_cb, void *data)
+/* appends name to the path of the directory, which is the dir_len first chars of m->path */
+/* returns the length of the new path, 0 if out of memory */
+static size_t dir_map_path(struct dir_map *m, size_t dir_len, const char *name)
 {
-	DIR *d;
-	int ret = 0;
+	size_t name_len = strlen(name);
+	size_t sep = (dir_len > 0 && m->path[dir_len - 1] == '/') ? 0 : 1;
 
-	d = opendir(path);
-	if (d == NULL) {
-		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "error opening directory %s (%s)", path, strerror(errno));
+	if (dir_len + sep + name_len + 1 > m->path_alloc) {
+		size_t alloc = 2 * m->path_alloc;
+		char *path;
 
-		// Call to scan_entry()
-		 ret = (*dirent_cb)(path, FILE_FLAG_IS_ERROR, errno, data);
+		if (alloc < dir_len + sep + name_len + 1)
+			alloc = dir_len + sep + name_len + 1;
 
-#if 0
-		if (errno != EACCES && errno != ENOENT && errno != ENOTDIR)
-			ret = 1;
-#endif
+		if ((path = realloc(m->path, alloc)) == NULL)
+			return 0;
 
-		// goto cleanup;
-		return ret;
+		m->path = path;
+		m->path_alloc = alloc;
 	}
 
-	while(1) {
-		char *entry_path;
-		char *real_entry_path;
-		struct dirent *entry;
-		int saved_errno;
+	if (sep)
+		m->path[dir_len] = '/';
+	memcpy(m->path + dir_len + sep, name, name_len + 1);
+
+	return dir_len + sep + name_len;
+}
+
+static int dir_map_entry(struct dir_map *m, int dir_fd, size_t dir_len, struct linux_dirent64 *entry)
+{
+	enum os_file_flag flags;
+	int entry_errno = 0;
 
-		errno = 0;
-		entry = readdir(d);
+	if (entry->d_name[0] == '.'
+		&& (entry->d_name[1] == '\0' || (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+		return 0;
 
-		if (entry == NULL) {
-			/* from man readdir: If the end of the directory stream is reached, NULL is returned and errno is not changed */
-			if (errno == 0)
-				break;
+	if (dir_map_path(m, dir_len, entry->d_name) == 0)
+		return -1;
 
-			saved_errno = errno;
-			a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "error reading directory entry in directory %s (error %s)", path, strerror(saved_errno));
+	flags = dirent_flags(dir_fd, entry, &entry_errno);
 
-			// Call to scan_entry()
-			ret = (*dirent_cb)(path, FILE_FLAG_IS_ERROR, saved_errno, data);
-			break;
-		}
+	// Call to scan_entry()
+	return (*m->dirent_cb)(m->path, flags, entry_errno, m->data);
+}
 
-		if (entry->d_type == DT_DIR && (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")))
-			continue;
+static int dir_map_fd(struct dir_map *m, int fd, size_t dir_len)
+{
+	char *buffer;
+	long n, offset;
+	int ret = 0;
+
+	buffer = malloc(DIRENT_BUFFER_SIZE);
+	if (buffer == NULL)
+		return -1;
 
-		if (asprintf(&entry_path, "%s/%s", path, entry->d_name) == -1){
-			ret = -1;
+	while (ret == 0) {
+		n = syscall(SYS_getdents64, fd, buffer, DIRENT_BUFFER_SIZE);
+
+		if (n == 0)
 			break;
-		}
 
-		if (entry->d_type == DT_DIR && recurse) {
-		      ret = os_dir_map(entry_path, recurse, dirent_cb, data);
-		      if (ret != 0) {
-			free(entry_path);
+		if (n < 0) {
+			int saved_errno = errno;
+
+			m->path[dir_len] = '\0';
+			a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "error reading directory entry in directory %s (error %s)", m->path, strerror(saved_errno));
+
+			// Call to scan_entry()
+			ret = (*m->dirent_cb)(m->path, FILE_FLAG_IS_ERROR, saved_errno, m->data);
 			break;
-		      }
-		}
-		else {
-			/* Call to scan_entry() */
-			real_entry_path = realpath(entry_path, NULL);
-			(*dirent_cb)(real_entry_path, dirent_flags(entry), 0, data);
-			free(real_entry_path);
 		}
 
-		free(entry_path);
+		for (offset = 0; offset < n && ret == 0; offset += ((struct linux_dirent64 *)(buffer + offset))->d_reclen)
+			ret = dir_map_entry(m, fd, dir_len, (struct linux_dirent64 *)(buffer + offset));
 	}
 
-	if (closedir(d) < 0)
+	free(buffer);
+
+	return ret;
+}
+
+int os_dir_open(int parent_fd, const char *path)
+{
+	const char *name;
+
+	if (parent_fd < 0)
+		return open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	name = strrchr(path, '/');
+	name = name != NULL && name[1] != '\0' ? name + 1 : path;
+
+	/* O_NOFOLLOW: the directory may have been replaced by a link since its parent was listed */
+	return openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+}
+
+void os_dir_close(int fd)
+{
+	if (fd >= 0 && close(fd) < 0)
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "error closing directory (%s)", strerror(errno));
+}
+
+/*
+ * Entries are read with getdents64 into a large buffer and their paths
+ * are built in a single buffer, without any allocation per entry.
+ * Links are reported and never followed, so that the entries paths are
+ * canonical if path is.
+ */
+int os_dir_map_fd(int fd, const char *path, dirent_cb_t dirent_cb, void *data)
+{
+	struct dir_map m;
+	size_t len = strlen(path);
+	int ret;
+
+	/* strip trailing '/', but keep the root directory */
+	while (len > 1 && path[len - 1] == '/')
+		len--;
+
+	m.dirent_cb = dirent_cb;
+	m.data = data;
+	m.path_alloc = len + 1 + NAME_MAX + 1;
+	m.path = malloc(m.path_alloc);
+
+	if (m.path == NULL)
+		return -1;
+
+	memcpy(m.path, path, len);
+	m.path[len] = '\0';
+	ret = dir_map_fd(&m, fd, len);
+	free(m.path);
+
+	return ret;
+}
+
+int os_dir_map(const char *path, dirent_cb_t dirent_cb, void *data)
+{
+	int fd, ret;
+
+	fd = os_dir_open(-1, path);
+	if (fd < 0) {
+		int saved_errno = errno;
+
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "error opening directory %s (%s)", path, strerror(saved_errno));
+
+		// Call to scan_entry()
+		return (*dirent_cb)(path, FILE_FLAG_IS_ERROR, saved_errno, data);
+	}
+
+	ret = os_dir_map_fd(fd, path, dirent_cb, data);
+
+	if (close(fd) < 0)
 		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "error closing directory %s (%s)", path, strerror(errno));
 
-	return 0;
+	return ret;
 }
 
 /*
@@ -182,3 +315,41 @@ int os_mkdir_p(const char *path)
 
 	return ret;
 }
+
+/*
+ * If path is a mount point, the number of used inodes of the file system
+ * is a good estimate of the number of files under path.
+ * It counts directories too, and some file systems (btrfs, NFS...) do
+ * not report inodes counts, hence returning -1.
+ */
+int os_dir_count_hint(const char *path)
+{
+	struct stat st, parent_st;
+	struct statvfs vfs;
+	char *parent;
+	int is_mount_point;
+
+	if (asprintf(&parent, "%s/..", path) == -1)
+		return -1;
+
+	if (stat(path, &st) < 0 || stat(parent, &parent_st) < 0) {
+		free(parent);
+		return -1;
+	}
+
+	free(parent);
+
+	/* either path and its parent are not on the same device, or path is the root */
+	is_mount_point = st.st_dev != parent_st.st_dev || st.st_ino == parent_st.st_ino;
+
+	if (!is_mount_point)
+		return -1;
+
+	if (statvfs(path, &vfs) < 0 || vfs.f_files == 0 || vfs.f_files < vfs.f_ffree)
+		return -1;
+
+	if (vfs.f_files - vfs.f_ffree > INT_MAX)
+		return INT_MAX;
+
+	return (int)(vfs.f_files - vfs.f_ffree);
+}
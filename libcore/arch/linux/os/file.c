@@ -19,15 +19,23 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 
 ***/
 
+#define _GNU_SOURCE
 #include <libarmadito/armadito.h>
 #include "armadito-config.h"
 
 #include "core/file.h"
+#include "core/mount.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
@@ -58,6 +66,10 @@ static void fill_stat(struct os_file_stat *buf, struct stat *sb)
 	}
 
 	buf->file_size = sb->st_size;
+	buf->dev = sb->st_dev;
+	buf->inode = sb->st_ino;
+	buf->mtime = (long long)sb->st_mtim.tv_sec * 1000000000LL + sb->st_mtim.tv_nsec;
+	buf->ctime = (long long)sb->st_ctim.tv_sec * 1000000000LL + sb->st_ctim.tv_nsec;
 }
 
 int os_file_stat(const char *path, struct os_file_stat *buf, int *pfile_errno)
@@ -92,6 +104,242 @@ int os_file_stat_fd(int fd, struct os_file_stat *buf, int *pfile_errno)
 	return 0;
 }
 
+/* the directory and the name to give to the *at() system calls */
+static const char *at_name(int *dir_fd, const char *path)
+{
+	const char *name;
+
+	if (*dir_fd < 0) {
+		*dir_fd = AT_FDCWD;
+		return path;
+	}
+
+	name = strrchr(path, '/');
+
+	return name != NULL ? name + 1 : path;
+}
+
+int os_file_stat_at(int dir_fd, const char *path, struct os_file_stat *buf, int *pfile_errno)
+{
+	const char *name = at_name(&dir_fd, path);
+	struct stat sb;
+
+	if (fstatat(dir_fd, name, &sb, 0) == -1) {
+		*pfile_errno = errno;
+		buf->flags = FILE_FLAG_IS_ERROR;
+
+		return -1;
+	}
+
+	fill_stat(buf, &sb);
+
+	return 0;
+}
+
+int os_file_physical_offset_at(int dir_fd, const char *path, unsigned long long *offset)
+{
+#ifdef FS_IOC_FIEMAP
+	/* room for the extents array of one extent, aligned for struct fiemap */
+	unsigned long long buffer[(sizeof(struct fiemap) + sizeof(struct fiemap_extent)) / sizeof(unsigned long long) + 1];
+	struct fiemap *map = (struct fiemap *)buffer;
+	const char *name = at_name(&dir_fd, path);
+	int fd, ret = -1;
+
+	if ((fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC | O_NONBLOCK)) < 0)
+		return -1;
+
+	memset(buffer, 0, sizeof(buffer));
+	map->fm_start = 0;
+	map->fm_length = FIEMAP_MAX_OFFSET;
+	map->fm_extent_count = 1;
+
+	/* delayed allocation extents have no location yet, inline data is in the inode */
+	if (ioctl(fd, FS_IOC_FIEMAP, map) == 0
+		&& map->fm_mapped_extents == 1
+		&& !(map->fm_extents[0].fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DATA_INLINE))) {
+		*offset = map->fm_extents[0].fe_physical;
+		ret = 0;
+	}
+
+	close(fd);
+
+	return ret;
+#else
+	return -1;
+#endif
+}
+
+int os_file_prefetch_at(int dir_fd, const char *path, size_t *size)
+{
+	const char *name = at_name(&dir_fd, path);
+	struct stat sb;
+	int fd, ret = -1;
+
+	if ((fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC | O_NONBLOCK)) < 0)
+		return -1;
+
+	if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode)) {
+		if ((size_t)sb.st_size < *size)
+			*size = sb.st_size;
+
+		/* a length of 0 would mean the whole file */
+		if (*size == 0 || posix_fadvise(fd, 0, *size, POSIX_FADV_WILLNEED) == 0)
+			ret = 0;
+	}
+
+	close(fd);
+
+	return ret;
+}
+
+/* O_NONBLOCK so that opening a fifo that replaced the file does not block, harmless for reading a regular file */
+#define OPEN_FLAGS (O_RDONLY | O_CLOEXEC | O_NONBLOCK)
+
+int os_file_open_at(int dir_fd, const char *path, int noatime)
+{
+	const char *name = at_name(&dir_fd, path);
+	struct stat sb;
+	int fd = -1;
+
+#ifdef O_NOATIME
+	/* only permitted to the owner of the file or to a privileged process */
+	if (noatime && (fd = openat(dir_fd, name, OPEN_FLAGS | O_NOATIME)) < 0 && errno != EPERM)
+		return -1;
+#endif
+
+	if (fd < 0 && (fd = openat(dir_fd, name, OPEN_FLAGS)) < 0)
+		return -1;
+
+	/* the path may have been replaced by a device or a fifo since the directory was read */
+	if (fstat(fd, &sb) != 0) {
+		int err = errno;
+
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	if (!S_ISREG(sb.st_mode)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return fd;
+}
+
+#ifdef __NR_cachestat
+/* arguments of cachestat(2), linux 6.5 */
+struct cache_range {
+	unsigned long long off;
+	unsigned long long len;
+};
+
+struct cache_stat {
+	unsigned long long nr_cache;
+	unsigned long long nr_dirty;
+	unsigned long long nr_writeback;
+	unsigned long long nr_evicted;
+	unsigned long long nr_recently_evicted;
+};
+
+/* returns the number of cached pages of the file, -1 if not available */
+static long long cached_pages(int fd)
+{
+	struct cache_range range = { 0, 0 };   /* a length of 0 means up to the end of the file */
+	struct cache_stat cs;
+
+	if (syscall(__NR_cachestat, fd, &range, &cs, 0) != 0)
+		return -1;
+
+	return cs.nr_cache;
+}
+#else
+static long long cached_pages(int fd)
+{
+	return -1;
+}
+#endif
+
+unsigned char *os_file_cache_resident(int fd, size_t size)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t n_pages = (size + page_size - 1) / page_size;
+	long long n_cached;
+	unsigned char *vec;
+	void *addr;
+	size_t i;
+
+	if (size == 0)
+		return NULL;
+
+	/* cachestat avoids mapping the file in the common cases: nothing or everything cached */
+	n_cached = cached_pages(fd);
+	if (n_cached == 0)
+		return NULL;
+
+	if ((vec = malloc(n_pages)) == NULL)
+		return NULL;
+
+	if (n_cached > 0 && (size_t)n_cached >= n_pages) {
+		memset(vec, 1, n_pages);
+		return vec;
+	}
+
+	/* mapping the file does not read it, mincore() only looks at the system cache */
+	addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		free(vec);
+		return NULL;
+	}
+
+	if (mincore(addr, size, vec) != 0) {
+		free(vec);
+		vec = NULL;
+	}
+
+	munmap(addr, size);
+
+	if (vec == NULL)
+		return NULL;
+
+	for (i = 0; i < n_pages && !(vec[i] & 1); i++)
+		;
+
+	if (i == n_pages) {
+		free(vec);
+		return NULL;
+	}
+
+	return vec;
+}
+
+int os_file_cache_drop(int fd, size_t size, const unsigned char *resident)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t n_pages = (size + page_size - 1) / page_size;
+	size_t start, end;
+
+	/* a length of 0 means up to the end of the file */
+	if (resident == NULL)
+		return posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0 ? 0 : -1;
+
+	/* drop each run of pages that were not cached */
+	for (start = 0; start < n_pages; start = end) {
+		while (start < n_pages && (resident[start] & 1))
+			start++;
+
+		for (end = start; end < n_pages && !(resident[end] & 1); end++)
+			;
+
+		if (end > start
+			&& posix_fadvise(fd, (off_t)(start * page_size), (off_t)((end - start) * page_size), POSIX_FADV_DONTNEED) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
 static const char *do_not_scan_paths[] = {
 	"/proc",
 	"/run",
@@ -114,6 +362,7 @@ int os_file_do_not_scan(const char *path)
 {
 	const char **p;
 	char * real_path;
+	int ret;
 
 	real_path =  realpath(path, NULL);
 	if( real_path == NULL){
@@ -128,6 +377,9 @@ int os_file_do_not_scan(const char *path)
 		}
 	}
 
+	/* kernel interfaces are also recognized by their file system, wherever they are mounted */
+	ret = os_mount_table_classify(NULL, 0, real_path) == OS_FS_PSEUDO;
+
 	free(real_path);
-	return 0;
+	return ret;
 }
@@ -0,0 +1,421 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#define _GNU_SOURCE
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/fileloader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+/* the io_uring operations used here (openat, statx, fadvise) appeared in linux 5.6, along with IORING_FEAT_CUR_PERSONALITY */
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) && defined(IORING_FEAT_CUR_PERSONALITY)
+
+/*
+ * Each load submits an openat and a statx of the path; once both are
+ * completed, a fadvise(WILLNEED) of the opened file starts reading it
+ * without waiting. The statx gives the file size, which bounds the
+ * read-ahead.
+ */
+
+enum load_op {
+	OP_OPEN = 0,
+	OP_STATX,
+	OP_FADVISE,
+};
+
+#define OP_BITS 2
+#define OP_MASK ((1 << OP_BITS) - 1)
+
+struct load {
+	int next;                    /* in free or done list, -1 at end */
+	unsigned long tag;
+	char *path;
+	size_t path_alloc;
+	size_t readahead;
+	int pending;                 /* operations submitted and not completed */
+	int fd;
+	int open_errno;
+	struct statx stx;
+	int stx_ok;
+};
+
+struct os_file_loader {
+	int ring_fd;
+	unsigned int sq_entries;
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	unsigned int to_submit;      /* queued in the submission ring, not yet given to the kernel */
+
+	int depth;
+	struct load *loads;
+	int free_list;
+	int done_head, done_tail;
+	int running;                 /* loads submitted and not yet in done list */
+	int open_flags;
+};
+
+static int ring_setup(struct os_file_loader *l, unsigned int entries)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+
+	l->ring_fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (l->ring_fd < 0)
+		return -1;
+
+	l->sq_entries = p.sq_entries;
+	l->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	l->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	l->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	l->sq_ring = mmap(NULL, l->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, l->ring_fd, IORING_OFF_SQ_RING);
+	l->cq_ring = mmap(NULL, l->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, l->ring_fd, IORING_OFF_CQ_RING);
+	l->sqes = mmap(NULL, l->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, l->ring_fd, IORING_OFF_SQES);
+
+	if (l->sq_ring == MAP_FAILED || l->cq_ring == MAP_FAILED || l->sqes == MAP_FAILED)
+		return -1;
+
+	l->sq_head = (unsigned int *)((char *)l->sq_ring + p.sq_off.head);
+	l->sq_tail = (unsigned int *)((char *)l->sq_ring + p.sq_off.tail);
+	l->sq_mask = (unsigned int *)((char *)l->sq_ring + p.sq_off.ring_mask);
+	l->sq_array = (unsigned int *)((char *)l->sq_ring + p.sq_off.array);
+	l->cq_head = (unsigned int *)((char *)l->cq_ring + p.cq_off.head);
+	l->cq_tail = (unsigned int *)((char *)l->cq_ring + p.cq_off.tail);
+	l->cq_mask = (unsigned int *)((char *)l->cq_ring + p.cq_off.ring_mask);
+	l->cqes = (struct io_uring_cqe *)((char *)l->cq_ring + p.cq_off.cqes);
+
+	return 0;
+}
+
+static void ring_destroy(struct os_file_loader *l)
+{
+	if (l->sq_ring != NULL && l->sq_ring != MAP_FAILED)
+		munmap(l->sq_ring, l->sq_ring_size);
+	if (l->cq_ring != NULL && l->cq_ring != MAP_FAILED)
+		munmap(l->cq_ring, l->cq_ring_size);
+	if (l->sqes != NULL && l->sqes != MAP_FAILED)
+		munmap(l->sqes, l->sqes_size);
+	if (l->ring_fd >= 0)
+		close(l->ring_fd);
+}
+
+/* the submission ring has room for 3 operations per load, so it is never full */
+static struct io_uring_sqe *get_sqe(struct os_file_loader *l, int index, enum load_op op)
+{
+	unsigned int tail = *l->sq_tail;
+	unsigned int i = tail & *l->sq_mask;
+	struct io_uring_sqe *sqe = &l->sqes[i];
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->user_data = ((unsigned long long)index << OP_BITS) | op;
+
+	l->sq_array[i] = i;
+	__atomic_store_n(l->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	l->to_submit++;
+
+	return sqe;
+}
+
+static int ring_enter(struct os_file_loader *l, unsigned int min_complete)
+{
+	int ret;
+
+	ret = syscall(__NR_io_uring_enter, l->ring_fd, l->to_submit, min_complete,
+		min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	if (ret < 0)
+		return (errno == EINTR || errno == EAGAIN || errno == EBUSY) ? 0 : -1;
+
+	l->to_submit -= ret;
+
+	return 0;
+}
+
+static void load_done(struct os_file_loader *l, int index)
+{
+	l->loads[index].next = -1;
+
+	if (l->done_tail >= 0)
+		l->loads[l->done_tail].next = index;
+	else
+		l->done_head = index;
+	l->done_tail = index;
+
+	l->running--;
+}
+
+static void start_fadvise(struct os_file_loader *l, int index)
+{
+	struct load *load = &l->loads[index];
+	struct io_uring_sqe *sqe;
+	size_t len = load->readahead;
+
+	if (load->stx_ok && load->stx.stx_size < len)
+		len = load->stx.stx_size;
+
+	/* len 0 would mean the whole file */
+	if (load->fd < 0 || len == 0) {
+		load->readahead = 0;
+		load_done(l, index);
+		return;
+	}
+
+	if (len > 0xffffffffUL)
+		len = 0xffffffffUL;
+	load->readahead = len;
+
+	sqe = get_sqe(l, index, OP_FADVISE);
+	sqe->opcode = IORING_OP_FADVISE;
+	sqe->fd = load->fd;
+	sqe->off = 0;
+	sqe->len = len;
+	sqe->fadvise_advice = POSIX_FADV_WILLNEED;
+	load->pending = 1;
+}
+
+static void reap(struct os_file_loader *l)
+{
+	unsigned int head = *l->cq_head;
+	unsigned int tail = __atomic_load_n(l->cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail) {
+		struct io_uring_cqe *cqe = &l->cqes[head & *l->cq_mask];
+		int index = cqe->user_data >> OP_BITS;
+		struct load *load = &l->loads[index];
+
+		switch (cqe->user_data & OP_MASK) {
+		case OP_OPEN:
+			if (cqe->res >= 0)
+				load->fd = cqe->res;
+			else
+				load->open_errno = -cqe->res;
+			break;
+		case OP_STATX:
+			load->stx_ok = cqe->res >= 0;
+			break;
+		case OP_FADVISE:
+			/* failure only means that the file will not be read in advance */
+			break;
+		}
+
+		head++;
+
+		if (--load->pending == 0) {
+			if ((cqe->user_data & OP_MASK) == OP_FADVISE)
+				load_done(l, index);
+			else
+				start_fadvise(l, index);
+		}
+	}
+
+	__atomic_store_n(l->cq_head, head, __ATOMIC_RELEASE);
+}
+
+struct os_file_loader *os_file_loader_new(int depth, int noatime)
+{
+	struct os_file_loader *l = malloc(sizeof(struct os_file_loader));
+	int i;
+
+	memset(l, 0, sizeof(struct os_file_loader));
+	l->ring_fd = -1;
+
+	if (depth <= 0 || ring_setup(l, 3 * depth) != 0) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "io_uring not available (%s)", strerror(errno));
+		ring_destroy(l);
+		free(l);
+		return NULL;
+	}
+
+	l->depth = depth;
+	l->loads = calloc(depth, sizeof(struct load));
+	for (i = 0; i < depth; i++)
+		l->loads[i].next = i + 1 < depth ? i + 1 : -1;
+	l->free_list = 0;
+	l->done_head = -1;
+	l->done_tail = -1;
+	l->running = 0;
+	l->open_flags = O_RDONLY | O_CLOEXEC | (noatime ? O_NOATIME : 0);
+
+	return l;
+}
+
+int os_file_loader_submit(struct os_file_loader *l, int dir_fd, const char *path, size_t readahead, unsigned long tag)
+{
+	struct io_uring_sqe *sqe;
+	struct load *load;
+	size_t len;
+	int index;
+
+	if ((index = l->free_list) < 0)
+		return -1;
+
+	/* relative to its directory, only the name of the file is looked up */
+	if (dir_fd >= 0 && strrchr(path, '/') != NULL)
+		path = strrchr(path, '/') + 1;
+	else if (dir_fd < 0)
+		dir_fd = AT_FDCWD;
+	len = strlen(path) + 1;
+
+	load = &l->loads[index];
+
+	/* the kernel may read the path after submission, so it stays in the load until completion */
+	if (len > load->path_alloc) {
+		char *p = realloc(load->path, len);
+
+		if (p == NULL)
+			return -1;
+		load->path = p;
+		load->path_alloc = len;
+	}
+
+	l->free_list = load->next;
+
+	memcpy(load->path, path, len);
+	load->tag = tag;
+	load->readahead = readahead;
+	load->fd = -1;
+	load->open_errno = 0;
+	load->stx_ok = 0;
+	load->pending = 2;
+
+	sqe = get_sqe(l, index, OP_OPEN);
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = dir_fd;
+	sqe->addr = (unsigned long)load->path;
+	sqe->open_flags = l->open_flags;
+
+	sqe = get_sqe(l, index, OP_STATX);
+	sqe->opcode = IORING_OP_STATX;
+	sqe->fd = dir_fd;
+	sqe->addr = (unsigned long)load->path;
+	sqe->len = STATX_SIZE;
+	sqe->off = (unsigned long)&load->stx;
+
+	l->running++;
+
+	return 0;
+}
+
+int os_file_loader_complete(struct os_file_loader *l, unsigned long *tag, int *fd, size_t *size, int *perrno)
+{
+	struct load *load;
+	int index;
+
+	if (l->done_head < 0 && (l->to_submit > 0 || l->running > 0)) {
+		if (l->to_submit > 0)
+			ring_enter(l, 0);
+		reap(l);
+		/* completions may have queued fadvise operations */
+		if (l->to_submit > 0)
+			ring_enter(l, 0);
+	}
+
+	if ((index = l->done_head) < 0)
+		return 0;
+
+	load = &l->loads[index];
+	l->done_head = load->next;
+	if (l->done_head < 0)
+		l->done_tail = -1;
+
+	*tag = load->tag;
+	*fd = load->fd;
+	*size = load->readahead;
+	*perrno = load->open_errno;
+
+	load->next = l->free_list;
+	l->free_list = index;
+
+	return 1;
+}
+
+void os_file_loader_free(struct os_file_loader *l)
+{
+	int index, i;
+
+	while (l->running > 0) {
+		if (ring_enter(l, 1) != 0)
+			break;
+		reap(l);
+	}
+
+	for (index = l->done_head; index >= 0; index = l->loads[index].next)
+		if (l->loads[index].fd >= 0)
+			close(l->loads[index].fd);
+
+	ring_destroy(l);
+
+	/* the kernel cancels the loads still in flight asynchronously and may still write their path and */
+	/* statx buffers after the ring is closed: they are leaked rather than freed under its feet */
+	if (l->running > 0)
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "io_uring: %d loads still in flight, leaking their buffers", l->running);
+	else {
+		for (i = 0; i < l->depth; i++)
+			free(l->loads[i].path);
+		free(l->loads);
+	}
+
+	free(l);
+}
+
+#else
+
+struct os_file_loader *os_file_loader_new(int depth, int noatime)
+{
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "io_uring not supported by this build");
+
+	return NULL;
+}
+
+int os_file_loader_submit(struct os_file_loader *l, int dir_fd, const char *path, size_t readahead, unsigned long tag)
+{
+	return -1;
+}
+
+int os_file_loader_complete(struct os_file_loader *l, unsigned long *tag, int *fd, size_t *size, int *perrno)
+{
+	return 0;
+}
+
+void os_file_loader_free(struct os_file_loader *l)
+{
+}
+
+#endif
@@ -24,47 +24,111 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "core/mimetype.h"
 
+#include "mimemagic_p.h"
+
 #include <glib.h>
 #include <magic.h>
 #include <string.h>
 #include <unistd.h>
 
-/* Unfortunately, libmagic is not thread-safe. */
-/* We create a new magic_t for each thread, and keep it  */
-/* in thread's private data, so that it is created only once. */
+/* Unfortunately, libmagic is not thread-safe: a magic_t must not be used */
+/* by two threads at the same time. Loading the magic database is costly, */
+/* so loaded magic_t are kept in a pool and lent to a thread for the time */
+/* of one classification. No more magic_t are loaded than there are */
+/* processors, however many threads classify files. */
 
 static int init_done = 0;
-static GPrivate *private_key;
 
-static void magic_destroy_notify(gpointer data)
-{
-	magic_close((magic_t)data);
-}
+static struct magic_pool {
+	GMutex lock;
+	GCond available;           /* signaled when a magic_t is given back */
+	GPtrArray *free_magics;    /* loaded magic_t that are not lent */
+	int n_magics;              /* number of magic_t loaded or being loaded */
+	int max_magics;
+	gint64 retry_time;         /* after a failed load, no other load is tried before this monotonic time */
+} pool;
+
+/* delay, in microseconds, before loading the database again after a failure */
+#define LOAD_RETRY_DELAY (60 * G_USEC_PER_SEC)
 
-static magic_t get_private_magic(void)
+/* the most common types are recognized without libmagic, if it names them the same way */
+static int builtin_magic = 0;
+
+static magic_t magic_pool_get(void)
 {
-	magic_t m;
+	magic_t m = NULL;
 
-	m = (magic_t)g_private_get(private_key);
+	g_mutex_lock(&pool.lock);
 
-	if (m == NULL) {
-		m = magic_open(MAGIC_MIME_TYPE);
-		magic_load(m, NULL);
+	/* a loaded magic_t is always lent if there is one, even while loads are failing */
+	while (pool.free_magics->len == 0) {
+		if (pool.n_magics < pool.max_magics && g_get_monotonic_time() >= pool.retry_time)
+			break;
+
+		/* nothing loaded, nor being loaded, and no load to try now */
+		if (pool.n_magics == 0) {
+			g_mutex_unlock(&pool.lock);
+			return NULL;
+		}
 
-		g_private_set(private_key, (gpointer)m);
+		g_cond_wait(&pool.available, &pool.lock);
+	}
+
+	if (pool.free_magics->len > 0)
+		m = (magic_t)g_ptr_array_remove_index_fast(pool.free_magics, pool.free_magics->len - 1);
+	else
+		pool.n_magics++;
+
+	g_mutex_unlock(&pool.lock);
+
+	if (m != NULL)
+		return m;
+
+	/* the database is loaded without holding the lock, other threads can still get a loaded magic_t */
+	m = magic_open(MAGIC_MIME_TYPE);
+	if (m != NULL && magic_load(m, NULL) != 0) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot load magic database: %s", magic_error(m));
+		magic_close(m);
+		m = NULL;
+	}
+
+	/* the database is not loaded again for each file, but after a delay */
+	if (m == NULL) {
+		g_mutex_lock(&pool.lock);
+		pool.n_magics--;
+		pool.retry_time = g_get_monotonic_time() + LOAD_RETRY_DELAY;
+		g_cond_broadcast(&pool.available);
+		g_mutex_unlock(&pool.lock);
 	}
 
 	return m;
 }
 
+static void magic_pool_put(magic_t m)
+{
+	g_mutex_lock(&pool.lock);
+	g_ptr_array_add(pool.free_magics, m);
+	g_cond_signal(&pool.available);
+	g_mutex_unlock(&pool.lock);
+}
+
 void os_mime_type_init(void)
 {
+	magic_t m;
+
 	if (!init_done) {
-		private_key = g_private_new(magic_destroy_notify);
+		pool.free_magics = g_ptr_array_new();
+		pool.max_magics = g_get_num_processors();
 
-		// this is to pre-load the magic file for the current thread
+		// this is to pre-load the magic file
 		// to avoid a dead-lock for the first scanned file
-		get_private_magic();
+		if ((m = magic_pool_get()) != NULL)
+			magic_pool_put(m);
+
+		mime_magic_init();
+		builtin_magic = magic_version() >= MIME_MAGIC_LIBMAGIC_VERSION;
+		if (!builtin_magic)
+			a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "libmagic version %d is older than %d, all file types are given by libmagic", magic_version(), MIME_MAGIC_LIBMAGIC_VERSION);
 
 		init_done = 1;
 	}
@@ -75,11 +139,17 @@ const char *os_mime_type_guess(const char *path)
 	magic_t m;
 	const char *mime_type;
 
-	m = get_private_magic();
+	if ((m = magic_pool_get()) == NULL)
+		return NULL;
 
+	/* the string returned by libmagic belongs to m, it must be interned before m is given back */
 	mime_type = magic_file(m, path);
+	if (mime_type != NULL)
+		mime_type = g_intern_string(mime_type);
+
+	magic_pool_put(m);
 
-	return strdup(mime_type);
+	return mime_type;
 }
 
 #define BUFFER_SIZE 1024
@@ -88,17 +158,25 @@ const char *os_mime_type_guess_fd(int fd)
 {
 	magic_t m;
 	const char *mime_type;
-	char *buffer[BUFFER_SIZE];
+	unsigned char buffer[BUFFER_SIZE];
 	int n_read;
 
-	m = get_private_magic();
-
 	if ((n_read = read(fd, buffer, BUFFER_SIZE)) < 0) {
 		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot read %d bytes from file descriptor %d", BUFFER_SIZE, fd);
 		return NULL;
 	}
 
+	if (builtin_magic && (mime_type = mime_magic_guess(buffer, n_read)) != NULL)
+		return mime_type;
+
+	if ((m = magic_pool_get()) == NULL)
+		return NULL;
+
 	mime_type = magic_buffer(m, buffer, n_read);
+	if (mime_type != NULL)
+		mime_type = g_intern_string(mime_type);
+
+	magic_pool_put(m);
 
-	return strdup(mime_type);
+	return mime_type;
 }
@@ -0,0 +1,281 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/mount.h"
+
+#include <glib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+
+#define MOUNTINFO_PATH "/proc/self/mountinfo"
+
+/* the system mount table is checked for changes at most this often, in microseconds */
+#define CHANGE_CHECK_PERIOD (1000 * 1000)
+
+struct os_mount_table {
+	GMutex lock;
+	GHashTable *devices;       /* device -> file system class + 1, for devices of the system mount table */
+	GHashTable *unmounted;     /* same, for devices not in the system mount table, classified by statfs */
+	int mountinfo_fd;          /* polled for mount table changes, -1 if not available */
+	gint64 last_check;
+};
+
+static const char *pseudo_types[] = {
+	"autofs",                  /* traversing it would trigger mounts */
+	"binfmt_misc",
+	"bpf",
+	"cgroup",
+	"cgroup2",
+	"configfs",
+	"debugfs",
+	"devpts",
+	"devtmpfs",
+	"efivarfs",
+	"fusectl",
+	"hugetlbfs",
+	"mqueue",
+	"nsfs",
+	"proc",
+	"pstore",
+	"rpc_pipefs",
+	"securityfs",
+	"selinuxfs",
+	"sysfs",
+	"tracefs",
+	NULL,
+};
+
+static const char *network_types[] = {
+	"9p",
+	"afs",
+	"ceph",
+	"cifs",
+	"coda",
+	"ncpfs",
+	"nfs",
+	"nfs4",
+	"smb3",
+	"smbfs",
+	NULL,
+};
+
+/* file system magic numbers, as given by statfs, for devices that are not in the mount table */
+struct fs_magic {
+	unsigned long magic;
+	enum os_fs_class fs_class;
+};
+
+static const struct fs_magic magics[] = {
+	{ 0x9fa0, OS_FS_PSEUDO },          /* proc */
+	{ 0x62656572, OS_FS_PSEUDO },      /* sysfs */
+	{ 0x27e0eb, OS_FS_PSEUDO },        /* cgroup */
+	{ 0x63677270, OS_FS_PSEUDO },      /* cgroup2 */
+	{ 0x64626720, OS_FS_PSEUDO },      /* debugfs */
+	{ 0x74726163, OS_FS_PSEUDO },      /* tracefs */
+	{ 0x73636673, OS_FS_PSEUDO },      /* securityfs */
+	{ 0x1cd1, OS_FS_PSEUDO },          /* devpts */
+	{ 0xcafe4a11, OS_FS_PSEUDO },      /* bpf */
+	{ 0x6165676c, OS_FS_PSEUDO },      /* pstore */
+	{ 0xf97cff8c, OS_FS_PSEUDO },      /* selinuxfs */
+	{ 0x62656570, OS_FS_PSEUDO },      /* configfs */
+	{ 0xde5e81e4, OS_FS_PSEUDO },      /* efivarfs */
+	{ 0x19800202, OS_FS_PSEUDO },      /* mqueue */
+	{ 0x6e736673, OS_FS_PSEUDO },      /* nsfs */
+	{ 0x958458f6, OS_FS_PSEUDO },      /* hugetlbfs */
+	{ 0x0187, OS_FS_PSEUDO },          /* autofs */
+	{ 0x42494e4d, OS_FS_PSEUDO },      /* binfmt_misc */
+	{ 0x6969, OS_FS_NETWORK },         /* nfs */
+	{ 0x517b, OS_FS_NETWORK },         /* smbfs */
+	{ 0xff534d42, OS_FS_NETWORK },     /* cifs */
+	{ 0xfe534d42, OS_FS_NETWORK },     /* smb2 */
+	{ 0x00c36400, OS_FS_NETWORK },     /* ceph */
+	{ 0x5346414f, OS_FS_NETWORK },     /* afs */
+	{ 0x73757245, OS_FS_NETWORK },     /* coda */
+	{ 0x01021997, OS_FS_NETWORK },     /* 9p */
+	{ 0x65735546, OS_FS_FUSE },        /* fuse */
+	{ 0, OS_FS_LOCAL },
+};
+
+static int in_list(const char *type, const char **list)
+{
+	for (; *list != NULL; list++)
+		if (!strcmp(type, *list))
+			return 1;
+
+	return 0;
+}
+
+static enum os_fs_class type_class(const char *type)
+{
+	if (in_list(type, pseudo_types))
+		return OS_FS_PSEUDO;
+
+	if (in_list(type, network_types))
+		return OS_FS_NETWORK;
+
+	/* fuseblk is a user space driver of a local disk (ntfs-3g, exfat) */
+	if (!strcmp(type, "fuse") || !strncmp(type, "fuse.", 5))
+		return OS_FS_FUSE;
+
+	return OS_FS_LOCAL;
+}
+
+static enum os_fs_class statfs_class(const char *path)
+{
+	struct statfs sfs;
+	const struct fs_magic *m;
+
+	if (path == NULL || statfs(path, &sfs) != 0)
+		return OS_FS_LOCAL;
+
+	for (m = magics; m->magic != 0; m++)
+		if (m->magic == ((unsigned long)sfs.f_type & 0xffffffffUL))
+			return m->fs_class;
+
+	return OS_FS_LOCAL;
+}
+
+static void add_device(GHashTable *devices, unsigned long long dev, enum os_fs_class fs_class)
+{
+	gint64 *key = g_new(gint64, 1);
+
+	*key = (gint64)dev;
+	g_hash_table_replace(devices, key, GINT_TO_POINTER(fs_class + 1));
+}
+
+/* lines of mountinfo are: id parent major:minor root mount-point options [optional fields] - type source super-options */
+static void read_mountinfo(struct os_mount_table *t)
+{
+	FILE *f;
+	char *line = NULL;
+	size_t alloc = 0;
+
+	/* a device number can be reused by a new mount, so both tables are renewed */
+	g_hash_table_remove_all(t->devices);
+	g_hash_table_remove_all(t->unmounted);
+
+	if ((f = fopen(MOUNTINFO_PATH, "r")) == NULL)
+		return;
+
+	while (getline(&line, &alloc, f) != -1) {
+		unsigned int major, minor;
+		char *type;
+
+		if (sscanf(line, "%*d %*d %u:%u", &major, &minor) != 2
+			|| (type = strstr(line, " - ")) == NULL)
+			continue;
+
+		type += 3;
+		type[strcspn(type, " \n")] = '\0';
+
+		add_device(t->devices, makedev(major, minor), type_class(type));
+	}
+
+	free(line);
+	fclose(f);
+}
+
+/* mountinfo is reported readable with POLLPRI once after each change of the mount table */
+static int mountinfo_changed(struct os_mount_table *t)
+{
+	struct pollfd pfd;
+	gint64 now = g_get_monotonic_time();
+
+	if (t->mountinfo_fd < 0 || now - t->last_check < CHANGE_CHECK_PERIOD)
+		return 0;
+
+	t->last_check = now;
+
+	pfd.fd = t->mountinfo_fd;
+	pfd.events = POLLPRI;
+	pfd.revents = 0;
+
+	return poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLPRI | POLLERR));
+}
+
+struct os_mount_table *os_mount_table_new(void)
+{
+	struct os_mount_table *t = malloc(sizeof(struct os_mount_table));
+
+	g_mutex_init(&t->lock);
+	t->devices = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+	t->unmounted = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+	t->mountinfo_fd = open(MOUNTINFO_PATH, O_RDONLY | O_CLOEXEC);
+	t->last_check = g_get_monotonic_time();
+
+	/* the first poll reports the table as changed */
+	mountinfo_changed(t);
+
+	read_mountinfo(t);
+
+	return t;
+}
+
+enum os_fs_class os_mount_table_classify(struct os_mount_table *t, unsigned long long dev, const char *path)
+{
+	gint64 key = (gint64)dev;
+	enum os_fs_class fs_class;
+	gpointer value;
+
+	if (t == NULL)
+		return statfs_class(path);
+
+	g_mutex_lock(&t->lock);
+
+	/* the system mount table is read again only when it has changed, not for each unknown device */
+	if (mountinfo_changed(t))
+		read_mountinfo(t);
+
+	if ((value = g_hash_table_lookup(t->devices, &key)) == NULL)
+		value = g_hash_table_lookup(t->unmounted, &key);
+
+	/* devices that are not mounted by themselves, like btrfs sub-volumes, or mounted */
+	/* since the last check; they are classified once, until the mount table changes */
+	if (value == NULL) {
+		fs_class = statfs_class(path);
+		add_device(t->unmounted, dev, fs_class);
+	} else
+		fs_class = (enum os_fs_class)(GPOINTER_TO_INT(value) - 1);
+
+	g_mutex_unlock(&t->lock);
+
+	return fs_class;
+}
+
+void os_mount_table_free(struct os_mount_table *t)
+{
+	if (t->mountinfo_fd >= 0)
+		close(t->mountinfo_fd);
+
+	g_hash_table_destroy(t->devices);
+	g_hash_table_destroy(t->unmounted);
+	g_mutex_clear(&t->lock);
+	free(t);
+}
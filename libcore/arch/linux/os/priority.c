@@ -0,0 +1,397 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#define _GNU_SOURCE
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/priority.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+/* from linux/ioprio.h, which is not exported by all distributions */
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_PRIO_VALUE(class, data) (((class) << IOPRIO_CLASS_SHIFT) | (data))
+#define IOPRIO_CLASS_NONE 0
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_BE_LOWEST 7
+
+int os_thread_set_priority(enum os_io_class io_class, int nice)
+{
+	pid_t tid = syscall(SYS_gettid);
+	int ioprio;
+
+	switch(io_class) {
+	case OS_IO_CLASS_BACKGROUND:
+		ioprio = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, IOPRIO_BE_LOWEST);
+		break;
+	case OS_IO_CLASS_IDLE:
+		ioprio = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0);
+		break;
+	default:
+		/* I/O priority follows the CPU priority */
+		ioprio = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_NONE, 0);
+		break;
+	}
+
+	/* on linux, I/O and CPU priorities apply to a thread when given its thread id */
+#ifdef SYS_ioprio_set
+	if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, ioprio) < 0) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot set I/O priority of thread %d (%s)", (int)tid, strerror(errno));
+		return -1;
+	}
+#endif
+
+	if (setpriority(PRIO_PROCESS, tid, nice) < 0) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot set CPU priority of thread %d (%s)", (int)tid, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+#define CGROUP_MOUNT "/sys/fs/cgroup"
+
+/* finds the control group of the process in /proc/self/cgroup, whose lines are */
+/* "<id>:<controllers>:<path>"; controller is NULL for the cgroup v2 hierarchy, whose id is 0 */
+/* returns 0 and fills controllers and path if found */
+static int self_cgroup(const char *controller, char *controllers, size_t controllers_size, char *path, size_t path_size)
+{
+	FILE *f = fopen("/proc/self/cgroup", "r");
+	char line[PATH_MAX + 256], *first, *second, *c, *saveptr;
+	int found = 0;
+
+	if (f == NULL)
+		return -1;
+
+	while (!found && fgets(line, sizeof(line), f) != NULL) {
+		line[strcspn(line, "\n")] = '\0';
+
+		if ((first = strchr(line, ':')) == NULL || (second = strchr(first + 1, ':')) == NULL)
+			continue;
+		*first++ = '\0';
+		*second++ = '\0';
+
+		if (controller == NULL)
+			found = !strcmp(line, "0") && *first == '\0';
+		else {
+			snprintf(controllers, controllers_size, "%s", first);
+			for (c = strtok_r(first, ",", &saveptr); c != NULL && !found; c = strtok_r(NULL, ",", &saveptr))
+				found = !strcmp(c, controller);
+		}
+
+		if (found)
+			snprintf(path, path_size, "%s", second);
+	}
+
+	fclose(f);
+
+	return found ? 0 : -1;
+}
+
+typedef int (*cgroup_quota_fun_t)(const char *dir);
+
+/* a quota applies to the whole sub-tree of a control group: the lowest quota of the */
+/* control group and of its ancestors applies; the path of the control group is modified */
+/* the control group of the process may not be visible, when mount is the root of a */
+/* cgroup namespace without being reported so: its ancestors up to mount are still tried */
+static int cgroup_lowest_quota(const char *mount, char *path, cgroup_quota_fun_t quota_fun)
+{
+	char dir[PATH_MAX], *slash;
+	int quota, lowest = -1;
+
+	for (;;) {
+		snprintf(dir, sizeof(dir), "%s%s", mount, path);
+
+		quota = (*quota_fun)(dir);
+		if (quota > 0 && (lowest < 0 || quota < lowest))
+			lowest = quota;
+
+		if ((slash = strrchr(path, '/')) == NULL || slash[1] == '\0')
+			break;
+
+		/* parent of "/a" is "/" */
+		slash[slash == path ? 1 : 0] = '\0';
+	}
+
+	return lowest;
+}
+
+/* cgroup v2 cpu.max contains "<quota> <period>", or "max <period>" if no quota */
+static int cgroup2_dir_quota(const char *dir)
+{
+	char path[PATH_MAX];
+	long long quota, period;
+	FILE *f;
+	int n;
+
+	snprintf(path, sizeof(path), "%s/cpu.max", dir);
+	if ((f = fopen(path, "r")) == NULL)
+		return -1;
+
+	n = fscanf(f, "%lld %lld", &quota, &period);
+	fclose(f);
+
+	if (n != 2 || quota <= 0 || period <= 0)
+		return -1;
+
+	return (int)((quota + period - 1) / period);
+}
+
+static int cgroup2_cpu_quota(void)
+{
+	char path[PATH_MAX];
+
+	if (self_cgroup(NULL, NULL, 0, path, sizeof(path)))
+		return -1;
+
+	return cgroup_lowest_quota(CGROUP_MOUNT, path, cgroup2_dir_quota);
+}
+
+static long long read_long_long(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	long long value;
+
+	if (f == NULL)
+		return -1;
+
+	if (fscanf(f, "%lld", &value) != 1)
+		value = -1;
+	fclose(f);
+
+	return value;
+}
+
+/* cgroup v1 quota is -1 if not limited */
+static int cgroup1_dir_quota(const char *dir)
+{
+	char path[PATH_MAX];
+	long long quota, period;
+
+	snprintf(path, sizeof(path), "%s/cpu.cfs_quota_us", dir);
+	quota = read_long_long(path);
+	snprintf(path, sizeof(path), "%s/cpu.cfs_period_us", dir);
+	period = read_long_long(path);
+
+	if (quota <= 0 || period <= 0)
+		return -1;
+
+	return (int)((quota + period - 1) / period);
+}
+
+/* the cpu controller hierarchy is mounted under its list of controllers, e.g. "cpu,cpuacct", */
+/* usually with a "cpu" link to it */
+static int cgroup1_cpu_quota(void)
+{
+	char controllers[256], path[PATH_MAX], mount[PATH_MAX];
+
+	if (self_cgroup("cpu", controllers, sizeof(controllers), path, sizeof(path)))
+		return -1;
+
+	snprintf(mount, sizeof(mount), CGROUP_MOUNT "/%s", controllers);
+	if (access(mount, F_OK))
+		snprintf(mount, sizeof(mount), CGROUP_MOUNT "/cpu");
+
+	return cgroup_lowest_quota(mount, path, cgroup1_dir_quota);
+}
+
+/* the affinity mask can have more processors than a cpu_set_t */
+static int affinity_cpu_count(void)
+{
+	cpu_set_t *set;
+	size_t size;
+	int n_max, count = -1;
+
+	for (n_max = CPU_SETSIZE; n_max <= 1024 * CPU_SETSIZE; n_max *= 2) {
+		set = CPU_ALLOC(n_max);
+		size = CPU_ALLOC_SIZE(n_max);
+
+		if (sched_getaffinity(0, size, set) == 0)
+			count = CPU_COUNT_S(size, set);
+
+		CPU_FREE(set);
+
+		if (count >= 0 || errno != EINVAL)
+			break;
+	}
+
+	return count;
+}
+
+int os_cpu_count(void)
+{
+	int n_cpus, quota;
+
+	/* processors the process is allowed to run on, including by its cpuset control group */
+	n_cpus = affinity_cpu_count();
+	if (n_cpus <= 0)
+		n_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n_cpus <= 0)
+		n_cpus = 1;
+
+	/* a container can have all the processors in its affinity, but a quota of a few of them */
+	quota = cgroup2_cpu_quota();
+	if (quota <= 0)
+		quota = cgroup1_cpu_quota();
+
+	if (quota > 0 && quota < n_cpus) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "CPU quota of control group limits processors from %d to %d", n_cpus, quota);
+		n_cpus = quota;
+	}
+
+	return n_cpus;
+}
+
+int os_cpu_load(void)
+{
+	double load;
+	long n_cpus;
+
+	if (getloadavg(&load, 1) != 1)
+		return -1;
+
+	n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n_cpus <= 0)
+		n_cpus = 1;
+
+	return (int)(100.0 * load / n_cpus);
+}
+
+#define MAX_DISKS 64
+#define DISK_NAME_SIZE 32
+
+struct disk_ticks {
+	char name[DISK_NAME_SIZE];
+	unsigned long long io_ticks;     /* milliseconds spent doing I/O */
+};
+
+struct os_disk_activity {
+	struct disk_ticks disks[MAX_DISKS];
+	int n_disks;
+	long long time;                  /* time of previous call, in milliseconds */
+};
+
+struct os_disk_activity *os_disk_activity_new(void)
+{
+	struct os_disk_activity *activity = malloc(sizeof(struct os_disk_activity));
+
+	activity->n_disks = 0;
+	activity->time = 0;
+
+	return activity;
+}
+
+static long long get_milliseconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* loop and ram devices do not compete with the disks the scan is reading */
+static int is_virtual_disk(const char *name)
+{
+	return !strncmp(name, "loop", 4) || !strncmp(name, "ram", 3) || !strncmp(name, "zram", 4);
+}
+
+static unsigned long long previous_ticks(struct os_disk_activity *activity, const char *name, int *found)
+{
+	int i;
+
+	for (i = 0; i < activity->n_disks; i++)
+		if (!strcmp(activity->disks[i].name, name)) {
+			*found = 1;
+			return activity->disks[i].io_ticks;
+		}
+
+	*found = 0;
+
+	return 0;
+}
+
+int os_disk_activity_busy(struct os_disk_activity *activity)
+{
+	struct disk_ticks disks[MAX_DISKS];
+	int n_disks = 0, busy = -1, found, i;
+	char line[256];
+	long long now, elapsed;
+	FILE *f;
+
+	if ((f = fopen("/proc/diskstats", "r")) == NULL)
+		return -1;
+
+	now = get_milliseconds();
+	elapsed = now - activity->time;
+
+	/* major minor name reads rmerged rsectors rms writes wmerged wsectors wms in_flight io_ticks ... */
+	while (n_disks < MAX_DISKS && fgets(line, sizeof(line), f) != NULL) {
+		struct disk_ticks *d = &disks[n_disks];
+		unsigned long long prev;
+
+		if (sscanf(line, "%*u %*u %31s %*u %*u %*u %*u %*u %*u %*u %*u %*u %llu", d->name, &d->io_ticks) != 2)
+			continue;
+
+		if (is_virtual_disk(d->name))
+			continue;
+
+		n_disks++;
+
+		prev = previous_ticks(activity, d->name, &found);
+		if (found && activity->time != 0 && elapsed > 0 && d->io_ticks >= prev) {
+			int percent = (int)(100 * (d->io_ticks - prev) / elapsed);
+
+			if (percent > busy)
+				busy = percent > 100 ? 100 : percent;
+		}
+	}
+
+	fclose(f);
+
+	for (i = 0; i < n_disks; i++)
+		activity->disks[i] = disks[i];
+	activity->n_disks = n_disks;
+	activity->time = now;
+
+	return busy;
+}
+
+void os_disk_activity_free(struct os_disk_activity *activity)
+{
+	free(activity);
+}
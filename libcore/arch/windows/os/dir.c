@@ -94,7 +94,7 @@ static BOOL DirectoryExists(LPCTSTR szPath)
   */
 
 
-int os_dir_map(const char *path, int recurse, dirent_cb_t dirent_cb, void *data) {
+int os_dir_map(const char *path, dirent_cb_t dirent_cb, void *data) {
 
 	char * sPath = NULL, *entryPath = NULL;
 	char * escapedPath = NULL;
@@ -150,20 +150,13 @@ int os_dir_map(const char *path, int recurse, dirent_cb_t dirent_cb, void *data)
 		entryPath[size] = '\0';
 		sprintf_s(entryPath, size, "%s\\%s", path, tmp.cFileName);		
 
-		// If it is a directory and we do recursive scan
-		if ((GetFileAttributesA(entryPath) & FILE_ATTRIBUTE_DIRECTORY) && recurse >= 1) {
-			ret = os_dir_map(entryPath, recurse, dirent_cb, data);
-			if (ret != 0){
-				free(entryPath);
-				break;
-			}
-		}
-		else {
-			flags = dirent_flags(tmp.dwFileAttributes);
-			ret = (*dirent_cb)(entryPath, flags, 0, data);
-		}
+		flags = dirent_flags(tmp.dwFileAttributes);
+		ret = (*dirent_cb)(entryPath, flags, 0, data);
 
 		free(entryPath);
+
+		if (ret != 0)
+			break;
 	}
 
 	if (sPath != NULL) {
@@ -173,7 +166,27 @@ int os_dir_map(const char *path, int recurse, dirent_cb_t dirent_cb, void *data)
 
 	FindClose(fh);
 
-	return 0;
+	return ret;
+}
+
+/* FindFirstFile() works on paths only: directories are not opened, only checked */
+int os_dir_open(int parent_fd, const char *path)
+{
+	if (!DirectoryExists(path)) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	return OS_DIR_NO_FD;
+}
+
+void os_dir_close(int fd)
+{
+}
+
+int os_dir_map_fd(int fd, const char *path, dirent_cb_t dirent_cb, void *data)
+{
+	return os_dir_map(path, dirent_cb, data);
 }
 
 /*
@@ -199,3 +212,9 @@ int os_mkdir_p(const char *path)
 	fprintf(stderr, "os_mkdir_p not implemented\n");
 	return -1;
 }
+
+int os_dir_count_hint(const char *path)
+{
+	/* no cheap estimate yet, GetDiskFreeSpaceEx() does not give a files count */
+	return -1;
+}
@@ -22,10 +22,13 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #include "armadito-config.h"
 
 #include "core/file.h"
+#include "core/io.h"
 
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <Windows.h>
+#include <winioctl.h>
 
 FILE * os_fopen(const char *filename, const char *mode) {
 
@@ -41,26 +44,119 @@ FILE * os_fopen(const char *filename, const char *mode) {
 
 }
 
+static void fill_stat(struct os_file_stat *buf, struct _stat64 *sb)
+{
+	if (sb->st_mode & S_IFDIR)
+		buf->flags = FILE_FLAG_IS_DIRECTORY;
+	else if (sb->st_mode & S_IFREG)
+		buf->flags = FILE_FLAG_IS_PLAIN_FILE;
+	else
+		buf->flags = FILE_FLAG_IS_UNKNOWN;
+
+	buf->file_size = (size_t)sb->st_size;
+	buf->dev = sb->st_dev;
+	/* no inode number and only seconds resolution with the C runtime stat functions */
+	buf->inode = 0;
+	buf->mtime = (long long)sb->st_mtime * 1000000000LL;
+	buf->ctime = (long long)sb->st_ctime * 1000000000LL;
+}
+
 int os_file_stat(const char *path, struct os_file_stat *buf, int *pfile_errno)
 {
-	struct stat sb;
+	struct _stat64 sb;
 
-	if (_stat(path, &sb) == -1) {
+	if (_stat64(path, &sb) == -1) {
 		*pfile_errno = errno;
 		buf->flags = FILE_FLAG_IS_ERROR;
 		return -1;
 	}
 
-	if (sb.st_mode & S_IFDIR)
-		buf->flags = FILE_FLAG_IS_DIRECTORY;
-	else if (sb.st_mode & S_IFREG)
-		buf->flags = FILE_FLAG_IS_PLAIN_FILE;
-	else
-		buf->flags = FILE_FLAG_IS_UNKNOWN;
+	fill_stat(buf, &sb);
+
+	return 0;
+}
+
+int os_file_stat_fd(int fd, struct os_file_stat *buf, int *pfile_errno)
+{
+	struct _stat64 sb;
+
+	if (_fstat64(fd, &sb) == -1) {
+		*pfile_errno = errno;
+		buf->flags = FILE_FLAG_IS_ERROR;
+		return -1;
+	}
+
+	fill_stat(buf, &sb);
 
 	return 0;
 }
 
+/* files are always opened by path: there are no directory descriptors */
+int os_file_stat_at(int dir_fd, const char *path, struct os_file_stat *buf, int *pfile_errno)
+{
+	return os_file_stat(path, buf, pfile_errno);
+}
+
+/* offset is the logical cluster number of the first extent */
+int os_file_physical_offset_at(int dir_fd, const char *path, unsigned long long *offset)
+{
+	STARTING_VCN_INPUT_BUFFER input;
+	RETRIEVAL_POINTERS_BUFFER output;
+	DWORD returned, error = 0;
+	HANDLE fh;
+
+	fh = CreateFileA(path, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fh == INVALID_HANDLE_VALUE)
+		return -1;
+
+	input.StartingVcn.QuadPart = 0;
+
+	/* output has room for one extent only, so fragmented files give ERROR_MORE_DATA */
+	if (!DeviceIoControl(fh, FSCTL_GET_RETRIEVAL_POINTERS, &input, sizeof(input), &output, sizeof(output), &returned, NULL))
+		error = GetLastError();
+
+	CloseHandle(fh);
+
+	/* small files resident in the MFT have no extent */
+	if ((error != 0 && error != ERROR_MORE_DATA) || output.ExtentCount == 0 || output.Extents[0].Lcn.QuadPart < 0)
+		return -1;
+
+	*offset = (unsigned long long)output.Extents[0].Lcn.QuadPart;
+
+	return 0;
+}
+
+int os_file_prefetch_at(int dir_fd, const char *path, size_t *size)
+{
+	/* no equivalent of posix_fadvise() */
+	*size = 0;
+
+	return -1;
+}
+
+int os_file_open_at(int dir_fd, const char *path, int noatime)
+{
+	int fd;
+
+	/* the access time is left as is by the system configuration (NtfsDisableLastAccessUpdate) */
+	if (_sopen_s(&fd, path, O_RDONLY | _O_BINARY, _SH_DENYNO, _S_IREAD) != 0)
+		return -1;
+
+	return fd;
+}
+
+unsigned char *os_file_cache_resident(int fd, size_t size)
+{
+	/* no equivalent of mincore() */
+	return NULL;
+}
+
+int os_file_cache_drop(int fd, size_t size, const unsigned char *resident)
+{
+	/* no equivalent of posix_fadvise(), the cache manager cannot be told to drop the pages of a file */
+	return -1;
+}
+
 int os_file_do_not_scan(const char *path)
 {
   return 0;
@@ -0,0 +1,48 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/fileloader.h"
+
+#include <stddef.h>
+
+/* no asynchronous open: files are opened by the scanning threads */
+
+struct os_file_loader *os_file_loader_new(int depth, int noatime)
+{
+	return NULL;
+}
+
+int os_file_loader_submit(struct os_file_loader *l, int dir_fd, const char *path, size_t readahead, unsigned long tag)
+{
+	return -1;
+}
+
+int os_file_loader_complete(struct os_file_loader *l, unsigned long *tag, int *fd, size_t *size, int *perrno)
+{
+	return 0;
+}
+
+void os_file_loader_free(struct os_file_loader *l)
+{
+}
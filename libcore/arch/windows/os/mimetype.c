@@ -26,6 +26,7 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #include "string_p.h"
 #include "core/io.h"
 
+#include <glib.h>
 #include <Windows.h>
 #include <stdio.h>
 
@@ -46,7 +47,7 @@ const char* getHresError(HRESULT hr)
 
 const char *os_mime_type_guess_fd(int fd)
 {
-	char *mime_type;
+	char mime_type[MIME_SIZE + 1];
 	LPWSTR mt = 0;
 	size_t i = 0;
 	int n_read = 0;
@@ -71,19 +72,19 @@ const char *os_mime_type_guess_fd(int fd)
 	}
 
 	// convert wchar * to char * 
-	mime_type = (char*)calloc(MIME_SIZE + 1, sizeof(char));
-	mime_type[MIME_SIZE] = '\0';
-	wcstombs_s(&i, mime_type, MIME_SIZE, (wchar_t*)mt, MIME_SIZE);
+	mime_type[0] = '\0';
+	wcstombs_s(&i, mime_type, sizeof(mime_type), (wchar_t*)mt, MIME_SIZE);
+	CoTaskMemFree(mt);
 
 	// printf("mime_type = %s \n", mime_type);
 
-	return mime_type;
+	return g_intern_string(mime_type);
 }
 
 
 const char *os_mime_type_guess(const char *path)
 {
-	char *mime_type;
+	char mime_type[MIME_SIZE + 1];
 	HANDLE fh;
 	size_t size = 0;
 	void * buf = NULL;
@@ -132,14 +133,14 @@ const char *os_mime_type_guess(const char *path)
 	}
 
 	// convert wchar * to char * 
-	mime_type = (char*)calloc(MIME_SIZE+1,sizeof(char));
-	mime_type[MIME_SIZE] = '\0';
-	wcstombs_s(&i, mime_type, MIME_SIZE,(wchar_t*)mt, MIME_SIZE);
+	mime_type[0] = '\0';
+	wcstombs_s(&i, mime_type, sizeof(mime_type), (wchar_t*)mt, MIME_SIZE);
+	CoTaskMemFree(mt);
 
 	free(buf);
 	CloseHandle(fh);
 	
-	return mime_type;
+	return g_intern_string(mime_type);
 }
 
 void os_mime_type_init(void) {
@@ -0,0 +1,49 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/mount.h"
+
+#include <stddef.h>
+#include <Windows.h>
+
+/* no cached view: drives are told apart by their type, which the system keeps */
+
+struct os_mount_table *os_mount_table_new(void)
+{
+	return NULL;
+}
+
+enum os_fs_class os_mount_table_classify(struct os_mount_table *t, unsigned long long dev, const char *path)
+{
+	char volume[MAX_PATH];
+
+	if (path == NULL || !GetVolumePathNameA(path, volume, MAX_PATH))
+		return OS_FS_LOCAL;
+
+	return GetDriveTypeA(volume) == DRIVE_REMOTE ? OS_FS_NETWORK : OS_FS_LOCAL;
+}
+
+void os_mount_table_free(struct os_mount_table *t)
+{
+}
@@ -0,0 +1,201 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/priority.h"
+
+#include <glib.h>
+#include <Windows.h>
+#include <Pdh.h>
+#include <PdhMsg.h>
+#include <stdlib.h>
+#include <string.h>
+
+int os_thread_set_priority(enum os_io_class io_class, int nice)
+{
+	HANDLE thread = GetCurrentThread();
+	int priority = THREAD_PRIORITY_NORMAL;
+
+	/* background mode lowers both the I/O and the memory priority of the thread */
+	if (io_class != OS_IO_CLASS_NORMAL) {
+		if (!SetThreadPriority(thread, THREAD_MODE_BACKGROUND_BEGIN)) {
+			a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot set background mode of thread (error %d)", GetLastError());
+			return -1;
+		}
+	} else
+		/* fails if thread was not in background mode, which is fine */
+		SetThreadPriority(thread, THREAD_MODE_BACKGROUND_END);
+
+	if (io_class == OS_IO_CLASS_IDLE || nice >= 15)
+		priority = THREAD_PRIORITY_IDLE;
+	else if (nice >= 10)
+		priority = THREAD_PRIORITY_LOWEST;
+	else if (nice > 0)
+		priority = THREAD_PRIORITY_BELOW_NORMAL;
+
+	if (!SetThreadPriority(thread, priority)) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot set priority of thread (error %d)", GetLastError());
+		return -1;
+	}
+
+	return 0;
+}
+
+/* TODO: take into account job objects CPU rate limits */
+int os_cpu_count(void)
+{
+	DWORD_PTR process_mask, system_mask;
+	SYSTEM_INFO info;
+	int n_cpus = 0;
+
+	if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+		for (; process_mask != 0; process_mask >>= 1)
+			n_cpus += (int)(process_mask & 1);
+
+	if (n_cpus <= 0) {
+		GetSystemInfo(&info);
+		n_cpus = (int)info.dwNumberOfProcessors;
+	}
+
+	return n_cpus > 0 ? n_cpus : 1;
+}
+
+/* times of the previous call, to measure the load between two calls */
+static ULONGLONG last_idle_time, last_total_time;
+G_LOCK_DEFINE_STATIC(last_times);
+
+static ULONGLONG filetime_to_ulonglong(const FILETIME *t)
+{
+	return ((ULONGLONG)t->dwHighDateTime << 32) | t->dwLowDateTime;
+}
+
+/* Windows has no load average: the load is the processors utilization since the previous call */
+int os_cpu_load(void)
+{
+	FILETIME idle, kernel, user;
+	ULONGLONG idle_time, total_time, idle_delta, total_delta;
+	int load = -1;
+
+	if (!GetSystemTimes(&idle, &kernel, &user))
+		return -1;
+
+	idle_time = filetime_to_ulonglong(&idle);
+	/* kernel time includes idle time */
+	total_time = filetime_to_ulonglong(&kernel) + filetime_to_ulonglong(&user);
+
+	G_LOCK(last_times);
+
+	if (last_total_time != 0 && total_time > last_total_time) {
+		idle_delta = idle_time - last_idle_time;
+		total_delta = total_time - last_total_time;
+		load = (int)((100 * (total_delta - idle_delta)) / total_delta);
+	}
+
+	last_idle_time = idle_time;
+	last_total_time = total_time;
+
+	G_UNLOCK(last_times);
+
+	return load;
+}
+
+/* the disks utilization is given by the idle time counter of each physical disk */
+struct os_disk_activity {
+	PDH_HQUERY query;
+	PDH_HCOUNTER idle_time;
+	int collected;                /* the counter has a first sample */
+};
+
+struct os_disk_activity *os_disk_activity_new(void)
+{
+	struct os_disk_activity *activity = malloc(sizeof(struct os_disk_activity));
+	PDH_STATUS status;
+
+	activity->query = NULL;
+	activity->collected = 0;
+
+	if ((status = PdhOpenQuery(NULL, 0, &activity->query)) != ERROR_SUCCESS) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot open disk activity query (error 0x%lx)", (unsigned long)status);
+		activity->query = NULL;
+		return activity;
+	}
+
+	if ((status = PdhAddEnglishCounterA(activity->query, "\\PhysicalDisk(*)\\% Idle Time", 0, &activity->idle_time)) != ERROR_SUCCESS) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot add disk idle time counter (error 0x%lx)", (unsigned long)status);
+		PdhCloseQuery(activity->query);
+		activity->query = NULL;
+		return activity;
+	}
+
+	/* rate counters need two samples: the first one is taken now */
+	activity->collected = PdhCollectQueryData(activity->query) == ERROR_SUCCESS;
+
+	return activity;
+}
+
+int os_disk_activity_busy(struct os_disk_activity *activity)
+{
+	PDH_FMT_COUNTERVALUE_ITEM_A *items;
+	DWORD size = 0, n_items = 0, i;
+	int was_collected, busy = -1, disk_busy;
+
+	if (activity->query == NULL)
+		return -1;
+
+	was_collected = activity->collected;
+	activity->collected = PdhCollectQueryData(activity->query) == ERROR_SUCCESS;
+	if (!was_collected || !activity->collected)
+		return -1;
+
+	if (PdhGetFormattedCounterArrayA(activity->idle_time, PDH_FMT_DOUBLE | PDH_FMT_NOCAP100, &size, &n_items, NULL) != PDH_MORE_DATA)
+		return -1;
+
+	items = malloc(size);
+
+	if (PdhGetFormattedCounterArrayA(activity->idle_time, PDH_FMT_DOUBLE | PDH_FMT_NOCAP100, &size, &n_items, items) == ERROR_SUCCESS) {
+		for (i = 0; i < n_items; i++) {
+			/* the _Total instance is the average of the disks, not the busiest one */
+			if (!strcmp(items[i].szName, "_Total") || items[i].FmtValue.CStatus != ERROR_SUCCESS)
+				continue;
+
+			disk_busy = 100 - (int)items[i].FmtValue.doubleValue;
+			if (disk_busy < 0)
+				disk_busy = 0;
+			if (disk_busy > busy)
+				busy = disk_busy;
+		}
+	}
+
+	free(items);
+
+	return busy;
+}
+
+void os_disk_activity_free(struct os_disk_activity *activity)
+{
+	if (activity->query != NULL)
+		PdhCloseQuery(activity->query);
+
+	free(activity);
+}
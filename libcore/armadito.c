@@ -29,6 +29,8 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #include "core/mimetype.h"
 #include "core/event.h"
 #include "core/dir.h"
+#include "core/info.h"
+#include "core/scanconf.h"
 #ifdef HAVE_ON_DEMAND_MODULE
 #include "builtin-modules/on-demand/ondemandmod.h"
 #endif
@@ -121,9 +123,14 @@ struct armadito *a6o_open(struct a6o_conf *conf)
 	if (module_manager_configure_all(u->module_manager, conf))
 		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "error during modules configuration");
 
+	a6o_scan_conf_publish();
+
 	if (module_manager_post_init_all(u->module_manager))
 		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "error during modules post_init");
 
+	/* bases are loaded by post_init */
+	a6o_notify_bases_update(u);
+
 	return u;
 }
 
@@ -142,6 +149,47 @@ struct a6o_module *a6o_get_module_by_name(struct armadito *u, const char *name)
 	return module_manager_get_module_by_name(u->module_manager, name);
 }
 
+G_LOCK_DEFINE_STATIC(reload);
+
+/* on-access keys that only fill the on-access scan configuration; the others drive the monitor, */
+/* which is set up once at startup */
+static const char *on_access_reload_keys[] = {
+	"white-list-dir",
+	"mime-types",
+	"modules",
+	"max-size",
+	"scan-threads",
+	NULL,
+};
+
+int a6o_reload_conf(struct armadito *u)
+{
+	struct a6o_conf *conf = a6o_conf_new();
+
+	if (a6o_conf_load_std(conf)) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "reloading configuration failed, previous configuration kept");
+		a6o_conf_free(conf);
+		return -1;
+	}
+
+	G_LOCK(reload);
+	a6o_scan_conf_reload_begin();
+	module_manager_configure_module(u->module_manager, conf, "on-demand", NULL);
+#ifdef HAVE_LINUX_ON_ACCESS_MODULE
+	module_manager_configure_module(u->module_manager, conf, on_access_linux_module.name, on_access_reload_keys);
+#endif
+#ifdef HAVE_ON_ACCESS_WINDOWS_MODULE
+	module_manager_configure_module(u->module_manager, conf, on_access_win_module.name, on_access_reload_keys);
+#endif
+	a6o_scan_conf_publish();
+	a6o_notify_bases_update(u);
+	G_UNLOCK(reload);
+
+	a6o_conf_free(conf);
+
+	return 0;
+}
+
 int a6o_close(struct armadito *u)
 {
 	return module_manager_close_all(u->module_manager);
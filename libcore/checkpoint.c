@@ -0,0 +1,225 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "checkpoint_p.h"
+#include "dirwalk_p.h"
+#include "string_p.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECKPOINT_MAGIC "armadito-checkpoint 1"
+
+char *checkpoint_file_path(const char *checkpoint_dir, time_t scan_id)
+{
+	char *name, *path;
+
+	name = g_strdup_printf("scan-%lld.checkpoint", (long long)scan_id);
+	path = g_build_filename(checkpoint_dir, name, NULL);
+	g_free(name);
+
+	return path;
+}
+
+static void append_path(GString *s, const char *keyword, const char *path)
+{
+	gchar *escaped = g_strescape(path, NULL);
+
+	g_string_append_printf(s, "%s %s\n", keyword, escaped);
+	g_free(escaped);
+}
+
+int checkpoint_save(const struct checkpoint *c, const char *path)
+{
+	GString *s = g_string_new(CHECKPOINT_MAGIC "\n");
+	GError *error = NULL;
+	gchar *dir;
+	guint i, j;
+	int ret = 0;
+
+	append_path(s, "root", c->root_path);
+	g_string_append_printf(s, "flags %d\n", c->flags);
+	g_string_append_printf(s, "counters %d %d %d %d %d\n",
+		c->scanned_count,
+		c->malware_count,
+		c->suspicious_count,
+		c->cached_count,
+		c->too_big_count);
+
+	for (i = 0; i < c->frontier->len; i++) {
+		struct dir_walker_dir *d = g_ptr_array_index(c->frontier, i);
+
+		if (d->files_only)
+			append_path(s, "files", d->path);
+		else if (d->skip == NULL)
+			append_path(s, "walk", d->path);
+		else {
+			append_path(s, "partial", d->path);
+			for (j = 0; j < d->skip->len; j++)
+				append_path(s, "skip", g_ptr_array_index(d->skip, j));
+		}
+	}
+
+	dir = g_path_get_dirname(path);
+	g_mkdir_with_parents(dir, 0700);
+	g_free(dir);
+
+	if (!g_file_set_contents(path, s->str, s->len, &error)) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot save checkpoint %s (%s)", path, error->message);
+		g_error_free(error);
+		ret = -1;
+	}
+
+	g_string_free(s, TRUE);
+
+	return ret;
+}
+
+static struct dir_walker_dir *frontier_dir_new(const char *escaped_path, int files_only)
+{
+	struct dir_walker_dir *d = malloc(sizeof(struct dir_walker_dir));
+	gchar *path = g_strcompress(escaped_path);
+
+	d->path = os_strdup(path);
+	d->files_only = files_only;
+	d->skip = NULL;
+	g_free(path);
+
+	return d;
+}
+
+static struct checkpoint *checkpoint_new(void)
+{
+	struct checkpoint *c = malloc(sizeof(struct checkpoint));
+
+	c->root_path = NULL;
+	c->flags = 0;
+	c->scanned_count = 0;
+	c->malware_count = 0;
+	c->suspicious_count = 0;
+	c->cached_count = 0;
+	c->too_big_count = 0;
+	c->frontier = g_ptr_array_new_with_free_func((GDestroyNotify)dir_walker_dir_free);
+
+	return c;
+}
+
+/* parses one line, returns 0 if line is valid */
+static int parse_line(struct checkpoint *c, const char *line)
+{
+	struct dir_walker_dir *last;
+	gchar *path;
+
+	if (g_str_has_prefix(line, "root ")) {
+		path = g_strcompress(line + 5);
+		free(c->root_path);
+		c->root_path = os_strdup(path);
+		g_free(path);
+	} else if (g_str_has_prefix(line, "flags ")) {
+		c->flags = atoi(line + 6);
+	} else if (g_str_has_prefix(line, "counters ")) {
+		if (sscanf(line + 9, "%d %d %d %d %d",
+				&c->scanned_count,
+				&c->malware_count,
+				&c->suspicious_count,
+				&c->cached_count,
+				&c->too_big_count) != 5)
+			return -1;
+	} else if (g_str_has_prefix(line, "walk "))
+		g_ptr_array_add(c->frontier, frontier_dir_new(line + 5, 0));
+	else if (g_str_has_prefix(line, "files "))
+		g_ptr_array_add(c->frontier, frontier_dir_new(line + 6, 1));
+	else if (g_str_has_prefix(line, "partial ")) {
+		last = frontier_dir_new(line + 8, 0);
+		last->skip = g_ptr_array_new_with_free_func(free);
+		g_ptr_array_add(c->frontier, last);
+	} else if (g_str_has_prefix(line, "skip ")) {
+		/* skip lines follow their partial line */
+		if (c->frontier->len == 0)
+			return -1;
+		last = g_ptr_array_index(c->frontier, c->frontier->len - 1);
+		if (last->skip == NULL)
+			return -1;
+		path = g_strcompress(line + 5);
+		g_ptr_array_add(last->skip, os_strdup(path));
+		g_free(path);
+	} else if (*line != '\0')
+		return -1;
+
+	return 0;
+}
+
+struct checkpoint *checkpoint_load(const char *path)
+{
+	struct checkpoint *c;
+	gchar *contents;
+	gchar **lines;
+	GError *error = NULL;
+	int i;
+
+	if (!g_file_get_contents(path, &contents, NULL, &error)) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "cannot load checkpoint %s (%s)", path, error->message);
+		g_error_free(error);
+		return NULL;
+	}
+
+	lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+
+	if (lines[0] == NULL || strcmp(lines[0], CHECKPOINT_MAGIC)) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "%s is not a checkpoint file", path);
+		g_strfreev(lines);
+		return NULL;
+	}
+
+	c = checkpoint_new();
+
+	for (i = 1; lines[i] != NULL; i++)
+		if (parse_line(c, lines[i])) {
+			a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "invalid line %d in checkpoint file %s", i + 1, path);
+			g_strfreev(lines);
+			checkpoint_free(c);
+			return NULL;
+		}
+
+	g_strfreev(lines);
+
+	if (c->root_path == NULL) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "no root path in checkpoint file %s", path);
+		checkpoint_free(c);
+		return NULL;
+	}
+
+	return c;
+}
+
+void checkpoint_free(struct checkpoint *c)
+{
+	free(c->root_path);
+	g_ptr_array_free(c->frontier, TRUE);
+	free(c);
+}
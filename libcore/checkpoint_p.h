@@ -0,0 +1,61 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+#ifndef LIBCORE_CHECKPOINT_P_H
+#define LIBCORE_CHECKPOINT_P_H
+
+#include <glib.h>
+#include <time.h>
+
+/*
+ * A checkpoint is the saved state of a running recursive on-demand scan:
+ * its root path and flags, its counters, and the frontier of the directory
+ * traversal (an array of struct dir_walker_dir).
+ *
+ * Checkpoints are saved as text files, one line per item, paths being escaped
+ * as C strings. A file is replaced atomically, so that an interrupted save
+ * leaves the previous checkpoint intact.
+ */
+
+struct checkpoint {
+	char *root_path;
+	int flags;
+	int scanned_count;
+	int malware_count;
+	int suspicious_count;
+	int cached_count;
+	int too_big_count;
+	GPtrArray *frontier;
+};
+
+/* returns the path of the checkpoint file of a scan, to be freed with g_free() */
+char *checkpoint_file_path(const char *checkpoint_dir, time_t scan_id);
+
+/* returns 0 on success */
+int checkpoint_save(const struct checkpoint *c, const char *path);
+
+/* returns NULL if file does not exist or is not a valid checkpoint */
+struct checkpoint *checkpoint_load(const char *path);
+
+void checkpoint_free(struct checkpoint *c);
+
+#endif
@@ -0,0 +1,181 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/concurrency.h"
+
+#include <glib.h>
+#include <stdlib.h>
+
+/* fixed work of a scan, in bytes, so that small files are not free */
+#define SCAN_COST (64 * 1024)
+
+/* a window lasts at least this time and this number of scans per allowed thread */
+#define WINDOW_DURATION G_USEC_PER_SEC
+#define WINDOW_SCANS_PER_THREAD 2
+
+/* latency over the lowest seen multiplied by this means contention */
+#define LATENCY_TOLERANCE 2.0
+/* an increase must improve throughput by this ratio to be kept */
+#define MIN_GAIN 0.05
+/* the lowest latency is forgotten slowly, as files and system load change */
+#define LATENCY_DRIFT 1.02
+
+struct a6o_concurrency {
+	GMutex lock;
+	char *name;
+	int limit;
+	int min;
+	int max;
+
+	gint64 window_start;            /* monotonic time, in microseconds */
+	int window_scans;
+	int window_saturated;           /* scans completed while all the allowed threads were busy */
+	double window_cost;             /* bytes */
+	double window_duration;         /* microseconds */
+
+	double min_latency;             /* microseconds per byte, 0 if not measured yet */
+	double previous_throughput;     /* bytes per microsecond */
+	int last_change;                /* sign of the last change of limit */
+};
+
+struct a6o_concurrency *a6o_concurrency_new(const char *name, int initial, int min, int max)
+{
+	struct a6o_concurrency *c = malloc(sizeof(struct a6o_concurrency));
+
+	g_mutex_init(&c->lock);
+	c->name = g_strdup(name);
+	c->min = min > 0 ? min : 1;
+	c->max = max > c->min ? max : c->min;
+	c->limit = CLAMP(initial, c->min, c->max);
+
+	c->window_start = 0;
+	c->window_scans = 0;
+	c->window_saturated = 0;
+	c->window_cost = 0.0;
+	c->window_duration = 0.0;
+
+	c->min_latency = 0.0;
+	c->previous_throughput = 0.0;
+	c->last_change = 0;
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "%s concurrency: %d threads, adjusted between %d and %d", c->name, c->limit, c->min, c->max);
+
+	return c;
+}
+
+/* must be called with lock held */
+static int next_limit(struct a6o_concurrency *c, double throughput, double latency)
+{
+	int decrease;
+
+	if (c->min_latency == 0.0 || latency < c->min_latency)
+		c->min_latency = latency;
+
+	if (latency > c->min_latency * LATENCY_TOLERANCE) {
+		decrease = c->limit / 4;
+		return c->limit - (decrease > 0 ? decrease : 1);
+	}
+
+	if (c->last_change > 0 && throughput < c->previous_throughput * (1.0 + MIN_GAIN))
+		return c->limit - 1;
+
+	return c->limit + 1;
+}
+
+int a6o_concurrency_account(struct a6o_concurrency *c, long long duration, size_t bytes, int saturated)
+{
+	gint64 now = g_get_monotonic_time();
+	double throughput, latency;
+	int limit, changed = 0;
+
+	g_mutex_lock(&c->lock);
+
+	if (c->window_start == 0)
+		c->window_start = now;
+
+	c->window_scans++;
+	if (saturated)
+		c->window_saturated++;
+	c->window_cost += (double)(bytes + SCAN_COST);
+	c->window_duration += (double)duration;
+
+	if (now - c->window_start < WINDOW_DURATION || c->window_scans < WINDOW_SCANS_PER_THREAD * c->limit) {
+		g_mutex_unlock(&c->lock);
+		return 0;
+	}
+
+	/* if threads were often idle, throughput was bounded by the work available, not by the limit */
+	if (2 * c->window_saturated >= c->window_scans) {
+		throughput = c->window_cost / (now - c->window_start);
+		latency = c->window_duration / c->window_cost;
+
+		limit = CLAMP(next_limit(c, throughput, latency), c->min, c->max);
+
+		if (limit != c->limit) {
+			a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "%s concurrency: %d -> %d threads (%.1f MB/s, %.1f ms per MB, lowest %.1f ms per MB)",
+				c->name,
+				c->limit,
+				limit,
+				throughput * G_USEC_PER_SEC / (1024 * 1024),
+				latency * 1024 * 1024 / 1000,
+				c->min_latency * 1024 * 1024 / 1000);
+
+			c->last_change = limit > c->limit ? 1 : -1;
+			c->limit = limit;
+			changed = limit;
+		} else
+			c->last_change = 0;
+
+		c->previous_throughput = throughput;
+		c->min_latency *= LATENCY_DRIFT;
+	}
+
+	c->window_start = now;
+	c->window_scans = 0;
+	c->window_saturated = 0;
+	c->window_cost = 0.0;
+	c->window_duration = 0.0;
+
+	g_mutex_unlock(&c->lock);
+
+	return changed;
+}
+
+int a6o_concurrency_get_limit(struct a6o_concurrency *c)
+{
+	int limit;
+
+	g_mutex_lock(&c->lock);
+	limit = c->limit;
+	g_mutex_unlock(&c->lock);
+
+	return limit;
+}
+
+void a6o_concurrency_free(struct a6o_concurrency *c)
+{
+	g_mutex_clear(&c->lock);
+	g_free(c->name);
+	free(c);
+}
@@ -529,3 +529,43 @@ int a6o_conf_add_list(struct a6o_conf *conf, const char *section, const char *ke
 
 	return 0;
 }
+
+static int load_conf_dir_entry(const char *full_path, enum os_file_flag flags, int entry_errno, void *data)
+{
+	struct a6o_conf *conf = (struct a6o_conf *)data;
+	size_t len = strlen(full_path);
+
+	if (!(flags & FILE_FLAG_IS_PLAIN_FILE) || len <= 5 || strcmp(full_path + len - 5, ".conf"))
+		return 0;
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "loading configuration file %s", full_path);
+
+	return a6o_conf_load_file(conf, full_path) ? 1 : 0;
+}
+
+int a6o_conf_load_std(struct a6o_conf *conf)
+{
+	const char *path;
+	int ret;
+
+	path = a6o_std_path(A6O_LOCATION_CONFIG_FILE);
+	if (path == NULL)
+		return -1;
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "loading configuration file %s", path);
+	ret = a6o_conf_load_file(conf, path);
+	free((void *)path);
+
+	if (ret)
+		return -1;
+
+	path = a6o_std_path(A6O_LOCATION_CONFIG_DIR);
+	if (path == NULL)
+		return 0;
+
+	/* a missing directory is not an error */
+	ret = os_dir_map(path, load_conf_dir_entry, conf) > 0 ? -1 : 0;
+	free((void *)path);
+
+	return ret;
+}
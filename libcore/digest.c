@@ -0,0 +1,167 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/io.h"
+#include "digest_p.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIGEST_READ_SIZE (64 * 1024)
+
+int digest_fd(int fd, unsigned char digest[DIGEST_SIZE])
+{
+	GChecksum *checksum;
+	unsigned char *buffer;
+	gsize digest_len = DIGEST_SIZE;
+	int n_read, ret = 0;
+
+	if (os_lseek(fd, 0, SEEK_SET) < 0)
+		return -1;
+
+	checksum = g_checksum_new(G_CHECKSUM_SHA256);
+	buffer = malloc(DIGEST_READ_SIZE);
+
+	for (;;) {
+		n_read = os_read(fd, buffer, DIGEST_READ_SIZE);
+
+		if (n_read == 0)
+			break;
+
+		if (n_read < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -1;
+			break;
+		}
+
+		g_checksum_update(checksum, buffer, n_read);
+	}
+
+	if (ret == 0)
+		g_checksum_get_digest(checksum, digest, &digest_len);
+
+	free(buffer);
+	g_checksum_free(checksum);
+
+	return ret;
+}
+
+void digest_to_string(const unsigned char digest[DIGEST_SIZE], char s[DIGEST_STRING_SIZE])
+{
+	static const char hex[] = "0123456789abcdef";
+	int i;
+
+	for (i = 0; i < DIGEST_SIZE; i++) {
+		*s++ = hex[digest[i] >> 4];
+		*s++ = hex[digest[i] & 0xf];
+	}
+
+	*s = '\0';
+}
+
+struct dc_record {
+	unsigned char digest[DIGEST_SIZE];
+	unsigned long long tag;
+	enum a6o_file_status status;
+	int used;
+};
+
+struct digest_cache {
+	GMutex lock;
+	unsigned int n_records;
+	struct dc_record *records;
+};
+
+struct digest_cache *digest_cache_new(unsigned int n_records)
+{
+	struct digest_cache *dc = malloc(sizeof(struct digest_cache));
+
+	g_mutex_init(&dc->lock);
+	dc->n_records = n_records > 0 ? n_records : DIGEST_CACHE_DEFAULT_SIZE;
+	dc->records = calloc(dc->n_records, sizeof(struct dc_record));
+
+	return dc;
+}
+
+/* digests are uniformly distributed: their first bytes are a good hash */
+static struct dc_record *slot(struct digest_cache *dc, const unsigned char digest[DIGEST_SIZE])
+{
+	guint64 h;
+
+	memcpy(&h, digest, sizeof(h));
+
+	return &dc->records[h % dc->n_records];
+}
+
+int digest_cache_lookup(struct digest_cache *dc, const unsigned char digest[DIGEST_SIZE], unsigned long long tag, enum a6o_file_status *status)
+{
+	struct dc_record *r;
+	int found;
+
+	if (dc == NULL)
+		return 0;
+
+	g_mutex_lock(&dc->lock);
+
+	r = slot(dc, digest);
+	found = r->used && r->tag == tag && !memcmp(r->digest, digest, DIGEST_SIZE);
+	if (found)
+		*status = r->status;
+
+	g_mutex_unlock(&dc->lock);
+
+	return found;
+}
+
+void digest_cache_store(struct digest_cache *dc, const unsigned char digest[DIGEST_SIZE], unsigned long long tag, enum a6o_file_status status)
+{
+	struct dc_record *r;
+
+	if (dc == NULL)
+		return;
+
+	g_mutex_lock(&dc->lock);
+
+	r = slot(dc, digest);
+	memcpy(r->digest, digest, DIGEST_SIZE);
+	r->tag = tag;
+	r->status = status;
+	r->used = 1;
+
+	g_mutex_unlock(&dc->lock);
+}
+
+void digest_cache_free(struct digest_cache *dc)
+{
+	if (dc == NULL)
+		return;
+
+	g_mutex_clear(&dc->lock);
+	free(dc->records);
+	free(dc);
+}
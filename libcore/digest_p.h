@@ -0,0 +1,65 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+#ifndef LIBCORE_DIGEST_P_H
+#define LIBCORE_DIGEST_P_H
+
+#include <libarmadito/armadito.h>
+
+/*
+ * Content digests of scanned files.
+ *
+ * The digest is a SHA-256 of the whole file content. Identical copies of a
+ * file, with different inodes or on different devices, have the same digest
+ * and can be given the verdict of the first copy without applying the modules.
+ *
+ * The digest cache keeps verdicts by digest and by tag (see verdictcache_p.h
+ * for the tag), in memory, for the lifetime of the scan configuration. It is
+ * a fixed size direct-mapped table: a new verdict replaces the one that
+ * was in its slot.
+ */
+
+#define DIGEST_SIZE 32
+
+/* size of the hexadecimal representation, including terminating null byte */
+#define DIGEST_STRING_SIZE (2 * DIGEST_SIZE + 1)
+
+/* reads the file from its beginning and computes its digest */
+/* returns 0 if ok, -1 if file could not be read */
+int digest_fd(int fd, unsigned char digest[DIGEST_SIZE]);
+
+void digest_to_string(const unsigned char digest[DIGEST_SIZE], char s[DIGEST_STRING_SIZE]);
+
+struct digest_cache;
+
+#define DIGEST_CACHE_DEFAULT_SIZE (1 << 16)
+
+struct digest_cache *digest_cache_new(unsigned int n_records);
+
+/* returns 1 and fills status if a verdict was found for this digest and tag, 0 otherwise */
+int digest_cache_lookup(struct digest_cache *dc, const unsigned char digest[DIGEST_SIZE], unsigned long long tag, enum a6o_file_status *status);
+
+void digest_cache_store(struct digest_cache *dc, const unsigned char digest[DIGEST_SIZE], unsigned long long tag, enum a6o_file_status status);
+
+void digest_cache_free(struct digest_cache *dc);
+
+#endif
@@ -0,0 +1,653 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/dir.h"
+#include "core/file.h"
+#include "dirwalk_p.h"
+#include "inodeset_p.h"
+#include "string_p.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+/* directories kept opened for their entries, per walker: the others are closed once listed */
+#define MAX_OPEN_DIRS 128
+
+/* a directory to list, then the directory of the entries found in it */
+/* it is referenced by its queue, by its sub-directories until they are opened and by the users of its entries */
+struct walk_dir {
+	struct dir_walker *walker;
+	struct walk_dir *parent;      /* this directory is opened relative to it, NULL if opened by path */
+	int fd;                       /* kept opened for the entries, -1 if not opened or closed once listed */
+	volatile gint refs;
+	volatile gint files;          /* files in flight, see walk_dir_file_add() */
+	struct walk_thread *owner;    /* once listed, the thread whose listed list holds this directory */
+	struct walk_dir *prev, *next; /* in the listed list, under the owner lock */
+	int files_only;               /* if set, sub-directories are not traversed */
+	GHashTable *skip;             /* if not NULL, sub-directories that are not traversed */
+	char path[1];
+};
+
+struct walk_thread {
+	struct dir_walker *walker;
+	GMutex lock;                  /* protects dirs, current, pushed and listed */
+	GQueue dirs;                  /* directories to list: owner pops the tail, thieves pop the head */
+	struct walk_dir *current;     /* directory being listed, written only by this thread */
+	GPtrArray *pushed;            /* sub-directories of current already pushed */
+	struct walk_dir *listed;      /* directories listed by this thread and still referenced */
+	int mark;                     /* mark of current, given to the callback */
+	GThread *thread;
+	int index;
+};
+
+struct dir_walker {
+	dir_walker_cb_t dirent_cb;
+	void *data;
+
+	int n_threads;
+	struct walk_thread *threads;
+
+	volatile gint queued;         /* directories waiting in the threads queues */
+	volatile gint pending;        /* directories queued or being listed, traversal is complete when it drops to 0 */
+	volatile gint idle;           /* threads waiting for directories */
+	volatile gint stopped;
+	volatile gint listed;         /* directories already listed, for statistics */
+	volatile gint duplicates;     /* directories not listed because already visited, for statistics */
+	volatile gint pruned;         /* directories not traversed because of prune or enter callback, for statistics */
+	volatile gint open_dirs;      /* directories kept opened, at most MAX_OPEN_DIRS */
+	struct inode_set *visited;    /* if not NULL, directories already visited through another path */
+	dir_prune_cb_t prune;
+	dir_enter_cb_t enter;
+	int next_root;                /* thread queue receiving the next directory added by dir_walker_add() */
+
+	GMutex idle_lock;
+	GCond idle_cond;
+};
+
+struct dir_walker *dir_walker_new(int n_threads, dir_walker_cb_t dirent_cb, void *data)
+{
+	struct dir_walker *w = malloc(sizeof(struct dir_walker));
+	int i;
+
+	if (n_threads < 1)
+		n_threads = 1;
+
+	w->dirent_cb = dirent_cb;
+	w->data = data;
+
+	w->n_threads = n_threads;
+	w->threads = malloc(n_threads * sizeof(struct walk_thread));
+
+	for (i = 0; i < n_threads; i++) {
+		struct walk_thread *t = &w->threads[i];
+
+		t->walker = w;
+		g_mutex_init(&t->lock);
+		g_queue_init(&t->dirs);
+		t->current = NULL;
+		t->pushed = g_ptr_array_new_with_free_func(free);
+		t->listed = NULL;
+		t->mark = 0;
+		t->thread = NULL;
+		t->index = i;
+	}
+
+	w->queued = 0;
+	w->pending = 0;
+	w->idle = 0;
+	w->stopped = 0;
+	w->listed = 0;
+	w->duplicates = 0;
+	w->pruned = 0;
+	w->open_dirs = 0;
+	w->visited = NULL;
+	w->prune = NULL;
+	w->enter = NULL;
+	w->next_root = 0;
+
+	g_mutex_init(&w->idle_lock);
+	g_cond_init(&w->idle_cond);
+
+	return w;
+}
+
+static void wake_up(struct dir_walker *w, int all)
+{
+	g_mutex_lock(&w->idle_lock);
+	if (all)
+		g_cond_broadcast(&w->idle_cond);
+	else
+		g_cond_signal(&w->idle_cond);
+	g_mutex_unlock(&w->idle_lock);
+}
+
+/* parent is referenced only if it is opened, as it is only needed to open the new directory */
+static struct walk_dir *walk_dir_new(struct dir_walker *w, const char *path, struct walk_dir *parent, int files_only)
+{
+	size_t len = strlen(path);
+	struct walk_dir *d = malloc(sizeof(struct walk_dir) + len);
+
+	d->walker = w;
+	d->parent = walk_dir_get_fd(parent) >= 0 ? walk_dir_ref(parent) : NULL;
+	d->fd = -1;
+	d->refs = 1;
+	d->files = 0;
+	d->owner = NULL;
+	d->prev = NULL;
+	d->next = NULL;
+	d->files_only = files_only;
+	d->skip = NULL;
+	memcpy(d->path, path, len + 1);
+
+	return d;
+}
+
+int walk_dir_get_fd(struct walk_dir *d)
+{
+	return d != NULL ? d->fd : -1;
+}
+
+struct walk_dir *walk_dir_ref(struct walk_dir *d)
+{
+	if (d != NULL)
+		g_atomic_int_inc(&d->refs);
+
+	return d;
+}
+
+/* releasing a directory may release its parent: the chain is followed in a loop, not by recursion */
+void walk_dir_unref(struct walk_dir *d)
+{
+	struct walk_dir *parent;
+
+	for (; d != NULL && g_atomic_int_dec_and_test(&d->refs); d = parent) {
+		parent = d->parent;
+
+		if (d->owner != NULL) {
+			g_mutex_lock(&d->owner->lock);
+			if (d->prev != NULL)
+				d->prev->next = d->next;
+			else
+				d->owner->listed = d->next;
+			if (d->next != NULL)
+				d->next->prev = d->prev;
+			g_mutex_unlock(&d->owner->lock);
+		}
+
+		if (d->fd >= 0) {
+			os_dir_close(d->fd);
+			g_atomic_int_add(&d->walker->open_dirs, -1);
+		}
+
+		if (d->skip != NULL)
+			g_hash_table_destroy(d->skip);
+		free(d);
+	}
+}
+
+void walk_dir_file_add(struct walk_dir *d)
+{
+	if (d != NULL)
+		g_atomic_int_inc(&d->files);
+}
+
+void walk_dir_file_done(struct walk_dir *d)
+{
+	if (d != NULL)
+		g_atomic_int_add(&d->files, -1);
+}
+
+/* called only by the thread listing the parent directory */
+static void walk_push(struct walk_thread *t, struct walk_dir *d)
+{
+	struct dir_walker *w = t->walker;
+
+	g_atomic_int_inc(&w->pending);
+
+	g_mutex_lock(&t->lock);
+	g_queue_push_tail(&t->dirs, d);
+	g_ptr_array_add(t->pushed, os_strdup(d->path));
+	g_mutex_unlock(&t->lock);
+
+	g_atomic_int_inc(&w->queued);
+
+	/* only pay for the lock if some thread is waiting for work */
+	if (g_atomic_int_get(&w->idle) > 0)
+		wake_up(w, 0);
+}
+
+/* a popped directory becomes current under the lock it was queued under, */
+/* so that dir_walker_get_frontier() always sees it either queued or current */
+
+/* pop from our own queue, newest first: keeps the traversal depth-first and the queues short */
+static struct walk_dir *walk_pop(struct walk_thread *t)
+{
+	struct walk_dir *d;
+
+	g_mutex_lock(&t->lock);
+	d = g_queue_pop_tail(&t->dirs);
+	t->current = d;
+	g_mutex_unlock(&t->lock);
+
+	return d;
+}
+
+/* steal from the other threads queues, oldest first: oldest directories are closest to the root */
+/* and have the biggest sub-trees, so that a thief does not come back too often */
+static struct walk_dir *walk_steal(struct walk_thread *t)
+{
+	struct dir_walker *w = t->walker;
+	int i;
+
+	for (i = 1; i < w->n_threads; i++) {
+		struct walk_thread *victim = &w->threads[(t->index + i) % w->n_threads];
+		struct walk_dir *d;
+
+		g_mutex_lock(&victim->lock);
+		d = g_queue_pop_head(&victim->dirs);
+		if (d != NULL)
+			t->current = d;
+		g_mutex_unlock(&victim->lock);
+
+		if (d != NULL)
+			return d;
+	}
+
+	return NULL;
+}
+
+/* returns the next directory to list, or NULL if traversal is complete or stopped */
+static struct walk_dir *walk_next(struct walk_thread *t)
+{
+	struct dir_walker *w = t->walker;
+	struct walk_dir *d;
+
+	while (!g_atomic_int_get(&w->stopped)) {
+		if ((d = walk_pop(t)) != NULL || (d = walk_steal(t)) != NULL) {
+			g_atomic_int_add(&w->queued, -1);
+			return d;
+		}
+
+		g_mutex_lock(&w->idle_lock);
+		g_atomic_int_inc(&w->idle);
+		while (g_atomic_int_get(&w->queued) == 0
+			&& g_atomic_int_get(&w->pending) != 0
+			&& !g_atomic_int_get(&w->stopped))
+			g_cond_wait(&w->idle_cond, &w->idle_lock);
+		g_atomic_int_add(&w->idle, -1);
+		g_mutex_unlock(&w->idle_lock);
+
+		if (g_atomic_int_get(&w->pending) == 0)
+			break;
+	}
+
+	return NULL;
+}
+
+/* the listed directory goes from current to the listed list at once, so that its files in flight */
+/* are always seen by dir_walker_get_frontier(); it leaves the list when it is released */
+static void walk_done(struct walk_thread *t)
+{
+	struct dir_walker *w = t->walker;
+	struct walk_dir *d;
+
+	g_mutex_lock(&t->lock);
+	d = t->current;
+	t->current = NULL;
+	g_ptr_array_set_size(t->pushed, 0);
+	d->owner = t;
+	d->next = t->listed;
+	if (t->listed != NULL)
+		t->listed->prev = d;
+	t->listed = d;
+	g_mutex_unlock(&t->lock);
+
+	walk_dir_unref(d);
+
+	g_atomic_int_inc(&w->listed);
+
+	/* last directory listed: wake up everybody so that they can terminate */
+	if (g_atomic_int_dec_and_test(&w->pending))
+		wake_up(w, 1);
+}
+
+static int walk_entry(const char *full_path, enum os_file_flag flags, int entry_errno, void *data)
+{
+	struct walk_thread *t = (struct walk_thread *)data;
+	struct dir_walker *w = t->walker;
+	struct walk_dir *current = t->current;
+
+	if (g_atomic_int_get(&w->stopped))
+		return 1;
+
+	if ((flags & FILE_FLAG_IS_DIRECTORY) && !(flags & FILE_FLAG_IS_ERROR)) {
+		if (full_path == NULL
+			|| current->files_only
+			|| (current->skip != NULL && g_hash_table_lookup(current->skip, full_path) != NULL))
+			return 0;
+
+		/* the whole tree is pruned without being listed */
+		if (w->prune != NULL && (*w->prune)(full_path, w->data)) {
+			g_atomic_int_inc(&w->pruned);
+			return 0;
+		}
+
+		walk_push(t, walk_dir_new(w, full_path, current, 0));
+		return 0;
+	}
+
+	if ((*w->dirent_cb)(full_path, flags, entry_errno, current, t->mark, w->data) != 0) {
+		dir_walker_stop(w);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* returns 1 if the directory must be listed, and sets its mark */
+/* fd is the opened directory, its identity is taken from it */
+static int walk_enter(struct walk_thread *t, struct walk_dir *d, int fd)
+{
+	struct dir_walker *w = t->walker;
+	struct os_file_stat stat_buf;
+	int stat_errno;
+
+	t->mark = 0;
+
+	if (w->visited == NULL && w->enter == NULL)
+		return 1;
+
+	/* on error, flags is FILE_FLAG_IS_ERROR and the error is reported when listing the directory */
+	if (fd >= 0)
+		os_file_stat_fd(fd, &stat_buf, &stat_errno);
+	else
+		os_file_stat(d->path, &stat_buf, &stat_errno);
+
+	/* a directory reachable by several paths, for instance through bind mounts, is listed only once */
+	if (w->visited != NULL
+		&& !(stat_buf.flags & FILE_FLAG_IS_ERROR)
+		&& inode_set_add(w->visited, stat_buf.dev, stat_buf.inode) != INODE_SET_ADDED) {
+		g_atomic_int_inc(&w->duplicates);
+		return 0;
+	}
+
+	if (w->enter != NULL && (t->mark = (*w->enter)(d->path, &stat_buf, w->data)) == DIR_WALKER_SKIP) {
+		g_atomic_int_inc(&w->pruned);
+		return 0;
+	}
+
+	return 1;
+}
+
+/* the directory stays opened for its entries if the bound on opened directories allows it */
+static int keep_opened(struct dir_walker *w)
+{
+	g_atomic_int_inc(&w->open_dirs);
+	if (g_atomic_int_get(&w->open_dirs) <= MAX_OPEN_DIRS)
+		return 1;
+
+	g_atomic_int_add(&w->open_dirs, -1);
+
+	return 0;
+}
+
+/* opens the directory relative to its parent and lists it */
+static void walk_list(struct walk_thread *t, struct walk_dir *d)
+{
+	struct dir_walker *w = t->walker;
+	int fd, open_errno;
+
+	fd = os_dir_open(walk_dir_get_fd(d->parent), d->path);
+	open_errno = errno;
+
+	/* the parent was only needed to open this directory */
+	walk_dir_unref(d->parent);
+	d->parent = NULL;
+
+	if (fd == -1) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "error opening directory %s (%s)", d->path, strerror(open_errno));
+
+		if ((*w->dirent_cb)(d->path, FILE_FLAG_IS_ERROR, open_errno, NULL, 0, w->data) != 0)
+			dir_walker_stop(w);
+		return;
+	}
+
+	if (walk_enter(t, d, fd)) {
+		/* set before the entries are given to the callback, which may give them to other threads */
+		if (fd >= 0 && keep_opened(w))
+			d->fd = fd;
+
+		/* list only this directory: sub-directories are pushed by walk_entry() */
+		os_dir_map_fd(fd, d->path, walk_entry, t);
+	}
+
+	if (d->fd != fd)
+		os_dir_close(fd);
+}
+
+static gpointer walk_thread_fun(gpointer data)
+{
+	struct walk_thread *t = (struct walk_thread *)data;
+	struct walk_dir *d;
+
+#ifdef _WIN32
+	void * OldValue = NULL;
+	if (Wow64DisableWow64FsRedirection(&OldValue) == FALSE) {
+		return NULL;
+	}
+#endif
+
+	while ((d = walk_next(t)) != NULL) {
+		walk_list(t, d);
+		walk_done(t);
+	}
+
+#ifdef _WIN32
+	if (Wow64RevertWow64FsRedirection(OldValue) == FALSE) {
+		return NULL;
+	}
+#endif
+
+	return NULL;
+}
+
+void dir_walker_add(struct dir_walker *w, const char *path, int files_only, GPtrArray *skip)
+{
+	struct walk_thread *t = &w->threads[w->next_root];
+	struct walk_dir *d = walk_dir_new(w, path, NULL, files_only);
+	guint i;
+
+	if (skip != NULL && skip->len > 0) {
+		d->skip = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+		for (i = 0; i < skip->len; i++) {
+			char *p = os_strdup(g_ptr_array_index(skip, i));
+
+			g_hash_table_replace(d->skip, p, p);
+		}
+	}
+
+	/* spread the initial directories over the threads queues */
+	w->next_root = (w->next_root + 1) % w->n_threads;
+
+	w->pending++;
+	w->queued++;
+	g_queue_push_tail(&t->dirs, d);
+}
+
+int dir_walker_run(struct dir_walker *w)
+{
+	int i;
+
+	for (i = 1; i < w->n_threads; i++) {
+#if defined(HAVE_GTHREAD_NEW)
+		w->threads[i].thread = g_thread_new("dir walker thread", walk_thread_fun, &w->threads[i]);
+#elif defined(HAVE_GTHREAD_CREATE)
+		w->threads[i].thread = g_thread_create(walk_thread_fun, &w->threads[i], TRUE, NULL);
+#endif
+	}
+
+	/* the calling thread is walker thread #0 */
+	walk_thread_fun(&w->threads[0]);
+
+	for (i = 1; i < w->n_threads; i++)
+		if (w->threads[i].thread != NULL) {
+			g_thread_join(w->threads[i].thread);
+			w->threads[i].thread = NULL;
+		}
+
+	return g_atomic_int_get(&w->stopped);
+}
+
+void dir_walker_set_visited(struct dir_walker *w, struct inode_set *visited)
+{
+	w->visited = visited;
+}
+
+void dir_walker_set_prune(struct dir_walker *w, dir_prune_cb_t prune)
+{
+	w->prune = prune;
+}
+
+void dir_walker_set_enter(struct dir_walker *w, dir_enter_cb_t enter)
+{
+	w->enter = enter;
+}
+
+void dir_walker_stop(struct dir_walker *w)
+{
+	g_atomic_int_set(&w->stopped, 1);
+	wake_up(w, 1);
+}
+
+void dir_walker_dir_free(struct dir_walker_dir *d)
+{
+	free(d->path);
+	if (d->skip != NULL)
+		g_ptr_array_free(d->skip, TRUE);
+	free(d);
+}
+
+static struct dir_walker_dir *frontier_dir_new(struct walk_dir *d, int files_only, GPtrArray *pushed)
+{
+	struct dir_walker_dir *fd = malloc(sizeof(struct dir_walker_dir));
+	GHashTableIter iter;
+	gpointer key;
+	guint i;
+
+	fd->path = os_strdup(d->path);
+	fd->files_only = files_only;
+	fd->skip = NULL;
+
+	if (files_only || (d->skip == NULL && (pushed == NULL || pushed->len == 0)))
+		return fd;
+
+	fd->skip = g_ptr_array_new_with_free_func(free);
+
+	if (d->skip != NULL) {
+		g_hash_table_iter_init(&iter, d->skip);
+		while (g_hash_table_iter_next(&iter, &key, NULL))
+			g_ptr_array_add(fd->skip, os_strdup(key));
+	}
+
+	if (pushed != NULL)
+		for (i = 0; i < pushed->len; i++)
+			g_ptr_array_add(fd->skip, os_strdup(g_ptr_array_index(pushed, i)));
+
+	return fd;
+}
+
+GPtrArray *dir_walker_get_frontier(struct dir_walker *w)
+{
+	GPtrArray *frontier = g_ptr_array_new_with_free_func((GDestroyNotify)dir_walker_dir_free);
+	int i;
+
+	/* all the queues are locked at once, so that no directory can move from a queue to another */
+	/* or from a queue to being listed while they are copied; locking order is always the same */
+	for (i = 0; i < w->n_threads; i++)
+		g_mutex_lock(&w->threads[i].lock);
+
+	for (i = 0; i < w->n_threads; i++) {
+		struct walk_thread *t = &w->threads[i];
+		struct walk_dir *d;
+		GList *l;
+
+		for (l = t->dirs.head; l != NULL; l = l->next) {
+			d = (struct walk_dir *)l->data;
+			g_ptr_array_add(frontier, frontier_dir_new(d, d->files_only, NULL));
+		}
+
+		/* a directory being listed must be listed again, but the sub-directories it has */
+		/* already pushed are either queued, hence already in the frontier, or done */
+		if (t->current != NULL)
+			g_ptr_array_add(frontier, frontier_dir_new(t->current, t->current->files_only, t->pushed));
+
+		/* the files of a listed directory that are not all scanned must be scanned again, */
+		/* but not its sub-directories, which are already in the frontier or done */
+		for (d = t->listed; d != NULL; d = d->next)
+			if (g_atomic_int_get(&d->files) > 0)
+				g_ptr_array_add(frontier, frontier_dir_new(d, 1, NULL));
+	}
+
+	for (i = w->n_threads - 1; i >= 0; i--)
+		g_mutex_unlock(&w->threads[i].lock);
+
+	return frontier;
+}
+
+void dir_walker_get_stats(struct dir_walker *w, struct dir_walker_stats *stats)
+{
+	stats->listed_dirs = g_atomic_int_get(&w->listed);
+	stats->pending_dirs = g_atomic_int_get(&w->pending);
+	stats->duplicate_dirs = g_atomic_int_get(&w->duplicates);
+	stats->pruned_dirs = g_atomic_int_get(&w->pruned);
+}
+
+void dir_walker_free(struct dir_walker *w)
+{
+	int i;
+
+	for (i = 0; i < w->n_threads; i++) {
+		struct walk_thread *t = &w->threads[i];
+		struct walk_dir *d;
+
+		/* if traversal was stopped, some directories may remain */
+		while ((d = g_queue_pop_head(&t->dirs)) != NULL)
+			walk_dir_unref(d);
+
+		g_ptr_array_free(t->pushed, TRUE);
+		g_mutex_clear(&t->lock);
+	}
+
+	g_mutex_clear(&w->idle_lock);
+	g_cond_clear(&w->idle_cond);
+
+	free(w->threads);
+	free(w);
+}
@@ -0,0 +1,148 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#ifndef LIBCORE_DIRWALK_P_H
+#define LIBCORE_DIRWALK_P_H
+
+#include "core/dir.h"
+#include "inodeset_p.h"
+
+#include <glib.h>
+
+/*
+ * A directory walker traverses a directory tree using a pool of threads.
+ *
+ * Each directory is a work item: listing a directory pushes its sub-directories
+ * as new work items and passes the other entries to the callback.
+ * Each walker thread has its own queue of directories; when it is empty, the
+ * thread steals directories from the other threads' queues.
+ * Traversal is iterative: there is no recursion and each walker thread
+ * lists one directory at a time.
+ *
+ * A directory is opened relative to its parent, and stays opened as long as
+ * it is referenced, so that its entries are opened relative to it too: the
+ * path of a file is only resolved by the system when a directory or a file
+ * cannot be opened relative to its parent. The number of directories kept
+ * opened is bounded; beyond this bound, entries are opened by path.
+ *
+ * The callback is called concurrently from all the walker threads, with the same
+ * semantics as for os_dir_map(), except that it is never called for directories:
+ * if it returns a nonzero value, the whole traversal is stopped.
+ * It is given the directory of the entry, which it references to open the
+ * entry later, and the mark of the directory, which is chosen by the enter
+ * callback when the directory is about to be listed, for instance to scan
+ * the files of a network file system differently.
+ *
+ * The frontier of a running traversal, i.e. the directories that remain to be
+ * listed and the directories whose files are not all done, can be saved and
+ * given back to a new walker to resume the traversal.
+ */
+
+struct dir_walker;
+
+/* a directory being listed or already listed, as given to the callback */
+struct walk_dir;
+
+/* returns the descriptor to give to the os_*_at() functions for the entries of d, -1 if d is NULL or not opened */
+int walk_dir_get_fd(struct walk_dir *d);
+
+/* a reference keeps the directory opened; both functions accept NULL */
+struct walk_dir *walk_dir_ref(struct walk_dir *d);
+
+void walk_dir_unref(struct walk_dir *d);
+
+/* counts the files of the directory given to the callback and not done yet, i.e. queued or being */
+/* scanned: a listed directory stays in the frontier, for its files only, until they are all done */
+/* the caller must keep a reference to d from walk_dir_file_add() to walk_dir_file_done() */
+void walk_dir_file_add(struct walk_dir *d);
+
+void walk_dir_file_done(struct walk_dir *d);
+
+struct dir_walker_stats {
+	int listed_dirs;         /* directories already listed */
+	int pending_dirs;        /* directories queued or being listed */
+	int duplicate_dirs;      /* directories not listed because already visited through another path */
+	int pruned_dirs;         /* directories not traversed because rejected by the prune or enter callback */
+};
+
+/* a directory of the frontier */
+struct dir_walker_dir {
+	char *path;
+	int files_only;          /* if set, no sub-directory is traversed */
+	GPtrArray *skip;         /* if not NULL, paths of the sub-directories that are not traversed */
+};
+
+void dir_walker_dir_free(struct dir_walker_dir *d);
+
+/* returns nonzero if the tree under path must not be traversed */
+typedef int (*dir_prune_cb_t)(const char *path, void *data);
+
+#define DIR_WALKER_SKIP (-1)
+
+/* st is the identity of the directory, st->flags is FILE_FLAG_IS_ERROR if not available */
+/* returns the mark of the directory, DIR_WALKER_SKIP if the tree under path must not be traversed */
+typedef int (*dir_enter_cb_t)(const char *path, const struct os_file_stat *st, void *data);
+
+/* returned by the callback to stop the whole traversal, like any nonzero value */
+#define DIR_WALKER_STOP 1
+
+/* dir is the directory of the entry, NULL for an error on a directory that could not be opened */
+/* mark is the mark of the directory of the entry, 0 if there is no enter callback */
+/* returns 0 to go on, DIR_WALKER_STOP to stop the traversal */
+typedef int (*dir_walker_cb_t)(const char *full_path, enum os_file_flag flags, int entry_errno, struct walk_dir *dir, int mark, void *data);
+
+struct dir_walker *dir_walker_new(int n_threads, dir_walker_cb_t dirent_cb, void *data);
+
+/* adds a directory to traverse, must be called before dir_walker_run() */
+/* skip can be NULL, it is not kept by the walker */
+void dir_walker_add(struct dir_walker *w, const char *path, int files_only, GPtrArray *skip);
+
+/* if visited is not NULL, directories are recorded in it and directories already in it are not listed */
+/* must be called before dir_walker_run() */
+void dir_walker_set_visited(struct dir_walker *w, struct inode_set *visited);
+
+/* if prune is not NULL, it is called with the walker data for each sub-directory, before the sub-directory is opened */
+/* must be called before dir_walker_run() */
+void dir_walker_set_prune(struct dir_walker *w, dir_prune_cb_t prune);
+
+/* if enter is not NULL, it is called with the walker data for each directory, when it is about to be listed */
+/* must be called before dir_walker_run() */
+void dir_walker_set_enter(struct dir_walker *w, dir_enter_cb_t enter);
+
+/* traverses the trees under the added directories, using the calling thread as one of the walker threads */
+/* returns when the traversal is complete or has been stopped */
+/* returns 0 if traversal is complete, nonzero if it was stopped */
+int dir_walker_run(struct dir_walker *w);
+
+/* stops the traversal; can be called from any thread, including from the callback */
+void dir_walker_stop(struct dir_walker *w);
+
+/* can be called from any thread, while traversal is running or after it has completed */
+void dir_walker_get_stats(struct dir_walker *w, struct dir_walker_stats *stats);
+
+/* returns the directories that remain to be listed or that have files in flight, as an array of struct dir_walker_dir */
+/* can be called from any thread while traversal is running; free the array with g_ptr_array_free(a, TRUE) */
+GPtrArray *dir_walker_get_frontier(struct dir_walker *w);
+
+/* the references to the directories given to the callback must all have been released */
+void dir_walker_free(struct dir_walker *w);
+
+#endif
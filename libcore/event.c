@@ -51,6 +51,7 @@ static void detection_event_clone(struct a6o_detection_event *dst, const struct
 	dst->scan_action = src->scan_action;
 	dst->module_name = os_strdup(src->module_name);
 	dst->module_report = os_strdup(src->module_report);
+	dst->digest = os_strdup(src->digest);
 }
 
 static void on_demand_start_event_clone(struct a6o_on_demand_start_event *dst, const struct a6o_on_demand_start_event *src)
@@ -63,6 +64,8 @@ static void on_demand_completed_event_clone(struct a6o_on_demand_completed_event
 {
 	dst->scan_id = src->scan_id;
 	dst->cancelled = src->cancelled;
+	dst->budget_exhausted = src->budget_exhausted;
+	dst->coverage = src->coverage;
 	dst->total_malware_count = src->total_malware_count;
 	dst->total_suspicious_count = src->total_suspicious_count;
 	dst->total_scanned_count = src->total_scanned_count;
@@ -77,6 +80,15 @@ static void on_demand_progress_event_clone(struct a6o_on_demand_progress_event *
 	dst->malware_count = src->malware_count;
 	dst->suspicious_count = src->suspicious_count;
 	dst->scanned_count = src->scanned_count;
+	dst->queued_count = src->queued_count;
+	dst->queued_bytes = src->queued_bytes;
+	dst->thread_share = src->thread_share;
+	dst->module_stage_utilization = src->module_stage_utilization;
+	dst->module_stage_queued = src->module_stage_queued;
+	dst->module_stage_inline = src->module_stage_inline;
+	dst->report_stage_utilization = src->report_stage_utilization;
+	dst->report_stage_queued = src->report_stage_queued;
+	dst->report_stage_inline = src->report_stage_inline;
 }
 
 static void quarantine_event_clone(struct a6o_quarantine_event *dst, const struct a6o_quarantine_event *src)
@@ -129,6 +141,7 @@ static void detection_event_free(struct a6o_detection_event *e)
 	free((void *)e->path);
 	free((void *)e->module_name);
 	free((void *)e->module_report);
+	free((void *)e->digest);
 }
 
 static void on_demand_start_event_free(struct a6o_on_demand_start_event *e)
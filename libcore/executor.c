@@ -0,0 +1,429 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/concurrency.h"
+#include "core/priority.h"
+
+#include "executor_p.h"
+
+#include <glib.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+/* fixed work of a file, in bytes, so that small files are not free */
+#define FILE_COST (64 * 1024)
+
+struct executor {
+	GMutex lock;
+	GCond work;                     /* signaled when files may be available */
+	GCond idle;                     /* signaled when a source may be done */
+	GThread **threads;
+	int n_threads;                  /* highest number of threads */
+	int n_started;                  /* threads started so far, never more than the highest limit reached */
+	int limit;                      /* number of threads allowed to scan at the same time */
+	int running;                    /* number of threads scanning */
+	struct a6o_concurrency *concurrency;  /* adjusts limit, NULL if number of threads is configured */
+
+	GList *clients;
+	double vtime;                   /* virtual time of the last file started */
+	unsigned long long total_cost;  /* work done for all clients */
+	unsigned int pick_serial;
+};
+
+struct executor_client {
+	struct executor *executor;
+	int weight;
+	double vtime;                   /* work done for this client, divided by its weight */
+	unsigned long long cost;        /* work done for this client */
+	unsigned long long start_cost;  /* work done for all clients when this client was created */
+	unsigned int pick_serial;       /* clients already considered by current pick */
+	gint64 (*acquire)(void *data);
+	void *data;
+	GList *sources;                 /* rotated, so that sources of a client are served in turn */
+};
+
+struct executor_source {
+	struct executor_client *client;
+	struct scan_queue *queue;
+	char *pending;                  /* popped from the queue, but not acquired yet */
+	int max_threads;
+	int running;
+	size_t (*fun)(const char *path, void *data);
+	void *data;
+};
+
+/* must be called with lock held */
+/* returns the path to scan if the client can scan a file now */
+static char *pick_from_client(struct executor_client *c, struct executor_source **ps, gint64 *retry_time)
+{
+	GList *l;
+	gint64 ready_time;
+	char *path;
+
+	for (l = c->sources; l != NULL; l = l->next) {
+		struct executor_source *s = (struct executor_source *)l->data;
+
+		if (s->running >= s->max_threads)
+			continue;
+
+		if (s->pending == NULL)
+			s->pending = scan_queue_try_pop(s->queue);
+
+		if (s->pending == NULL)
+			continue;
+
+		ready_time = (*c->acquire)(c->data);
+		if (ready_time != 0) {
+			if (ready_time > 0 && (*retry_time == 0 || ready_time < *retry_time))
+				*retry_time = ready_time;
+			return NULL;
+		}
+
+		path = s->pending;
+		s->pending = NULL;
+
+		c->sources = g_list_remove_link(c->sources, l);
+		c->sources = g_list_concat(c->sources, l);
+
+		*ps = s;
+		return path;
+	}
+
+	return NULL;
+}
+
+/* must be called with lock held */
+/* clients are considered by increasing virtual time, i.e. the one that received the least work first */
+static char *pick(struct executor *e, struct executor_source **ps, gint64 *retry_time)
+{
+	struct executor_client *best;
+	GList *l;
+	char *path;
+
+	e->pick_serial++;
+
+	for (;;) {
+		best = NULL;
+		for (l = e->clients; l != NULL; l = l->next) {
+			struct executor_client *c = (struct executor_client *)l->data;
+
+			if (c->pick_serial != e->pick_serial && (best == NULL || c->vtime < best->vtime))
+				best = c;
+		}
+
+		if (best == NULL)
+			return NULL;
+
+		best->pick_serial = e->pick_serial;
+
+		if ((path = pick_from_client(best, ps, retry_time)) != NULL)
+			return path;
+	}
+}
+
+/* must be called with lock held */
+static void start(struct executor *e, struct executor_source *s)
+{
+	struct executor_client *c = s->client;
+
+	/* a client that had nothing to scan for a while must not get all the threads to catch up */
+	if (c->vtime < e->vtime)
+		c->vtime = e->vtime;
+	e->vtime = c->vtime;
+
+	/* the fixed cost is charged now, so that concurrent picks see it */
+	c->vtime += (double)FILE_COST / c->weight;
+	s->running++;
+	e->running++;
+}
+
+static gpointer executor_thread_fun(gpointer data);
+
+/* must be called with lock held */
+/* threads are started only when the limit reaches them, and then live as long as the process */
+static void grow(struct executor *e)
+{
+	while (e->n_started < e->limit && e->n_started < e->n_threads) {
+#if defined(HAVE_GTHREAD_NEW)
+		e->threads[e->n_started] = g_thread_new("scan thread", executor_thread_fun, e);
+#elif defined(HAVE_GTHREAD_CREATE)
+		e->threads[e->n_started] = g_thread_create(executor_thread_fun, e, TRUE, NULL);
+#endif
+		e->n_started++;
+	}
+}
+
+/* must be called with lock held */
+static void done(struct executor *e, struct executor_source *s, size_t bytes, gint64 duration)
+{
+	struct executor_client *c = s->client;
+	int limit;
+
+	c->vtime += (double)bytes / c->weight;
+	c->cost += FILE_COST + bytes;
+	e->total_cost += FILE_COST + bytes;
+
+	if (e->concurrency != NULL
+		&& (limit = a6o_concurrency_account(e->concurrency, duration, bytes, e->running >= e->limit)) > 0) {
+		if (limit > e->limit)
+			g_cond_broadcast(&e->work);
+		e->limit = limit;
+		grow(e);
+	}
+
+	/* a thread waiting for the limit can scan now */
+	e->running--;
+	g_cond_signal(&e->work);
+
+	if (--s->running == 0)
+		g_cond_broadcast(&e->idle);
+}
+
+static gpointer executor_thread_fun(gpointer data)
+{
+	struct executor *e = (struct executor *)data;
+	struct executor_source *s;
+	gint64 retry_time, start_time;
+	size_t bytes;
+	char *path;
+
+#ifdef _WIN32
+	void * OldValue = NULL;
+	if (Wow64DisableWow64FsRedirection(&OldValue) == FALSE) {
+		return NULL;
+	}
+#endif
+
+	g_mutex_lock(&e->lock);
+
+	/* threads live as long as the process */
+	for (;;) {
+		if (e->running >= e->limit) {
+			g_cond_wait(&e->work, &e->lock);
+			continue;
+		}
+
+		retry_time = 0;
+
+		path = pick(e, &s, &retry_time);
+
+		if (path == NULL) {
+			if (retry_time > 0)
+				g_cond_wait_until(&e->work, &e->lock, retry_time);
+			else
+				g_cond_wait(&e->work, &e->lock);
+			continue;
+		}
+
+		start(e, s);
+
+		g_mutex_unlock(&e->lock);
+
+		start_time = g_get_monotonic_time();
+		bytes = (*s->fun)(path, s->data);
+		scan_queue_release(s->queue, path);
+
+		g_mutex_lock(&e->lock);
+
+		done(e, s, bytes, g_get_monotonic_time() - start_time);
+	}
+
+	return NULL;
+}
+
+static struct executor *executor_new(int n_threads)
+{
+	struct executor *e = malloc(sizeof(struct executor));
+
+	g_mutex_init(&e->lock);
+	g_cond_init(&e->work);
+	g_cond_init(&e->idle);
+
+	e->clients = NULL;
+	e->vtime = 0.0;
+	e->total_cost = 0;
+	e->pick_serial = 0;
+
+	e->running = 0;
+
+	/* threads over the limit wait; threads are started as the limit grows */
+	if (n_threads > 0) {
+		e->concurrency = NULL;
+		e->limit = n_threads;
+	} else {
+		n_threads = A6O_MAX_THREADS_PER_CPU * os_cpu_count();
+		e->concurrency = a6o_concurrency_new("scan executor", os_cpu_count(), 1, n_threads);
+		e->limit = a6o_concurrency_get_limit(e->concurrency);
+	}
+
+	e->n_threads = n_threads;
+	e->n_started = 0;
+	e->threads = malloc(n_threads * sizeof(GThread *));
+
+	g_mutex_lock(&e->lock);
+	grow(e);
+	g_mutex_unlock(&e->lock);
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "scan executor started with %d threads, up to %d%s", e->n_started, n_threads,
+		e->concurrency != NULL ? ", adjusted to throughput" : "");
+
+	return e;
+}
+
+static struct executor *the_executor = NULL;
+G_LOCK_DEFINE_STATIC(the_executor);
+
+struct executor *executor_get(int n_threads)
+{
+	struct executor *e;
+
+	G_LOCK(the_executor);
+	if (the_executor == NULL)
+		the_executor = executor_new(n_threads);
+	e = the_executor;
+	G_UNLOCK(the_executor);
+
+	return e;
+}
+
+int executor_get_n_threads(struct executor *e)
+{
+	return e->n_threads;
+}
+
+struct executor_client *executor_client_new(struct executor *e, int weight, gint64 (*acquire)(void *data), void *data)
+{
+	struct executor_client *c = malloc(sizeof(struct executor_client));
+
+	c->executor = e;
+	c->weight = weight > 0 ? weight : 1;
+	c->cost = 0;
+	c->pick_serial = 0;
+	c->acquire = acquire;
+	c->data = data;
+	c->sources = NULL;
+
+	g_mutex_lock(&e->lock);
+	c->vtime = e->vtime;
+	c->start_cost = e->total_cost;
+	e->clients = g_list_append(e->clients, c);
+	g_mutex_unlock(&e->lock);
+
+	return c;
+}
+
+void executor_client_set_weight(struct executor_client *c, int weight)
+{
+	g_mutex_lock(&c->executor->lock);
+	c->weight = weight > 0 ? weight : 1;
+	g_mutex_unlock(&c->executor->lock);
+}
+
+void executor_client_wake(struct executor_client *c)
+{
+	g_mutex_lock(&c->executor->lock);
+	g_cond_broadcast(&c->executor->work);
+	g_mutex_unlock(&c->executor->lock);
+}
+
+int executor_client_get_share(struct executor_client *c)
+{
+	struct executor *e = c->executor;
+	int share = 0;
+
+	g_mutex_lock(&e->lock);
+	if (e->total_cost > c->start_cost)
+		share = (int)((100 * c->cost) / (e->total_cost - c->start_cost));
+	g_mutex_unlock(&e->lock);
+
+	return share;
+}
+
+void executor_client_free(struct executor_client *c)
+{
+	struct executor *e = c->executor;
+
+	g_mutex_lock(&e->lock);
+	e->clients = g_list_remove(e->clients, c);
+	g_mutex_unlock(&e->lock);
+
+	free(c);
+}
+
+static void source_notify(void *data)
+{
+	struct executor_source *s = (struct executor_source *)data;
+	struct executor *e = s->client->executor;
+
+	g_mutex_lock(&e->lock);
+	g_cond_signal(&e->work);
+	/* the queue may have been closed */
+	g_cond_broadcast(&e->idle);
+	g_mutex_unlock(&e->lock);
+}
+
+struct executor_source *executor_source_new(struct executor_client *c, struct scan_queue *queue, int max_threads,
+					size_t (*fun)(const char *path, void *data), void *data)
+{
+	struct executor_source *s = malloc(sizeof(struct executor_source));
+	struct executor *e = c->executor;
+
+	s->client = c;
+	s->queue = queue;
+	s->pending = NULL;
+	s->max_threads = max_threads > 0 ? max_threads : 1;
+	s->running = 0;
+	s->fun = fun;
+	s->data = data;
+
+	scan_queue_set_notify(queue, source_notify, s);
+
+	g_mutex_lock(&e->lock);
+	c->sources = g_list_append(c->sources, s);
+	g_mutex_unlock(&e->lock);
+
+	return s;
+}
+
+void executor_source_wait_and_free(struct executor_source *s)
+{
+	struct executor_client *c = s->client;
+	struct executor *e = c->executor;
+
+	g_mutex_lock(&e->lock);
+
+	while (s->pending != NULL || s->running > 0 || !scan_queue_is_drained(s->queue))
+		g_cond_wait(&e->idle, &e->lock);
+
+	c->sources = g_list_remove(c->sources, s);
+
+	g_mutex_unlock(&e->lock);
+
+	scan_queue_set_notify(s->queue, NULL, NULL);
+
+	free(s);
+}
@@ -0,0 +1,89 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#ifndef LIBCORE_EXECUTOR_P_H
+#define LIBCORE_EXECUTOR_P_H
+
+#include <glib.h>
+#include <stddef.h>
+
+#include "scanqueue_p.h"
+
+/*
+ * The scan executor: a pool of threads shared by all the threaded scans.
+ *
+ * The total number of scan threads is set once, when the executor is
+ * created, whatever the number of concurrent scans. If it is not
+ * configured, the number of threads scanning at the same time is adjusted
+ * to the observed throughput, starting from the number of processors.
+ * Threads are started as this number grows, not all at creation.
+ * Each scan is a client of the executor, and each of its scan queues is a
+ * source of files. Threads are shared between clients by fair queuing:
+ * the next file is taken from the client that received the least work,
+ * weighted by its weight, where the work of a file is its size plus a
+ * fixed cost. A client can have several sources, each with a maximum
+ * number of threads.
+ *
+ * A client that cannot scan now (paused or rate limited) does not block a
+ * thread: its files are left in its queues and the threads scan the files
+ * of other clients meanwhile.
+ */
+
+struct executor;
+
+struct executor_client;
+
+struct executor_source;
+
+/* returns the executor of the process, creating it on first call */
+/* n_threads is only used by the first call, 0 for an adaptive number of threads */
+struct executor *executor_get(int n_threads);
+
+/* the highest number of threads scanning at the same time */
+int executor_get_n_threads(struct executor *e);
+
+/* acquire is called, with the executor lock held, before a file of the client is scanned */
+/* it returns 0 if the file can be scanned now, otherwise the monotonic time in microseconds */
+/* from which to call it again, or -1 if it must not be called before executor_client_wake() */
+struct executor_client *executor_client_new(struct executor *e, int weight, gint64 (*acquire)(void *data), void *data);
+
+/* a client with twice the weight of another gets twice its share of the threads */
+void executor_client_set_weight(struct executor_client *c, int weight);
+
+/* must be called when acquire may return 0 again, for instance after an unpause */
+void executor_client_wake(struct executor_client *c);
+
+/* percentage of the work of the executor done for this client since its creation */
+int executor_client_get_share(struct executor_client *c);
+
+/* all the sources of the client must have been freed */
+void executor_client_free(struct executor_client *c);
+
+/* fun scans the path and returns the number of bytes read; path is free'd by the executor after */
+/* at most max_threads threads scan files of this source at the same time */
+struct executor_source *executor_source_new(struct executor_client *c, struct scan_queue *queue, int max_threads,
+					size_t (*fun)(const char *path, void *data), void *data);
+
+/* queue must be closed or discarded: waits until all its files have been scanned and frees the source */
+/* the queue is not freed */
+void executor_source_wait_and_free(struct executor_source *s);
+
+#endif
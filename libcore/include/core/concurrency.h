@@ -0,0 +1,64 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#ifndef ARMADITO_CORE_CONCURRENCY_H
+#define ARMADITO_CORE_CONCURRENCY_H
+
+#include <stddef.h>
+
+/*
+ * Adaptive concurrency of a pool of scan threads.
+ *
+ * The limit is the number of threads allowed to scan at the same time.
+ * It is adjusted at the end of each measurement window, from the
+ * throughput and the latency of the scans completed during the window,
+ * the work of a scan being the bytes it read plus a fixed cost:
+ * - if latency grew well over the lowest latency seen, threads are
+ *   contending for the processors or the disks: the limit is decreased
+ *   multiplicatively
+ * - if the previous increase did not improve throughput, the limit is
+ *   decreased by one
+ * - otherwise, the limit is increased by one
+ * so that the limit stays close to the point where adding threads stops
+ * paying, whether modules are CPU bound or I/O bound.
+ * Windows during which threads were not all busy are ignored, because
+ * the limit was not what bounded throughput.
+ */
+
+struct a6o_concurrency;
+
+/* upper bound of the scan threads per processor when their number is not configured, */
+/* shared by the executor, the stage pool and the on-access thread pool */
+#define A6O_MAX_THREADS_PER_CPU 4
+
+/* name is used in log messages; limit starts at initial and stays between min and max */
+struct a6o_concurrency *a6o_concurrency_new(const char *name, int initial, int min, int max);
+
+/* reports a completed scan, its duration in microseconds and the number of bytes it read */
+/* saturated must be set if all the allowed threads were busy when the scan completed */
+/* returns the new limit if it was changed, 0 otherwise */
+int a6o_concurrency_account(struct a6o_concurrency *c, long long duration, size_t bytes, int saturated);
+
+int a6o_concurrency_get_limit(struct a6o_concurrency *c);
+
+void a6o_concurrency_free(struct a6o_concurrency *c);
+
+#endif
@@ -58,6 +58,10 @@ void a6o_conf_apply(struct a6o_conf *conf, a6o_conf_fun_t fun, void *user_data);
 
 int a6o_conf_load_file(struct a6o_conf *conf, const char *path);
 
+/* loads the configuration file, then the .conf files of the configuration directory, which may be missing */
+/* used at startup and by reloads, so that both read the same files; returns 0 if OK, -1 on first error */
+int a6o_conf_load_std(struct a6o_conf *conf);
+
 int a6o_conf_save_file(struct a6o_conf *conf, const char *path);
 
 const char **a6o_conf_get_sections(struct a6o_conf *conf, size_t *length);
@@ -29,15 +29,35 @@ extern "C" {
 #include "core/file.h"   /* for os_file_flag */
 
 /* the callback function, called for each entry (file or directory) */
-/* if it returns a nonzero value, the tree walk is stopped and this returned value become the return value of os_dir_map() */
-/* if it returns 0, os_dir_map() will continue until it has traversed the entire tree, in which case it will return zero, or */
+/* if it returns a nonzero value, the listing is stopped and this returned value become the return value of os_dir_map() */
+/* if it returns 0, os_dir_map() will continue until it has listed the entire directory, in which case it will return zero, or */
 /* until it encounters an error, in which case it will return -1 */
 typedef int (*dirent_cb_t)(const char *full_path, enum os_file_flag flags, int entry_errno, void *data);
 
-int os_dir_map(const char *path, int recurse, dirent_cb_t dirent_cb, void *data);
+/* lists the entries of the directory, sub-directories are given to the callback and not traversed */
+/* trees are traversed by the directory walker, which lists one directory at a time */
+int os_dir_map(const char *path, dirent_cb_t dirent_cb, void *data);
+
+/* returned by os_dir_open() where directories cannot be opened (windows): */
+/* the directory is then listed and its entries opened by path */
+#define OS_DIR_NO_FD (-2)
+
+/* opens a directory, to list it and to open its entries relative to it */
+/* if parent_fd is not negative, it is the directory containing path, and only the last component of path is looked up */
+/* returns the directory descriptor, OS_DIR_NO_FD if not available, -1 on error with errno set */
+int os_dir_open(int parent_fd, const char *path);
+
+void os_dir_close(int fd);
+
+/* same as os_dir_map(), for a directory opened by os_dir_open(); path is the path of the directory, to build the entries paths */
+int os_dir_map_fd(int fd, const char *path, dirent_cb_t dirent_cb, void *data);
 
 int os_mkdir_p(const char *path);
 
+/* returns a cheap estimate of the number of files under path, without traversing it, */
+/* or -1 if no estimate is available */
+int os_dir_count_hint(const char *path);
+
 #ifdef __cplusplus
 }
 #endif
@@ -54,6 +54,7 @@ struct a6o_detection_event {
 	enum a6o_action scan_action;
 	const char *module_name;
 	const char *module_report;
+	const char *digest;   /* hexadecimal SHA-256 of the file content, empty if not computed */
 };
 
 struct a6o_on_demand_start_event {
@@ -64,6 +65,8 @@ struct a6o_on_demand_start_event {
 struct a6o_on_demand_completed_event {
 	time_t scan_id;
 	int cancelled;
+	int budget_exhausted;              /* the scan was stopped because its time budget was spent */
+	int coverage;                      /* percentage of the files to scan that were scanned, estimated if stopped */
 	size_t total_malware_count;
 	size_t total_suspicious_count;
 	size_t total_scanned_count;
@@ -77,6 +80,15 @@ struct a6o_on_demand_progress_event {
 	size_t malware_count;
 	size_t suspicious_count;
 	size_t scanned_count;
+	size_t queued_count;      /* files waiting to be scanned */
+	size_t queued_bytes;      /* memory used by files waiting to be scanned */
+	int thread_share;         /* percentage of the shared scan threads used by this scan, -1 if not threaded */
+	int module_stage_utilization;    /* percentage of the module scan stage threads time spent scanning, -1 if no stages */
+	size_t module_stage_queued;      /* files waiting for the module scan stage */
+	size_t module_stage_inline;      /* files scanned by the opening threads because the stage was full */
+	int report_stage_utilization;    /* percentage of the report stage threads time spent reporting, -1 if no stages */
+	size_t report_stage_queued;      /* files waiting for the report stage */
+	size_t report_stage_inline;      /* files reported by the module scan threads because the stage was full */
 };
 
 struct a6o_quarantine_event {
@@ -44,12 +44,115 @@ enum os_file_flag {
 struct os_file_stat {
 	enum os_file_flag flags;
 	size_t file_size;
+	unsigned long long dev;            /* device containing the file */
+	unsigned long long inode;          /* inode number, 0 if not available */
+	long long mtime;                   /* last modification time, in nanoseconds */
+	long long ctime;                   /* last status change time, in nanoseconds */
 };
 
 int os_file_stat(const char *path, struct os_file_stat *buf, int *pfile_errno);
 
 int os_file_stat_fd(int fd, struct os_file_stat *buf, int *pfile_errno);
 
+/*
+ * The functions with a dir_fd argument look the file up relative to the
+ * directory that contains it, as opened by os_dir_open(): only the last
+ * component of path is resolved, instead of the whole path from the root.
+ * If dir_fd is negative, the whole path is used.
+ */
+
+/**
+ *      \fn int os_file_stat_at(int dir_fd, const char *path, struct os_file_stat *buf, int *pfile_errno);
+ *      \brief Same as os_file_stat(), relative to the directory of the file
+ *
+ *      \param[in] dir_fd the directory containing the file, or -1
+ *      \param[in] path the path of the file
+ *      \param[out] buf the file status
+ *      \param[out] pfile_errno the error, if the file status is not available
+ *
+ *      \return 0 if ok, -1 on error
+ */
+int os_file_stat_at(int dir_fd, const char *path, struct os_file_stat *buf, int *pfile_errno);
+
+/**
+ *      \fn int os_file_physical_offset_at(int dir_fd, const char *path, unsigned long long *offset);
+ *      \brief Gives the position on disk of the beginning of a file
+ *
+ *      The position is only meaningful to compare files of the same device,
+ *      for instance to read them in disk order.
+ *
+ *      \param[in] dir_fd the directory containing the file, or -1
+ *      \param[in] path the path of the file
+ *      \param[out] offset the position of the first extent of the file
+ *
+ *      \return 0 if ok, -1 if not available (file system without extent mapping, empty or inline file...)
+ */
+int os_file_physical_offset_at(int dir_fd, const char *path, unsigned long long *offset);
+
+/**
+ *      \fn int os_file_prefetch_at(int dir_fd, const char *path, size_t *size);
+ *      \brief Starts reading the beginning of a file in the background
+ *
+ *      The file content is read into the system cache without waiting for
+ *      the read to complete, so that a later read of the file does not wait
+ *      for the disk.
+ *
+ *      \param[in] dir_fd the directory containing the file, or -1
+ *      \param[in] path the path of the file
+ *      \param[in,out] size the maximum number of bytes to read, set to the number of bytes requested
+ *
+ *      \return 0 if ok, -1 if the file cannot be read in advance
+ */
+int os_file_prefetch_at(int dir_fd, const char *path, size_t *size);
+
+/**
+ *      \fn int os_file_open_at(int dir_fd, const char *path, int noatime);
+ *      \brief Opens a file for reading
+ *
+ *      If noatime is set, the file is opened without updating its access
+ *      time; if the access time cannot be left alone (the process does not
+ *      own the file and is not privileged, or the system does not allow it),
+ *      the file is opened normally.
+ *
+ *      The file is opened close-on-exec and without blocking; if it is not
+ *      a regular file (e.g. a fifo or a device that replaced it), it is
+ *      closed and the function fails with errno set to EINVAL.
+ *
+ *      \param[in] dir_fd the directory containing the file, or -1
+ *      \param[in] path the path of the file
+ *      \param[in] noatime if set, try not to update the access time
+ *
+ *      \return the file descriptor, -1 on error
+ */
+int os_file_open_at(int dir_fd, const char *path, int noatime);
+
+/**
+ *      \fn unsigned char *os_file_cache_resident(int fd, size_t size);
+ *      \brief Tells which pages of a file are in the system cache
+ *
+ *      \param[in] fd the file descriptor
+ *      \param[in] size the size of the file
+ *
+ *      \return a vector of one byte per page of the file, with bit 0 set if
+ *      the page is cached, to be freed by the caller; NULL if no page is
+ *      cached or if not available
+ */
+unsigned char *os_file_cache_resident(int fd, size_t size);
+
+/**
+ *      \fn int os_file_cache_drop(int fd, size_t size, const unsigned char *resident);
+ *      \brief Removes the pages of a file from the system cache
+ *
+ *      Pages that are not cached or that are being written are left as is.
+ *
+ *      \param[in] fd the file descriptor
+ *      \param[in] size the size of the file
+ *      \param[in] resident if not NULL, the pages that must stay cached, as returned by os_file_cache_resident()
+ *
+ *      \return 0 if ok, -1 if not available
+ */
+int os_file_cache_drop(int fd, size_t size, const unsigned char *resident);
+
 /**
  *      \fn int os_file_do_not_scan(const char *path);
  *      \brief Returns true if path must never be scanned (like /proc on linux)
@@ -0,0 +1,102 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#ifndef ARMADITO_CORE_OS_FILELOADER_H
+#define ARMADITO_CORE_OS_FILELOADER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/*
+ * A file loader opens files asynchronously, by batches, and starts reading
+ * their content into the system cache, so that the thread that scans a file
+ * finds it already opened and does not wait for the disk.
+ *
+ * It is only available where the system provides asynchronous open (linux
+ * io_uring); elsewhere, os_file_loader_new() returns NULL and files are
+ * opened by the scanning thread.
+ *
+ * A loader must be used by one thread at a time.
+ */
+
+struct os_file_loader;
+
+/**
+ *      \fn struct os_file_loader *os_file_loader_new(int depth, int noatime);
+ *      \brief Creates a file loader
+ *
+ *      \param[in] depth the maximum number of loads in progress
+ *      \param[in] noatime if not 0, files are opened without updating their access time;
+ *      the open fails with EPERM if the process does not own the file and is not privileged
+ *
+ *      \return the loader, NULL if asynchronous open is not available
+ */
+struct os_file_loader *os_file_loader_new(int depth, int noatime);
+
+/**
+ *      \fn int os_file_loader_submit(struct os_file_loader *l, int dir_fd, const char *path, size_t readahead, unsigned long tag);
+ *      \brief Starts opening a file and reading its beginning
+ *
+ *      The load is actually submitted to the system by the next call to
+ *      os_file_loader_complete(), so that consecutive submits are batched.
+ *
+ *      \param[in] l the loader
+ *      \param[in] dir_fd the directory containing the file, or -1; it must stay opened until the load is completed
+ *      \param[in] path the path of the file, copied by the loader
+ *      \param[in] readahead the maximum number of bytes to read in advance
+ *      \param[in] tag identifies the load in os_file_loader_complete()
+ *
+ *      \return 0 if ok, -1 if depth loads are already in progress
+ */
+int os_file_loader_submit(struct os_file_loader *l, int dir_fd, const char *path, size_t readahead, unsigned long tag);
+
+/**
+ *      \fn int os_file_loader_complete(struct os_file_loader *l, unsigned long *tag, int *fd, size_t *size, int *perrno);
+ *      \brief Returns a completed load, without waiting
+ *
+ *      \param[in] l the loader
+ *      \param[out] tag the tag given to os_file_loader_submit()
+ *      \param[out] fd the opened file, to be closed by the caller, -1 if open failed
+ *      \param[out] size the number of bytes requested to be read in advance
+ *      \param[out] perrno the open error if fd is -1
+ *
+ *      \return 1 if a load was completed, 0 if none
+ */
+int os_file_loader_complete(struct os_file_loader *l, unsigned long *tag, int *fd, size_t *size, int *perrno);
+
+/**
+ *      \fn void os_file_loader_free(struct os_file_loader *l);
+ *      \brief Waits for the loads in progress and frees the loader
+ *
+ *      Files opened and not returned by os_file_loader_complete() are closed.
+ *
+ *      \param[in] l the loader
+ */
+void os_file_loader_free(struct os_file_loader *l);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
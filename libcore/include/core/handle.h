@@ -80,6 +80,28 @@ struct armadito *a6o_open(struct a6o_conf *conf);
  */
 int a6o_close(struct armadito *u);
 
+/**
+ * \fn int a6o_reload_conf(struct armadito *u)
+ * \brief reload the scan configuration from the configuration files
+ *
+ * The configuration file and the files of the configuration directory are
+ * loaded again. The `on-demand` section is applied to a new on-demand scan
+ * configuration, which is used by the scans started afterwards; running
+ * scans keep the configuration they started with. The white list, mime
+ * types, modules and max size of the on-access section are applied to a new
+ * on-access scan configuration, used by the files opened afterwards.
+ *
+ * The other settings need a restart: the on-access monitoring settings
+ * (enable, mount, directory...), the number of scan threads, which is fixed
+ * by the first scan for on-demand and at startup for on-access, and the
+ * sections of the other modules.
+ *
+ * \param[in] u          the armadito handle
+ *
+ * \return               0 if OK, -1 if the configuration cannot be loaded, in which case the previous one is kept
+ */
+int a6o_reload_conf(struct armadito *u);
+
 struct a6o_conf *a6o_get_conf(struct armadito *u);
 
 struct a6o_event_source *a6o_get_event_source(struct armadito *u);
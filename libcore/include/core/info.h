@@ -28,6 +28,8 @@ struct a6o_info {
 	const char *antivirus_version;
 	enum a6o_update_status global_status;
 	time_t global_update_ts;
+	int stage_threads;             /* threads of the scan stages, shared by all the scans */
+	int stage_busy_threads;        /* stage threads processing a file */
 	/* NULL terminated array of pointers to struct a6o_module_info */
 	struct a6o_module_info **module_infos;
 };
@@ -40,4 +42,8 @@ void a6o_info_to_stdout(struct a6o_info *info);
 
 void a6o_info_free(struct a6o_info *info);
 
+/* must be called when modules may have updated their bases, and when configurations are */
+/* published: verdicts cached with other modules or bases versions are no longer used */
+void a6o_notify_bases_update(struct armadito *armadito);
+
 #endif
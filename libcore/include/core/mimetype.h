@@ -44,6 +44,8 @@ void os_mime_type_init(void);
  *      \param[in] path the path of the file
  *
  *      \return the mime type as a string, NULL if not guessable
+ *      The string is interned and must not be freed: the same mime type is
+ *      always returned as the same pointer.
  */
 const char *os_mime_type_guess(const char *path);
 
@@ -54,6 +56,8 @@ const char *os_mime_type_guess(const char *path);
  *      \param[in] fd file descriptor of the opened file
  *
  *      \return the mime type as a string, NULL if not guessable
+ *      The string is interned and must not be freed: the same mime type is
+ *      always returned as the same pointer.
  */
 const char *os_mime_type_guess_fd(int fd);
 
@@ -0,0 +1,78 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#ifndef ARMADITO_CORE_OS_MOUNT_H
+#define ARMADITO_CORE_OS_MOUNT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* kind of file system, which tells how costly and how useful scanning its files is */
+enum os_fs_class {
+	OS_FS_LOCAL = 0,       /* disk or memory file system */
+	OS_FS_PSEUDO,          /* kernel interface (proc, sysfs, cgroup...), no file worth scanning */
+	OS_FS_NETWORK,         /* NFS, CIFS..., reads may wait for a remote server */
+	OS_FS_FUSE,            /* user space file system, reads may wait for a user process */
+};
+
+/*
+ * A mount table is a cached view of the mounted file systems, indexed by
+ * device, so that the file system of a directory is known without any
+ * system call once the directory is stat'ed.
+ *
+ * The view is read again only when the system mount table changes.
+ * Devices not found in it are classified by their file system type
+ * (statfs), once until the next change.
+ *
+ * A mount table can be used by several threads at once.
+ */
+
+struct os_mount_table;
+
+/**
+ *      \fn struct os_mount_table *os_mount_table_new(void);
+ *      \brief Creates a view of the mount table
+ *
+ *      \return the view, NULL if there is no view on this system, in which
+ *      case os_mount_table_classify() looks at each path
+ */
+struct os_mount_table *os_mount_table_new(void);
+
+/**
+ *      \fn enum os_fs_class os_mount_table_classify(struct os_mount_table *t, unsigned long long dev, const char *path);
+ *      \brief Tells what kind of file system a file belongs to
+ *
+ *      \param[in] t the mount table, NULL to classify path without any cache
+ *      \param[in] dev the device of the file, as given by os_file_stat()
+ *      \param[in] path the path of the file, used if dev is not in the mount table
+ *
+ *      \return the class of the file system, OS_FS_LOCAL if not known
+ */
+enum os_fs_class os_mount_table_classify(struct os_mount_table *t, unsigned long long dev, const char *path);
+
+void os_mount_table_free(struct os_mount_table *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -34,10 +34,23 @@ struct a6o_on_demand;
 
 struct a6o_on_demand *a6o_on_demand_new(struct armadito *armadito, const char *root_path, time_t scan_id, enum a6o_scan_flags flags, int send_progress);
 
+/* re-creates a recursive scan interrupted by a daemon stop from its last checkpoint */
+/* returns NULL if there is no checkpoint for this scan id */
+struct a6o_on_demand *a6o_on_demand_resume(struct armadito *armadito, time_t scan_id, int send_progress);
+
 time_t a6o_on_demand_get_id(struct a6o_on_demand *on_demand);
 
 void a6o_on_demand_cancel(struct a6o_on_demand *on_demand);
 
+struct a6o_scan_limits;
+
+/* changes the rate limits and priority of a scan, which may be running */
+/* scan starts with the limits of the on-demand scan configuration */
+void a6o_on_demand_set_limits(struct a6o_on_demand *on_demand, const struct a6o_scan_limits *limits);
+
+/* pauses a running scan if paused is set, continues it otherwise */
+void a6o_on_demand_pause(struct a6o_on_demand *on_demand, int paused);
+
 void a6o_on_demand_run(struct a6o_on_demand *on_demand);
 
 void a6o_on_demand_free(struct a6o_on_demand *on_demand);
@@ -0,0 +1,69 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+#ifndef ARMADITO_CORE_OS_PRIORITY_H
+#define ARMADITO_CORE_OS_PRIORITY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum os_io_class {
+	OS_IO_CLASS_NORMAL = 0,           /* default I/O priority */
+	OS_IO_CLASS_BACKGROUND,           /* lowest priority among normal I/O */
+	OS_IO_CLASS_IDLE,                 /* I/O only when no other process is using the disk */
+};
+
+/**
+ *      \fn int os_thread_set_priority(enum os_io_class io_class, int nice);
+ *      \brief Sets the I/O and CPU priority of the calling thread
+ *
+ *      \param[in] io_class the I/O priority class
+ *      \param[in] nice the CPU priority, from 0 (normal) to 19 (lowest)
+ *
+ *      \return 0 if ok, -1 if priority could not be changed
+ */
+int os_thread_set_priority(enum os_io_class io_class, int nice);
+
+/* returns the number of processors this process can use, taking into account */
+/* its CPU affinity and, on linux, the CPU quota of its control group; at least 1 */
+int os_cpu_count(void);
+
+/* returns the system load, in percent of the available processors, or -1 if not available */
+int os_cpu_load(void);
+
+/* measures the utilization of the disks between two calls */
+struct os_disk_activity;
+
+struct os_disk_activity *os_disk_activity_new(void);
+
+/* returns the percentage of time the busiest disk was doing I/O since previous call, */
+/* or -1 if not available or if this is the first call */
+int os_disk_activity_busy(struct os_disk_activity *activity);
+
+void os_disk_activity_free(struct os_disk_activity *activity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
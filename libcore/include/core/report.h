@@ -40,6 +40,7 @@ struct a6o_report {
 	enum a6o_action action;               /*!< the action that was executed on this file (alert, quarantine, etc) */
 	char *module_name;                    /*!< name of the module that decided the file scan status               */
 	char *module_report;                  /*!< the report of this module, usually a malware name                  */
+	char *digest;                         /*!< hexadecimal SHA-256 of the file content, NULL if not computed      */
 };
 
 void a6o_report_init(struct a6o_report *report, const char *path);
@@ -48,4 +49,6 @@ void a6o_report_destroy(struct a6o_report *report);
 
 void a6o_report_change(struct a6o_report *report, enum a6o_file_status status, const char *module_name, const char *module_report);
 
+void a6o_report_set_digest(struct a6o_report *report, const char *digest);
+
 #endif
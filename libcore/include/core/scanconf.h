@@ -22,14 +22,81 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef ARMADITO_CORE_SCANCONF_H
 #define ARMADITO_CORE_SCANCONF_H
 
+#include <libarmadito/armadito.h>
+#include <core/file.h>
+#include <core/priority.h>
+
 struct a6o_scan_conf;
 
+/* intensity of a scan, so that background scans do not compete with production I/O */
+struct a6o_scan_limits {
+	size_t bytes_per_second;          /* 0 for no limit */
+	int files_per_second;             /* 0 for no limit */
+	enum os_io_class io_class;        /* I/O priority of scan threads */
+	int nice;                         /* CPU priority of scan threads, 0 to 19 */
+	int idle_only;                    /* if set, scan waits while system is busy */
+	int max_load;                     /* in idle only mode, system is busy over this load, in percent of processors */
+	int max_disk_busy;                /* in idle only mode, system is busy over this disk utilization, in percent */
+};
+
+/* order in which the files found by directory traversal are scanned */
+enum a6o_scan_order {
+	A6O_SCAN_ORDER_DISCOVERY = 0,     /* order of traversal */
+	A6O_SCAN_ORDER_INODE,             /* by batches, sorted by inode number */
+	A6O_SCAN_ORDER_EXTENT,            /* by batches, sorted by position on disk, or by inode if not available */
+	A6O_SCAN_ORDER_RISK,              /* by batches, likely malicious and cheap files first */
+};
+
+/* how files are read in advance of their scan */
+enum a6o_prefetch_engine {
+	A6O_PREFETCH_FADVISE = 0,         /* read hint given by the scan threads */
+	A6O_PREFETCH_IO_URING,            /* asynchronous open and read hint, falls back to fadvise if not available */
+};
+
+/* what becomes of the pages of scanned files in the system cache */
+enum a6o_cache_neutral {
+	A6O_CACHE_NEUTRAL_OFF = 0,        /* pages stay cached */
+	A6O_CACHE_NEUTRAL_DROP,           /* pages are dropped once the file is scanned */
+	A6O_CACHE_NEUTRAL_KEEP_RESIDENT,  /* only the pages that were not cached before the scan are dropped */
+};
+
+/* how a recursive scan treats the files of network and user space file systems */
+enum a6o_fs_policy {
+	A6O_FS_POLICY_SCAN = 0,           /* like local files */
+	A6O_FS_POLICY_REDUCED,            /* by their own lane of few threads, so that a slow mount cannot hold all scan threads */
+	A6O_FS_POLICY_SMALL_FILES_ONLY,   /* reduced, and files over 64 KB are not scanned at all */
+	A6O_FS_POLICY_SKIP,               /* not traversed */
+};
+
+/*
+ * Scan configurations are published as snapshots that are never modified,
+ * so that scan threads read them without lock. A scan takes a reference on
+ * the current snapshot when it starts and keeps it until it ends: a reload
+ * publishes a new snapshot without waiting for the running scans.
+ */
+
+/* the configuration the configuration keys apply to: the one being built by a reload, if any, or else the current one */
 struct a6o_scan_conf *a6o_scan_conf_on_demand(void);
 
 struct a6o_scan_conf *a6o_scan_conf_on_access(void);
 
+/* returns a reference on the current snapshot, to be released by a6o_scan_conf_release() */
+struct a6o_scan_conf *a6o_scan_conf_acquire_on_demand(void);
+
+struct a6o_scan_conf *a6o_scan_conf_acquire_on_access(void);
+
+void a6o_scan_conf_release(struct a6o_scan_conf *c);
+
+/* starts building new on-demand and on-access configurations, which a6o_scan_conf_on_demand() */
+/* and a6o_scan_conf_on_access() return until they are published */
+void a6o_scan_conf_reload_begin(void);
+
+/* compiles the configurations that were built and makes them the current snapshots */
+void a6o_scan_conf_publish(void);
+
 void a6o_scan_conf_white_list_directory(struct a6o_scan_conf *c, const char *path);
 
+/* returns 1 if path is a white listed directory or is under one, in one walk whatever the size of the white list */
 int a6o_scan_conf_is_white_listed(struct a6o_scan_conf *c, const char *path);
 
 void a6o_scan_conf_add_mime_type(struct a6o_scan_conf *c, const char *mime_type);
@@ -38,8 +105,171 @@ void a6o_scan_conf_add_module(struct a6o_scan_conf *c, const char *module_name,
 
 struct a6o_module **a6o_scan_conf_get_applicable_modules(struct a6o_scan_conf *c, const char *mime_type);
 
+/* files of this size or more are not scanned, 0 for no limit */
 void a6o_scan_conf_max_file_size(struct a6o_scan_conf *c, int max_file_size);
 
+size_t a6o_scan_conf_get_max_file_size(struct a6o_scan_conf *c);
+
+/* number of threads scanning files, 0 to adjust it to the observed throughput */
+/* for on-demand scans, threads are shared by all the threaded scans and only */
+/* the value set before the first threaded scan is used */
+void a6o_scan_conf_scan_threads(struct a6o_scan_conf *c, int scan_threads);
+
+int a6o_scan_conf_get_scan_threads(struct a6o_scan_conf *c);
+
+/* maximum number of files waiting to be scanned, 0 for no limit */
+void a6o_scan_conf_queue_depth(struct a6o_scan_conf *c, int queue_depth);
+
+int a6o_scan_conf_get_queue_depth(struct a6o_scan_conf *c);
+
+/* maximum memory in bytes used by files waiting to be scanned, 0 for no limit */
+void a6o_scan_conf_queue_memory(struct a6o_scan_conf *c, int queue_memory);
+
+size_t a6o_scan_conf_get_queue_memory(struct a6o_scan_conf *c);
+
+/* in a threaded scan, files of this size or more are scanned by a separate pool of threads, */
+/* so that a few large files do not delay the scan of small ones; 0 to disable */
+void a6o_scan_conf_large_file_size(struct a6o_scan_conf *c, int large_file_size);
+
+size_t a6o_scan_conf_get_large_file_size(struct a6o_scan_conf *c);
+
+/* number of threads scanning large files */
+void a6o_scan_conf_large_file_threads(struct a6o_scan_conf *c, int large_file_threads);
+
+int a6o_scan_conf_get_large_file_threads(struct a6o_scan_conf *c);
+
+/* on rotating disks, scanning files in disk order avoids seeks */
+void a6o_scan_conf_scan_order(struct a6o_scan_conf *c, enum a6o_scan_order order);
+
+enum a6o_scan_order a6o_scan_conf_get_scan_order(struct a6o_scan_conf *c);
+
+/* number of files reordered together, the larger the fewer seeks but the later the first files are scanned */
+void a6o_scan_conf_scan_order_batch(struct a6o_scan_conf *c, int n_files);
+
+int a6o_scan_conf_get_scan_order_batch(struct a6o_scan_conf *c);
+
+/* seconds after which a scan is stopped, 0 for no limit */
+/* with risk order, the files left unscanned are the least likely to be malicious */
+void a6o_scan_conf_time_budget(struct a6o_scan_conf *c, int seconds);
+
+int a6o_scan_conf_get_time_budget(struct a6o_scan_conf *c);
+
+/* in a threaded scan, number of queued files read in advance of their scan, 0 to disable */
+void a6o_scan_conf_prefetch_depth(struct a6o_scan_conf *c, int n_files);
+
+int a6o_scan_conf_get_prefetch_depth(struct a6o_scan_conf *c);
+
+/* maximum bytes read in advance and not yet scanned, 0 for no limit */
+void a6o_scan_conf_prefetch_memory(struct a6o_scan_conf *c, int prefetch_memory);
+
+size_t a6o_scan_conf_get_prefetch_memory(struct a6o_scan_conf *c);
+
+void a6o_scan_conf_prefetch_engine(struct a6o_scan_conf *c, enum a6o_prefetch_engine engine);
+
+enum a6o_prefetch_engine a6o_scan_conf_get_prefetch_engine(struct a6o_scan_conf *c);
+
+/* so that a scan does not evict the working set of other processes from the system cache; */
+/* files are also opened without updating their access time */
+void a6o_scan_conf_cache_neutral(struct a6o_scan_conf *c, enum a6o_cache_neutral mode);
+
+enum a6o_cache_neutral a6o_scan_conf_get_cache_neutral(struct a6o_scan_conf *c);
+
+/* if set, a recursive scan does not cross into other file systems than the one of its root */
+/* pseudo file systems (proc, sysfs...) are never traversed */
+void a6o_scan_conf_one_file_system(struct a6o_scan_conf *c, int enable);
+
+int a6o_scan_conf_get_one_file_system(struct a6o_scan_conf *c);
+
+void a6o_scan_conf_network_fs_policy(struct a6o_scan_conf *c, enum a6o_fs_policy policy);
+
+enum a6o_fs_policy a6o_scan_conf_get_network_fs_policy(struct a6o_scan_conf *c);
+
+void a6o_scan_conf_fuse_fs_policy(struct a6o_scan_conf *c, enum a6o_fs_policy policy);
+
+enum a6o_fs_policy a6o_scan_conf_get_fuse_fs_policy(struct a6o_scan_conf *c);
+
+/* number of threads scanning the files of network and user space file systems with a reduced policy */
+void a6o_scan_conf_remote_fs_threads(struct a6o_scan_conf *c, int remote_fs_threads);
+
+int a6o_scan_conf_get_remote_fs_threads(struct a6o_scan_conf *c);
+
+/* threaded scans hand opened files to up to module-threads stage threads, which hand their reports to up to report-threads stage threads */
+/* 0 module threads means files are opened, scanned and reported by the same thread */
+void a6o_scan_conf_module_threads(struct a6o_scan_conf *c, int module_threads);
+
+int a6o_scan_conf_get_module_threads(struct a6o_scan_conf *c);
+
+void a6o_scan_conf_report_threads(struct a6o_scan_conf *c, int report_threads);
+
+int a6o_scan_conf_get_report_threads(struct a6o_scan_conf *c);
+
+/* maximum number of files waiting between two stages, beyond which the previous stage does the work of the next one */
+void a6o_scan_conf_stage_queue_depth(struct a6o_scan_conf *c, int stage_queue_depth);
+
+int a6o_scan_conf_get_stage_queue_depth(struct a6o_scan_conf *c);
+
+/* directory where recursive scans save their checkpoints, no checkpoint if not set */
+void a6o_scan_conf_checkpoint_dir(struct a6o_scan_conf *c, const char *path);
+
+const char *a6o_scan_conf_get_checkpoint_dir(struct a6o_scan_conf *c);
+
+/* seconds between two checkpoints, 0 for no checkpoint */
+void a6o_scan_conf_checkpoint_interval(struct a6o_scan_conf *c, int seconds);
+
+int a6o_scan_conf_get_checkpoint_interval(struct a6o_scan_conf *c);
+
+/* path of the file used to keep clean verdicts between scans, no verdict cache if not set */
+void a6o_scan_conf_verdict_cache(struct a6o_scan_conf *c, const char *path);
+
+/* maximum number of verdicts kept in the verdict cache */
+void a6o_scan_conf_verdict_cache_size(struct a6o_scan_conf *c, int n_records);
+
+struct a6o_info;
+
+/* computes the tag of the modules and bases versions given by info, which invalidates the */
+/* verdicts cached with other versions; can be called while scan threads use the configuration */
+void a6o_scan_conf_update_verdict_tag(struct a6o_scan_conf *c, struct a6o_info *info);
+
+/* same, for the current on-demand and on-access configurations */
+void a6o_scan_conf_update_verdict_tags(struct a6o_info *info);
+
+/* returns 1 and fills status if a verdict is cached for this file */
+int a6o_scan_conf_get_cached_verdict(struct a6o_scan_conf *c, const struct os_file_stat *st, enum a6o_file_status *status);
+
+void a6o_scan_conf_cache_verdict(struct a6o_scan_conf *c, const struct os_file_stat *st, enum a6o_file_status status);
+
+/* if enabled, a digest of the content of scanned files is computed and added to the report; */
+/* files with the same content as an already scanned file get its verdict */
+void a6o_scan_conf_content_digest(struct a6o_scan_conf *c, int enable);
+
+int a6o_scan_conf_get_content_digest(struct a6o_scan_conf *c);
+
+/* maximum number of verdicts kept by content digest, 0 to only report digests */
+void a6o_scan_conf_digest_cache_size(struct a6o_scan_conf *c, int n_records);
+
+/* digest is a SHA-256 of the file content, i.e. 32 bytes */
+/* returns 1 and fills status if a verdict is known for this content */
+int a6o_scan_conf_get_digest_verdict(struct a6o_scan_conf *c, const unsigned char *digest, enum a6o_file_status *status);
+
+void a6o_scan_conf_digest_verdict(struct a6o_scan_conf *c, const unsigned char *digest, enum a6o_file_status status);
+
+/* default limits of scans, which can be changed for a running scan */
+void a6o_scan_conf_max_bytes_per_second(struct a6o_scan_conf *c, int bytes_per_second);
+
+void a6o_scan_conf_max_files_per_second(struct a6o_scan_conf *c, int files_per_second);
+
+void a6o_scan_conf_io_class(struct a6o_scan_conf *c, enum os_io_class io_class);
+
+void a6o_scan_conf_nice(struct a6o_scan_conf *c, int nice);
+
+void a6o_scan_conf_idle_only(struct a6o_scan_conf *c, int idle_only);
+
+void a6o_scan_conf_idle_max_load(struct a6o_scan_conf *c, int percent);
+
+void a6o_scan_conf_idle_max_disk_busy(struct a6o_scan_conf *c, int percent);
+
+void a6o_scan_conf_get_limits(struct a6o_scan_conf *c, struct a6o_scan_limits *limits);
+
 void a6o_scan_conf_free(struct a6o_scan_conf *scan_conf);
 
 #endif
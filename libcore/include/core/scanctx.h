@@ -22,14 +22,15 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef ARMADITO_CORE_FILECTX_H
 #define ARMADITO_CORE_FILECTX_H
 
+#include <core/file.h>
 #include <core/report.h>
 #include <core/scanconf.h>
 
 enum a6o_scan_context_status {
 	A6O_SC_MUST_SCAN = 0,                     /* !< file must be scanned                              */
 	A6O_SC_WHITE_LISTED_DIRECTORY,            /* !< a directory ancestor of path is white listed      */
-	A6O_SC_FILE_TOO_BIG,                      /* !< file size is >= maximum file size                 */
-	A6O_SC_FILE_CACHED,                       /* !< file path is in path cache                        */
+	A6O_SC_FILE_TOO_BIG,                      /* !< file size is > maximum file size                  */
+	A6O_SC_FILE_CACHED,                       /* !< file verdict is in verdict cache                  */
 	A6O_SC_FILE_TYPE_NOT_SCANNED,             /* !< file mime type has no associated scan modules     */
 	A6O_SC_FILE_OPEN_ERROR                    /* !< error when opening the file                      */
 };
@@ -42,8 +43,16 @@ struct a6o_scan_context {
 	const char *path;
 	const char *mime_type;
 	struct a6o_module **applicable_modules;
+	struct a6o_scan_conf *conf;
+	struct os_file_stat file_stat;   /* file identity when opened, flags is FILE_FLAG_IS_ERROR if unknown */
+	volatile int *cancelled;     /* if not NULL and set, scan is interrupted before next module */
+	int same_content;            /* set by scan if the verdict of a file with the same content was reused */
+	int drop_cache;              /* in cache neutral mode, set if the file may be read and its pages must be dropped when closed */
+	unsigned char *cached_pages; /* pages of the file that were cached before the scan, NULL if none or if all pages are dropped */
 };
 
+/* if report is not NULL, its status is changed when the file is not to be scanned, */
+/* except for A6O_SC_FILE_TOO_BIG which leaves it A6O_FILE_UNDECIDED */
 enum a6o_scan_context_status a6o_scan_context_get(struct a6o_scan_context *ctx, int fd, const char *path, struct a6o_scan_conf *conf, struct a6o_report *report);
 
 enum a6o_file_status a6o_scan_context_scan(struct a6o_scan_context *ctx, struct a6o_report *report);
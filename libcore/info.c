@@ -27,6 +27,8 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #include "string_p.h"
 #include "core/io.h"
 #include "core/info.h"
+#include "core/scanconf.h"
+#include "stage_p.h"
 
 #include <assert.h>
 #include <glib.h>
@@ -72,11 +74,16 @@ struct a6o_info *a6o_info_new(struct armadito *armadito)
 	struct a6o_info *info = malloc(sizeof(struct a6o_info));
 	GArray *g_module_infos;
 	struct a6o_module **modv;
+	struct stage_pool_stats stage_stats;
 
 	info->antivirus_version = os_strdup(VERSION);
 	info->global_status = A6O_UPDATE_NON_AVAILABLE;
 	info->global_update_ts = 0;
 
+	stage_pool_get_stats(&stage_stats);
+	info->stage_threads = stage_stats.n_threads;
+	info->stage_busy_threads = stage_stats.busy_threads;
+
 	g_module_infos = g_array_new(TRUE, TRUE, sizeof(struct a6o_module_info *));
 
 	for (modv = a6o_get_modules(armadito); *modv != NULL; modv++) {
@@ -154,6 +161,14 @@ void a6o_info_free(struct a6o_info *info)
 	free(info);
 }
 
+void a6o_notify_bases_update(struct armadito *armadito)
+{
+	struct a6o_info *info = a6o_info_new(armadito);
+
+	a6o_scan_conf_update_verdict_tags(info);
+	a6o_info_free(info);
+}
+
 #if 0
 void a6o_info_to_stdout(struct a6o_info *info)
 {
@@ -200,4 +215,3 @@ const char *a6o_base_info_debug(struct a6o_base_info *info)
 }
 #endif
 #endif
-
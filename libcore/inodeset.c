@@ -0,0 +1,249 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "inodeset_p.h"
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* a slot is: inode (48 bits) | device index (10 bits) | value (6 bits), 0 if slot is empty */
+#define VALUE_BITS 6
+#define DEVICE_BITS 10
+#define INODE_BITS 48
+#define VALUE_MASK ((1ULL << VALUE_BITS) - 1)
+#define MAX_DEVICES ((1 << DEVICE_BITS) - 1)
+
+#define N_SHARDS 64                 /* must be a power of 2 */
+#define SHARD_BITS 6
+#define INITIAL_CAPACITY 1024       /* slots per shard, must be a power of 2 */
+
+struct shard {
+	GMutex lock;
+	guint64 *slots;
+	gsize capacity;
+	gsize count;
+};
+
+struct inode_set {
+	struct shard shards[N_SHARDS];
+
+	/* devices are given a small index; the array is only appended to, so that it can be read without lock */
+	GMutex devices_lock;
+	volatile gint n_devices;
+	unsigned long long devices[MAX_DEVICES];
+};
+
+struct inode_set *inode_set_new(void)
+{
+	struct inode_set *s = malloc(sizeof(struct inode_set));
+	int i;
+
+	for (i = 0; i < N_SHARDS; i++) {
+		struct shard *sh = &s->shards[i];
+
+		g_mutex_init(&sh->lock);
+		sh->slots = calloc(INITIAL_CAPACITY, sizeof(guint64));
+		sh->capacity = INITIAL_CAPACITY;
+		sh->count = 0;
+	}
+
+	g_mutex_init(&s->devices_lock);
+	s->n_devices = 0;
+
+	return s;
+}
+
+/* returns device index, from 1 to MAX_DEVICES, or 0 if there are too many devices */
+static int device_index(struct inode_set *s, unsigned long long dev)
+{
+	int n = g_atomic_int_get(&s->n_devices);
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (s->devices[i] == dev)
+			return i + 1;
+
+	g_mutex_lock(&s->devices_lock);
+
+	/* another thread may have added it meanwhile */
+	n = s->n_devices;
+	for (; i < n; i++)
+		if (s->devices[i] == dev)
+			break;
+
+	if (i == n) {
+		if (n < MAX_DEVICES) {
+			s->devices[n] = dev;
+			/* the device is written before the count is published */
+			g_atomic_int_set(&s->n_devices, n + 1);
+		} else
+			i = -1;
+	}
+
+	g_mutex_unlock(&s->devices_lock);
+
+	return i + 1;
+}
+
+/* returns the key of an inode, i.e. a slot without value, or 0 if inode cannot be recorded */
+static guint64 inode_key(struct inode_set *s, unsigned long long dev, unsigned long long inode)
+{
+	int index;
+
+	if (inode == 0 || inode >= (1ULL << INODE_BITS))
+		return 0;
+
+	if ((index = device_index(s, dev)) == 0)
+		return 0;
+
+	return ((guint64)inode << (DEVICE_BITS + VALUE_BITS)) | ((guint64)index << VALUE_BITS);
+}
+
+static guint64 hash_key(guint64 key)
+{
+	/* Fibonacci hashing: high bits select the shard, low bits the first slot */
+	return (key >> VALUE_BITS) * 0x9E3779B97F4A7C15ULL;
+}
+
+static struct shard *key_shard(struct inode_set *s, guint64 h)
+{
+	return &s->shards[h >> (64 - SHARD_BITS)];
+}
+
+/* returns the slot containing key, or the empty slot where it must be inserted */
+static guint64 *shard_find(struct shard *sh, guint64 key, guint64 h)
+{
+	gsize mask = sh->capacity - 1;
+	gsize i = (gsize)(h >> 16) & mask;
+
+	while (sh->slots[i] != 0 && (sh->slots[i] & ~VALUE_MASK) != key)
+		i = (i + 1) & mask;
+
+	return &sh->slots[i];
+}
+
+static void shard_grow(struct shard *sh)
+{
+	guint64 *old_slots = sh->slots;
+	gsize old_capacity = sh->capacity;
+	gsize i;
+
+	sh->capacity *= 2;
+	sh->slots = calloc(sh->capacity, sizeof(guint64));
+
+	for (i = 0; i < old_capacity; i++)
+		if (old_slots[i] != 0) {
+			guint64 key = old_slots[i] & ~VALUE_MASK;
+
+			*shard_find(sh, key, hash_key(key)) = old_slots[i];
+		}
+
+	free(old_slots);
+}
+
+int inode_set_add(struct inode_set *s, unsigned long long dev, unsigned long long inode)
+{
+	guint64 key = inode_key(s, dev, inode);
+	guint64 h, *slot;
+	struct shard *sh;
+	int ret;
+
+	if (key == 0)
+		return INODE_SET_ADDED;
+
+	h = hash_key(key);
+	sh = key_shard(s, h);
+
+	g_mutex_lock(&sh->lock);
+
+	slot = shard_find(sh, key, h);
+
+	if (*slot != 0)
+		ret = (int)(*slot & VALUE_MASK);
+	else {
+		*slot = key;
+		ret = INODE_SET_ADDED;
+
+		/* keep load factor under 70% */
+		if (++sh->count * 10 > sh->capacity * 7)
+			shard_grow(sh);
+	}
+
+	g_mutex_unlock(&sh->lock);
+
+	return ret;
+}
+
+void inode_set_set_value(struct inode_set *s, unsigned long long dev, unsigned long long inode, int value)
+{
+	guint64 key = inode_key(s, dev, inode);
+	guint64 h, *slot;
+	struct shard *sh;
+
+	if (key == 0 || value < 0 || value > INODE_SET_MAX_VALUE)
+		return;
+
+	h = hash_key(key);
+	sh = key_shard(s, h);
+
+	g_mutex_lock(&sh->lock);
+
+	slot = shard_find(sh, key, h);
+	if (*slot != 0)
+		*slot = key | (guint64)value;
+
+	g_mutex_unlock(&sh->lock);
+}
+
+void inode_set_get_stats(struct inode_set *s, size_t *count, size_t *bytes)
+{
+	int i;
+
+	*count = 0;
+	*bytes = sizeof(struct inode_set);
+
+	for (i = 0; i < N_SHARDS; i++) {
+		struct shard *sh = &s->shards[i];
+
+		g_mutex_lock(&sh->lock);
+		*count += sh->count;
+		*bytes += sh->capacity * sizeof(guint64);
+		g_mutex_unlock(&sh->lock);
+	}
+}
+
+void inode_set_free(struct inode_set *s)
+{
+	int i;
+
+	for (i = 0; i < N_SHARDS; i++) {
+		free(s->shards[i].slots);
+		g_mutex_clear(&s->shards[i].lock);
+	}
+
+	g_mutex_clear(&s->devices_lock);
+	free(s);
+}
@@ -0,0 +1,62 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+#ifndef LIBCORE_INODESET_P_H
+#define LIBCORE_INODESET_P_H
+
+#include <stddef.h>
+
+/*
+ * An inode set records the files and directories already visited by a scan,
+ * identified by device and inode, so that a file reachable by several paths
+ * (hard links, bind mounts) is scanned only once.
+ *
+ * A small value (0 to INODE_SET_MAX_VALUE) is kept with each inode, for
+ * instance the verdict of the first scan of the file.
+ *
+ * The set is safe to use from several threads: it is split in shards, each
+ * protected by its own lock, and each shard is an open addressing hash table
+ * of 64 bits words packing inode, device index and value.
+ * Inodes that do not fit (inode 0, inode numbers over 48 bits, more than 1023
+ * devices) are never recorded.
+ */
+
+struct inode_set;
+
+#define INODE_SET_ADDED (-1)        /* returned by inode_set_add() when inode was not yet in the set */
+#define INODE_SET_MAX_VALUE 63
+
+struct inode_set *inode_set_new(void);
+
+/* adds an inode with value 0 */
+/* returns INODE_SET_ADDED if it was not in the set, otherwise the value stored for it */
+int inode_set_add(struct inode_set *s, unsigned long long dev, unsigned long long inode);
+
+/* changes the value of an inode already in the set, does nothing if not in the set */
+void inode_set_set_value(struct inode_set *s, unsigned long long dev, unsigned long long inode, int value);
+
+/* returns the number of inodes in the set and the memory used by the tables */
+void inode_set_get_stats(struct inode_set *s, size_t *count, size_t *bytes);
+
+void inode_set_free(struct inode_set *s);
+
+#endif
@@ -0,0 +1,472 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+#include "mimemagic_p.h"
+
+#include <glib.h>
+#include <string.h>
+
+enum magic_mime {
+	MIME_NONE = 0,
+	MIME_ELF_OBJECT,
+	MIME_ELF_EXECUTABLE,
+	MIME_ELF_SHAREDLIB,
+	MIME_ELF_COREDUMP,
+	MIME_PE,
+	MIME_MACH_O,
+	MIME_PDF,
+	MIME_ZIP,
+	MIME_DOCX,
+	MIME_XLSX,
+	MIME_PPTX,
+	MIME_GZIP,
+	MIME_BZIP2,
+	MIME_XZ,
+	MIME_7Z,
+	MIME_RAR,
+	MIME_TAR,
+	MIME_AR,
+	MIME_DEB,
+	MIME_SHELL,
+	MIME_PERL,
+	MIME_PYTHON,
+	MIME_RUBY,
+	MIME_JAVASCRIPT,
+	MIME_PHP,
+	MIME_TCL,
+	MIME_LUA,
+	MIME_PNG,
+	MIME_GIF,
+	MIME_JPEG,
+	MIME_TIFF,
+	MIME_WEBP,
+	MIME_HEIC,
+	MIME_FLAC,
+	MIME_WAV,
+	MIME_OGG_AUDIO,
+	MIME_M4A,
+	MIME_OGG_VIDEO,
+	MIME_AVI,
+	MIME_MP4,
+	MIME_QUICKTIME,
+	MIME_MATROSKA,
+	MIME_WEBM,
+	N_MAGIC_MIMES,
+};
+
+/* in the order of enum magic_mime */
+static const char *mime_names[N_MAGIC_MIMES] = {
+	NULL,
+	"application/x-object",
+	"application/x-executable",
+	"application/x-sharedlib",
+	"application/x-coredump",
+	"application/vnd.microsoft.portable-executable",
+	"application/x-mach-binary",
+	"application/pdf",
+	"application/zip",
+	"application/vnd.openxmlformats-officedocument.wordprocessingml.document",
+	"application/vnd.openxmlformats-officedocument.spreadsheetml.sheet",
+	"application/vnd.openxmlformats-officedocument.presentationml.presentation",
+	"application/gzip",
+	"application/x-bzip2",
+	"application/x-xz",
+	"application/x-7z-compressed",
+	"application/x-rar",
+	"application/x-tar",
+	"application/x-archive",
+	"application/vnd.debian.binary-package",
+	"text/x-shellscript",
+	"text/x-perl",
+	"text/x-script.python",
+	"text/x-ruby",
+	"application/javascript",
+	"text/x-php",
+	"text/x-tcl",
+	"text/x-lua",
+	"image/png",
+	"image/gif",
+	"image/jpeg",
+	"image/tiff",
+	"image/webp",
+	"image/heic",
+	"audio/flac",
+	"audio/x-wav",
+	"audio/ogg",
+	"audio/x-m4a",
+	"video/ogg",
+	"video/x-msvideo",
+	"video/mp4",
+	"video/quicktime",
+	"video/x-matroska",
+	"video/webm",
+};
+
+static const char *interned_mimes[N_MAGIC_MIMES];
+
+/* the matched bytes must be followed by a blank or by the end of the line, like a command name */
+#define MATCH_WORD     1
+/* version digits and dots may follow the matched bytes, before the end of the word */
+#define MATCH_VERSION  2
+
+struct magic_rule {
+	size_t offset;
+	const char *bytes;
+	size_t len;
+	/* second sequence that must also match, len2 is 0 if none */
+	size_t offset2;
+	const char *bytes2;
+	size_t len2;
+	int flags;
+	enum magic_mime mime;
+	/* if not NULL, gives the type of the files matching the sequences, MIME_NONE if unknown */
+	enum magic_mime (*refine)(const unsigned char *buffer, size_t size);
+};
+
+/* a byte sequence given as a string literal, that may contain null bytes */
+#define AT(OFFSET, BYTES) (OFFSET), (BYTES), sizeof(BYTES) - 1
+#define NOTHING 0, NULL, 0
+
+static unsigned int get_le16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned long get_le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/* reads a little-endian or big-endian integer of len bytes */
+static guint64 get_int(const unsigned char *p, size_t len, int big_endian)
+{
+	guint64 v = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		v |= (guint64)p[i] << (8 * (big_endian ? len - 1 - i : i));
+
+	return v;
+}
+
+static const unsigned char *find_bytes(const unsigned char *buffer, size_t size, const char *bytes, size_t len)
+{
+	const unsigned char *p, *end;
+
+	if (size < len)
+		return NULL;
+
+	for (p = buffer, end = buffer + size - len; p <= end; p++)
+		if (*p == (unsigned char)bytes[0] && !memcmp(p, bytes, len))
+			return p;
+
+	return NULL;
+}
+
+#define ET_REL      1
+#define ET_EXEC     2
+#define ET_DYN      3
+#define ET_CORE     4
+#define PT_DYNAMIC  2
+
+/*
+ * Shared objects and position independent executables have the same ELF
+ * type and are told apart by libmagic from the flags of the dynamic
+ * section. When this section is beyond the header given to libmagic, it
+ * names the file a shared object.
+ */
+static enum magic_mime refine_elf_dyn(const unsigned char *buffer, size_t size, int is_64, int big_endian)
+{
+	guint64 ph_offset, ph_size, ph_num, i;
+	const unsigned char *ph;
+
+	if (size < (is_64 ? 64 : 52))
+		return MIME_NONE;
+
+	ph_offset = get_int(buffer + (is_64 ? 32 : 28), is_64 ? 8 : 4, big_endian);
+	ph_size = get_int(buffer + (is_64 ? 54 : 42), 2, big_endian);
+	ph_num = get_int(buffer + (is_64 ? 56 : 44), 2, big_endian);
+
+	if (ph_size < (is_64 ? 56 : 32) || ph_offset > size || ph_num > (size - ph_offset) / ph_size)
+		return MIME_NONE;
+
+	for (i = 0, ph = buffer + ph_offset; i < ph_num; i++, ph += ph_size) {
+		/* the dynamic section starts within the header: libmagic may read the flags */
+		if (get_int(ph, 4, big_endian) == PT_DYNAMIC
+			&& get_int(ph + (is_64 ? 8 : 4), is_64 ? 8 : 4, big_endian) < size)
+			return MIME_NONE;
+	}
+
+	return MIME_ELF_SHAREDLIB;
+}
+
+static enum magic_mime refine_elf(const unsigned char *buffer, size_t size)
+{
+	int is_64, big_endian;
+
+	/* class, data encoding and object type */
+	if (size < 18 || buffer[4] < 1 || buffer[4] > 2 || buffer[5] < 1 || buffer[5] > 2)
+		return MIME_NONE;
+
+	is_64 = buffer[4] == 2;
+	big_endian = buffer[5] == 2;
+
+	switch (get_int(buffer + 16, 2, big_endian)) {
+	case ET_REL:
+		return MIME_ELF_OBJECT;
+	case ET_EXEC:
+		return MIME_ELF_EXECUTABLE;
+	case ET_DYN:
+		return refine_elf_dyn(buffer, size, is_64, big_endian);
+	case ET_CORE:
+		return MIME_ELF_COREDUMP;
+	}
+
+	return MIME_NONE;
+}
+
+static enum magic_mime refine_pe(const unsigned char *buffer, size_t size)
+{
+	unsigned long offset;
+
+	/* MS-DOS header points to the PE header */
+	if (size < 0x40)
+		return MIME_NONE;
+
+	offset = get_le32(buffer + 0x3c);
+	if (offset > size - 4 || memcmp(buffer + offset, "PE\0\0", 4))
+		return MIME_NONE;
+
+	return MIME_PE;
+}
+
+static int zip_entry_has_prefix(const unsigned char *entry, const unsigned char *end, const char *prefix)
+{
+	size_t len = strlen(prefix);
+
+	return entry + 30 <= end
+		&& get_le16(entry + 26) >= len
+		&& entry + 30 + len <= end
+		&& !memcmp(entry + 30, prefix, len);
+}
+
+static enum magic_mime refine_zip(const unsigned char *buffer, size_t size)
+{
+	const unsigned char *end = buffer + size;
+	const unsigned char *p;
+	size_t name_len;
+
+	if (size < 30)
+		return MIME_NONE;
+
+	name_len = get_le16(buffer + 26);
+	if (30 + name_len > size)
+		return MIME_NONE;
+
+	/* ODF and EPUB store their type in the archive, Java and Android archives are told by their content */
+	if (zip_entry_has_prefix(buffer, end, "mimetype")
+		|| zip_entry_has_prefix(buffer, end, "META-INF/")
+		|| zip_entry_has_prefix(buffer, end, "AndroidManifest.xml")
+		|| zip_entry_has_prefix(buffer, end, "classes.dex"))
+		return MIME_NONE;
+
+	if (name_len != 19 || memcmp(buffer + 30, "[Content_Types].xml", 19))
+		return MIME_ZIP;
+
+	/* Office Open XML: the kind of document is given by the directory of the next entries */
+	for (p = buffer + 30; (p = find_bytes(p, end - p, "PK\x03\x04", 4)) != NULL; p += 4) {
+		if (zip_entry_has_prefix(p, end, "word/"))
+			return MIME_DOCX;
+		if (zip_entry_has_prefix(p, end, "xl/"))
+			return MIME_XLSX;
+		if (zip_entry_has_prefix(p, end, "ppt/"))
+			return MIME_PPTX;
+	}
+
+	return MIME_NONE;
+}
+
+static enum magic_mime refine_matroska(const unsigned char *buffer, size_t size)
+{
+	/* DocType element of the EBML header */
+	if (size > 64)
+		size = 64;
+
+	if (find_bytes(buffer, size, "\x42\x82\x88matroska", 11) != NULL)
+		return MIME_MATROSKA;
+	if (find_bytes(buffer, size, "\x42\x82\x84webm", 7) != NULL)
+		return MIME_WEBM;
+
+	return MIME_NONE;
+}
+
+/*
+ * Rules are tried in order, the first match wins, so that a more
+ * specific rule must come before a more general one with the same bytes.
+ */
+static const struct magic_rule rules[] = {
+	/* executables */
+	{ AT(0, "\x7f" "ELF"), NOTHING, 0, MIME_NONE, refine_elf },
+	{ AT(0, "MZ"), NOTHING, 0, MIME_NONE, refine_pe },
+	{ AT(0, "\xfe\xed\xfa\xce"), NOTHING, 0, MIME_MACH_O, NULL },
+	{ AT(0, "\xfe\xed\xfa\xcf"), NOTHING, 0, MIME_MACH_O, NULL },
+	{ AT(0, "\xce\xfa\xed\xfe"), NOTHING, 0, MIME_MACH_O, NULL },
+	{ AT(0, "\xcf\xfa\xed\xfe"), NOTHING, 0, MIME_MACH_O, NULL },
+
+	/* documents and archives */
+	{ AT(0, "%PDF-"), NOTHING, 0, MIME_PDF, NULL },
+	{ AT(0, "PK\x03\x04"), NOTHING, 0, MIME_NONE, refine_zip },
+	{ AT(0, "\x1f\x8b\x08"), NOTHING, 0, MIME_GZIP, NULL },
+	{ AT(0, "BZh"), NOTHING, 0, MIME_BZIP2, NULL },
+	{ AT(0, "\xfd" "7zXZ\0"), NOTHING, 0, MIME_XZ, NULL },
+	{ AT(0, "7z\xbc\xaf\x27\x1c"), NOTHING, 0, MIME_7Z, NULL },
+	{ AT(0, "Rar!\x1a\x07"), NOTHING, 0, MIME_RAR, NULL },
+	{ AT(0, "!<arch>\ndebian-binary"), NOTHING, 0, MIME_DEB, NULL },
+	{ AT(0, "!<arch>\n"), NOTHING, 0, MIME_AR, NULL },
+	{ AT(257, "ustar"), NOTHING, 0, MIME_TAR, NULL },
+
+	/* scripts: libmagic only knows some interpreter paths, not any path to the interpreter */
+	{ AT(0, "#!/bin/sh"), NOTHING, MATCH_WORD, MIME_SHELL, NULL },
+	{ AT(0, "#! /bin/sh"), NOTHING, MATCH_WORD, MIME_SHELL, NULL },
+	{ AT(0, "#!/bin/bash"), NOTHING, MATCH_WORD, MIME_SHELL, NULL },
+	{ AT(0, "#!/usr/bin/bash"), NOTHING, MATCH_WORD, MIME_SHELL, NULL },
+	{ AT(0, "#!/usr/bin/env bash"), NOTHING, MATCH_WORD, MIME_SHELL, NULL },
+	{ AT(0, "#!/bin/ash"), NOTHING, MATCH_WORD, MIME_SHELL, NULL },
+	{ AT(0, "#!/bin/ksh"), NOTHING, MATCH_WORD, MIME_SHELL, NULL },
+	{ AT(0, "#!/bin/zsh"), NOTHING, MATCH_WORD, MIME_SHELL, NULL },
+	{ AT(0, "#!/usr/bin/zsh"), NOTHING, MATCH_WORD, MIME_SHELL, NULL },
+	{ AT(0, "#!/bin/csh"), NOTHING, MATCH_WORD, MIME_SHELL, NULL },
+	{ AT(0, "#!/bin/tcsh"), NOTHING, MATCH_WORD, MIME_SHELL, NULL },
+	{ AT(0, "#!/usr/bin/perl"), NOTHING, MATCH_WORD, MIME_PERL, NULL },
+	{ AT(0, "#!/usr/local/bin/perl"), NOTHING, MATCH_WORD, MIME_PERL, NULL },
+	{ AT(0, "#!/usr/bin/env perl"), NOTHING, MATCH_WORD, MIME_PERL, NULL },
+	{ AT(0, "#!/usr/bin/python"), NOTHING, MATCH_WORD | MATCH_VERSION, MIME_PYTHON, NULL },
+	{ AT(0, "#!/usr/local/bin/python"), NOTHING, MATCH_WORD | MATCH_VERSION, MIME_PYTHON, NULL },
+	{ AT(0, "#!/usr/bin/env python"), NOTHING, MATCH_WORD | MATCH_VERSION, MIME_PYTHON, NULL },
+	{ AT(0, "#! /usr/bin/env python"), NOTHING, MATCH_WORD | MATCH_VERSION, MIME_PYTHON, NULL },
+	{ AT(0, "#!/usr/bin/ruby"), NOTHING, MATCH_WORD, MIME_RUBY, NULL },
+	{ AT(0, "#!/usr/local/bin/ruby"), NOTHING, MATCH_WORD, MIME_RUBY, NULL },
+	{ AT(0, "#!/usr/bin/env ruby"), NOTHING, MATCH_WORD, MIME_RUBY, NULL },
+	{ AT(0, "#!/usr/bin/node"), NOTHING, MATCH_WORD, MIME_JAVASCRIPT, NULL },
+	{ AT(0, "#!/usr/bin/nodejs"), NOTHING, MATCH_WORD, MIME_JAVASCRIPT, NULL },
+	{ AT(0, "#!/usr/bin/env node"), NOTHING, MATCH_WORD, MIME_JAVASCRIPT, NULL },
+	{ AT(0, "#!/usr/bin/php"), NOTHING, MATCH_WORD, MIME_PHP, NULL },
+	{ AT(0, "#!/usr/bin/tclsh"), NOTHING, MATCH_WORD | MATCH_VERSION, MIME_TCL, NULL },
+	{ AT(0, "#!/usr/bin/env tclsh"), NOTHING, MATCH_WORD | MATCH_VERSION, MIME_TCL, NULL },
+	{ AT(0, "#!/usr/bin/lua"), NOTHING, MATCH_WORD, MIME_LUA, NULL },
+	{ AT(0, "#!/usr/bin/env lua"), NOTHING, MATCH_WORD, MIME_LUA, NULL },
+
+	/* images */
+	{ AT(0, "\x89PNG\r\n\x1a\n"), AT(12, "IHDR"), 0, MIME_PNG, NULL },
+	{ AT(0, "GIF87a"), NOTHING, 0, MIME_GIF, NULL },
+	{ AT(0, "GIF89a"), NOTHING, 0, MIME_GIF, NULL },
+	{ AT(0, "\xff\xd8\xff"), NOTHING, 0, MIME_JPEG, NULL },
+	{ AT(0, "II*\0"), NOTHING, 0, MIME_TIFF, NULL },
+	{ AT(0, "MM\0*"), NOTHING, 0, MIME_TIFF, NULL },
+	{ AT(0, "RIFF"), AT(8, "WEBP"), 0, MIME_WEBP, NULL },
+	{ AT(4, "ftypheic"), NOTHING, 0, MIME_HEIC, NULL },
+
+	/* audio and video */
+	{ AT(0, "fLaC"), NOTHING, 0, MIME_FLAC, NULL },
+	{ AT(0, "RIFF"), AT(8, "WAVE"), 0, MIME_WAV, NULL },
+	{ AT(0, "RIFF"), AT(8, "AVI "), 0, MIME_AVI, NULL },
+	{ AT(0, "OggS"), AT(28, "\x01vorbis"), 0, MIME_OGG_AUDIO, NULL },
+	{ AT(0, "OggS"), AT(28, "\x80theora"), 0, MIME_OGG_VIDEO, NULL },
+	{ AT(4, "ftypisom"), NOTHING, 0, MIME_MP4, NULL },
+	{ AT(4, "ftypmp42"), NOTHING, 0, MIME_MP4, NULL },
+	{ AT(4, "ftypM4A "), NOTHING, 0, MIME_M4A, NULL },
+	{ AT(4, "ftypqt  "), NOTHING, 0, MIME_QUICKTIME, NULL },
+	{ AT(0, "\x1a\x45\xdf\xa3"), NOTHING, 0, MIME_NONE, refine_matroska },
+};
+
+#define N_RULES (sizeof(rules) / sizeof(rules[0]))
+
+void mime_magic_init(void)
+{
+	int i;
+
+	/* interned once, so that recognizing a file does not lock the table of interned strings */
+	for (i = 1; i < N_MAGIC_MIMES; i++)
+		interned_mimes[i] = g_intern_static_string(mime_names[i]);
+}
+
+static int match_bytes(const unsigned char *buffer, size_t size, size_t offset, const char *bytes, size_t len)
+{
+	return offset + len <= size
+		&& buffer[offset] == (unsigned char)bytes[0]
+		&& !memcmp(buffer + offset + 1, bytes + 1, len - 1);
+}
+
+static int match_word_end(const unsigned char *buffer, size_t size, size_t pos, int flags)
+{
+	if (flags & MATCH_VERSION)
+		while (pos < size && ((buffer[pos] >= '0' && buffer[pos] <= '9') || buffer[pos] == '.'))
+			pos++;
+
+	return pos == size || buffer[pos] == ' ' || buffer[pos] == '\t' || buffer[pos] == '\r' || buffer[pos] == '\n';
+}
+
+static const struct magic_rule *match_rule(const unsigned char *b, size_t size)
+{
+	const struct magic_rule *r;
+
+	for (r = rules; r < rules + N_RULES; r++) {
+		if (!match_bytes(b, size, r->offset, r->bytes, r->len))
+			continue;
+
+		if (r->len2 != 0 && !match_bytes(b, size, r->offset2, r->bytes2, r->len2))
+			continue;
+
+		if ((r->flags & MATCH_WORD) && !match_word_end(b, size, r->offset + r->len, r->flags))
+			continue;
+
+		return r;
+	}
+
+	return NULL;
+}
+
+const char *mime_magic_guess(const void *buffer, size_t size)
+{
+	const struct magic_rule *r = match_rule(buffer, size);
+	enum magic_mime mime;
+
+	if (r == NULL)
+		return NULL;
+
+	mime = r->refine != NULL ? (*r->refine)(buffer, size) : r->mime;
+
+	/* MIME_NONE gives NULL: a known header that is not classified here is left to libmagic */
+	return interned_mimes[mime];
+}
+
+int mime_magic_n_rules(void)
+{
+	return (int)N_RULES;
+}
+
+int mime_magic_rule(const void *buffer, size_t size)
+{
+	const struct magic_rule *r = match_rule(buffer, size);
+
+	return r != NULL ? (int)(r - rules) : -1;
+}
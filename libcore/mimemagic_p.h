@@ -0,0 +1,63 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+#ifndef LIBCORE_MIMEMAGIC_P_H
+#define LIBCORE_MIMEMAGIC_P_H
+
+#include <stddef.h>
+
+/*
+ * Built-in recognition of the most common file types from their magic
+ * numbers.
+ *
+ * A table of byte sequences at fixed offsets of the file header is
+ * compared to the beginning of the file, a few entries being refined by
+ * looking at header fields (ELF object type, PE header, name of the first
+ * entry of a ZIP archive...). This is much cheaper than libmagic, whose
+ * rules are interpreted for each file, and is used first, libmagic being
+ * called only for the files that are not recognized here.
+ *
+ * Types are named as libmagic names them, so that the mime types of the
+ * scan configurations do not depend on which one recognized the file. As
+ * these names change between libmagic versions, they are the ones of
+ * libmagic MIME_MAGIC_LIBMAGIC_VERSION and must not be used with an older
+ * libmagic. When libmagic would give different types to files with the
+ * same header (ELF shared objects and position independent executables,
+ * ODF documents...), the file is left to libmagic.
+ */
+
+/* version of libmagic, as given by magic_version(), from which types are named */
+#define MIME_MAGIC_LIBMAGIC_VERSION 544
+
+/* must be called once, before any call to mime_magic_guess() */
+void mime_magic_init(void);
+
+/* returns the interned mime type of the file beginning with buffer, NULL if not recognized */
+const char *mime_magic_guess(const void *buffer, size_t size);
+
+/* for tests: the rules are numbered from 0, in the order they are tried */
+int mime_magic_n_rules(void);
+
+/* returns the number of the rule matching the beginning of buffer, -1 if none */
+int mime_magic_rule(const void *buffer, size_t size);
+
+#endif
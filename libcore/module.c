@@ -170,7 +170,7 @@ int module_manager_load_path(struct module_manager *mm, const char *path)
 
 	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "loading modules from directory %s", path);
 
-	ret = os_dir_map(path, 0, module_load_dirent_cb, mm);
+	ret = os_dir_map(path, module_load_dirent_cb, mm);
 
 	return ret;
 }
@@ -269,6 +269,47 @@ int module_manager_configure_all(struct module_manager *mm, struct a6o_conf *con
 	return 0;
 }
 
+struct module_conf_filter {
+	struct module_manager *mm;
+	const char *name;
+	const char **keys;
+};
+
+static int module_conf_filter_key(struct module_conf_filter *filter, const char *key)
+{
+	const char **p;
+
+	if (filter->keys == NULL)
+		return 1;
+
+	for (p = filter->keys; *p != NULL; p++)
+		if (!strcmp(*p, key))
+			return 1;
+
+	return 0;
+}
+
+static void module_conf_filter_fun(const char *section, const char *key, struct a6o_conf_value *value, void *user_data)
+{
+	struct module_conf_filter *filter = (struct module_conf_filter *)user_data;
+
+	if (!strcmp(section, filter->name) && module_conf_filter_key(filter, key))
+		module_conf_fun(section, key, value, filter->mm);
+}
+
+int module_manager_configure_module(struct module_manager *mm, struct a6o_conf *conf, const char *name, const char **keys)
+{
+	struct module_conf_filter filter;
+
+	filter.mm = mm;
+	filter.name = name;
+	filter.keys = keys;
+
+	a6o_conf_apply(conf, module_conf_filter_fun, &filter);
+
+	return 0;
+}
+
 static int module_post_init(struct a6o_module *mod)
 {
 	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "post-initializing module %s", mod->name);
@@ -40,6 +40,9 @@ int module_manager_init_all(struct module_manager *mm);
 
 int module_manager_configure_all(struct module_manager *mm, struct a6o_conf *conf);
 
+/* applies only the section of conf named after the module, restricted to the NULL-terminated keys if not NULL */
+int module_manager_configure_module(struct module_manager *mm, struct a6o_conf *conf, const char *name, const char **keys);
+
 int module_manager_post_init_all(struct module_manager *mm);
 
 int module_manager_close_all(struct module_manager *mm);
@@ -28,19 +28,54 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #include "core/handle.h"
 #include "core/scanctx.h"
 #include "core/io.h"
+#include "core/priority.h"
 #include "core/dir.h"
 #include "core/event.h"
-
+#include "core/info.h"
+#include "core/mount.h"
+
+#include "checkpoint_p.h"
+#include "dirwalk_p.h"
+#include "executor_p.h"
+#include "inodeset_p.h"
+#include "prefetch_p.h"
+#include "scanorder_p.h"
+#include "scanqueue_p.h"
+#include "stage_p.h"
 #include "string_p.h"
+#include "throttle_p.h"
 
 #include <errno.h>
 #include <glib.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #ifdef _WIN32
 #include <Windows.h>
 #endif
 
+/* in threaded scans, files are dispatched by size and file system to scan lanes, each with its own queue and maximum number of threads */
+/* the threads are those of the executor, shared by all the threaded scans */
+enum scan_lane_id {
+	SMALL_FILES_LANE = 0,
+	LARGE_FILES_LANE,
+	REMOTE_FILES_LANE,
+	N_SCAN_LANES
+};
+
+struct scan_lane {
+	struct a6o_on_demand *on_demand;
+	const char *name;
+	struct scan_queue *queue;           /* files waiting to be scanned in this lane */
+	struct executor_source *source;     /* the lane queue, as seen by the executor */
+	struct prefetch *prefetch;          /* reads queued files in advance, NULL if disabled */
+	int n_threads;                      /* maximum number of threads scanning files of this lane */
+	GMutex stats_lock;                  /* protects scanned_files, scanned_bytes and busy_time */
+	int scanned_files;
+	unsigned long long scanned_bytes;
+	gint64 busy_time;                   /* microseconds spent by the threads on files of this lane */
+};
+
 struct a6o_on_demand {
 	struct armadito *armadito;
 	struct a6o_scan_conf *scan_conf;
@@ -49,22 +84,53 @@ struct a6o_on_demand {
 	time_t scan_id;                     /* scan id for client */
 	enum a6o_scan_flags flags;          /* scan flags (recursive, threaded, etc) */
 
-	GThread *count_thread;              /* thread used to count the files to compute progress */
-	GThreadPool *thread_pool;           /* the thread pool if multi-threaded */
+	struct dir_walker *walker;          /* the directory walker, if recursive */
+	struct scan_batch *batch;           /* files found by traversal waiting to be reordered, NULL if not reordered */
+	struct scan_lane lanes[N_SCAN_LANES];  /* the scan lanes, if multi-threaded */
+	struct stage *module_stage;         /* scans the files opened by the lanes, NULL if the lanes scan them */
+	struct stage *report_stage;         /* reports the files scanned by module_stage, NULL if no module_stage */
+	size_t large_file_size;             /* files of this size or more go to the large files lane, 0 if no such lane */
+	size_t max_file_size;
 
 	time_t start_time;                  /* start time in milliseconds */
 	time_t duration;                    /* duration in milliseconds */
 
-	int to_scan_count;                  /* files to scan counter, to compute progress */
+	int discovered_count;               /* files found by traversal, to compute progress */
+	int traversal_done;                 /* if set, discovered_count is the exact count of files to scan */
+	int count_hint;                     /* files to scan estimate available before traversal, or -1 */
 	int scanned_count;                  /* already scanned counter, to compute progress */
+	int cached_count;                   /* files not scanned because their verdict was cached */
+	int too_big_count;                  /* files not scanned because of their size */
+	int duplicate_count;                /* files not scanned because already scanned through another path */
+	int same_content_count;             /* files not scanned because a file with the same content was scanned */
+	struct inode_set *visited;          /* files and directories already visited, if scanning a directory */
+	struct os_mount_table *mounts;      /* file systems of the traversed directories, if scanning a directory */
+	unsigned long long root_dev;        /* device of the scanned directory, for one file system scans */
+	int root_fs_policy;                 /* file system policy of the scanned directory, for non recursive scans */
 	int malware_count;                  /* detected as malicious counter */
 	int suspicious_count;               /* detected as suspicious counter */
 
-	int was_cancelled;
+	volatile int was_cancelled;         /* set by a6o_on_demand_cancel() */
+	time_t cancel_time;                 /* time of cancellation, to measure stop latency */
+	int to_scan_at_cancel;              /* estimate of the files to scan when cancelled, to compute coverage */
+	time_t budget_end_time;             /* time at which the scan is stopped, 0 if no time budget */
+	int budget_exhausted;               /* set if the scan was stopped by its time budget */
+	GMutex lock;                        /* protects walker and lanes queues against concurrent cancellation */
+
+	struct throttle *throttle;          /* rate limits, pause and priority of the scan threads */
+	struct executor_client *executor_client;  /* share of the executor threads, if multi-threaded */
+	int weight;                         /* weight of the scan against other scans in the executor */
 
 	time_t progress_period;
 	time_t last_progress_time;
 	int last_progress_value;
+	GMutex progress_lock;               /* protects last_progress_* */
+
+	char *checkpoint_path;              /* file where scan state is saved, NULL if no checkpoint */
+	time_t checkpoint_period;           /* milliseconds */
+	time_t last_checkpoint_time;
+	GMutex checkpoint_lock;             /* protects last_checkpoint_time and serializes checkpoints */
+	struct checkpoint *resume;          /* checkpoint of an interrupted scan, NULL if new scan */
 };
 
 #ifdef DEBUG
@@ -73,17 +139,31 @@ const char *a6o_scan_conf_debug(struct a6o_scan_conf *c);
 
 #define DEFAULT_PROGRESS_PERIOD 200  /* milliseconds */
 
+static int estimate_to_scan_count(struct a6o_on_demand *on_demand);
+
+/* scans with a lower nice value get a larger share of the executor threads: */
+/* from 1 for nice 19 to 20 for nice 0, the nice value of a scan being limited to 0..19 */
+static int scan_weight(const struct a6o_scan_limits *limits)
+{
+	return 20 - limits->nice;
+}
+
 struct a6o_on_demand *a6o_on_demand_new(struct armadito *armadito, const char *root_path, time_t scan_id, enum a6o_scan_flags flags, int send_progress)
 {
 	struct a6o_on_demand *on_demand = (struct a6o_on_demand *)malloc(sizeof(struct a6o_on_demand));
+	static const char *lane_names[N_SCAN_LANES] = { "small files", "large files", "remote files" };
+	struct a6o_scan_limits limits;
+	int i;
 
 	on_demand->armadito = armadito;
-	on_demand->scan_conf = a6o_scan_conf_on_demand();
+	/* the scan keeps the configuration it started with, even if it is reloaded */
+	on_demand->scan_conf = a6o_scan_conf_acquire_on_demand();
 
 #ifdef HAVE_REALPATH
 	on_demand->root_path = (const char *)realpath(root_path, NULL);
 	if (on_demand->root_path == NULL) {
 		perror("realpath");
+		a6o_scan_conf_release(on_demand->scan_conf);
 		free(on_demand);
 		return NULL;
 	}
@@ -93,15 +173,53 @@ struct a6o_on_demand *a6o_on_demand_new(struct armadito *armadito, const char *r
 	on_demand->scan_id = scan_id;
 	on_demand->flags = flags;
 
-	on_demand->count_thread = NULL;
-	on_demand->thread_pool = NULL;
-
-	on_demand->to_scan_count = 0;
+	on_demand->walker = NULL;
+	on_demand->batch = NULL;
+	for (i = 0; i < N_SCAN_LANES; i++) {
+		struct scan_lane *lane = &on_demand->lanes[i];
+
+		lane->on_demand = on_demand;
+		lane->name = lane_names[i];
+		lane->queue = NULL;
+		lane->source = NULL;
+		lane->prefetch = NULL;
+		lane->n_threads = 0;
+		g_mutex_init(&lane->stats_lock);
+		lane->scanned_files = 0;
+		lane->scanned_bytes = 0;
+		lane->busy_time = 0;
+	}
+	on_demand->module_stage = NULL;
+	on_demand->report_stage = NULL;
+	on_demand->large_file_size = 0;
+	on_demand->max_file_size = a6o_scan_conf_get_max_file_size(on_demand->scan_conf);
+
+	on_demand->discovered_count = 0;
+	on_demand->traversal_done = 0;
+	on_demand->count_hint = -1;
 	on_demand->scanned_count = 0;
+	on_demand->cached_count = 0;
+	on_demand->too_big_count = 0;
+	on_demand->duplicate_count = 0;
+	on_demand->same_content_count = 0;
+	on_demand->visited = NULL;
+	on_demand->mounts = NULL;
+	on_demand->root_dev = 0;
+	on_demand->root_fs_policy = A6O_FS_POLICY_SCAN;
 	on_demand->malware_count = 0;
 	on_demand->suspicious_count = 0;
 
 	on_demand->was_cancelled = 0;
+	on_demand->cancel_time = 0L;
+	on_demand->to_scan_at_cancel = 0;
+	on_demand->budget_end_time = 0;
+	on_demand->budget_exhausted = 0;
+	g_mutex_init(&on_demand->lock);
+
+	a6o_scan_conf_get_limits(on_demand->scan_conf, &limits);
+	on_demand->throttle = throttle_new(&limits);
+	on_demand->executor_client = NULL;
+	on_demand->weight = scan_weight(&limits);
 
 	if (send_progress)
 		on_demand->progress_period = DEFAULT_PROGRESS_PERIOD;
@@ -109,29 +227,68 @@ struct a6o_on_demand *a6o_on_demand_new(struct armadito *armadito, const char *r
 		on_demand->progress_period = 0;
 	on_demand->last_progress_time = 0L;
 	on_demand->last_progress_value = A6O_ON_DEMAND_PROGRESS_UNKNOWN;
+	g_mutex_init(&on_demand->progress_lock);
+
+	/* only recursive scans are long enough to need checkpoints */
+	on_demand->checkpoint_path = NULL;
+	on_demand->checkpoint_period = 1000L * a6o_scan_conf_get_checkpoint_interval(on_demand->scan_conf);
+	on_demand->last_checkpoint_time = 0L;
+	g_mutex_init(&on_demand->checkpoint_lock);
+	on_demand->resume = NULL;
+
+	if ((flags & A6O_SCAN_RECURSE)
+		&& on_demand->checkpoint_period > 0
+		&& a6o_scan_conf_get_checkpoint_dir(on_demand->scan_conf) != NULL)
+		on_demand->checkpoint_path = checkpoint_file_path(a6o_scan_conf_get_checkpoint_dir(on_demand->scan_conf), scan_id);
 
 	return on_demand;
 }
 
-time_t a6o_on_demand_get_id(struct a6o_on_demand *on_demand)
+struct a6o_on_demand *a6o_on_demand_resume(struct armadito *armadito, time_t scan_id, int send_progress)
 {
-	return on_demand->scan_id;
-}
+	struct a6o_scan_conf *scan_conf = a6o_scan_conf_acquire_on_demand();
+	struct a6o_on_demand *on_demand;
+	struct checkpoint *c = NULL;
+	char *path;
+
+	if (a6o_scan_conf_get_checkpoint_dir(scan_conf) != NULL) {
+		path = checkpoint_file_path(a6o_scan_conf_get_checkpoint_dir(scan_conf), scan_id);
+		c = checkpoint_load(path);
+		g_free(path);
+	}
 
-void a6o_on_demand_cancel(struct a6o_on_demand *on_demand)
-{
-  a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "-- on_demand_cancel call !");
+	a6o_scan_conf_release(scan_conf);
 
-  /* to be reimplemented cleanly */
-}
+	if (c == NULL)
+		return NULL;
 
-static int a6o_on_demand_is_cancelled(struct a6o_on_demand *on_demand)
-{
- // a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cancel = %d", cancel);
+	on_demand = a6o_on_demand_new(armadito, c->root_path, scan_id, c->flags, send_progress);
+	if (on_demand == NULL) {
+		checkpoint_free(c);
+		return NULL;
+	}
 
-  /* to be reimplemented cleanly */
+	/* files in the directories that were being listed or scanned will be counted twice */
+	on_demand->scanned_count = c->scanned_count;
+	on_demand->discovered_count = c->scanned_count;
+	on_demand->malware_count = c->malware_count;
+	on_demand->suspicious_count = c->suspicious_count;
+	on_demand->cached_count = c->cached_count;
+	on_demand->too_big_count = c->too_big_count;
+	on_demand->resume = c;
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "resuming scan %ld of %s: %d files already scanned, %d directories remaining",
+		scan_id,
+		on_demand->root_path,
+		c->scanned_count,
+		c->frontier->len);
+
+	return on_demand;
+}
 
-  return 0;
+time_t a6o_on_demand_get_id(struct a6o_on_demand *on_demand)
+{
+	return on_demand->scan_id;
 }
 
 static void update_counters(struct a6o_on_demand *on_demand, struct a6o_report *report)
@@ -178,6 +335,73 @@ static time_t get_milliseconds( )
 }
 #endif
 
+/* cancellation is cooperative: traversal is stopped, files waiting in the scan queue are discarded, */
+/* and the files being scanned are interrupted before their next module */
+void a6o_on_demand_cancel(struct a6o_on_demand *on_demand)
+{
+	int i;
+
+	if (!g_atomic_int_compare_and_exchange(&on_demand->was_cancelled, 0, 1))
+		return;
+
+	on_demand->cancel_time = get_milliseconds();
+	on_demand->to_scan_at_cancel = estimate_to_scan_count(on_demand);
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "cancelling scan %ld", on_demand->scan_id);
+
+	g_mutex_lock(&on_demand->lock);
+
+	if (on_demand->walker != NULL)
+		dir_walker_stop(on_demand->walker);
+
+	for (i = 0; i < N_SCAN_LANES; i++)
+		if (on_demand->lanes[i].queue != NULL)
+			scan_queue_discard(on_demand->lanes[i].queue);
+
+	g_mutex_unlock(&on_demand->lock);
+
+	/* paused or throttled threads must see the cancellation now */
+	throttle_wake(on_demand->throttle);
+}
+
+void a6o_on_demand_set_limits(struct a6o_on_demand *on_demand, const struct a6o_scan_limits *limits)
+{
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "scan %ld limits: %lu bytes/s, %d files/s, I/O class %d, nice %d%s",
+		on_demand->scan_id,
+		(unsigned long)limits->bytes_per_second,
+		limits->files_per_second,
+		limits->io_class,
+		limits->nice,
+		limits->idle_only ? ", idle only" : "");
+
+	throttle_set_limits(on_demand->throttle, limits);
+
+	g_mutex_lock(&on_demand->lock);
+	on_demand->weight = scan_weight(limits);
+	if (on_demand->executor_client != NULL) {
+		executor_client_set_weight(on_demand->executor_client, on_demand->weight);
+		executor_client_wake(on_demand->executor_client);
+	}
+	g_mutex_unlock(&on_demand->lock);
+}
+
+void a6o_on_demand_pause(struct a6o_on_demand *on_demand, int paused)
+{
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "%s scan %ld", paused ? "pausing" : "continuing", on_demand->scan_id);
+
+	throttle_pause(on_demand->throttle, paused);
+
+	g_mutex_lock(&on_demand->lock);
+	if (on_demand->executor_client != NULL)
+		executor_client_wake(on_demand->executor_client);
+	g_mutex_unlock(&on_demand->lock);
+}
+
+static int a6o_on_demand_is_cancelled(struct a6o_on_demand *on_demand)
+{
+	return g_atomic_int_get(&on_demand->was_cancelled);
+}
+
 static int must_send_progress_event(struct a6o_on_demand *on_demand, struct a6o_report *report, int progress, time_t now)
 {
 	if (report->path == NULL)
@@ -198,10 +422,30 @@ static int must_send_progress_event(struct a6o_on_demand *on_demand, struct a6o_
 	return 0;
 }
 
+/* stage may be NULL, if the scan is not split in stages */
+static void get_stage_progress(struct stage *stage, int *utilization, size_t *queued, size_t *inline_count)
+{
+	struct stage_stats stats;
+
+	if (stage == NULL) {
+		*utilization = -1;
+		*queued = 0;
+		*inline_count = 0;
+		return;
+	}
+
+	stage_get_stats(stage, &stats);
+	*utilization = stage_stats_utilization(&stats);
+	*queued = stats.queued;
+	*inline_count = stats.inline_items;
+}
+
 static void fire_progress_event(struct a6o_on_demand *on_demand, struct a6o_report *report, int progress)
 {
 	struct a6o_on_demand_progress_event progress_ev;
 	struct a6o_event *ev;
+	struct scan_queue_stats queue_stats;
+	int i;
 
 	/* should strdup? */
 	progress_ev.path = report->path;
@@ -211,28 +455,111 @@ static void fire_progress_event(struct a6o_on_demand *on_demand, struct a6o_repo
 	progress_ev.suspicious_count = on_demand->suspicious_count;
 	progress_ev.scanned_count = on_demand->scanned_count;
 
+	/* scan threads are the only ones to fire progress events while the executor client exists */
+	progress_ev.thread_share = on_demand->executor_client != NULL ? executor_client_get_share(on_demand->executor_client) : -1;
+
+	progress_ev.queued_count = 0;
+	progress_ev.queued_bytes = 0;
+	for (i = 0; i < N_SCAN_LANES; i++)
+		if (on_demand->lanes[i].queue != NULL) {
+			scan_queue_get_stats(on_demand->lanes[i].queue, &queue_stats);
+			progress_ev.queued_count += queue_stats.count;
+			progress_ev.queued_bytes += queue_stats.bytes;
+		}
+
+	get_stage_progress(on_demand->module_stage, &progress_ev.module_stage_utilization,
+		&progress_ev.module_stage_queued, &progress_ev.module_stage_inline);
+	get_stage_progress(on_demand->report_stage, &progress_ev.report_stage_utilization,
+		&progress_ev.report_stage_queued, &progress_ev.report_stage_inline);
+
 	ev = a6o_event_new(EVENT_ON_DEMAND_PROGRESS, &progress_ev);
 
 	a6o_event_source_fire_event(a6o_get_event_source(on_demand->armadito), ev);
 	a6o_event_free(ev);
 }
 
+/* files count of previous scans, by root path, to seed progress estimation of next scans */
+static GHashTable *previous_counts = NULL;
+G_LOCK_DEFINE_STATIC(previous_counts);
+
+static int get_previous_count(const char *root_path)
+{
+	gpointer value = NULL;
+
+	G_LOCK(previous_counts);
+	if (previous_counts != NULL)
+		value = g_hash_table_lookup(previous_counts, root_path);
+	G_UNLOCK(previous_counts);
+
+	return value != NULL ? GPOINTER_TO_INT(value) - 1 : -1;
+}
+
+static void set_previous_count(const char *root_path, int count)
+{
+	G_LOCK(previous_counts);
+	if (previous_counts == NULL)
+		previous_counts = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+	/* store count + 1, so that a count of 0 is not a NULL value */
+	g_hash_table_replace(previous_counts, os_strdup(root_path), GINT_TO_POINTER(count + 1));
+	G_UNLOCK(previous_counts);
+}
+
+/* the estimate is computed from the traversal itself: files already found, plus the files expected */
+/* in the directories not yet listed, assuming they contain as many files as the already listed ones */
+/* before traversal has gone far enough, the hint given by previous scan or by the file system is used */
+static int estimate_to_scan_count(struct a6o_on_demand *on_demand)
+{
+	struct dir_walker *walker = g_atomic_pointer_get(&on_demand->walker);
+	struct dir_walker_stats stats;
+	int estimate;
+
+	estimate = g_atomic_int_get(&on_demand->discovered_count);
+
+	if (g_atomic_int_get(&on_demand->traversal_done))
+		return estimate;
+
+	if (walker != NULL) {
+		dir_walker_get_stats(walker, &stats);
+
+		if (stats.listed_dirs > 0)
+			estimate += (int)(((double)estimate * stats.pending_dirs) / stats.listed_dirs);
+	}
+
+	if (on_demand->count_hint > estimate)
+		estimate = on_demand->count_hint;
+
+	return estimate;
+}
+
 static void update_progress(struct a6o_on_demand *on_demand, struct a6o_report *report)
 {
-	int progress;
+	int progress, to_scan_count;
 	time_t now;
 
 	if (on_demand->progress_period == 0)
 		return;
 
-	if (on_demand->to_scan_count == 0)
+	to_scan_count = estimate_to_scan_count(on_demand);
+
+	if (to_scan_count == 0)
 		return;
 
-	progress = (int)((100.0 * on_demand->scanned_count) / on_demand->to_scan_count);
+	progress = (int)((100.0 * g_atomic_int_get(&on_demand->scanned_count)) / to_scan_count);
 
-	if (progress > 100)
+	/* only the exact count known when traversal is done allows to reach 100% */
+	if (!g_atomic_int_get(&on_demand->traversal_done) && progress > 99)
+		progress = 99;
+	else if (progress > 100)
 		progress = 100;
 
+	/* if another scan thread is updating progress, there is no need to do it twice */
+	if (!g_mutex_trylock(&on_demand->progress_lock))
+		return;
+
+	/* estimate can grow during traversal, but progress must not go backward */
+	if (progress < on_demand->last_progress_value)
+		progress = on_demand->last_progress_value;
+
 	now = get_milliseconds();
 
 	if (must_send_progress_event(on_demand, report, progress, now)) {
@@ -240,6 +567,24 @@ static void update_progress(struct a6o_on_demand *on_demand, struct a6o_report *
 		on_demand->last_progress_time = now;
 		on_demand->last_progress_value = progress;
 	}
+
+	g_mutex_unlock(&on_demand->progress_lock);
+}
+
+/* once its time budget is spent, the scan is stopped like a cancelled scan */
+static void check_time_budget(struct a6o_on_demand *on_demand)
+{
+	if (on_demand->budget_end_time == 0 || get_milliseconds() < on_demand->budget_end_time)
+		return;
+
+	if (!g_atomic_int_compare_and_exchange(&on_demand->budget_exhausted, 0, 1))
+		return;
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "scan %ld time budget of %d s spent",
+		on_demand->scan_id,
+		a6o_scan_conf_get_time_budget(on_demand->scan_conf));
+
+	a6o_on_demand_cancel(on_demand);
 }
 
 static void fire_detection_event(struct a6o_on_demand *on_demand, struct a6o_report *report)
@@ -255,6 +600,7 @@ static void fire_detection_event(struct a6o_on_demand *on_demand, struct a6o_rep
 	detection_ev.scan_action = report->action;
 	detection_ev.module_name = report->module_name;
 	detection_ev.module_report = report->module_report;
+	detection_ev.digest = report->digest != NULL ? report->digest : "";
 
 	ev = a6o_event_new(EVENT_DETECTION, &detection_ev);
 
@@ -276,13 +622,29 @@ static void fire_on_demand_start_event(struct a6o_on_demand *on_demand)
 	a6o_event_free(ev);
 }
 
+/* percentage of the files to scan that were scanned */
+/* a stopped scan does not know exactly how many files it would have scanned: the count is estimated when it is stopped */
+static int scan_coverage(struct a6o_on_demand *on_demand)
+{
+	int coverage;
+
+	if (!on_demand->was_cancelled || on_demand->to_scan_at_cancel <= 0)
+		return 100;
+
+	coverage = (int)((100.0 * on_demand->scanned_count) / on_demand->to_scan_at_cancel);
+
+	return coverage > 100 ? 100 : coverage;
+}
+
 static void fire_on_demand_completed_event(struct a6o_on_demand *on_demand)
 {
 	struct a6o_on_demand_completed_event completed_ev;
 	struct a6o_event *ev;
 
 	completed_ev.scan_id = on_demand->scan_id;
-	completed_ev.cancelled = on_demand->was_cancelled;
+	completed_ev.cancelled = on_demand->was_cancelled && !on_demand->budget_exhausted;
+	completed_ev.budget_exhausted = on_demand->budget_exhausted;
+	completed_ev.coverage = scan_coverage(on_demand);
 	completed_ev.total_malware_count = on_demand->malware_count;
 	completed_ev.total_suspicious_count = on_demand->suspicious_count;
 	completed_ev.total_scanned_count = on_demand->scanned_count;
@@ -313,154 +675,778 @@ static void process_error(struct a6o_on_demand *on_demand, const char *path, int
 #endif
 }
 
-static void scan_file(struct a6o_on_demand *on_demand, const char *path)
+/* the frontier of the walker includes the directories whose files are not all scanned: */
+/* they are counted in the walker directories, from scan_entry() to job_report() */
+static void save_checkpoint(struct a6o_on_demand *on_demand, struct dir_walker *walker)
 {
-	struct a6o_scan_context file_context;
-	enum a6o_scan_context_status context_status;
-	struct a6o_report report;
+	struct checkpoint c;
 
-	a6o_report_init(&report, path);
+	c.root_path = (char *)on_demand->root_path;
+	c.flags = on_demand->flags;
+	c.frontier = dir_walker_get_frontier(walker);
 
-	context_status = a6o_scan_context_get(&file_context, -1, path, on_demand->scan_conf, &report);
+	c.scanned_count = g_atomic_int_get(&on_demand->scanned_count);
+	c.malware_count = g_atomic_int_get(&on_demand->malware_count);
+	c.suspicious_count = g_atomic_int_get(&on_demand->suspicious_count);
+	c.cached_count = g_atomic_int_get(&on_demand->cached_count);
+	c.too_big_count = g_atomic_int_get(&on_demand->too_big_count);
 
-	if (context_status == A6O_SC_MUST_SCAN)
-		a6o_scan_context_scan(&file_context, &report);
-	else if (context_status == A6O_SC_FILE_OPEN_ERROR)
-		process_error(on_demand, report.path, errno);
+	if (checkpoint_save(&c, on_demand->checkpoint_path) == 0)
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "scan %ld checkpoint: %d files scanned, %d directories remaining",
+			on_demand->scan_id,
+			c.scanned_count,
+			c.frontier->len);
 
-	if ((report.status == A6O_FILE_MALWARE || report.status == A6O_FILE_SUSPICIOUS)
-		&& report.path != NULL)
-		fire_detection_event(on_demand, &report);
+	g_ptr_array_free(c.frontier, TRUE);
+}
 
-	/* update counters */
-	update_counters(on_demand, &report);
+static void update_checkpoint(struct a6o_on_demand *on_demand)
+{
+	struct dir_walker *walker;
+	time_t now;
 
-	/* update progress */
-	update_progress(on_demand, &report);
+	if (on_demand->checkpoint_path == NULL)
+		return;
 
-	a6o_scan_context_destroy(&file_context);
-	a6o_report_destroy(&report);
+	now = get_milliseconds();
+
+	/* if another thread is saving a checkpoint, there is no need to do it twice */
+	if (!g_mutex_trylock(&on_demand->checkpoint_lock))
+		return;
+
+	if (on_demand->last_checkpoint_time == 0)
+		on_demand->last_checkpoint_time = now;
+
+	walker = g_atomic_pointer_get(&on_demand->walker);
+
+	if (now - on_demand->last_checkpoint_time >= on_demand->checkpoint_period
+		&& walker != NULL
+		&& !a6o_on_demand_is_cancelled(on_demand)) {
+		save_checkpoint(on_demand, walker);
+		on_demand->last_checkpoint_time = now;
+	}
+
+	g_mutex_unlock(&on_demand->checkpoint_lock);
 }
 
-/* the thread function called by the thread pool, in case of threaded scan */
-static void scan_entry_thread_fun(gpointer data, gpointer user_data)
+/* only verdicts that depend on the file content alone can be given to the other paths of the file */
+/* malware and suspicious files are scanned again, so that each path gets a complete report */
+static int verdict_is_reusable(enum a6o_scan_context_status context_status, enum a6o_file_status status)
 {
-	struct a6o_on_demand *on_demand = (struct a6o_on_demand *)user_data;
-	char *path = (char *)data;
+	if (context_status != A6O_SC_MUST_SCAN
+		&& context_status != A6O_SC_FILE_CACHED
+		&& context_status != A6O_SC_FILE_TYPE_NOT_SCANNED)
+		return 0;
 
-#ifdef _WIN32
-	void * OldValue = NULL;
-	if (Wow64DisableWow64FsRedirection(&OldValue) == FALSE) {
+	return status == A6O_FILE_CLEAN || status == A6O_FILE_UNKNOWN_TYPE || status == A6O_FILE_WHITE_LISTED;
+}
+
+/* a file found by traversal is opened relative to its directory, without resolving its path again */
+static int open_file(struct a6o_on_demand *on_demand, struct walk_dir *dir, const char *path)
+{
+	return os_file_open_at(walk_dir_get_fd(dir), path, a6o_scan_conf_get_cache_neutral(on_demand->scan_conf) != A6O_CACHE_NEUTRAL_OFF);
+}
+
+/* a file being scanned, going through the open, module scan and report steps */
+/* the steps run in sequence in the same thread or, if the scan has stages, in the threads of each stage */
+struct scan_job {
+	struct a6o_on_demand *on_demand;
+	struct a6o_report report;
+	struct a6o_scan_context context;
+	enum a6o_scan_context_status context_status;
+	int has_context;                    /* set if context must be destroyed */
+	struct os_file_stat stat_buf;
+	struct walk_dir *dir;               /* directory of the file, referenced until the report if its files are counted for checkpoints */
+	int first_visit;                    /* set if this is the first path of the file, whose verdict is recorded for the other paths */
+	int open_errno;                     /* error of the scan context, if it cannot open the file */
+	size_t scanned_bytes;
+};
+
+/* opens the file and finds whether and how it must be scanned */
+/* fd, if not -1, is the file already opened in advance and is closed with the scan context */
+/* dir, if not NULL, is the directory of the file, as found by traversal */
+static void job_open(struct scan_job *job, struct a6o_on_demand *on_demand, int fd, struct walk_dir *dir, const char *path)
+{
+	int stat_errno;
+	int visited = INODE_SET_ADDED;
+
+	job->on_demand = on_demand;
+	job->dir = on_demand->checkpoint_path != NULL ? walk_dir_ref(dir) : NULL;
+	job->has_context = 0;
+	job->context_status = A6O_SC_FILE_OPEN_ERROR;
+	job->first_visit = 0;
+	job->scanned_bytes = 0;
+	job->open_errno = 0;
+
+	a6o_report_init(&job->report, path);
+
+	/* the file is opened only once: its identity is taken from the descriptor, which is then given to the scan context */
+	/* if the open fails, the scan context opens it again and reports the error */
+	if (fd < 0 && path != NULL && !a6o_scan_conf_is_white_listed(on_demand->scan_conf, path))
+		fd = open_file(on_demand, dir, path);
+
+	/* a file already scanned through another path (hard link, bind mount) gets the same verdict */
+	/* if its first path is still being scanned, its verdict is not known yet and it is scanned again */
+	if (on_demand->visited != NULL && fd >= 0 && os_file_stat_fd(fd, &job->stat_buf, &stat_errno) == 0) {
+		visited = inode_set_add(on_demand->visited, job->stat_buf.dev, job->stat_buf.inode);
+		if (visited == INODE_SET_ADDED)
+			job->first_visit = 1;
+	}
+
+	if (visited > 0) {
+		a6o_report_change(&job->report, (enum a6o_file_status)visited, NULL, NULL);
+		g_atomic_int_inc(&on_demand->duplicate_count);
+		os_close(fd);
 		return;
 	}
-#endif
 
-	/* must check cancellation */
-	scan_file(on_demand, path);
+	job->context_status = a6o_scan_context_get(&job->context, fd, path, on_demand->scan_conf, &job->report);
+	job->open_errno = errno;
+	job->context.cancelled = &on_demand->was_cancelled;
+	job->has_context = 1;
+}
+
+/* applies the modules, if the file must be scanned */
+static void job_scan(struct scan_job *job)
+{
+	struct a6o_on_demand *on_demand = job->on_demand;
 
-	/* path was strdup'ed, so free it */
-	free(path);
+	if (!job->has_context || job->context_status != A6O_SC_MUST_SCAN)
+		return;
 
-#ifdef _WIN32
-	if (Wow64RevertWow64FsRedirection(OldValue) == FALSE ){
+	/* files queued between stages are not scanned after cancellation, but still reported */
+	if (a6o_on_demand_is_cancelled(on_demand))
 		return;
+
+	a6o_scan_context_scan(&job->context, &job->report);
+	if (job->context.same_content)
+		g_atomic_int_inc(&on_demand->same_content_count);
+	if (!(job->context.file_stat.flags & FILE_FLAG_IS_ERROR))
+		job->scanned_bytes = job->context.file_stat.file_size;
+
+	/* the file is not needed anymore: close it now rather than after the report */
+	a6o_scan_context_close(&job->context);
+}
+
+/* records the verdict and notifies it */
+static void job_report(struct scan_job *job)
+{
+	struct a6o_on_demand *on_demand = job->on_demand;
+	struct a6o_report *report = &job->report;
+
+	if (job->has_context) {
+		if (job->context_status == A6O_SC_FILE_CACHED)
+			g_atomic_int_inc(&on_demand->cached_count);
+		else if (job->context_status == A6O_SC_FILE_TOO_BIG)
+			g_atomic_int_inc(&on_demand->too_big_count);
+		else if (job->context_status == A6O_SC_FILE_OPEN_ERROR)
+			process_error(on_demand, report->path, job->open_errno);
+
+		if (job->first_visit
+			&& !a6o_on_demand_is_cancelled(on_demand)
+			&& verdict_is_reusable(job->context_status, report->status))
+			inode_set_set_value(on_demand->visited, job->stat_buf.dev, job->stat_buf.inode, report->status);
+
+		a6o_scan_context_destroy(&job->context);
 	}
-#endif
+
+	if ((report->status == A6O_FILE_MALWARE || report->status == A6O_FILE_SUSPICIOUS)
+		&& report->path != NULL)
+		fire_detection_event(on_demand, report);
+
+	/* update counters */
+	update_counters(on_demand, report);
+
+	/* update progress */
+	update_progress(on_demand, report);
+
+	walk_dir_file_done(job->dir);
+	walk_dir_unref(job->dir);
+
+	update_checkpoint(on_demand);
+
+	check_time_budget(on_demand);
+
+	a6o_report_destroy(report);
+
+	throttle_account(on_demand->throttle, job->scanned_bytes);
 }
 
-/* scan one entry of the directory traversal */
-/* entry can be either a directory, a file or anything else */
-/* we scan only plain files, but also signal errors */
-static int scan_entry(const char *full_path, enum os_file_flag flags, int entry_errno, void *data)
+/* returns the number of bytes scanned, 0 if the file was not scanned */
+/* the caller must have obtained the right to scan from the throttle, either by waiting or through the executor */
+/* fd, if not -1, is the file already opened in advance and is closed by the scan */
+static size_t scan_file(struct a6o_on_demand *on_demand, int fd, struct walk_dir *dir, const char *path)
+{
+	struct scan_job job;
+
+	throttle_apply_priority(on_demand->throttle);
+
+	job_open(&job, on_demand, fd, dir, path);
+	job_scan(&job);
+	job_report(&job);
+
+	return job.scanned_bytes;
+}
+
+/* the module scan stage function: scans the file and hands it to the report stage */
+static void module_stage_job(void *item, void *data)
 {
+	struct scan_job *job = (struct scan_job *)item;
 	struct a6o_on_demand *on_demand = (struct a6o_on_demand *)data;
-	int canceled = a6o_on_demand_is_cancelled(on_demand);
 
-	if (canceled){
-		//a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "scan canceled on path %s", full_path);
-		return 2;
+	throttle_apply_priority(on_demand->throttle);
+
+	job_scan(job);
+
+	stage_push(on_demand->report_stage, job);
+}
+
+/* the report stage function */
+static void report_stage_job(void *item, void *data)
+{
+	struct scan_job *job = (struct scan_job *)item;
+
+	job_report(job);
+
+	free(job);
+}
+
+/* opens the file and hands it to the module scan stage, or directly to the report stage if it must not be scanned */
+/* if the next stage is full, this thread does its work, so that files cannot be opened too far ahead of their scan */
+/* returns the number of bytes to be scanned, for the executor accounting */
+static size_t stage_file(struct a6o_on_demand *on_demand, int fd, struct walk_dir *dir, const char *path)
+{
+	struct scan_job *job = malloc(sizeof(struct scan_job));
+	size_t file_size;
+
+	throttle_apply_priority(on_demand->throttle);
+
+	job_open(job, on_demand, fd, dir, path);
+
+	if (job->has_context && job->context_status == A6O_SC_MUST_SCAN) {
+		file_size = (job->context.file_stat.flags & FILE_FLAG_IS_ERROR) ? 0 : job->context.file_stat.file_size;
+		stage_push(on_demand->module_stage, job);
+		return file_size;
 	}
 
-	if (flags & FILE_FLAG_IS_ERROR) {
-		process_error(on_demand, full_path, entry_errno);
-		return 1;
+	stage_push(on_demand->report_stage, job);
+
+	return 0;
+}
+
+/* large files go to their own lane, so that they cannot delay the scan of small files */
+/* the size is taken from the opened file by the scan thread, so that traversal does not stat each file */
+/* and the file scanned is the one whose size was checked */
+/* files over the maximum size are rejected without being read, so they stay in the small files lane */
+/* returns 1 if the file was moved to the large files lane, 0 if it is scanned here with *pfd opened if possible */
+static int move_to_large_lane(struct scan_lane *lane, int *pfd, struct walk_dir *dir, const char *path)
+{
+	struct a6o_on_demand *on_demand = lane->on_demand;
+	struct os_file_stat stat_buf;
+	int stat_errno;
+
+	if (lane != &on_demand->lanes[SMALL_FILES_LANE] || on_demand->large_file_size == 0)
+		return 0;
+
+	if (*pfd < 0 && !a6o_scan_conf_is_white_listed(on_demand->scan_conf, path))
+		*pfd = open_file(on_demand, dir, path);
+
+	if (*pfd < 0
+		|| os_file_stat_fd(*pfd, &stat_buf, &stat_errno) != 0
+		|| stat_buf.file_size < on_demand->large_file_size
+		|| (on_demand->max_file_size != 0 && stat_buf.file_size >= on_demand->max_file_size))
+		return 0;
+
+	/* a scan thread must not wait for room in a queue drained by the scan threads: */
+	/* if the large files lane is full, the file is scanned here */
+	if (scan_queue_try_push(on_demand->lanes[LARGE_FILES_LANE].queue, path, dir) != 0)
+		return 0;
+
+	/* the large files lane opens it again, relative to its directory */
+	os_close(*pfd);
+	*pfd = -1;
+
+	return 1;
+}
+
+/* the executor function, in case of threaded scan */
+/* called by the executor threads for each file of the lane queue */
+static size_t scan_lane_file(const char *path, void *data)
+{
+	struct scan_lane *lane = (struct scan_lane *)data;
+	struct a6o_on_demand *on_demand = lane->on_demand;
+	size_t scanned_bytes;
+	gint64 start_time;
+	int fd = -1;
+
+	if (a6o_on_demand_is_cancelled(on_demand))
+		return 0;
+
+	start_time = g_get_monotonic_time();
+
+	if (lane->prefetch != NULL) {
+		fd = prefetch_take(lane->prefetch, scan_queue_get_serial(path));
+		prefetch_ahead(lane->prefetch);
 	}
 
-	if (!(flags & FILE_FLAG_IS_PLAIN_FILE))
-		return 1;
+	if (move_to_large_lane(lane, &fd, scan_queue_get_dir(path), path))
+		return 0;
+
+	/* large files keep being scanned by their lane, whose few threads bound how many of them are read at once */
+	if (on_demand->module_stage != NULL && lane != &on_demand->lanes[LARGE_FILES_LANE])
+		scanned_bytes = stage_file(on_demand, fd, scan_queue_get_dir(path), path);
+	else
+		scanned_bytes = scan_file(on_demand, fd, scan_queue_get_dir(path), path);
+
+	g_mutex_lock(&lane->stats_lock);
+	lane->scanned_files++;
+	lane->scanned_bytes += scanned_bytes;
+	lane->busy_time += g_get_monotonic_time() - start_time;
+	g_mutex_unlock(&lane->stats_lock);
+
+	return scanned_bytes;
+}
+
+/* called by the executor, with its lock held, before it scans a file of this scan */
+static gint64 acquire_file(void *data)
+{
+	struct a6o_on_demand *on_demand = (struct a6o_on_demand *)data;
+
+	return throttle_try_acquire(on_demand->throttle, &on_demand->was_cancelled);
+}
+
+/* queue a file to be scanned by the scan threads */
+/* files go to the small files lane, whose threads move the large ones to their lane once opened */
+/* blocks if the lane queue is full, so that directory traversal cannot run too far ahead of scan */
+static void queue_file(struct a6o_on_demand *on_demand, const char *path, struct walk_dir *dir)
+{
+	scan_queue_push(on_demand->lanes[SMALL_FILES_LANE].queue, path, dir);
+}
+
+/* if scan is multi thread, just queue the scan to the thread pool, otherwise do it here */
+static void dispatch_file(const char *path, struct walk_dir *dir, void *data)
+{
+	struct a6o_on_demand *on_demand = (struct a6o_on_demand *)data;
+
+	/* a batch of reordered files can be dispatched after cancellation */
+	check_time_budget(on_demand);
+	if (a6o_on_demand_is_cancelled(on_demand))
+		return;
 
-	/* if scan is multi thread, just queue the scan to the thread pool, otherwise do it here */
 	if (on_demand->flags & A6O_SCAN_THREADED) {
-		if( full_path != NULL)
-		   g_thread_pool_push(on_demand->thread_pool, (gpointer)os_strdup(full_path), NULL);
+		if (path != NULL)
+			queue_file(on_demand, path, dir);
 		/*
 		   full_path can be NULL if AV is launched as normal user and file rights are 700 for example.
 		   In this case, we just skip these files to avoid segfault. To be improved.
 		*/
 	}
+	else {
+		throttle_wait(on_demand->throttle, &on_demand->was_cancelled);
+		scan_file(on_demand, -1, dir, path);
+	}
+}
+
+/* files of network and user space file systems with a reduced policy go to their own lane, without being reordered */
+static void dispatch_remote_file(struct a6o_on_demand *on_demand, const char *path, struct walk_dir *dir)
+{
+	if ((on_demand->flags & A6O_SCAN_THREADED) && on_demand->lanes[REMOTE_FILES_LANE].queue != NULL && path != NULL)
+		scan_queue_push(on_demand->lanes[REMOTE_FILES_LANE].queue, path, dir);
+	else if (on_demand->batch != NULL && path != NULL)
+		scan_batch_add(on_demand->batch, path, dir);
 	else
-		scan_file(on_demand, full_path);
+		dispatch_file(path, dir, on_demand);
+}
 
-	return 0;
+/* in small files only policy, larger files are not scanned: only their size is read, not their content */
+#define SMALL_FILE_SIZE (64 * 1024)
+
+static int is_small_file(struct walk_dir *dir, const char *path)
+{
+	struct os_file_stat stat_buf;
+	int stat_errno;
+
+	return os_file_stat_at(walk_dir_get_fd(dir), path, &stat_buf, &stat_errno) != 0 || stat_buf.file_size <= SMALL_FILE_SIZE;
 }
 
-/* dummy function, should use platform (# of cores) or configuration data */
-static int get_max_threads(void)
+/* a file that is not scanned is reported like a file over the maximum size */
+static void skip_large_file(struct a6o_on_demand *on_demand, const char *path)
 {
-	return 4;
+	struct a6o_report report;
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "file %s not scanned: larger than %d bytes on a small files only file system", path, SMALL_FILE_SIZE);
+
+	a6o_report_init(&report, path);
+
+	g_atomic_int_inc(&on_demand->too_big_count);
+	update_counters(on_demand, &report);
+	update_progress(on_demand, &report);
+
+	a6o_report_destroy(&report);
 }
 
-static int count_entry(const char *full_path, enum os_file_flag flags, int entry_errno, void *data)
+/* scan one entry of the directory traversal */
+/* entry can be either a directory, a file or anything else */
+/* we scan only plain files, but also signal errors */
+/* dir is the directory of the entry, fs_policy is the policy of its file system */
+static int scan_entry(const char *full_path, enum os_file_flag flags, int entry_errno, struct walk_dir *dir, int fs_policy, void *data)
 {
-	int *pcount = (int *)data;
+	struct a6o_on_demand *on_demand = (struct a6o_on_demand *)data;
+
+	/* also stops os_dir_map() in a non recursive scan, for which any nonzero value stops the listing */
+	if (a6o_on_demand_is_cancelled(on_demand))
+		return DIR_WALKER_STOP;
+
+	/* errors and entries that are not plain files are skipped, but must not stop the traversal */
+	if (flags & FILE_FLAG_IS_ERROR) {
+		process_error(on_demand, full_path, entry_errno);
+		return 0;
+	}
 
 	if (!(flags & FILE_FLAG_IS_PLAIN_FILE))
 		return 0;
 
-	(*pcount)++;
+	/* traversal threads run with the scan priority and stop while the scan is paused */
+	throttle_apply_priority(on_demand->throttle);
+	throttle_wait_unpaused(on_demand->throttle, &on_demand->was_cancelled);
+
+	g_atomic_int_inc(&on_demand->discovered_count);
+
+	if (fs_policy == A6O_FS_POLICY_SMALL_FILES_ONLY && full_path != NULL && !is_small_file(dir, full_path)) {
+		skip_large_file(on_demand, full_path);
+		return 0;
+	}
+
+	/* the directory stays in checkpoints until the file is reported */
+	if (on_demand->checkpoint_path != NULL)
+		walk_dir_file_add(dir);
+
+	if (fs_policy == A6O_FS_POLICY_REDUCED || fs_policy == A6O_FS_POLICY_SMALL_FILES_ONLY)
+		dispatch_remote_file(on_demand, full_path, dir);
+	/* reordered files are dispatched when their batch is full */
+	else if (on_demand->batch != NULL && full_path != NULL)
+		scan_batch_add(on_demand->batch, full_path, dir);
+	else
+		dispatch_file(full_path, dir, on_demand);
+
 	return 0;
 }
 
-static gpointer count_thread_fun(gpointer data)
+/* entry of the scanned directory, in a non recursive scan */
+static int scan_dir_entry(const char *full_path, enum os_file_flag flags, int entry_errno, void *data)
 {
 	struct a6o_on_demand *on_demand = (struct a6o_on_demand *)data;
-	int recurse = on_demand->flags & A6O_SCAN_RECURSE;
-	int count = 0;
 
-#ifdef WIN32
-	void * OldValue = NULL;
-	if (Wow64DisableWow64FsRedirection(&OldValue) == FALSE) {
-		return NULL;
+	return scan_entry(full_path, flags, entry_errno, NULL, on_demand->root_fs_policy, data);
+}
+
+/* returns the policy for the files of a directory, DIR_WALKER_SKIP if it must not be traversed */
+/* the mount table is indexed by device, so that the decision does not depend on the length of the path */
+static int fs_policy(struct a6o_on_demand *on_demand, const char *path, const struct os_file_stat *st)
+{
+	enum a6o_fs_policy policy;
+
+	if (st->flags & FILE_FLAG_IS_ERROR)
+		return A6O_FS_POLICY_SCAN;
+
+	if (a6o_scan_conf_get_one_file_system(on_demand->scan_conf) && st->dev != on_demand->root_dev)
+		return DIR_WALKER_SKIP;
+
+	switch (os_mount_table_classify(on_demand->mounts, st->dev, path)) {
+	case OS_FS_PSEUDO:
+		return DIR_WALKER_SKIP;
+	case OS_FS_NETWORK:
+		policy = a6o_scan_conf_get_network_fs_policy(on_demand->scan_conf);
+		break;
+	case OS_FS_FUSE:
+		policy = a6o_scan_conf_get_fuse_fs_policy(on_demand->scan_conf);
+		break;
+	default:
+		return A6O_FS_POLICY_SCAN;
 	}
-#endif
 
-	os_dir_map(on_demand->root_path, recurse, count_entry, &count);
-	/* set the counter inside the struct only at the end, so */
-	/* that the scan function does not see the intermediate values, only the last one */
-	on_demand->to_scan_count = count;
+	return policy == A6O_FS_POLICY_SKIP ? DIR_WALKER_SKIP : (int)policy;
+}
 
-#ifdef WIN32
-	if (Wow64RevertWow64FsRedirection(OldValue) == FALSE ) {
-		return NULL;
+/* called by the walker threads before listing each directory */
+static int enter_dir(const char *path, const struct os_file_stat *st, void *data)
+{
+	return fs_policy((struct a6o_on_demand *)data, path, st);
+}
+
+/* white listed directories are not traversed at all, rather than having each of their files rejected */
+static int prune_dir(const char *full_path, void *data)
+{
+	struct a6o_on_demand *on_demand = (struct a6o_on_demand *)data;
+
+	return a6o_scan_conf_is_white_listed(on_demand->scan_conf, full_path);
+}
+
+/* directory traversal threads are not shared between scans, unlike scan threads */
+/* traversal is mostly waiting for metadata I/O, so more threads than processors do not help much */
+#define MAX_WALKER_THREADS 4
+
+static int get_max_threads(void)
+{
+	int n_cpus = os_cpu_count();
+
+	return n_cpus < MAX_WALKER_THREADS ? n_cpus : MAX_WALKER_THREADS;
+}
+
+/* number of directory walker threads */
+/* if scan is not threaded, the calling thread is the only walker and scans the files itself */
+static int get_walker_threads(struct a6o_on_demand *on_demand)
+{
+	if (on_demand->flags & A6O_SCAN_THREADED)
+		return get_max_threads();
+
+	return 1;
+}
+
+/* traverse the directory tree, listing directories in parallel */
+/* walker is kept until the end of the scan, because its statistics are used by progress estimation */
+/* returns 0 if traversal is complete */
+static int walk_dir(struct a6o_on_demand *on_demand)
+{
+	struct dir_walker *walker;
+	guint i;
+
+	walker = dir_walker_new(get_walker_threads(on_demand), scan_entry, on_demand);
+	dir_walker_set_visited(walker, on_demand->visited);
+	dir_walker_set_prune(walker, prune_dir);
+	dir_walker_set_enter(walker, enter_dir);
+
+	/* a resumed scan starts from the frontier saved in its checkpoint */
+	if (on_demand->resume != NULL)
+		for (i = 0; i < on_demand->resume->frontier->len; i++) {
+			struct dir_walker_dir *d = g_ptr_array_index(on_demand->resume->frontier, i);
+
+			dir_walker_add(walker, d->path, d->files_only, d->skip);
+		}
+	else
+		dir_walker_add(walker, on_demand->root_path, 0, NULL);
+
+	g_mutex_lock(&on_demand->lock);
+	g_atomic_pointer_set(&on_demand->walker, walker);
+	/* scan may have been cancelled before walker was visible to a6o_on_demand_cancel() */
+	if (a6o_on_demand_is_cancelled(on_demand))
+		dir_walker_stop(walker);
+	g_mutex_unlock(&on_demand->lock);
+
+	return dir_walker_run(walker);
+}
+
+static void start_lane(struct scan_lane *lane, int n_threads)
+{
+	struct a6o_on_demand *on_demand = lane->on_demand;
+	enum a6o_cache_neutral cache_neutral = a6o_scan_conf_get_cache_neutral(on_demand->scan_conf);
+	struct scan_queue *queue;
+
+	queue = scan_queue_new(a6o_scan_conf_get_queue_depth(on_demand->scan_conf),
+			a6o_scan_conf_get_queue_memory(on_demand->scan_conf));
+
+	g_mutex_lock(&on_demand->lock);
+	lane->queue = queue;
+	g_mutex_unlock(&on_demand->lock);
+
+	/* prefetched pages would be taken for pages cached before the scan, and never dropped */
+	if (a6o_scan_conf_get_prefetch_depth(on_demand->scan_conf) > 0
+		&& cache_neutral != A6O_CACHE_NEUTRAL_KEEP_RESIDENT)
+		lane->prefetch = prefetch_new(queue,
+					a6o_scan_conf_get_prefetch_depth(on_demand->scan_conf),
+					a6o_scan_conf_get_prefetch_memory(on_demand->scan_conf),
+					a6o_scan_conf_get_prefetch_engine(on_demand->scan_conf),
+					cache_neutral != A6O_CACHE_NEUTRAL_OFF);
+
+	lane->n_threads = n_threads;
+	lane->source = executor_source_new(on_demand->executor_client, queue, n_threads, scan_lane_file, lane);
+}
+
+static void start_scan_threads(struct a6o_on_demand *on_demand)
+{
+	struct executor *executor = executor_get(a6o_scan_conf_get_scan_threads(on_demand->scan_conf));
+	int large_file_threads = a6o_scan_conf_get_large_file_threads(on_demand->scan_conf);
+	struct executor_client *client;
+
+	g_mutex_lock(&on_demand->lock);
+	client = executor_client_new(executor, on_demand->weight, acquire_file, on_demand);
+	on_demand->executor_client = client;
+	g_mutex_unlock(&on_demand->lock);
+
+	start_lane(&on_demand->lanes[SMALL_FILES_LANE], executor_get_n_threads(executor));
+
+	/* the large files lane has a limited number of threads, so that large files */
+	/* never occupy all the scan threads */
+	if (large_file_threads > 0 && a6o_scan_conf_get_large_file_size(on_demand->scan_conf) != 0) {
+		on_demand->large_file_size = a6o_scan_conf_get_large_file_size(on_demand->scan_conf);
+		start_lane(&on_demand->lanes[LARGE_FILES_LANE], large_file_threads);
 	}
-#endif
 
-	return NULL;
+	/* files of slow file systems, likewise, never occupy all the scan threads */
+	if (a6o_scan_conf_get_remote_fs_threads(on_demand->scan_conf) > 0)
+		start_lane(&on_demand->lanes[REMOTE_FILES_LANE], a6o_scan_conf_get_remote_fs_threads(on_demand->scan_conf));
+
+	/* the lanes only open the files and find their type, the modules and the reports are run by the threads */
+	/* of the stage pool, each stage being given the number of threads it needs */
+	if (a6o_scan_conf_get_module_threads(on_demand->scan_conf) > 0) {
+		int depth = a6o_scan_conf_get_stage_queue_depth(on_demand->scan_conf);
+
+		on_demand->report_stage = stage_new("report", a6o_scan_conf_get_report_threads(on_demand->scan_conf), depth, report_stage_job, on_demand);
+		on_demand->module_stage = stage_new("module scan", a6o_scan_conf_get_module_threads(on_demand->scan_conf), depth, module_stage_job, on_demand);
+	}
 }
 
-static void count_to_scan(struct a6o_on_demand *on_demand)
+/* waits for completion of *all* the scans in the lanes queues */
+static void wait_scan_threads(struct a6o_on_demand *on_demand)
 {
-#if defined(HAVE_GTHREAD_NEW)
-	on_demand->count_thread = g_thread_new("to_scan_count_thread", count_thread_fun, on_demand);
-#elif defined(HAVE_GTHREAD_CREATE)
-	on_demand->count_thread = g_thread_create(count_thread_fun, on_demand, TRUE, NULL);
-#endif
+	struct executor_client *client;
+	int l;
+
+	/* close all queues first, so that lanes terminate concurrently */
+	for (l = 0; l < N_SCAN_LANES; l++)
+		if (on_demand->lanes[l].queue != NULL)
+			scan_queue_close(on_demand->lanes[l].queue);
+
+	for (l = 0; l < N_SCAN_LANES; l++) {
+		struct scan_lane *lane = &on_demand->lanes[l];
+
+		if (lane->source != NULL)
+			executor_source_wait_and_free(lane->source);
+		lane->source = NULL;
+	}
+
+	/* no more files are opened: the stages can be drained, in order */
+	if (on_demand->module_stage != NULL) {
+		stage_close_and_wait(on_demand->module_stage);
+		stage_close_and_wait(on_demand->report_stage);
+	}
+
+	g_mutex_lock(&on_demand->lock);
+	client = on_demand->executor_client;
+	on_demand->executor_client = NULL;
+	g_mutex_unlock(&on_demand->lock);
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "scan %ld used %d%% of the scan threads",
+		on_demand->scan_id,
+		executor_client_get_share(client));
+
+	executor_client_free(client);
+}
+
+static void log_lanes_stats(struct a6o_on_demand *on_demand)
+{
+	struct scan_queue_stats queue_stats;
+	double seconds = on_demand->duration > 0 ? on_demand->duration / 1000.0 : 0.0;
+	int l;
+
+	for (l = 0; l < N_SCAN_LANES; l++) {
+		struct scan_lane *lane = &on_demand->lanes[l];
+
+		if (lane->queue == NULL)
+			continue;
+
+		scan_queue_get_stats(lane->queue, &queue_stats);
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "scan %ld %s lane: up to %d threads, %d files, %llu bytes (%.1f files/s, %.1f MB/s), %lld ms busy, max queued %d files %lu bytes, traversal paused %lu times",
+			on_demand->scan_id,
+			lane->name,
+			lane->n_threads,
+			lane->scanned_files,
+			lane->scanned_bytes,
+			seconds > 0 ? lane->scanned_files / seconds : 0.0,
+			seconds > 0 ? lane->scanned_bytes / (seconds * 1024 * 1024) : 0.0,
+			(long long)(lane->busy_time / 1000),
+			queue_stats.max_count,
+			(unsigned long)queue_stats.max_bytes,
+			queue_stats.waits);
+
+		if (lane->prefetch != NULL) {
+			unsigned long prefetched_files;
+			unsigned long long prefetched_bytes;
+
+			prefetch_get_stats(lane->prefetch, &prefetched_files, &prefetched_bytes);
+			a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "scan %ld %s lane: %lu files prefetched (%llu bytes), %.1f%% of scanned files were prefetched",
+				on_demand->scan_id,
+				lane->name,
+				prefetched_files,
+				prefetched_bytes,
+				queue_stats.pops > 0 ? (100.0 * queue_stats.prefetched_pops) / queue_stats.pops : 0.0);
+		}
+	}
+}
+
+/* a stage that is busy most of the time while the stage before processes many of its files is the bottleneck */
+static void log_stage_stats(struct a6o_on_demand *on_demand, struct stage *stage, const char *name)
+{
+	struct stage_stats stats;
+
+	stage_get_stats(stage, &stats);
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "scan %ld %s stage: %d threads, %lu files, %d%% utilization, max queued %d files, %lu files processed by previous stage in %lld ms",
+		on_demand->scan_id,
+		name,
+		stats.n_threads,
+		stats.items,
+		stage_stats_utilization(&stats),
+		stats.max_queued,
+		stats.inline_items,
+		(long long)(stats.inline_time / 1000));
+}
+
+static void log_visited_stats(struct a6o_on_demand *on_demand)
+{
+	struct dir_walker_stats walker_stats;
+	size_t count, bytes;
+
+	inode_set_get_stats(on_demand->visited, &count, &bytes);
+
+	walker_stats.duplicate_dirs = 0;
+	walker_stats.pruned_dirs = 0;
+	if (on_demand->walker != NULL)
+		dir_walker_get_stats(on_demand->walker, &walker_stats);
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "scan %ld visited %lu inodes using %lu bytes, %d directories already visited, %d directories not traversed (white list, file system policy)",
+		on_demand->scan_id,
+		(unsigned long)count,
+		(unsigned long)bytes,
+		walker_stats.duplicate_dirs,
+		walker_stats.pruned_dirs);
+}
+
+static void log_batch_stats(struct a6o_on_demand *on_demand)
+{
+	unsigned long by_extent, by_inode, by_risk;
+
+	scan_batch_get_stats(on_demand->batch, &by_extent, &by_inode, &by_risk);
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "scan %ld reordered files by batches of %d: %lu by position on disk, %lu by inode number, %lu by risk",
+		on_demand->scan_id,
+		a6o_scan_conf_get_scan_order_batch(on_demand->scan_conf),
+		by_extent,
+		by_inode,
+		by_risk);
+}
+
+static void init_count_hint(struct a6o_on_demand *on_demand)
+{
+	int previous_count, fs_count;
+
+	previous_count = get_previous_count(on_demand->root_path);
+
+	/* file system hint is about the whole file system, so it is useless if not recursive */
+	fs_count = (on_demand->flags & A6O_SCAN_RECURSE) ? os_dir_count_hint(on_demand->root_path) : -1;
+
+	on_demand->count_hint = previous_count > fs_count ? previous_count : fs_count;
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "scan %ld files count hint: %d (previous scan %d, file system %d)",
+		on_demand->scan_id,
+		on_demand->count_hint,
+		previous_count,
+		fs_count);
 }
 
 /* NOTE: this function has several shortcomings: */
 /* - it should return also a file status for directories (but how to compute it?) */
 /* - it should be made simpler by separating the file case and the directory case */
-/* - it should use a thread pool also for traversing directories */
 /* run a scan by traversing the directory (if scan root_path is a directory) */
 /* or scanning the file (if not) */
 /* blocks until scan is finished, even if scan is multi-threaded */
@@ -468,6 +1454,10 @@ void a6o_on_demand_run(struct a6o_on_demand *on_demand)
 {
 	struct os_file_stat stat_buf;
 	int stat_errno;
+	struct dir_walker *walker;
+	struct scan_queue *queues[N_SCAN_LANES];
+	struct a6o_info *info;
+	int i;
 
 	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "starting %sthreaded scan %ld of %s",
 		on_demand->flags & A6O_SCAN_THREADED ? "" : "non-",
@@ -475,54 +1465,187 @@ void a6o_on_demand_run(struct a6o_on_demand *on_demand)
 		on_demand->root_path);
 
 	on_demand->start_time = get_milliseconds();
+	if (a6o_scan_conf_get_time_budget(on_demand->scan_conf) > 0)
+		on_demand->budget_end_time = on_demand->start_time + 1000 * (time_t)a6o_scan_conf_get_time_budget(on_demand->scan_conf);
 
-	/* create the thread pool now */
+	/* cached verdicts obtained with other modules or bases versions must not be used: bases */
+	/* may have been updated without notification, and the scan may not use the current configuration */
+	info = a6o_info_new(on_demand->armadito);
+	a6o_scan_conf_update_verdict_tag(on_demand->scan_conf, info);
+	a6o_info_free(info);
+
+	/* register the scan to the executor now */
 	if (on_demand->flags & A6O_SCAN_THREADED)
-		on_demand->thread_pool = g_thread_pool_new(scan_entry_thread_fun, on_demand, get_max_threads(), FALSE, NULL);
+		start_scan_threads(on_demand);
 
 	/* signal start */
 	fire_on_demand_start_event(on_demand);
 
 	/* what is scan root_path? a file or a directory? */
-	os_file_stat(on_demand->root_path, &stat_buf, &stat_errno);
+	/* a resumed scan is always the recursive scan of a directory */
+	if (on_demand->resume != NULL)
+		stat_buf.flags = FILE_FLAG_IS_DIRECTORY;
+	else
+		os_file_stat(on_demand->root_path, &stat_buf, &stat_errno);
 
 	/* it is a file, scan it, in a thread if scan is threaded */
 	/* otherwise, walk through the directory and apply 'scan_entry' function to each entry (either file or directory) */
 	if (stat_buf.flags & FILE_FLAG_IS_PLAIN_FILE) {
-		on_demand->to_scan_count = 1;
+		on_demand->discovered_count = 1;
+		g_atomic_int_set(&on_demand->traversal_done, 1);
 
 		if (on_demand->flags & A6O_SCAN_THREADED)
-			g_thread_pool_push(on_demand->thread_pool, (gpointer)os_strdup(on_demand->root_path), NULL);
-		else
-			scan_file(on_demand, on_demand->root_path);
+			queue_file(on_demand, on_demand->root_path, NULL);
+		else {
+			throttle_wait(on_demand->throttle, &on_demand->was_cancelled);
+			scan_file(on_demand, -1, NULL, on_demand->root_path);
+		}
 	} else if (stat_buf.flags & FILE_FLAG_IS_DIRECTORY) {
 		int recurse = on_demand->flags & A6O_SCAN_RECURSE;
+		int ret;
 
 		if (on_demand->progress_period != 0)
-			count_to_scan(on_demand);
+			init_count_hint(on_demand);
+
+		on_demand->visited = inode_set_new();
+
+		/* a resumed scan has not stat'ed its root yet */
+		on_demand->mounts = os_mount_table_new();
+		if (os_file_stat(on_demand->root_path, &stat_buf, &stat_errno) == 0) {
+			on_demand->root_dev = stat_buf.dev;
+			on_demand->root_fs_policy = fs_policy(on_demand, on_demand->root_path, &stat_buf);
+		}
+
+		if (a6o_scan_conf_get_scan_order(on_demand->scan_conf) != A6O_SCAN_ORDER_DISCOVERY)
+			on_demand->batch = scan_batch_new(a6o_scan_conf_get_scan_order(on_demand->scan_conf),
+							a6o_scan_conf_get_scan_order_batch(on_demand->scan_conf),
+							dispatch_file, on_demand);
+
+		if (recurse)
+			ret = walk_dir(on_demand);
+		else if (on_demand->root_fs_policy == DIR_WALKER_SKIP)
+			ret = 0;
+		else
+			ret = os_dir_map(on_demand->root_path, scan_dir_entry, on_demand);
+
+		if (on_demand->batch != NULL)
+			scan_batch_flush(on_demand->batch);
+
+		/* from now on, progress is computed from the exact files count */
+		g_atomic_int_set(&on_demand->traversal_done, 1);
 
-		os_dir_map(on_demand->root_path, recurse, scan_entry, on_demand);
+		if (ret == 0)
+			set_previous_count(on_demand->root_path, on_demand->discovered_count);
 	}
 
-	/* if threaded, free the thread_pool */
-	/* this has a side effect to wait for completion of *all* the scans queue'd in the thread pool */
+	/* if threaded, wait for the executor threads to empty the scan queues */
 	if (on_demand->flags & A6O_SCAN_THREADED)
-		g_thread_pool_free(on_demand->thread_pool, FALSE, TRUE);
+		wait_scan_threads(on_demand);
+
+	/* scan is over, completed or cancelled: it cannot be resumed */
+	if (on_demand->checkpoint_path != NULL && remove(on_demand->checkpoint_path) == 0)
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "removed checkpoint %s", on_demand->checkpoint_path);
 
 	on_demand->duration = get_milliseconds() - on_demand->start_time;
 	/* signal completion */
 	fire_on_demand_completed_event(on_demand);
 
-	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "finished scan %ld of %s",
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "finished scan %ld of %s: %d files (%d cached verdicts, %d too big, %d already scanned through another path, %d with already scanned content) in %ld ms (%.1f files/s)",
 		on_demand->scan_id,
-		on_demand->root_path);
+		on_demand->root_path,
+		on_demand->scanned_count,
+		on_demand->cached_count,
+		on_demand->too_big_count,
+		on_demand->duplicate_count,
+		on_demand->same_content_count,
+		(long)on_demand->duration,
+		on_demand->duration > 0 ? (1000.0 * on_demand->scanned_count) / on_demand->duration : 0.0);
+
+	log_lanes_stats(on_demand);
+
+	if (on_demand->module_stage != NULL) {
+		log_stage_stats(on_demand, on_demand->module_stage, "module scan");
+		log_stage_stats(on_demand, on_demand->report_stage, "report");
+	}
+
+	if (on_demand->visited != NULL)
+		log_visited_stats(on_demand);
+
+	if (on_demand->batch != NULL)
+		log_batch_stats(on_demand);
+
+	if (throttle_get_wait_time(on_demand->throttle) > 0)
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "scan %ld threads waited %lld ms in total because of pause, rate limits or system activity",
+			on_demand->scan_id,
+			throttle_get_wait_time(on_demand->throttle));
+
+	if (on_demand->was_cancelled)
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "scan %ld %s, stopped %ld ms after cancel request, %d%% of the files scanned",
+			on_demand->scan_id,
+			on_demand->budget_exhausted ? "out of time budget" : "cancelled",
+			(long)(on_demand->start_time + on_demand->duration - on_demand->cancel_time),
+			scan_coverage(on_demand));
+
+	g_mutex_lock(&on_demand->lock);
+	walker = on_demand->walker;
+	on_demand->walker = NULL;
+	for (i = 0; i < N_SCAN_LANES; i++) {
+		queues[i] = on_demand->lanes[i].queue;
+		on_demand->lanes[i].queue = NULL;
+	}
+	g_mutex_unlock(&on_demand->lock);
+
+	if (on_demand->batch != NULL) {
+		scan_batch_free(on_demand->batch);
+		on_demand->batch = NULL;
+	}
+
+	if (on_demand->visited != NULL) {
+		inode_set_free(on_demand->visited);
+		on_demand->visited = NULL;
+	}
+
+	if (on_demand->mounts != NULL) {
+		os_mount_table_free(on_demand->mounts);
+		on_demand->mounts = NULL;
+	}
+
+	if (on_demand->module_stage != NULL) {
+		stage_free(on_demand->module_stage);
+		on_demand->module_stage = NULL;
+		stage_free(on_demand->report_stage);
+		on_demand->report_stage = NULL;
+	}
+
+	for (i = 0; i < N_SCAN_LANES; i++) {
+		if (on_demand->lanes[i].prefetch != NULL) {
+			prefetch_free(on_demand->lanes[i].prefetch);
+			on_demand->lanes[i].prefetch = NULL;
+		}
+		if (queues[i] != NULL)
+			scan_queue_free(queues[i]);
+	}
 
-	if (on_demand->count_thread != NULL)
-		g_thread_join(on_demand->count_thread);
+	/* the queues, the batch and the prefetched files referenced directories of the walker */
+	if (walker != NULL)
+		dir_walker_free(walker);
 }
 
 void a6o_on_demand_free(struct a6o_on_demand *on_demand)
 {
+	int i;
+
+	for (i = 0; i < N_SCAN_LANES; i++)
+		g_mutex_clear(&on_demand->lanes[i].stats_lock);
+
+	if (on_demand->resume != NULL)
+		checkpoint_free(on_demand->resume);
+	g_free(on_demand->checkpoint_path);
+	g_mutex_clear(&on_demand->checkpoint_lock);
+	g_mutex_clear(&on_demand->progress_lock);
+	g_mutex_clear(&on_demand->lock);
+	throttle_free(on_demand->throttle);
+	a6o_scan_conf_release(on_demand->scan_conf);
 	free(on_demand);
 }
 
@@ -0,0 +1,165 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "pathtrie_p.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct path_node {
+	struct path_node *children;
+	struct path_node *next;      /* next child of the same parent */
+	int terminal;                /* a directory of the trie ends at this node */
+	size_t len;
+	char name[];                 /* the component, empty for the root of an absolute path */
+};
+
+struct path_trie {
+	struct path_node *root;
+};
+
+static struct path_node *path_node_new(const char *name, size_t len)
+{
+	struct path_node *n = malloc(sizeof(struct path_node) + len + 1);
+
+	n->children = NULL;
+	n->next = NULL;
+	n->terminal = 0;
+	n->len = len;
+	memcpy(n->name, name, len);
+	n->name[len] = '\0';
+
+	return n;
+}
+
+static void path_node_free(struct path_node *n)
+{
+	struct path_node *child, *next;
+
+	for (child = n->children; child != NULL; child = next) {
+		next = child->next;
+		path_node_free(child);
+	}
+
+	free(n);
+}
+
+static struct path_node *find_child(struct path_node *n, const char *name, size_t len)
+{
+	struct path_node *child;
+
+	for (child = n->children; child != NULL; child = child->next)
+		if (child->len == len && !memcmp(child->name, name, len))
+			return child;
+
+	return NULL;
+}
+
+static int is_separator(char c)
+{
+	return c == '/' || c == '\\';
+}
+
+/* returns the length of the component at the beginning of s, after its leading separators */
+static size_t next_component(const char **s)
+{
+	size_t len;
+
+	while (is_separator(**s))
+		(*s)++;
+
+	for (len = 0; (*s)[len] != '\0' && !is_separator((*s)[len]); len++)
+		;
+
+	return len;
+}
+
+struct path_trie *path_trie_new(void)
+{
+	struct path_trie *t = malloc(sizeof(struct path_trie));
+
+	t->root = path_node_new("", 0);
+
+	return t;
+}
+
+static struct path_node *add_child(struct path_node *n, const char *name, size_t len)
+{
+	struct path_node *child = find_child(n, name, len);
+
+	if (child == NULL) {
+		child = path_node_new(name, len);
+		child->next = n->children;
+		n->children = child;
+	}
+
+	return child;
+}
+
+void path_trie_add(struct path_trie *t, const char *path)
+{
+	struct path_node *n = t->root;
+	const char *s = path;
+	size_t len;
+
+	/* the root of an absolute path is an empty component */
+	if (is_separator(*s))
+		n = add_child(n, s, 0);
+
+	for (len = next_component(&s); len > 0; s += len, len = next_component(&s))
+		n = add_child(n, s, len);
+
+	if (n != t->root)
+		n->terminal = 1;
+}
+
+int path_trie_match(struct path_trie *t, const char *path)
+{
+	struct path_node *n = t->root;
+	const char *s = path;
+	size_t len;
+
+	if (is_separator(*s) && (n = find_child(n, s, 0)) == NULL)
+		return 0;
+
+	if (n->terminal)
+		return 1;
+
+	/* the walk stops at the first directory of the trie, or at the first component that leaves the trie */
+	for (len = next_component(&s); len > 0; s += len, len = next_component(&s)) {
+		if ((n = find_child(n, s, len)) == NULL)
+			return 0;
+
+		if (n->terminal)
+			return 1;
+	}
+
+	return 0;
+}
+
+void path_trie_free(struct path_trie *t)
+{
+	path_node_free(t->root);
+	free(t);
+}
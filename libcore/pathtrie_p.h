@@ -0,0 +1,48 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#ifndef LIBCORE_PATHTRIE_P_H
+#define LIBCORE_PATHTRIE_P_H
+
+/*
+ * A path trie holds a set of directories, one node per path component, so
+ * that telling whether a path is one of them or lies under one of them takes
+ * a single walk from the root, whatever the number of directories.
+ *
+ * Both '/' and '\' separate components; consecutive and trailing separators
+ * are ignored, and the root of an absolute path is a component of its own.
+ *
+ * A trie is built before being used and can then be read from several
+ * threads without lock.
+ */
+
+struct path_trie;
+
+struct path_trie *path_trie_new(void);
+
+void path_trie_add(struct path_trie *t, const char *path);
+
+/* returns 1 if path is one of the directories of the trie or is under one of them */
+int path_trie_match(struct path_trie *t, const char *path);
+
+void path_trie_free(struct path_trie *t);
+
+#endif
@@ -0,0 +1,269 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/file.h"
+#include "core/fileloader.h"
+#include "core/io.h"
+
+#include "prefetch_p.h"
+
+#include <glib.h>
+#include <stdlib.h>
+
+/* a file prefetched and maybe not yet popped from the queue */
+struct prefetched {
+	unsigned long serial;
+	size_t bytes;
+	int fd;                         /* opened by the loader and not yet taken, or -1 */
+	struct walk_dir *dir;           /* directory the loader opens the file in, referenced until the load completes */
+};
+
+struct prefetch {
+	GMutex lock;                    /* held by the thread currently prefetching */
+	struct scan_queue *queue;
+	int depth;
+	size_t max_bytes;
+	GString *path;
+	struct os_file_loader *loader;  /* NULL if files are not opened in advance */
+	struct prefetched *ring;        /* indexed by serial modulo ring_size */
+	int ring_size;                  /* depth files ahead of the head, and as many popped files not yet taken */
+	unsigned long files;
+	unsigned long long bytes;
+};
+
+struct prefetch *prefetch_new(struct scan_queue *q, int depth, size_t max_bytes, enum a6o_prefetch_engine engine, int noatime)
+{
+	struct prefetch *p = malloc(sizeof(struct prefetch));
+	int i;
+
+	g_mutex_init(&p->lock);
+	p->queue = q;
+	p->depth = depth > 0 ? depth : 1;
+	p->max_bytes = max_bytes;
+	p->path = g_string_new("");
+	p->loader = engine == A6O_PREFETCH_IO_URING ? os_file_loader_new(p->depth, noatime) : NULL;
+	p->ring_size = 2 * p->depth;
+	p->ring = calloc(p->ring_size, sizeof(struct prefetched));
+	for (i = 0; i < p->ring_size; i++)
+		p->ring[i].fd = -1;
+	p->files = 0;
+	p->bytes = 0;
+
+	return p;
+}
+
+/* must be called with lock held */
+/* returns the bytes of the files prefetched but not yet popped */
+/* serials only grow, so older files of the ring have all been popped */
+static size_t bytes_in_flight(struct prefetch *p, unsigned long pops)
+{
+	size_t bytes = 0;
+	int i;
+
+	for (i = 0; i < p->ring_size; i++)
+		if (p->ring[i].serial >= pops)
+			bytes += p->ring[i].bytes;
+
+	return bytes;
+}
+
+/* must be called with lock held */
+static void ring_set_fd(struct prefetched *r, int fd)
+{
+	if (r->fd >= 0)
+		os_close(r->fd);
+	r->fd = fd;
+}
+
+/* must be called with lock held */
+/* gives the files opened by the loader to the ring */
+static void complete_loads(struct prefetch *p)
+{
+	struct prefetched *r;
+	unsigned long serial;
+	size_t size;
+	int fd, open_errno;
+
+	while (os_file_loader_complete(p->loader, &serial, &fd, &size, &open_errno)) {
+		r = &p->ring[serial % p->ring_size];
+
+		/* the ring entry was reused by a later file */
+		if (r->serial != serial) {
+			if (fd >= 0)
+				os_close(fd);
+			continue;
+		}
+
+		walk_dir_unref(r->dir);
+		r->dir = NULL;
+
+		r->bytes = size;
+		ring_set_fd(r, fd);
+
+		if (fd >= 0) {
+			p->files++;
+			p->bytes += size;
+		}
+	}
+}
+
+/* must be called with lock held */
+static void loader_ahead(struct prefetch *p)
+{
+	struct scan_queue_stats stats;
+	struct prefetched *r;
+	struct walk_dir *dir;
+	unsigned long serial;
+	size_t in_flight;
+
+	scan_queue_get_stats(p->queue, &stats);
+	complete_loads(p);
+
+	for (;;) {
+		in_flight = bytes_in_flight(p, stats.pops);
+		if (p->max_bytes != 0 && in_flight >= p->max_bytes)
+			break;
+
+		if (scan_queue_prefetch_next(p->queue, p->depth, p->path, &serial, &dir) != 0)
+			break;
+
+		r = &p->ring[serial % p->ring_size];
+
+		/* the load of an older file of this ring entry is still in progress, */
+		/* and the kernel still uses its directory: the entry will be opened by the scan thread */
+		if (r->dir != NULL) {
+			walk_dir_unref(dir);
+			break;
+		}
+
+		r->serial = serial;
+		ring_set_fd(r, -1);
+
+		/* until the load completes with the file size, it reserves its share of the bytes */
+		r->bytes = p->max_bytes / p->depth;
+
+		/* loader is full: the entry will be opened by the scan thread */
+		if (os_file_loader_submit(p->loader, walk_dir_get_fd(dir), p->path->str, p->max_bytes != 0 ? p->max_bytes - in_flight : (size_t)-1, serial) != 0) {
+			walk_dir_unref(dir);
+			r->bytes = 0;
+			break;
+		}
+
+		r->dir = dir;
+	}
+
+	/* submits the loads */
+	complete_loads(p);
+}
+
+void prefetch_ahead(struct prefetch *p)
+{
+	struct scan_queue_stats stats;
+	struct walk_dir *dir;
+	unsigned long serial;
+	size_t in_flight, size;
+
+	if (!g_mutex_trylock(&p->lock))
+		return;
+
+	if (p->loader != NULL) {
+		loader_ahead(p);
+		g_mutex_unlock(&p->lock);
+		return;
+	}
+
+	for (;;) {
+		scan_queue_get_stats(p->queue, &stats);
+
+		in_flight = bytes_in_flight(p, stats.pops);
+		if (p->max_bytes != 0 && in_flight >= p->max_bytes)
+			break;
+
+		if (scan_queue_prefetch_next(p->queue, p->depth, p->path, &serial, &dir) != 0)
+			break;
+
+		size = p->max_bytes != 0 ? p->max_bytes - in_flight : (size_t)-1;
+		if (os_file_prefetch_at(walk_dir_get_fd(dir), p->path->str, &size) != 0)
+			size = 0;
+		walk_dir_unref(dir);
+
+		p->ring[serial % p->ring_size].serial = serial;
+		p->ring[serial % p->ring_size].bytes = size;
+
+		p->files++;
+		p->bytes += size;
+	}
+
+	g_mutex_unlock(&p->lock);
+}
+
+int prefetch_take(struct prefetch *p, unsigned long serial)
+{
+	struct prefetched *r = &p->ring[serial % p->ring_size];
+	int fd = -1;
+
+	if (p->loader == NULL)
+		return -1;
+
+	g_mutex_lock(&p->lock);
+
+	/* the load may be completed without having been seen yet */
+	if (r->serial == serial && r->fd < 0)
+		complete_loads(p);
+
+	if (r->serial == serial && r->fd >= 0) {
+		fd = r->fd;
+		r->fd = -1;
+	}
+
+	g_mutex_unlock(&p->lock);
+
+	return fd;
+}
+
+void prefetch_get_stats(struct prefetch *p, unsigned long *files, unsigned long long *bytes)
+{
+	g_mutex_lock(&p->lock);
+	*files = p->files;
+	*bytes = p->bytes;
+	g_mutex_unlock(&p->lock);
+}
+
+void prefetch_free(struct prefetch *p)
+{
+	int i;
+
+	if (p->loader != NULL)
+		os_file_loader_free(p->loader);
+
+	for (i = 0; i < p->ring_size; i++) {
+		ring_set_fd(&p->ring[i], -1);
+		walk_dir_unref(p->ring[i].dir);
+	}
+
+	g_string_free(p->path, TRUE);
+	free(p->ring);
+	g_mutex_clear(&p->lock);
+	free(p);
+}
@@ -0,0 +1,62 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#ifndef LIBCORE_PREFETCH_P_H
+#define LIBCORE_PREFETCH_P_H
+
+#include "core/scanconf.h"
+
+#include "scanqueue_p.h"
+
+#include <stddef.h>
+
+/*
+ * Prefetch starts reading the files waiting in a scan queue before scan
+ * threads pop them, so that on cold storage their content is already in
+ * the system cache when the scan reads it.
+ *
+ * At most depth files ahead of the queue head are prefetched, and at most
+ * max_bytes of prefetched files may wait in the queue.
+ *
+ * With the io_uring engine, files are also opened in advance, by batches,
+ * and the scan thread that pops a file takes its opened descriptor.
+ */
+
+struct prefetch;
+
+/* if engine is not available, falls back to A6O_PREFETCH_FADVISE */
+/* noatime is given to the io_uring engine, to open files without updating their access time */
+struct prefetch *prefetch_new(struct scan_queue *q, int depth, size_t max_bytes, enum a6o_prefetch_engine engine, int noatime);
+
+/* called by scan threads after popping a file: prefetches the next files of the queue */
+/* does not wait if another thread is already prefetching */
+void prefetch_ahead(struct prefetch *p);
+
+/* returns the descriptor of the popped file of this serial if it was opened in advance, -1 otherwise */
+/* the caller owns the returned descriptor */
+int prefetch_take(struct prefetch *p, unsigned long serial);
+
+/* returns the number of files prefetched and the number of bytes requested */
+void prefetch_get_stats(struct prefetch *p, unsigned long *files, unsigned long long *bytes);
+
+void prefetch_free(struct prefetch *p);
+
+#endif
@@ -41,6 +41,7 @@ void a6o_report_init(struct a6o_report *report, const char *path)
 	report->action = A6O_ACTION_NONE;
 	report->module_name = NULL;
 	report->module_report = NULL;
+	report->digest = NULL;
 }
 
 void a6o_report_destroy(struct a6o_report *report)
@@ -49,6 +50,8 @@ void a6o_report_destroy(struct a6o_report *report)
 		free(report->path);
 	if (report->module_report != NULL)
 		free(report->module_report);
+	if (report->digest != NULL)
+		free(report->digest);
 }
 
 void a6o_report_change(struct a6o_report *report, enum a6o_file_status status, const char *module_name, const char *module_report)
@@ -65,3 +68,11 @@ void a6o_report_change(struct a6o_report *report, enum a6o_file_status status, c
 		report->module_report = (char *)module_report;
 	}
 }
+
+void a6o_report_set_digest(struct a6o_report *report, const char *digest)
+{
+	if (report->digest != NULL)
+		free(report->digest);
+
+	report->digest = os_strdup(digest);
+}
@@ -24,93 +24,247 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "armadito_p.h"
 #include "string_p.h"
+#include "verdictcache_p.h"
+#include "digest_p.h"
+#include "pathtrie_p.h"
+#include "core/info.h"
+#include "core/scanconf.h"
 
 #include <glib.h>
 #include <stdlib.h>
+#include <string.h>
+
+/* verdict and digest caches outlive the configuration snapshots: a reloaded configuration */
+/* with the same cache settings shares them with the snapshots still used by running scans */
+struct scan_caches {
+	gint refcount;
+	struct verdict_cache *verdict_cache;
+	struct digest_cache *digest_cache;
+};
+
+/* the verdict tag is recomputed when bases are updated, while scan threads read it: being 64 bits, */
+/* it is published by a sequence lock, odd while being written, so that a reader never sees half of it */
+struct verdict_tag {
+	volatile gint seq;
+	volatile gint high;
+	volatile gint low;
+};
 
+/* once published, a configuration is only read, except for verdict_tag, so that scan threads need no lock */
 struct a6o_scan_conf {
+	gint refcount;                    /* the published slot and the scans using the snapshot each hold a reference */
 	const char *name;
 	size_t max_file_size;
+	int scan_threads;
+	int queue_depth;
+	size_t queue_memory;
+	size_t large_file_size;
+	int large_file_threads;
+	enum a6o_scan_order scan_order;
+	int scan_order_batch;
+	int time_budget;
+	int prefetch_depth;
+	size_t prefetch_memory;
+	enum a6o_prefetch_engine prefetch_engine;
+	enum a6o_cache_neutral cache_neutral;
+	int one_file_system;
+	enum a6o_fs_policy network_fs_policy;
+	enum a6o_fs_policy fuse_fs_policy;
+	int remote_fs_threads;
+	int module_threads;
+	int report_threads;
+	int stage_queue_depth;
+	const char *checkpoint_dir;
+	int checkpoint_interval;
+	struct a6o_scan_limits limits;
 
 	GArray *mime_types;
 	GArray *modules;
-	GHashTable *mime_type_cache;
+	GHashTable *routes;               /* mime type -> NULL-terminated array of modules, compiled when published */
+	struct a6o_module **wildcard_modules;  /* the modules for mime types routes does not name, NULL if none */
+
+	struct path_trie *directories_white_list;
+
+	const char *verdict_cache_path;
+	unsigned int verdict_cache_size;
+	struct scan_caches *caches;
+	struct verdict_tag verdict_tag;   /* identifies modules and bases versions of cached verdicts, 0 if not known yet */
 
-	/* a GArray and not a GPtrArray because GArray can be automatically NULL terminated */
-	GArray *directories_white_list;
+	int content_digest;
+	unsigned int digest_cache_size;
 };
 
 /* macros for easy access to GArray */
 #define modules(c) ((struct a6o_module **)((c)->modules->data))
 #define mime_types(c) ((const char **)((c)->mime_types->data))
-#define directories_white_list(c) ((const char **)((c)->directories_white_list->data))
+
+/* bounds of the queue of files waiting to be scanned */
+#define DEFAULT_QUEUE_DEPTH 10000
+#define DEFAULT_QUEUE_MEMORY (16 * 1024 * 1024)
+
+/* files of this size or more are scanned by their own, smaller, pool of threads */
+#define DEFAULT_LARGE_FILE_SIZE (32 * 1024 * 1024)
+#define DEFAULT_LARGE_FILE_THREADS 1
+
+/* files reordered together when scan order is not discovery order */
+#define DEFAULT_SCAN_ORDER_BATCH 4096
+
+/* files read in advance by threaded scans */
+#define DEFAULT_PREFETCH_DEPTH 16
+#define DEFAULT_PREFETCH_MEMORY (32 * 1024 * 1024)
+
+/* threads scanning the files of network and user space file systems */
+#define DEFAULT_REMOTE_FS_THREADS 2
+
+/* threads of the module scan and report stages of threaded scans, no stages if no module scan thread */
+#define DEFAULT_MODULE_THREADS 0
+#define DEFAULT_REPORT_THREADS 1
+#define DEFAULT_STAGE_QUEUE_DEPTH 64
+
+/* seconds between two checkpoints of a recursive scan */
+#define DEFAULT_CHECKPOINT_INTERVAL 60
+
+/* in idle only mode, scan waits over these system load and disk utilization, in percent */
+#define DEFAULT_IDLE_MAX_LOAD 50
+#define DEFAULT_IDLE_MAX_DISK_BUSY 50
 
 static struct a6o_scan_conf *a6o_scan_conf_new(const char *name)
 {
 	struct a6o_scan_conf *c = malloc(sizeof(struct a6o_scan_conf));
 
+	c->refcount = 1;
 	c->name = os_strdup(name);
 	c->max_file_size = 0;
+	c->scan_threads = 0;
+	c->queue_depth = DEFAULT_QUEUE_DEPTH;
+	c->queue_memory = DEFAULT_QUEUE_MEMORY;
+	c->large_file_size = DEFAULT_LARGE_FILE_SIZE;
+	c->large_file_threads = DEFAULT_LARGE_FILE_THREADS;
+	c->scan_order = A6O_SCAN_ORDER_DISCOVERY;
+	c->scan_order_batch = DEFAULT_SCAN_ORDER_BATCH;
+	c->time_budget = 0;
+	c->prefetch_depth = DEFAULT_PREFETCH_DEPTH;
+	c->prefetch_memory = DEFAULT_PREFETCH_MEMORY;
+	c->prefetch_engine = A6O_PREFETCH_FADVISE;
+	c->cache_neutral = A6O_CACHE_NEUTRAL_OFF;
+	c->one_file_system = 0;
+	c->network_fs_policy = A6O_FS_POLICY_REDUCED;
+	c->fuse_fs_policy = A6O_FS_POLICY_REDUCED;
+	c->remote_fs_threads = DEFAULT_REMOTE_FS_THREADS;
+	c->module_threads = DEFAULT_MODULE_THREADS;
+	c->report_threads = DEFAULT_REPORT_THREADS;
+	c->stage_queue_depth = DEFAULT_STAGE_QUEUE_DEPTH;
+	c->checkpoint_dir = NULL;
+	c->checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+	c->limits.bytes_per_second = 0;
+	c->limits.files_per_second = 0;
+	c->limits.io_class = OS_IO_CLASS_NORMAL;
+	c->limits.nice = 0;
+	c->limits.idle_only = 0;
+	c->limits.max_load = DEFAULT_IDLE_MAX_LOAD;
+	c->limits.max_disk_busy = DEFAULT_IDLE_MAX_DISK_BUSY;
 
 	c->mime_types = g_array_new(TRUE, TRUE, sizeof(const char *));
 	c->modules = g_array_new(TRUE, TRUE, sizeof(struct a6o_module *));
-	c->mime_type_cache = g_hash_table_new(g_str_hash, g_str_equal);
+	c->routes = NULL;
+	c->wildcard_modules = NULL;
+
+	c->directories_white_list = path_trie_new();
+
+	c->verdict_cache_path = NULL;
+	c->verdict_cache_size = VERDICT_CACHE_DEFAULT_SIZE;
+	c->caches = g_new0(struct scan_caches, 1);
+	c->caches->refcount = 1;
+	c->verdict_tag.seq = 0;
+	c->verdict_tag.high = 0;
+	c->verdict_tag.low = 0;
 
-	c->directories_white_list = g_array_new(TRUE, TRUE, sizeof(const char *));
+	c->content_digest = 0;
+	c->digest_cache_size = DIGEST_CACHE_DEFAULT_SIZE;
 
 	return c;
 }
 
-static struct a6o_scan_conf *on_demand_conf = NULL;
-static struct a6o_scan_conf *on_access_conf = NULL;
+/* a published configuration, and the one being built by a reload */
+struct scan_conf_slot {
+	const char *name;
+	struct a6o_scan_conf *current;
+	struct a6o_scan_conf *pending;
+};
+
+static struct scan_conf_slot on_demand_slot = { "on-demand scan configuration", NULL, NULL };
+static struct scan_conf_slot on_access_slot = { "on-access scan configuration", NULL, NULL };
+
+/* protects the current pointers of the slots and the references taken on them */
+static GMutex slots_lock;
 
-static struct a6o_scan_conf *get_conf(struct a6o_scan_conf **pc, const char *name)
+static struct a6o_scan_conf *get_conf(struct scan_conf_slot *slot)
 {
-	if (*pc == NULL)
-		*pc = a6o_scan_conf_new(name);
+	if (slot->pending != NULL)
+		return slot->pending;
 
-	return *pc;
+	if (slot->current == NULL)
+		slot->current = a6o_scan_conf_new(slot->name);
+
+	return slot->current;
 }
 
 struct a6o_scan_conf *a6o_scan_conf_on_demand(void)
 {
-	return get_conf(&on_demand_conf, "on-demand scan configuration");
+	return get_conf(&on_demand_slot);
 }
 
 struct a6o_scan_conf *a6o_scan_conf_on_access(void)
 {
-	return get_conf(&on_access_conf, "on-access scan configuration");
+	return get_conf(&on_access_slot);
 }
 
-void a6o_scan_conf_white_list_directory(struct a6o_scan_conf *c, const char *path)
+static struct a6o_scan_conf *acquire(struct scan_conf_slot *slot)
 {
-	const char *cp = os_strdup(path);
+	struct a6o_scan_conf *c;
+
+	g_mutex_lock(&slots_lock);
+	if (slot->current == NULL)
+		slot->current = a6o_scan_conf_new(slot->name);
+	c = slot->current;
+	g_atomic_int_inc(&c->refcount);
+	g_mutex_unlock(&slots_lock);
 
-	g_array_append_val(c->directories_white_list, cp);
+	return c;
 }
 
-static int strprefix(const char *s, const char *prefix)
+struct a6o_scan_conf *a6o_scan_conf_acquire_on_demand(void)
 {
-	while (*prefix && *s && *prefix++ == *s++)
-		;
+	return acquire(&on_demand_slot);
+}
 
-	if (*prefix == '\0')
-		return *s == '\0' || *s == '/' || *s == '\\';
+struct a6o_scan_conf *a6o_scan_conf_acquire_on_access(void)
+{
+	return acquire(&on_access_slot);
+}
 
-	return 0;
+void a6o_scan_conf_release(struct a6o_scan_conf *c)
+{
+	if (g_atomic_int_dec_and_test(&c->refcount))
+		a6o_scan_conf_free(c);
 }
 
-int a6o_scan_conf_is_white_listed(struct a6o_scan_conf *c, const char *path)
+void a6o_scan_conf_reload_begin(void)
 {
-	const char **p = directories_white_list(c);
+	if (on_demand_slot.pending == NULL)
+		on_demand_slot.pending = a6o_scan_conf_new(on_demand_slot.name);
+	if (on_access_slot.pending == NULL)
+		on_access_slot.pending = a6o_scan_conf_new(on_access_slot.name);
+}
 
-	while (*p != NULL) {
-		if (strprefix(path, *p))
-			return 1;
-		p++;
-	}
+void a6o_scan_conf_white_list_directory(struct a6o_scan_conf *c, const char *path)
+{
+	path_trie_add(c->directories_white_list, path);
+}
 
-	return 0;
+int a6o_scan_conf_is_white_listed(struct a6o_scan_conf *c, const char *path)
+{
+	return path_trie_match(c->directories_white_list, path);
 }
 
 void a6o_scan_conf_add_mime_type(struct a6o_scan_conf *c, const char *mime_type)
@@ -163,22 +317,115 @@ static struct a6o_module **build_module_array(struct a6o_scan_conf *c, const cha
 	return NULL;
 }
 
+static void add_route(struct a6o_scan_conf *c, const char *mime_type)
+{
+	if (!strcmp(mime_type, "*")
+		|| g_hash_table_contains(c->routes, mime_type)
+		|| !mime_type_contains(mime_types(c), mime_type))
+		return;
+
+	g_hash_table_insert(c->routes, os_strdup(mime_type), build_module_array(c, mime_type));
+}
+
+/* the mime types named by the modules get their own array of modules, all other mime types */
+/* can only be handled by the modules accepting any mime type */
+static void compile_routes(struct a6o_scan_conf *c)
+{
+	struct a6o_module **p_module;
+	const char **p_mime_type;
+	GArray *wildcard = g_array_new(TRUE, TRUE, sizeof(struct a6o_module *));
+
+	c->routes = g_hash_table_new_full(g_str_hash, g_str_equal, free, g_free);
+
+	for(p_module = modules(c); *p_module != NULL; p_module++) {
+		if ((*p_module)->supported_mime_types == NULL)
+			continue;
+
+		for (p_mime_type = (*p_module)->supported_mime_types; *p_mime_type != NULL; p_mime_type++)
+			if (!strcmp(*p_mime_type, "*"))
+				g_array_append_val(wildcard, *p_module);
+			else
+				add_route(c, *p_mime_type);
+	}
+
+	if (wildcard->len > 0)
+		c->wildcard_modules = (struct a6o_module **)g_array_free(wildcard, FALSE);
+	else
+		g_array_free(wildcard, TRUE);
+}
+
+/* a published configuration is never modified: no lock */
 static struct a6o_module **get_applicable_modules(struct a6o_scan_conf *c, const char *mime_type)
 {
 	struct a6o_module **modules = NULL;
 
-	if (g_hash_table_lookup_extended(c->mime_type_cache, mime_type, NULL, (gpointer *)&modules))
+	if (g_hash_table_lookup_extended(c->routes, mime_type, NULL, (gpointer *)&modules))
 		return modules;
 
-	if (!mime_type_contains(mime_types(c), mime_type)) {
-		g_hash_table_insert(c->mime_type_cache, (gpointer)(os_strdup(mime_type)), NULL);
+	if (!mime_type_contains(mime_types(c), mime_type))
 		return NULL;
+
+	return c->wildcard_modules;
+}
+
+static int same_caches_settings(struct a6o_scan_conf *a, struct a6o_scan_conf *b)
+{
+	return !g_strcmp0(a->verdict_cache_path, b->verdict_cache_path)
+		&& a->verdict_cache_size == b->verdict_cache_size
+		&& a->content_digest == b->content_digest
+		&& a->digest_cache_size == b->digest_cache_size;
+}
+
+/* caches are opened when published, so that scan threads never see them change */
+static void open_caches(struct a6o_scan_conf *c)
+{
+	if (c->caches->verdict_cache == NULL && c->verdict_cache_path != NULL)
+		c->caches->verdict_cache = verdict_cache_open(c->verdict_cache_path, c->verdict_cache_size);
+	if (c->caches->digest_cache == NULL && c->content_digest && c->digest_cache_size > 0)
+		c->caches->digest_cache = digest_cache_new(c->digest_cache_size);
+}
+
+/* publications are serialized by the caller: only publish() changes the current pointers */
+static void publish(struct scan_conf_slot *slot)
+{
+	struct a6o_scan_conf *old;
+
+	/* first publication: the configuration was built in place and is not used yet */
+	if (slot->pending == NULL) {
+		if (slot->current != NULL && slot->current->routes == NULL) {
+			compile_routes(slot->current);
+			open_caches(slot->current);
+		}
+		return;
 	}
 
-	modules = build_module_array(c, mime_type);
-	g_hash_table_insert(c->mime_type_cache, (gpointer)(os_strdup(mime_type)), modules);
+	compile_routes(slot->pending);
 
-	return modules;
+	/* the verdict tag is not shared: modules or mime types may have changed */
+	old = slot->current;
+	if (old != NULL && same_caches_settings(old, slot->pending)) {
+		g_free(slot->pending->caches);
+		g_atomic_int_inc(&old->caches->refcount);
+		slot->pending->caches = old->caches;
+	} else
+		open_caches(slot->pending);
+
+	g_mutex_lock(&slots_lock);
+	slot->current = slot->pending;
+	slot->pending = NULL;
+	g_mutex_unlock(&slots_lock);
+
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "%s: new configuration published", slot->name);
+
+	/* scans that started with the old configuration keep it until they end */
+	if (old != NULL)
+		a6o_scan_conf_release(old);
+}
+
+void a6o_scan_conf_publish(void)
+{
+	publish(&on_demand_slot);
+	publish(&on_access_slot);
 }
 
 struct a6o_module **a6o_scan_conf_get_applicable_modules(struct a6o_scan_conf *c, const char *mime_type)
@@ -204,12 +451,450 @@ void a6o_scan_conf_max_file_size(struct a6o_scan_conf *c, int max_file_size)
 	c->max_file_size = max_file_size;
 }
 
+size_t a6o_scan_conf_get_max_file_size(struct a6o_scan_conf *c)
+{
+	return c->max_file_size;
+}
+
+void a6o_scan_conf_scan_threads(struct a6o_scan_conf *c, int scan_threads)
+{
+	c->scan_threads = scan_threads;
+}
+
+int a6o_scan_conf_get_scan_threads(struct a6o_scan_conf *c)
+{
+	return c->scan_threads;
+}
+
+void a6o_scan_conf_queue_depth(struct a6o_scan_conf *c, int queue_depth)
+{
+	c->queue_depth = queue_depth;
+}
+
+int a6o_scan_conf_get_queue_depth(struct a6o_scan_conf *c)
+{
+	return c->queue_depth;
+}
+
+void a6o_scan_conf_queue_memory(struct a6o_scan_conf *c, int queue_memory)
+{
+	c->queue_memory = queue_memory;
+}
+
+size_t a6o_scan_conf_get_queue_memory(struct a6o_scan_conf *c)
+{
+	return c->queue_memory;
+}
+
+void a6o_scan_conf_large_file_size(struct a6o_scan_conf *c, int large_file_size)
+{
+	c->large_file_size = large_file_size;
+}
+
+size_t a6o_scan_conf_get_large_file_size(struct a6o_scan_conf *c)
+{
+	return c->large_file_size;
+}
+
+void a6o_scan_conf_large_file_threads(struct a6o_scan_conf *c, int large_file_threads)
+{
+	c->large_file_threads = large_file_threads;
+}
+
+int a6o_scan_conf_get_large_file_threads(struct a6o_scan_conf *c)
+{
+	return c->large_file_threads;
+}
+
+void a6o_scan_conf_scan_order(struct a6o_scan_conf *c, enum a6o_scan_order order)
+{
+	c->scan_order = order;
+}
+
+enum a6o_scan_order a6o_scan_conf_get_scan_order(struct a6o_scan_conf *c)
+{
+	return c->scan_order;
+}
+
+void a6o_scan_conf_scan_order_batch(struct a6o_scan_conf *c, int n_files)
+{
+	c->scan_order_batch = n_files;
+}
+
+int a6o_scan_conf_get_scan_order_batch(struct a6o_scan_conf *c)
+{
+	return c->scan_order_batch;
+}
+
+void a6o_scan_conf_time_budget(struct a6o_scan_conf *c, int seconds)
+{
+	c->time_budget = seconds;
+}
+
+int a6o_scan_conf_get_time_budget(struct a6o_scan_conf *c)
+{
+	return c->time_budget;
+}
+
+void a6o_scan_conf_prefetch_depth(struct a6o_scan_conf *c, int n_files)
+{
+	c->prefetch_depth = n_files;
+}
+
+int a6o_scan_conf_get_prefetch_depth(struct a6o_scan_conf *c)
+{
+	return c->prefetch_depth;
+}
+
+void a6o_scan_conf_prefetch_memory(struct a6o_scan_conf *c, int prefetch_memory)
+{
+	c->prefetch_memory = prefetch_memory;
+}
+
+size_t a6o_scan_conf_get_prefetch_memory(struct a6o_scan_conf *c)
+{
+	return c->prefetch_memory;
+}
+
+void a6o_scan_conf_prefetch_engine(struct a6o_scan_conf *c, enum a6o_prefetch_engine engine)
+{
+	c->prefetch_engine = engine;
+}
+
+enum a6o_prefetch_engine a6o_scan_conf_get_prefetch_engine(struct a6o_scan_conf *c)
+{
+	return c->prefetch_engine;
+}
+
+void a6o_scan_conf_cache_neutral(struct a6o_scan_conf *c, enum a6o_cache_neutral mode)
+{
+	c->cache_neutral = mode;
+}
+
+enum a6o_cache_neutral a6o_scan_conf_get_cache_neutral(struct a6o_scan_conf *c)
+{
+	return c->cache_neutral;
+}
+
+void a6o_scan_conf_one_file_system(struct a6o_scan_conf *c, int enable)
+{
+	c->one_file_system = enable;
+}
+
+int a6o_scan_conf_get_one_file_system(struct a6o_scan_conf *c)
+{
+	return c->one_file_system;
+}
+
+void a6o_scan_conf_network_fs_policy(struct a6o_scan_conf *c, enum a6o_fs_policy policy)
+{
+	c->network_fs_policy = policy;
+}
+
+enum a6o_fs_policy a6o_scan_conf_get_network_fs_policy(struct a6o_scan_conf *c)
+{
+	return c->network_fs_policy;
+}
+
+void a6o_scan_conf_fuse_fs_policy(struct a6o_scan_conf *c, enum a6o_fs_policy policy)
+{
+	c->fuse_fs_policy = policy;
+}
+
+enum a6o_fs_policy a6o_scan_conf_get_fuse_fs_policy(struct a6o_scan_conf *c)
+{
+	return c->fuse_fs_policy;
+}
+
+void a6o_scan_conf_remote_fs_threads(struct a6o_scan_conf *c, int remote_fs_threads)
+{
+	c->remote_fs_threads = remote_fs_threads;
+}
+
+int a6o_scan_conf_get_remote_fs_threads(struct a6o_scan_conf *c)
+{
+	return c->remote_fs_threads;
+}
+
+void a6o_scan_conf_module_threads(struct a6o_scan_conf *c, int module_threads)
+{
+	c->module_threads = module_threads;
+}
+
+int a6o_scan_conf_get_module_threads(struct a6o_scan_conf *c)
+{
+	return c->module_threads;
+}
+
+void a6o_scan_conf_report_threads(struct a6o_scan_conf *c, int report_threads)
+{
+	c->report_threads = report_threads;
+}
+
+int a6o_scan_conf_get_report_threads(struct a6o_scan_conf *c)
+{
+	return c->report_threads;
+}
+
+void a6o_scan_conf_stage_queue_depth(struct a6o_scan_conf *c, int stage_queue_depth)
+{
+	c->stage_queue_depth = stage_queue_depth;
+}
+
+int a6o_scan_conf_get_stage_queue_depth(struct a6o_scan_conf *c)
+{
+	return c->stage_queue_depth;
+}
+
+void a6o_scan_conf_checkpoint_dir(struct a6o_scan_conf *c, const char *path)
+{
+	if (c->checkpoint_dir != NULL)
+		free((void *)c->checkpoint_dir);
+
+	c->checkpoint_dir = os_strdup(path);
+}
+
+const char *a6o_scan_conf_get_checkpoint_dir(struct a6o_scan_conf *c)
+{
+	return c->checkpoint_dir;
+}
+
+void a6o_scan_conf_checkpoint_interval(struct a6o_scan_conf *c, int seconds)
+{
+	c->checkpoint_interval = seconds;
+}
+
+int a6o_scan_conf_get_checkpoint_interval(struct a6o_scan_conf *c)
+{
+	return c->checkpoint_interval;
+}
+
+void a6o_scan_conf_verdict_cache(struct a6o_scan_conf *c, const char *path)
+{
+	if (c->verdict_cache_path != NULL)
+		free((void *)c->verdict_cache_path);
+
+	c->verdict_cache_path = os_strdup(path);
+}
+
+void a6o_scan_conf_verdict_cache_size(struct a6o_scan_conf *c, int n_records)
+{
+	if (n_records > 0)
+		c->verdict_cache_size = n_records;
+}
+
+void a6o_scan_conf_content_digest(struct a6o_scan_conf *c, int enable)
+{
+	c->content_digest = enable;
+}
+
+int a6o_scan_conf_get_content_digest(struct a6o_scan_conf *c)
+{
+	return c->content_digest;
+}
+
+void a6o_scan_conf_digest_cache_size(struct a6o_scan_conf *c, int n_records)
+{
+	if (n_records >= 0)
+		c->digest_cache_size = n_records;
+}
+
+static unsigned long long module_tag(unsigned long long h, struct a6o_module *mod, struct a6o_info *info)
+{
+	struct a6o_module_info **m;
+	struct a6o_base_info **b;
+
+	h = verdict_cache_hash_str(h, mod->name);
+
+	for (m = info->module_infos; m != NULL && *m != NULL; m++) {
+		if (strcmp((*m)->name, mod->name))
+			continue;
+
+		h = verdict_cache_hash(h, &(*m)->mod_update_ts, sizeof((*m)->mod_update_ts));
+
+		for (b = (*m)->base_infos; b != NULL && *b != NULL; b++) {
+			h = verdict_cache_hash_str(h, (*b)->name);
+			h = verdict_cache_hash_str(h, (*b)->version);
+			h = verdict_cache_hash(h, &(*b)->base_update_ts, sizeof((*b)->base_update_ts));
+			h = verdict_cache_hash(h, &(*b)->signature_count, sizeof((*b)->signature_count));
+		}
+	}
+
+	return h;
+}
+
+static unsigned long long get_verdict_tag(struct a6o_scan_conf *c)
+{
+	gint seq;
+	guint high, low;
+
+	do {
+		while ((seq = g_atomic_int_get(&c->verdict_tag.seq)) & 1)
+			;
+		high = (guint)g_atomic_int_get(&c->verdict_tag.high);
+		low = (guint)g_atomic_int_get(&c->verdict_tag.low);
+	} while (g_atomic_int_get(&c->verdict_tag.seq) != seq);
+
+	return ((unsigned long long)high << 32) | low;
+}
+
+/* writers are serialized by this lock, readers do not take it */
+G_LOCK_DEFINE_STATIC(verdict_tag);
+
+static void set_verdict_tag(struct a6o_scan_conf *c, unsigned long long h)
+{
+	g_atomic_int_inc(&c->verdict_tag.seq);
+	g_atomic_int_set(&c->verdict_tag.high, (gint)(guint)(h >> 32));
+	g_atomic_int_set(&c->verdict_tag.low, (gint)(guint)(h & 0xffffffffULL));
+	g_atomic_int_inc(&c->verdict_tag.seq);
+}
+
+void a6o_scan_conf_update_verdict_tag(struct a6o_scan_conf *c, struct a6o_info *info)
+{
+	unsigned long long h = VERDICT_CACHE_HASH_INIT;
+	struct a6o_module **modv;
+	const char **mime_typev;
+
+	if (c->caches->verdict_cache == NULL && c->caches->digest_cache == NULL)
+		return;
+
+	/* a verdict is valid only for the same modules, with the same bases, applied to the same mime types */
+	for (modv = modules(c); *modv != NULL; modv++)
+		h = module_tag(h, *modv, info);
+
+	for (mime_typev = mime_types(c); *mime_typev != NULL; mime_typev++)
+		h = verdict_cache_hash_str(h, *mime_typev);
+
+	/* 0 means not known yet */
+	if (h == 0)
+		h = 1;
+
+	G_LOCK(verdict_tag);
+	if (h != get_verdict_tag(c)) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "%s: verdict cache tag is now %016llx", c->name, h);
+		set_verdict_tag(c, h);
+	}
+	G_UNLOCK(verdict_tag);
+}
+
+void a6o_scan_conf_update_verdict_tags(struct a6o_info *info)
+{
+	struct a6o_scan_conf *on_demand = a6o_scan_conf_acquire_on_demand();
+	struct a6o_scan_conf *on_access = a6o_scan_conf_acquire_on_access();
+
+	a6o_scan_conf_update_verdict_tag(on_demand, info);
+	a6o_scan_conf_update_verdict_tag(on_access, info);
+
+	a6o_scan_conf_release(on_demand);
+	a6o_scan_conf_release(on_access);
+}
+
+/* until the tag is known, verdicts are neither used nor stored */
+int a6o_scan_conf_get_cached_verdict(struct a6o_scan_conf *c, const struct os_file_stat *st, enum a6o_file_status *status)
+{
+	unsigned long long tag;
+
+	if (c->caches->verdict_cache == NULL || (tag = get_verdict_tag(c)) == 0)
+		return 0;
+
+	return verdict_cache_lookup(c->caches->verdict_cache, st, tag, status);
+}
+
+void a6o_scan_conf_cache_verdict(struct a6o_scan_conf *c, const struct os_file_stat *st, enum a6o_file_status status)
+{
+	unsigned long long tag;
+
+	if (c->caches->verdict_cache == NULL || (tag = get_verdict_tag(c)) == 0)
+		return;
+
+	verdict_cache_store(c->caches->verdict_cache, st, tag, status);
+}
+
+int a6o_scan_conf_get_digest_verdict(struct a6o_scan_conf *c, const unsigned char *digest, enum a6o_file_status *status)
+{
+	unsigned long long tag;
+
+	if (c->caches->digest_cache == NULL || (tag = get_verdict_tag(c)) == 0)
+		return 0;
+
+	return digest_cache_lookup(c->caches->digest_cache, digest, tag, status);
+}
+
+void a6o_scan_conf_digest_verdict(struct a6o_scan_conf *c, const unsigned char *digest, enum a6o_file_status status)
+{
+	unsigned long long tag;
+
+	if (c->caches->digest_cache == NULL || (tag = get_verdict_tag(c)) == 0)
+		return;
+
+	digest_cache_store(c->caches->digest_cache, digest, tag, status);
+}
+
+void a6o_scan_conf_max_bytes_per_second(struct a6o_scan_conf *c, int bytes_per_second)
+{
+	if (bytes_per_second >= 0)
+		c->limits.bytes_per_second = bytes_per_second;
+}
+
+void a6o_scan_conf_max_files_per_second(struct a6o_scan_conf *c, int files_per_second)
+{
+	if (files_per_second >= 0)
+		c->limits.files_per_second = files_per_second;
+}
+
+void a6o_scan_conf_io_class(struct a6o_scan_conf *c, enum os_io_class io_class)
+{
+	c->limits.io_class = io_class;
+}
+
+void a6o_scan_conf_nice(struct a6o_scan_conf *c, int nice)
+{
+	c->limits.nice = nice < 0 ? 0 : nice > 19 ? 19 : nice;
+}
+
+void a6o_scan_conf_idle_only(struct a6o_scan_conf *c, int idle_only)
+{
+	c->limits.idle_only = idle_only;
+}
+
+void a6o_scan_conf_idle_max_load(struct a6o_scan_conf *c, int percent)
+{
+	c->limits.max_load = percent;
+}
+
+void a6o_scan_conf_idle_max_disk_busy(struct a6o_scan_conf *c, int percent)
+{
+	c->limits.max_disk_busy = percent;
+}
+
+void a6o_scan_conf_get_limits(struct a6o_scan_conf *c, struct a6o_scan_limits *limits)
+{
+	*limits = c->limits;
+}
+
 void a6o_scan_conf_free(struct a6o_scan_conf *scan_conf)
 {
-	g_array_free(scan_conf->directories_white_list, TRUE);
+	const char **mime_typev;
+
+	if (g_atomic_int_dec_and_test(&scan_conf->caches->refcount)) {
+		verdict_cache_close(scan_conf->caches->verdict_cache);
+		digest_cache_free(scan_conf->caches->digest_cache);
+		g_free(scan_conf->caches);
+	}
+	if (scan_conf->verdict_cache_path != NULL)
+		free((void *)scan_conf->verdict_cache_path);
+	if (scan_conf->checkpoint_dir != NULL)
+		free((void *)scan_conf->checkpoint_dir);
+
+	path_trie_free(scan_conf->directories_white_list);
+	for (mime_typev = mime_types(scan_conf); *mime_typev != NULL; mime_typev++)
+		free((void *)*mime_typev);
 	g_array_free(scan_conf->mime_types, TRUE);
 	g_array_free(scan_conf->modules, TRUE);
-	g_hash_table_unref(scan_conf->mime_type_cache);
+	if (scan_conf->routes != NULL)
+		g_hash_table_unref(scan_conf->routes);
+	g_free(scan_conf->wildcard_modules);
+	free((void *)scan_conf->name);
 
 	free(scan_conf);
 }
@@ -238,7 +923,8 @@ const char *a6o_scan_conf_debug(struct a6o_scan_conf *c)
 
 	g_string_append_printf(s, "scan configuration: %s\n", c->name);
 
-	g_hash_table_foreach(c->mime_type_cache, mime_type_print, s);
+	if (c->routes != NULL)
+		g_hash_table_foreach(c->routes, mime_type_print, s);
 
 	ret = s->str;
 	g_string_free(s, FALSE);
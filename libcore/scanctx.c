@@ -28,6 +28,7 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #include "core/mimetype.h"
 #include "string_p.h"
 #include "status_p.h"
+#include "digest_p.h"
 
 #include <errno.h>
 #include <stdlib.h>
@@ -53,6 +54,9 @@ enum a6o_scan_context_status a6o_scan_context_get(struct a6o_scan_context *ctx,
 {
 	struct a6o_module **applicable_modules;
 	const char *mime_type;
+	enum a6o_file_status cached_status;
+	size_t max_file_size;
+	int stat_errno;
 	int err = 0;
 
 	if (fd < 0 && path == NULL) {
@@ -67,6 +71,12 @@ enum a6o_scan_context_status a6o_scan_context_get(struct a6o_scan_context *ctx,
 	ctx->path = NULL;
 	ctx->mime_type = NULL;
 	ctx->applicable_modules = NULL;
+	ctx->conf = conf;
+	ctx->file_stat.flags = FILE_FLAG_IS_ERROR;
+	ctx->cancelled = NULL;
+	ctx->same_content = 0;
+	ctx->drop_cache = 0;
+	ctx->cached_pages = NULL;
 
 	/* check file name vs. directories white list */
 	if (path != NULL && a6o_scan_conf_is_white_listed(conf, path)) {
@@ -83,7 +93,7 @@ enum a6o_scan_context_status a6o_scan_context_get(struct a6o_scan_context *ctx,
 		/* TODO write portable code for this function */
 		err = _sopen_s(&(ctx->fd), path, O_RDONLY | _O_BINARY, _SH_DENYNO, _S_IREAD);
 #else
-		ctx->fd = os_open(path, O_RDONLY);
+		ctx->fd = os_file_open_at(-1, path, a6o_scan_conf_get_cache_neutral(conf) != A6O_CACHE_NEUTRAL_OFF);
 #endif
 
 		if (ctx->fd < 0) {
@@ -95,8 +105,38 @@ enum a6o_scan_context_status a6o_scan_context_get(struct a6o_scan_context *ctx,
 		}
 	}
 
-	/* fstat file descriptor and get file size */
-	/* not yet */
+	/* fstat file descriptor to get file size and identity */
+	if (os_file_stat_fd(ctx->fd, &ctx->file_stat, &stat_errno) == 0) {
+		max_file_size = a6o_scan_conf_get_max_file_size(conf);
+
+		/* check file size before reading anything from the file */
+		/* the report is left undecided: the file is not scanned, and no file status means "too big" */
+		/* on-demand scans count these files apart, on-access lets them be opened like other unscanned files */
+		if (max_file_size != 0 && ctx->file_stat.file_size > max_file_size) {
+			a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "file %s not scanned: size %lu is over maximum size %lu",
+				path != NULL ? path : "(null)",
+				(unsigned long)ctx->file_stat.file_size,
+				(unsigned long)max_file_size);
+			ctx->status = A6O_SC_FILE_TOO_BIG;
+			return ctx->status;
+		}
+
+		/* look for an already known verdict */
+		if (a6o_scan_conf_get_cached_verdict(conf, &ctx->file_stat, &cached_status)) {
+			ctx->status = A6O_SC_FILE_CACHED;
+			if (report != NULL)
+				a6o_report_change(report, cached_status, NULL, NULL);
+			return ctx->status;
+		}
+	}
+
+	/* from now on the file is read: remember which pages were already cached, before reading them */
+	if (a6o_scan_conf_get_cache_neutral(conf) != A6O_CACHE_NEUTRAL_OFF
+		&& (ctx->file_stat.flags & FILE_FLAG_IS_PLAIN_FILE)) {
+		ctx->drop_cache = 1;
+		if (a6o_scan_conf_get_cache_neutral(conf) == A6O_CACHE_NEUTRAL_KEEP_RESIDENT)
+			ctx->cached_pages = os_file_cache_resident(ctx->fd, ctx->file_stat.file_size);
+	}
 
 	/* file type using mime_type_guess and applicable modules from configuration */
 	mime_type = os_mime_type_guess_fd(ctx->fd);
@@ -110,7 +150,6 @@ enum a6o_scan_context_status a6o_scan_context_get(struct a6o_scan_context *ctx,
 	applicable_modules = a6o_scan_conf_get_applicable_modules(conf, mime_type);
 
 	if (applicable_modules == NULL) {
-		free((void *)mime_type);
 		if (report != NULL)
 			a6o_report_change(report, A6O_FILE_UNKNOWN_TYPE, NULL, NULL);
 		ctx->status = A6O_SC_FILE_TYPE_NOT_SCANNED;
@@ -131,7 +170,8 @@ enum a6o_scan_context_status a6o_scan_context_get(struct a6o_scan_context *ctx,
 /* apply the modules contained in 'modules' in order to compute the scan status of 'path' */
 /* 'modules' is a NULL-terminated array of pointers to struct a6o_module */
 /* 'mime_type' is the mime-type of the file */
-static enum a6o_file_status scan_apply_modules(int fd, const char *path, const char *mime_type, struct a6o_module **modules,  struct a6o_report *report)
+/* if 'cancelled' is not NULL and becomes set, modules that have not been applied yet are skipped */
+static enum a6o_file_status scan_apply_modules(int fd, const char *path, const char *mime_type, struct a6o_module **modules, volatile int *cancelled, struct a6o_report *report)
 {
 	enum a6o_file_status current_status = A6O_FILE_UNDECIDED;
 
@@ -141,6 +181,11 @@ static enum a6o_file_status scan_apply_modules(int fd, const char *path, const c
 		enum a6o_file_status mod_status;
 		char *module_report = NULL;
 
+		if (cancelled != NULL && *cancelled) {
+			a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "scan of path %s cancelled before module %s", path, mod->name);
+			break;
+		}
+
 		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "scanning fd %d path %s with module %s", fd, path, mod->name);
 
 		/* if module status is not OK, don't call it */
@@ -176,11 +221,39 @@ static enum a6o_file_status scan_apply_modules(int fd, const char *path, const c
 	return current_status;
 }
 
+/* returns 1 if the file was not modified since the context was created, i.e. during the scan */
+static int file_unchanged(struct a6o_scan_context *ctx)
+{
+	struct os_file_stat now;
+	int stat_errno;
+
+	if (ctx->file_stat.flags & FILE_FLAG_IS_ERROR)
+		return 0;
+
+	if (os_file_stat_fd(ctx->fd, &now, &stat_errno) != 0)
+		return 0;
+
+	return now.file_size == ctx->file_stat.file_size
+		&& now.mtime == ctx->file_stat.mtime
+		&& now.ctime == ctx->file_stat.ctime;
+}
+
+/* only verdicts that depend on the file content alone are kept by digest */
+/* as for the verdict cache, malware and suspicious files must always be scanned, hence lead to an alert */
+static int digest_verdict_is_reusable(enum a6o_file_status status)
+{
+	return status == A6O_FILE_CLEAN || status == A6O_FILE_WHITE_LISTED;
+}
+
 /* scan a file context: */
+/* - if content digest is enabled, compute the digest and look for the verdict of a file with the same content */
 /* - apply the modules to scan the file */
 enum a6o_file_status a6o_scan_context_scan(struct a6o_scan_context *ctx, struct a6o_report *report)
 {
 	enum a6o_file_status status;
+	unsigned char digest[DIGEST_SIZE];
+	char digest_str[DIGEST_STRING_SIZE];
+	int has_digest = 0;
 
 	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "scanning file %s", ctx->path);
 
@@ -193,8 +266,36 @@ enum a6o_file_status a6o_scan_context_scan(struct a6o_scan_context *ctx, struct
 		return status;
 	}
 
+	if (a6o_scan_conf_get_content_digest(ctx->conf)) {
+		if (digest_fd(ctx->fd, digest) == 0) {
+			has_digest = 1;
+			digest_to_string(digest, digest_str);
+			a6o_report_set_digest(report, digest_str);
+		} else
+			a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot compute digest of file %s (error %s)", ctx->path, os_strerror(errno));
+	}
+
+	if (has_digest && a6o_scan_conf_get_digest_verdict(ctx->conf, digest, &status)) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "file %s has the same content as an already scanned file (%s)", ctx->path, digest_str);
+		ctx->same_content = 1;
+		a6o_report_change(report, status, NULL, NULL);
+		if (status == A6O_FILE_CLEAN && file_unchanged(ctx))
+			a6o_scan_conf_cache_verdict(ctx->conf, &ctx->file_stat, status);
+		return status;
+	}
+
 	/* otherwise we scan it by applying the modules */
-	status = scan_apply_modules(ctx->fd, ctx->path, ctx->mime_type, ctx->applicable_modules, report);
+	status = scan_apply_modules(ctx->fd, ctx->path, ctx->mime_type, ctx->applicable_modules, ctx->cancelled, report);
+
+	if ((ctx->cancelled != NULL && *ctx->cancelled) || !file_unchanged(ctx))
+		return status;
+
+	/* only clean verdicts are cached: other verdicts must always lead to a scan, hence to an alert */
+	if (status == A6O_FILE_CLEAN)
+		a6o_scan_conf_cache_verdict(ctx->conf, &ctx->file_stat, status);
+
+	if (has_digest && digest_verdict_is_reusable(status))
+		a6o_scan_conf_digest_verdict(ctx->conf, digest, status);
 
 	return status;
 }
@@ -204,6 +305,17 @@ void a6o_scan_context_close(struct a6o_scan_context *ctx)
 	if (ctx->fd < 0)
 		return;
 
+	/* the file is fully scanned, its pages are not needed anymore */
+	if (ctx->drop_cache) {
+		os_file_cache_drop(ctx->fd, ctx->file_stat.file_size, ctx->cached_pages);
+		ctx->drop_cache = 0;
+	}
+
+	if (ctx->cached_pages != NULL) {
+		free(ctx->cached_pages);
+		ctx->cached_pages = NULL;
+	}
+
 	if (os_close(ctx->fd) != 0)
 		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "closing file descriptor %3d failed (%s)", ctx->fd, os_strerror(errno));
 
@@ -216,7 +328,5 @@ void a6o_scan_context_destroy(struct a6o_scan_context *ctx)
 
 	if (ctx->path != NULL)
 		free((void *)ctx->path);
-	if (ctx->mime_type != NULL)
-		free((void *)ctx->mime_type);
 }
 
@@ -0,0 +1,342 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/file.h"
+
+#include "scanorder_p.h"
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* initial size of the memory blocks holding the paths of a batch */
+#define PATHS_CHUNK_SIZE 4096
+
+/* what the sort key of an entry is: entries with different kinds of keys are not interleaved */
+enum key_kind {
+	KEY_EXTENT = 0,
+	KEY_INODE,
+	KEY_RISK,
+	KEY_NONE,
+};
+
+struct scan_batch_entry {
+	char *path;
+	struct walk_dir *dir;           /* referenced until the entry is dispatched */
+	unsigned long long dev;
+	enum key_kind kind;
+	unsigned long long key;
+};
+
+struct scan_batch {
+	GMutex lock;                    /* protects entries and statistics */
+	GArray *entries;
+	GStringChunk *paths;            /* paths of entries, freed at once when entries are dispatched */
+	enum a6o_scan_order order;
+	guint size;
+	void (*dispatch)(const char *path, struct walk_dir *dir, void *data);
+	void *data;
+
+	unsigned long by_extent;
+	unsigned long by_inode;
+	unsigned long by_risk;
+};
+
+struct scan_batch *scan_batch_new(enum a6o_scan_order order, int size, void (*dispatch)(const char *path, struct walk_dir *dir, void *data), void *data)
+{
+	struct scan_batch *b = malloc(sizeof(struct scan_batch));
+
+	g_mutex_init(&b->lock);
+	b->order = order;
+	b->size = size > 0 ? size : 1;
+	b->entries = g_array_sized_new(FALSE, FALSE, sizeof(struct scan_batch_entry), b->size);
+	b->paths = g_string_chunk_new(PATHS_CHUNK_SIZE);
+	b->dispatch = dispatch;
+	b->data = data;
+	b->by_extent = 0;
+	b->by_inode = 0;
+	b->by_risk = 0;
+
+	return b;
+}
+
+/* risk of a file from its extension, the higher the more likely to be malicious */
+static const char *executable_extensions[] = {
+	"exe", "dll", "sys", "scr", "com", "cpl", "ocx", "msi", "so", "ko", "dylib", "jar", "apk", "elf", "bin", NULL,
+};
+
+static const char *script_extensions[] = {
+	"sh", "bash", "ps1", "psm1", "vbs", "vbe", "js", "jse", "wsf", "wsh", "hta", "bat", "cmd", "py", "pl", "rb", "php", "lnk", NULL,
+};
+
+static const char *document_extensions[] = {
+	"pdf", "doc", "docx", "docm", "dot", "dotm", "xls", "xlsx", "xlsm", "xlsb", "ppt", "pptx", "pptm", "rtf", "odt", "ods", "odp", NULL,
+};
+
+static const char *archive_extensions[] = {
+	"zip", "rar", "7z", "gz", "tgz", "bz2", "xz", "tar", "cab", NULL,
+};
+
+static const char *media_extensions[] = {
+	"mp3", "mp4", "m4a", "mkv", "avi", "mov", "wmv", "flac", "wav", "ogg", "webm",
+	"jpg", "jpeg", "png", "gif", "bmp", "tif", "tiff", "webp", "heic", "iso", "img", "vmdk", "vdi", "qcow2", NULL,
+};
+
+#define RISK_EXECUTABLE 40
+#define RISK_SCRIPT 35
+#define RISK_DOCUMENT 30
+#define RISK_NO_EXTENSION 25   /* unix executables and scripts have no extension */
+#define RISK_ARCHIVE 20
+#define RISK_OTHER 10
+#define RISK_MEDIA 0
+#define RISK_MAX 100
+
+static int extension_in(const char *ext, const char **extensions)
+{
+	for (; *extensions != NULL; extensions++)
+		if (!g_ascii_strcasecmp(ext, *extensions))
+			return 1;
+
+	return 0;
+}
+
+static int extension_risk(const char *path)
+{
+	const char *base, *ext;
+
+	base = strrchr(path, '/');
+#ifdef _WIN32
+	if (strrchr(path, '\\') > base)
+		base = strrchr(path, '\\');
+#endif
+	base = base != NULL ? base + 1 : path;
+
+	/* a leading dot is a hidden file, not an extension */
+	ext = strrchr(base, '.');
+	if (ext == NULL || ext == base)
+		return RISK_NO_EXTENSION;
+	ext++;
+
+	if (extension_in(ext, executable_extensions))
+		return RISK_EXECUTABLE;
+	if (extension_in(ext, script_extensions))
+		return RISK_SCRIPT;
+	if (extension_in(ext, document_extensions))
+		return RISK_DOCUMENT;
+	if (extension_in(ext, archive_extensions))
+		return RISK_ARCHIVE;
+	if (extension_in(ext, media_extensions))
+		return RISK_MEDIA;
+
+	return RISK_OTHER;
+}
+
+#define DAY_NS (24LL * 3600 * 1000000000LL)
+
+/* files dropped or modified recently are more likely to be part of an ongoing incident */
+static int recency_risk(const struct os_file_stat *stat_buf, long long now)
+{
+	long long changed = stat_buf->mtime > stat_buf->ctime ? stat_buf->mtime : stat_buf->ctime;
+	long long age = now - changed;
+
+	if (age < DAY_NS)
+		return 30;
+	if (age < 7 * DAY_NS)
+		return 20;
+	if (age < 30 * DAY_NS)
+		return 10;
+
+	return 0;
+}
+
+/* large files are expensive to scan: they go after smaller files of the same risk */
+static int size_cost(size_t size)
+{
+	if (size >= 64 * 1024 * 1024)
+		return 20;
+	if (size >= 8 * 1024 * 1024)
+		return 10;
+	if (size >= 1024 * 1024)
+		return 5;
+
+	return 0;
+}
+
+/* the key sorts by decreasing risk, then by increasing size */
+#define RISK_SIZE_BITS 40
+
+static unsigned long long risk_key(const char *path, const struct os_file_stat *stat_buf, long long now)
+{
+	int risk = extension_risk(path) + recency_risk(stat_buf, now) - size_cost(stat_buf->file_size);
+	unsigned long long size = stat_buf->file_size;
+
+	if (risk < 0)
+		risk = 0;
+	if (size >= (1ULL << RISK_SIZE_BITS))
+		size = (1ULL << RISK_SIZE_BITS) - 1;
+
+	return ((unsigned long long)(RISK_MAX - risk) << RISK_SIZE_BITS) | size;
+}
+
+static void entry_init(struct scan_batch *b, struct scan_batch_entry *e, const char *path, struct walk_dir *dir)
+{
+	struct os_file_stat stat_buf;
+	int stat_errno;
+
+	e->path = NULL;
+	e->dir = walk_dir_ref(dir);
+	e->dev = 0;
+	e->kind = KEY_NONE;
+	e->key = 0;
+
+	if (os_file_stat_at(walk_dir_get_fd(dir), path, &stat_buf, &stat_errno) != 0)
+		return;
+
+	/* risk does not depend on the device: files of all devices are interleaved */
+	if (b->order == A6O_SCAN_ORDER_RISK) {
+		e->kind = KEY_RISK;
+		e->key = risk_key(path, &stat_buf, g_get_real_time() * 1000LL);
+		return;
+	}
+
+	e->dev = stat_buf.dev;
+
+	if (b->order == A6O_SCAN_ORDER_EXTENT && os_file_physical_offset_at(walk_dir_get_fd(dir), path, &e->key) == 0)
+		e->kind = KEY_EXTENT;
+	else if (stat_buf.inode != 0) {
+		e->kind = KEY_INODE;
+		e->key = stat_buf.inode;
+	}
+}
+
+static int entry_compare(gconstpointer pa, gconstpointer pb)
+{
+	const struct scan_batch_entry *a = (const struct scan_batch_entry *)pa;
+	const struct scan_batch_entry *b = (const struct scan_batch_entry *)pb;
+
+	if (a->dev != b->dev)
+		return a->dev < b->dev ? -1 : 1;
+
+	if (a->kind != b->kind)
+		return a->kind < b->kind ? -1 : 1;
+
+	if (a->key != b->key)
+		return a->key < b->key ? -1 : 1;
+
+	return 0;
+}
+
+/* sorts and dispatches entries, without lock held so that other threads can fill the next batch */
+static void dispatch_entries(struct scan_batch *b, GArray *entries, GStringChunk *paths)
+{
+	guint i;
+
+	g_array_sort(entries, entry_compare);
+
+	for (i = 0; i < entries->len; i++) {
+		struct scan_batch_entry *e = &g_array_index(entries, struct scan_batch_entry, i);
+
+		(*b->dispatch)(e->path, e->dir, b->data);
+		walk_dir_unref(e->dir);
+	}
+
+	g_array_free(entries, TRUE);
+	g_string_chunk_free(paths);
+}
+
+/* must be called with lock held */
+static GArray *take_entries(struct scan_batch *b, GStringChunk **paths)
+{
+	GArray *entries = b->entries;
+
+	*paths = b->paths;
+
+	b->entries = g_array_sized_new(FALSE, FALSE, sizeof(struct scan_batch_entry), b->size);
+	b->paths = g_string_chunk_new(PATHS_CHUNK_SIZE);
+
+	return entries;
+}
+
+void scan_batch_add(struct scan_batch *b, const char *path, struct walk_dir *dir)
+{
+	struct scan_batch_entry e;
+	GArray *full = NULL;
+	GStringChunk *paths = NULL;
+
+	entry_init(b, &e, path, dir);
+
+	g_mutex_lock(&b->lock);
+
+	e.path = g_string_chunk_insert(b->paths, path);
+	g_array_append_val(b->entries, e);
+
+	if (e.kind == KEY_EXTENT)
+		b->by_extent++;
+	else if (e.kind == KEY_INODE)
+		b->by_inode++;
+	else if (e.kind == KEY_RISK)
+		b->by_risk++;
+
+	if (b->entries->len >= b->size)
+		full = take_entries(b, &paths);
+
+	g_mutex_unlock(&b->lock);
+
+	if (full != NULL)
+		dispatch_entries(b, full, paths);
+}
+
+void scan_batch_flush(struct scan_batch *b)
+{
+	GArray *entries;
+	GStringChunk *paths;
+
+	g_mutex_lock(&b->lock);
+	entries = take_entries(b, &paths);
+	g_mutex_unlock(&b->lock);
+
+	dispatch_entries(b, entries, paths);
+}
+
+void scan_batch_get_stats(struct scan_batch *b, unsigned long *by_extent, unsigned long *by_inode, unsigned long *by_risk)
+{
+	g_mutex_lock(&b->lock);
+	*by_extent = b->by_extent;
+	*by_inode = b->by_inode;
+	*by_risk = b->by_risk;
+	g_mutex_unlock(&b->lock);
+}
+
+void scan_batch_free(struct scan_batch *b)
+{
+	guint i;
+
+	for (i = 0; i < b->entries->len; i++)
+		walk_dir_unref(g_array_index(b->entries, struct scan_batch_entry, i).dir);
+
+	g_array_free(b->entries, TRUE);
+	g_string_chunk_free(b->paths);
+	g_mutex_clear(&b->lock);
+	free(b);
+}
@@ -0,0 +1,64 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#ifndef LIBCORE_SCANORDER_P_H
+#define LIBCORE_SCANORDER_P_H
+
+#include "core/scanconf.h"
+
+#include "dirwalk_p.h"
+
+/*
+ * Reordering of the files found by directory traversal.
+ *
+ * Files are collected in a batch; when the batch is full, or when it is
+ * flushed at the end of traversal, its files are sorted by device, then by
+ * position on disk or by inode number, and passed to the dispatch function
+ * in this order. On rotating disks, this replaces seeks between unrelated
+ * places by mostly forward reads.
+ *
+ * In risk order, files are instead sorted by an estimate of how likely they
+ * are to be malicious and how cheap they are to scan, highest first, so
+ * that detections are reported early in long scans.
+ *
+ * Sort keys are computed when files are added, i.e. by the traversal
+ * threads, relative to the directory of the file, and files are dispatched
+ * by the thread that filled the batch.
+ */
+
+struct scan_batch;
+
+/* dispatch is given the directory of the file, which it must reference if it keeps it */
+struct scan_batch *scan_batch_new(enum a6o_scan_order order, int size, void (*dispatch)(const char *path, struct walk_dir *dir, void *data), void *data);
+
+/* dir, which can be NULL, is referenced until the file is dispatched */
+/* may dispatch the whole batch, and then blocks as long as dispatch does */
+void scan_batch_add(struct scan_batch *b, const char *path, struct walk_dir *dir);
+
+/* dispatches the files of the batch, even if it is not full */
+void scan_batch_flush(struct scan_batch *b);
+
+/* numbers of files sorted by position on disk, by inode number and by risk */
+void scan_batch_get_stats(struct scan_batch *b, unsigned long *by_extent, unsigned long *by_inode, unsigned long *by_risk);
+
+void scan_batch_free(struct scan_batch *b);
+
+#endif
@@ -0,0 +1,502 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "scanqueue_p.h"
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Paths are copied one after the other into chunks, each entry being
+ * preceded by a header giving its chunk and its serial number. A chunk is recycled once all its
+ * entries have been popped and released, so that a running scan does not
+ * allocate memory for each queued path.
+ */
+#define CHUNK_SIZE (64 * 1024)
+#define MAX_FREE_CHUNKS 4
+
+struct chunk {
+	struct chunk *next;          /* next chunk in queue order, or in free list */
+	size_t size;                 /* bytes available for entries */
+	size_t write_offset;         /* where next pushed entry is copied */
+	size_t read_offset;          /* next entry to pop */
+	int live;                    /* entries popped and not yet released */
+	int retired;                 /* no longer in the queue, recycled when last live entry is released */
+};
+
+struct entry_header {
+	struct chunk *chunk;
+	unsigned long serial;        /* entries are numbered in push order, which is also pop order */
+	struct walk_dir *dir;        /* referenced until the entry is released or discarded */
+};
+
+#define CHUNK_DATA(C) ((char *)((C) + 1))
+#define ENTRY_HEADER(PATH) ((struct entry_header *)((PATH) - sizeof(struct entry_header)))
+#define ENTRY_PATH(C, OFFSET) (CHUNK_DATA(C) + (OFFSET) + sizeof(struct entry_header))
+
+struct scan_queue {
+	GMutex lock;
+	GCond not_full;
+	GCond not_empty;
+	struct chunk *head;          /* chunk of the next entry to pop */
+	struct chunk *tail;          /* chunk where entries are pushed */
+	struct chunk *free_chunks;
+	int n_free_chunks;
+
+	struct chunk *prefetch_chunk;    /* chunk of the next entry to prefetch, NULL to restart from head */
+	size_t prefetch_offset;
+	unsigned long prefetch_serial;   /* serial of next entry to prefetch, entries being numbered in pop order */
+
+	int max_count;
+	size_t max_bytes;
+	int closed;
+
+	void (*notify)(void *data);
+	void *notify_data;
+
+	struct scan_queue_stats stats;
+};
+
+/* memory used by one entry: the header and the path, aligned for the next header */
+static size_t entry_size(const char *path)
+{
+	size_t size = sizeof(struct entry_header) + strlen(path) + 1;
+
+	return (size + sizeof(struct chunk *) - 1) & ~(sizeof(struct chunk *) - 1);
+}
+
+struct scan_queue *scan_queue_new(int max_count, size_t max_bytes)
+{
+	struct scan_queue *q = malloc(sizeof(struct scan_queue));
+
+	g_mutex_init(&q->lock);
+	g_cond_init(&q->not_full);
+	g_cond_init(&q->not_empty);
+
+	q->head = NULL;
+	q->tail = NULL;
+	q->free_chunks = NULL;
+	q->n_free_chunks = 0;
+
+	q->prefetch_chunk = NULL;
+	q->prefetch_offset = 0;
+	q->prefetch_serial = 0;
+
+	q->max_count = max_count;
+	q->max_bytes = max_bytes;
+	q->closed = 0;
+
+	q->notify = NULL;
+	q->notify_data = NULL;
+
+	memset(&q->stats, 0, sizeof(struct scan_queue_stats));
+
+	return q;
+}
+
+/* must be called with lock held */
+static struct chunk *chunk_get(struct scan_queue *q, size_t entry_size)
+{
+	struct chunk *c;
+
+	if (entry_size <= CHUNK_SIZE && q->free_chunks != NULL) {
+		c = q->free_chunks;
+		q->free_chunks = c->next;
+		q->n_free_chunks--;
+	} else {
+		size_t size = entry_size > CHUNK_SIZE ? entry_size : CHUNK_SIZE;
+
+		c = malloc(sizeof(struct chunk) + size);
+		if (c == NULL)
+			return NULL;
+		c->size = size;
+	}
+
+	c->next = NULL;
+	c->write_offset = 0;
+	c->read_offset = 0;
+	c->live = 0;
+	c->retired = 0;
+
+	return c;
+}
+
+/* must be called with lock held */
+static void chunk_recycle(struct scan_queue *q, struct chunk *c)
+{
+	if (c->size == CHUNK_SIZE && q->n_free_chunks < MAX_FREE_CHUNKS) {
+		c->next = q->free_chunks;
+		q->free_chunks = c;
+		q->n_free_chunks++;
+	} else
+		free(c);
+}
+
+/* must be called with lock held */
+/* releases the directories of the entries not yet popped */
+static void chunk_drop_entries(struct chunk *c)
+{
+	size_t offset;
+	char *path;
+
+	for (offset = c->read_offset; offset < c->write_offset; offset += entry_size(path)) {
+		path = ENTRY_PATH(c, offset);
+		walk_dir_unref(ENTRY_HEADER(path)->dir);
+	}
+
+	c->read_offset = c->write_offset;
+}
+
+/* must be called with lock held */
+/* removes the chunk from the queue, its memory being reused once its popped entries are released */
+static void chunk_retire(struct scan_queue *q, struct chunk *c)
+{
+	if (c == q->prefetch_chunk)
+		q->prefetch_chunk = NULL;
+
+	if (c->live == 0)
+		chunk_recycle(q, c);
+	else
+		c->retired = 1;
+}
+
+static void notify_consumer(struct scan_queue *q)
+{
+	if (q->notify != NULL)
+		(*q->notify)(q->notify_data);
+}
+
+static int is_full(struct scan_queue *q, size_t size)
+{
+	if (q->stats.count == 0)
+		return 0;
+
+	if (q->max_count > 0 && q->stats.count >= q->max_count)
+		return 1;
+
+	if (q->max_bytes > 0 && q->stats.bytes + size > q->max_bytes)
+		return 1;
+
+	return 0;
+}
+
+/* must be called with lock held */
+static int push_tail(struct scan_queue *q, const char *path, struct walk_dir *dir, size_t size)
+{
+	struct chunk *c = q->tail;
+	struct entry_header *header;
+
+	if (c == NULL || c->size - c->write_offset < size) {
+		if ((c = chunk_get(q, size)) == NULL)
+			return -1;
+
+		if (q->tail != NULL)
+			q->tail->next = c;
+		else
+			q->head = c;
+		q->tail = c;
+	}
+
+	header = (struct entry_header *)(CHUNK_DATA(c) + c->write_offset);
+	header->chunk = c;
+	header->serial = q->stats.pops + q->stats.count;
+	header->dir = walk_dir_ref(dir);
+	strcpy(ENTRY_PATH(c, c->write_offset), path);
+	c->write_offset += size;
+
+	return 0;
+}
+
+static int push(struct scan_queue *q, const char *path, struct walk_dir *dir, int wait)
+{
+	size_t size = entry_size(path);
+
+	g_mutex_lock(&q->lock);
+
+	if (!q->closed && is_full(q, size)) {
+		if (!wait) {
+			g_mutex_unlock(&q->lock);
+			return -1;
+		}
+
+		q->stats.waits++;
+		while (!q->closed && is_full(q, size))
+			g_cond_wait(&q->not_full, &q->lock);
+	}
+
+	if (q->closed || push_tail(q, path, dir, size) != 0) {
+		g_mutex_unlock(&q->lock);
+		return -1;
+	}
+
+	q->stats.count++;
+	q->stats.bytes += size;
+
+	if (q->stats.count > q->stats.max_count)
+		q->stats.max_count = q->stats.count;
+	if (q->stats.bytes > q->stats.max_bytes)
+		q->stats.max_bytes = q->stats.bytes;
+
+	g_cond_signal(&q->not_empty);
+
+	g_mutex_unlock(&q->lock);
+
+	notify_consumer(q);
+
+	return 0;
+}
+
+int scan_queue_push(struct scan_queue *q, const char *path, struct walk_dir *dir)
+{
+	return push(q, path, dir, 1);
+}
+
+int scan_queue_try_push(struct scan_queue *q, const char *path, struct walk_dir *dir)
+{
+	return push(q, path, dir, 0);
+}
+
+/* must be called with lock held */
+static char *pop_head(struct scan_queue *q)
+{
+	struct chunk *c;
+	char *path;
+	size_t size;
+
+	if (q->stats.count == 0)
+		return NULL;
+
+	/* entries are never pushed into a chunk before the tail, so a consumed head chunk can be retired */
+	for (c = q->head; c->read_offset == c->write_offset; c = q->head) {
+		q->head = c->next;
+		chunk_retire(q, c);
+	}
+
+	path = ENTRY_PATH(c, c->read_offset);
+	size = entry_size(path);
+
+	c->read_offset += size;
+	c->live++;
+
+	if (q->prefetch_chunk != NULL && q->stats.pops < q->prefetch_serial)
+		q->stats.prefetched_pops++;
+	q->stats.pops++;
+
+	q->stats.count--;
+	q->stats.bytes -= size;
+
+	/* several producers may be waiting, and a big entry may free room for more than one */
+	g_cond_broadcast(&q->not_full);
+
+	return path;
+}
+
+char *scan_queue_pop(struct scan_queue *q)
+{
+	char *path;
+
+	g_mutex_lock(&q->lock);
+
+	while (q->stats.count == 0 && !q->closed)
+		g_cond_wait(&q->not_empty, &q->lock);
+
+	path = pop_head(q);
+
+	g_mutex_unlock(&q->lock);
+
+	return path;
+}
+
+char *scan_queue_try_pop(struct scan_queue *q)
+{
+	char *path;
+
+	g_mutex_lock(&q->lock);
+	path = pop_head(q);
+	g_mutex_unlock(&q->lock);
+
+	return path;
+}
+
+void scan_queue_release(struct scan_queue *q, char *path)
+{
+	struct chunk *c = ENTRY_HEADER(path)->chunk;
+
+	walk_dir_unref(ENTRY_HEADER(path)->dir);
+
+	g_mutex_lock(&q->lock);
+
+	c->live--;
+
+	if (c->live == 0) {
+		if (c->retired)
+			chunk_recycle(q, c);
+		else if (c == q->tail && c->read_offset == c->write_offset) {
+			/* queue is empty and nothing refers to the tail chunk anymore: reuse it from the start */
+			c->read_offset = 0;
+			c->write_offset = 0;
+			if (c == q->prefetch_chunk)
+				q->prefetch_chunk = NULL;
+		}
+	}
+
+	g_mutex_unlock(&q->lock);
+}
+
+int scan_queue_prefetch_next(struct scan_queue *q, int max_ahead, GString *path, unsigned long *serial, struct walk_dir **dir)
+{
+	struct chunk *c;
+	char *entry;
+	int ret = -1;
+
+	g_mutex_lock(&q->lock);
+
+	/* consumers went past the entries already prefetched: restart from the head */
+	if (q->prefetch_chunk == NULL || q->prefetch_serial < q->stats.pops) {
+		q->prefetch_chunk = q->head;
+		q->prefetch_offset = q->head != NULL ? q->head->read_offset : 0;
+		q->prefetch_serial = q->stats.pops;
+	}
+
+	if (q->prefetch_serial < q->stats.pops + q->stats.count
+		&& q->prefetch_serial < q->stats.pops + max_ahead) {
+		for (c = q->prefetch_chunk; q->prefetch_offset == c->write_offset; c = c->next)
+			q->prefetch_offset = 0;
+
+		entry = ENTRY_PATH(c, q->prefetch_offset);
+		g_string_assign(path, entry);
+
+		q->prefetch_chunk = c;
+		q->prefetch_offset += entry_size(entry);
+		*serial = ENTRY_HEADER(entry)->serial;
+		*dir = walk_dir_ref(ENTRY_HEADER(entry)->dir);
+		q->prefetch_serial++;
+		ret = 0;
+	}
+
+	g_mutex_unlock(&q->lock);
+
+	return ret;
+}
+
+unsigned long scan_queue_get_serial(const char *path)
+{
+	return ENTRY_HEADER(path)->serial;
+}
+
+struct walk_dir *scan_queue_get_dir(const char *path)
+{
+	return ENTRY_HEADER(path)->dir;
+}
+
+int scan_queue_is_drained(struct scan_queue *q)
+{
+	int drained;
+
+	g_mutex_lock(&q->lock);
+	drained = q->closed && q->stats.count == 0;
+	g_mutex_unlock(&q->lock);
+
+	return drained;
+}
+
+void scan_queue_set_notify(struct scan_queue *q, void (*notify)(void *data), void *data)
+{
+	g_mutex_lock(&q->lock);
+	q->notify = notify;
+	q->notify_data = data;
+	g_mutex_unlock(&q->lock);
+}
+
+void scan_queue_close(struct scan_queue *q)
+{
+	g_mutex_lock(&q->lock);
+
+	q->closed = 1;
+	g_cond_broadcast(&q->not_empty);
+	g_cond_broadcast(&q->not_full);
+
+	g_mutex_unlock(&q->lock);
+
+	notify_consumer(q);
+}
+
+/* must be called with lock held */
+static void retire_all(struct scan_queue *q)
+{
+	struct chunk *c, *next;
+
+	for (c = q->head; c != NULL; c = next) {
+		next = c->next;
+		chunk_drop_entries(c);
+		chunk_retire(q, c);
+	}
+
+	q->head = NULL;
+	q->tail = NULL;
+}
+
+void scan_queue_discard(struct scan_queue *q)
+{
+	g_mutex_lock(&q->lock);
+
+	retire_all(q);
+
+	q->stats.count = 0;
+	q->stats.bytes = 0;
+
+	q->closed = 1;
+	g_cond_broadcast(&q->not_empty);
+	g_cond_broadcast(&q->not_full);
+
+	g_mutex_unlock(&q->lock);
+
+	notify_consumer(q);
+}
+
+void scan_queue_get_stats(struct scan_queue *q, struct scan_queue_stats *stats)
+{
+	g_mutex_lock(&q->lock);
+	*stats = q->stats;
+	g_mutex_unlock(&q->lock);
+}
+
+void scan_queue_free(struct scan_queue *q)
+{
+	struct chunk *c;
+
+	retire_all(q);
+
+	while ((c = q->free_chunks) != NULL) {
+		q->free_chunks = c->next;
+		free(c);
+	}
+
+	g_mutex_clear(&q->lock);
+	g_cond_clear(&q->not_full);
+	g_cond_clear(&q->not_empty);
+
+	free(q);
+}
@@ -0,0 +1,108 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#ifndef LIBCORE_SCANQUEUE_P_H
+#define LIBCORE_SCANQUEUE_P_H
+
+#include "dirwalk_p.h"
+
+#include <glib.h>
+#include <stddef.h>
+
+/*
+ * A bounded queue of paths between directory traversal and scan threads.
+ *
+ * The queue is bounded both by its number of entries and by the memory
+ * used by the queued paths: when one of the bounds is reached, producers
+ * block until scan threads have consumed enough entries.
+ * An entry is always accepted if the queue is empty, even if it is bigger
+ * than the memory bound.
+ *
+ * Paths are copied into memory owned by the queue and recycled, so that
+ * pushing a path does not allocate memory once the queue has warmed up.
+ * Each path comes with a reference to its directory, if it was found by
+ * the directory walker, so that the file is opened relative to it.
+ */
+
+struct scan_queue;
+
+struct scan_queue_stats {
+	int count;               /* current number of entries */
+	size_t bytes;            /* current memory used by entries */
+	int max_count;           /* highest number of entries reached */
+	size_t max_bytes;        /* highest memory reached */
+	unsigned long waits;     /* number of times a producer was blocked */
+	unsigned long pops;      /* number of entries popped */
+	unsigned long prefetched_pops;  /* entries popped after having been returned by scan_queue_prefetch_next() */
+};
+
+struct scan_queue *scan_queue_new(int max_count, size_t max_bytes);
+
+/* path is copied into the queue, and dir, which can be NULL, is referenced until the path is released */
+/* blocks while the queue is full */
+/* returns 0 if path was queued, -1 if queue is closed or out of memory */
+int scan_queue_push(struct scan_queue *q, const char *path, struct walk_dir *dir);
+
+/* does not block: returns -1 if queue is full, closed or out of memory */
+int scan_queue_try_push(struct scan_queue *q, const char *path, struct walk_dir *dir);
+
+/* blocks while the queue is empty */
+/* returns NULL if queue is closed and empty; returned path must be given back with scan_queue_release() */
+char *scan_queue_pop(struct scan_queue *q);
+
+/* does not block: returns NULL if queue is empty */
+char *scan_queue_try_pop(struct scan_queue *q);
+
+/* returns the serial number of a popped path, entries being numbered in pop order from 0 */
+unsigned long scan_queue_get_serial(const char *path);
+
+/* returns the directory of a popped path, NULL if none, referenced until the path is released */
+struct walk_dir *scan_queue_get_dir(const char *path);
+
+/* gives back a popped path, which must not be used afterwards */
+/* all popped paths must be released before scan_queue_free() */
+void scan_queue_release(struct scan_queue *q, char *path);
+
+/* copies into path the next entry not yet returned by this function, if it is less than */
+/* max_ahead entries from the head of the queue, so that the file can be read in advance */
+/* serial numbers the entry in pop order: the entry has been popped once pops in stats is over serial */
+/* dir is set to a new reference to the directory of the entry, to be released with walk_dir_unref() */
+/* returns 0 if an entry was copied, -1 otherwise */
+int scan_queue_prefetch_next(struct scan_queue *q, int max_ahead, GString *path, unsigned long *serial, struct walk_dir **dir);
+
+/* returns 1 if queue is closed and empty, i.e. no entry will ever be popped again */
+int scan_queue_is_drained(struct scan_queue *q);
+
+/* notify is called after each push, close or discard, without the queue lock held, */
+/* so that consumers that do not block in scan_queue_pop() know when to pop */
+void scan_queue_set_notify(struct scan_queue *q, void (*notify)(void *data), void *data);
+
+/* no more entries will be pushed: wakes up blocked consumers once queue is drained */
+void scan_queue_close(struct scan_queue *q);
+
+/* closes the queue and drops the entries not yet consumed, waking up blocked producers and consumers */
+void scan_queue_discard(struct scan_queue *q);
+
+void scan_queue_get_stats(struct scan_queue *q, struct scan_queue_stats *stats);
+
+void scan_queue_free(struct scan_queue *q);
+
+#endif
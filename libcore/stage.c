@@ -0,0 +1,305 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "core/concurrency.h"
+#include "core/priority.h"
+
+#include "stage_p.h"
+
+#include <glib.h>
+#include <stdlib.h>
+
+/* the threads of all the stages */
+struct stage_pool {
+	GMutex lock;                  /* protects the pool and all its stages */
+	GCond work;                   /* signaled when items are queued */
+	GCond idle;                   /* signaled when a stage may be drained */
+	int max_threads;              /* threads are started as the stages need them, up to this number */
+	int n_started;                /* threads started, never stopped */
+	int busy;                     /* threads processing an item */
+	int wanted;                   /* sum of the threads of the stages */
+	GList *stages;                /* rotated, so that stages are served in turn */
+};
+
+struct stage {
+	struct stage_pool *pool;
+	const char *name;
+	stage_fun_t fun;
+	void *data;
+
+	/* fields below are protected by the pool lock */
+	GQueue items;
+	int max_queued;
+	int max_threads;
+	int running;                  /* pool threads processing items of this stage */
+	int closed;
+
+	struct stage_stats stats;
+	gint64 start_time;
+	gint64 end_time;              /* 0 while the stage is running */
+};
+
+/* must be called with lock held */
+/* returns a stage with items waiting and a free thread */
+static struct stage *pick(struct stage_pool *p)
+{
+	GList *l;
+
+	for (l = p->stages; l != NULL; l = l->next) {
+		struct stage *s = (struct stage *)l->data;
+
+		if (s->running >= s->max_threads || g_queue_is_empty(&s->items))
+			continue;
+
+		p->stages = g_list_remove_link(p->stages, l);
+		p->stages = g_list_concat(p->stages, l);
+
+		return s;
+	}
+
+	return NULL;
+}
+
+static gpointer stage_thread_fun(gpointer data)
+{
+	struct stage_pool *p = (struct stage_pool *)data;
+	struct stage *s;
+	gint64 start;
+	void *item;
+
+	g_mutex_lock(&p->lock);
+
+	/* threads live as long as the process */
+	for (;;) {
+		if ((s = pick(p)) == NULL) {
+			g_cond_wait(&p->work, &p->lock);
+			continue;
+		}
+
+		item = g_queue_pop_head(&s->items);
+		s->running++;
+		p->busy++;
+		g_mutex_unlock(&p->lock);
+
+		start = g_get_monotonic_time();
+		(*s->fun)(item, s->data);
+
+		g_mutex_lock(&p->lock);
+		s->stats.items++;
+		s->stats.busy_time += g_get_monotonic_time() - start;
+		s->running--;
+		p->busy--;
+
+		/* another thread can take the next item of a stage at its limit */
+		if (!g_queue_is_empty(&s->items))
+			g_cond_signal(&p->work);
+		else if (s->running == 0)
+			g_cond_broadcast(&p->idle);
+	}
+
+	return NULL;
+}
+
+/* must be called with lock held */
+static void grow(struct stage_pool *p)
+{
+	while (p->n_started < p->wanted && p->n_started < p->max_threads) {
+#if defined(HAVE_GTHREAD_NEW)
+		g_thread_unref(g_thread_new("stage thread", stage_thread_fun, p));
+#elif defined(HAVE_GTHREAD_CREATE)
+		g_thread_create(stage_thread_fun, p, FALSE, NULL);
+#endif
+		p->n_started++;
+	}
+}
+
+static struct stage_pool *the_pool = NULL;
+G_LOCK_DEFINE_STATIC(the_pool);
+
+static struct stage_pool *stage_pool_get(void)
+{
+	struct stage_pool *p;
+
+	G_LOCK(the_pool);
+
+	if (the_pool == NULL) {
+		p = malloc(sizeof(struct stage_pool));
+
+		g_mutex_init(&p->lock);
+		g_cond_init(&p->work);
+		g_cond_init(&p->idle);
+		p->max_threads = A6O_MAX_THREADS_PER_CPU * os_cpu_count();
+		p->n_started = 0;
+		p->busy = 0;
+		p->wanted = 0;
+		p->stages = NULL;
+
+		the_pool = p;
+	}
+
+	p = the_pool;
+
+	G_UNLOCK(the_pool);
+
+	return p;
+}
+
+struct stage *stage_new(const char *name, int n_threads, int max_queued, stage_fun_t fun, void *data)
+{
+	struct stage *s = malloc(sizeof(struct stage));
+	struct stage_pool *p = stage_pool_get();
+
+	if (n_threads < 1)
+		n_threads = 1;
+	if (max_queued < 1)
+		max_queued = 1;
+
+	s->pool = p;
+	s->name = name;
+	s->fun = fun;
+	s->data = data;
+
+	g_queue_init(&s->items);
+	s->max_queued = max_queued;
+	s->max_threads = n_threads;
+	s->running = 0;
+	s->closed = 0;
+
+	s->stats.items = 0;
+	s->stats.inline_items = 0;
+	s->stats.n_threads = n_threads;
+	s->stats.queued = 0;
+	s->stats.max_queued = 0;
+	s->stats.busy_time = 0;
+	s->stats.inline_time = 0;
+	s->stats.elapsed_time = 0;
+	s->start_time = g_get_monotonic_time();
+	s->end_time = 0;
+
+	g_mutex_lock(&p->lock);
+	p->stages = g_list_append(p->stages, s);
+	p->wanted += n_threads;
+	grow(p);
+	g_mutex_unlock(&p->lock);
+
+	return s;
+}
+
+void stage_push(struct stage *s, void *item)
+{
+	struct stage_pool *p = s->pool;
+	gint64 start;
+
+	g_mutex_lock(&p->lock);
+
+	if ((int)g_queue_get_length(&s->items) < s->max_queued) {
+		g_queue_push_tail(&s->items, item);
+		if ((int)g_queue_get_length(&s->items) > s->stats.max_queued)
+			s->stats.max_queued = g_queue_get_length(&s->items);
+
+		g_cond_signal(&p->work);
+		g_mutex_unlock(&p->lock);
+		return;
+	}
+
+	g_mutex_unlock(&p->lock);
+
+	/* the queue is full: waiting for room would hold the producer thread, it does the work instead */
+	start = g_get_monotonic_time();
+	(*s->fun)(item, s->data);
+
+	g_mutex_lock(&p->lock);
+	s->stats.items++;
+	s->stats.inline_items++;
+	s->stats.inline_time += g_get_monotonic_time() - start;
+	g_mutex_unlock(&p->lock);
+}
+
+void stage_close_and_wait(struct stage *s)
+{
+	struct stage_pool *p = s->pool;
+
+	g_mutex_lock(&p->lock);
+
+	if (!s->closed) {
+		while (!g_queue_is_empty(&s->items) || s->running > 0)
+			g_cond_wait(&p->idle, &p->lock);
+
+		p->stages = g_list_remove(p->stages, s);
+		p->wanted -= s->max_threads;
+		s->end_time = g_get_monotonic_time();
+		s->closed = 1;
+	}
+
+	g_mutex_unlock(&p->lock);
+}
+
+void stage_get_stats(struct stage *s, struct stage_stats *stats)
+{
+	struct stage_pool *p = s->pool;
+
+	g_mutex_lock(&p->lock);
+	*stats = s->stats;
+	stats->queued = g_queue_get_length(&s->items);
+	stats->elapsed_time = (s->end_time != 0 ? s->end_time : g_get_monotonic_time()) - s->start_time;
+	g_mutex_unlock(&p->lock);
+}
+
+int stage_stats_utilization(const struct stage_stats *stats)
+{
+	if (stats->elapsed_time <= 0 || stats->n_threads <= 0)
+		return 0;
+
+	return (int)((100 * stats->busy_time) / (stats->elapsed_time * stats->n_threads));
+}
+
+void stage_free(struct stage *s)
+{
+	stage_close_and_wait(s);
+
+	g_queue_clear(&s->items);
+	free(s);
+}
+
+void stage_pool_get_stats(struct stage_pool_stats *stats)
+{
+	struct stage_pool *p;
+
+	G_LOCK(the_pool);
+	p = the_pool;
+	G_UNLOCK(the_pool);
+
+	if (p == NULL) {
+		stats->n_threads = 0;
+		stats->busy_threads = 0;
+		stats->n_stages = 0;
+		return;
+	}
+
+	g_mutex_lock(&p->lock);
+	stats->n_threads = p->n_started;
+	stats->busy_threads = p->busy;
+	stats->n_stages = g_list_length(p->stages);
+	g_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,83 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#ifndef LIBCORE_STAGE_P_H
+#define LIBCORE_STAGE_P_H
+
+#include <glib.h>
+
+/*
+ * A stage of the scan pipeline: a bounded queue of items and a function
+ * applied to each item, which usually pushes the item to the next stage.
+ *
+ * The items of all the stages of all the scans are processed by one pool
+ * of threads, started as stages need them and living as long as the
+ * process, like the threads of the scan executor. Each stage limits the
+ * number of pool threads processing its items at the same time.
+ *
+ * Pushing to a full stage does not block: the producer processes the item
+ * itself, so that a fast stage is slowed down to the pace of the next one
+ * without holding a thread idle. The time pool threads and producers spend
+ * processing items are accounted, to tell which stage limits the
+ * throughput.
+ */
+
+struct stage;
+
+struct stage_stats {
+	unsigned long items;          /* items processed, by the pool threads or by the producers */
+	unsigned long inline_items;   /* items processed by the producers because the queue was full */
+	int n_threads;                /* highest number of pool threads processing items of the stage */
+	int queued;                   /* items waiting in the queue */
+	int max_queued;               /* highest number of items waiting in the queue */
+	gint64 busy_time;             /* microseconds spent by the pool threads processing items */
+	gint64 inline_time;           /* microseconds spent by the producers processing items */
+	gint64 elapsed_time;          /* microseconds since the stage was created, or until it was closed */
+};
+
+struct stage_pool_stats {
+	int n_threads;                /* threads started */
+	int busy_threads;             /* threads processing an item */
+	int n_stages;                 /* stages of running scans */
+};
+
+typedef void (*stage_fun_t)(void *item, void *data);
+
+/* at most n_threads threads of the pool process items of this stage at the same time */
+struct stage *stage_new(const char *name, int n_threads, int max_queued, stage_fun_t fun, void *data);
+
+/* if max_queued items are waiting, the item is processed by the calling thread before returning */
+void stage_push(struct stage *s, void *item);
+
+/* must be called once no more items are pushed: waits until all the items are processed */
+void stage_close_and_wait(struct stage *s);
+
+void stage_get_stats(struct stage *s, struct stage_stats *stats);
+
+/* percentage of the time of the stage threads spent processing items */
+int stage_stats_utilization(const struct stage_stats *stats);
+
+void stage_free(struct stage *s);
+
+/* all zeros if no stage was ever created */
+void stage_pool_get_stats(struct stage_pool_stats *stats);
+
+#endif
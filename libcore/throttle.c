@@ -0,0 +1,314 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "throttle_p.h"
+
+#include <glib.h>
+#include <stdlib.h>
+
+/* in idle only mode, seconds between two measures of system activity */
+#define IDLE_CHECK_PERIOD G_USEC_PER_SEC
+
+struct throttle {
+	GMutex lock;
+	GCond cond;
+	volatile gint active;           /* set if paused or if there is any limit, read without lock */
+	volatile gint priority_id;      /* identifies the current priority, 0 for the default priority */
+
+	struct a6o_scan_limits limits;
+	int paused;
+
+	gint64 next_file_time;          /* monotonic times before which next file must not be scanned, in microseconds */
+	gint64 next_bytes_time;
+
+	struct os_disk_activity *disk_activity;
+	gint64 next_idle_check;
+	int system_busy;
+
+	gint64 wait_time;               /* in microseconds */
+};
+
+/* each priority change of any throttle gets a new id, so that an id is never reused, */
+/* even by a throttle allocated at the address of a freed one */
+static gint last_priority_id;
+G_LOCK_DEFINE_STATIC(last_priority_id);
+
+/* the id of the priority that was applied to a thread, so that it is applied only once */
+static GPrivate applied_priority_key;
+
+static void update_active(struct throttle *t)
+{
+	g_atomic_int_set(&t->active, t->paused
+		|| t->limits.bytes_per_second > 0
+		|| t->limits.files_per_second > 0
+		|| t->limits.idle_only);
+}
+
+struct throttle *throttle_new(const struct a6o_scan_limits *limits)
+{
+	struct throttle *t = malloc(sizeof(struct throttle));
+
+	g_mutex_init(&t->lock);
+	g_cond_init(&t->cond);
+	t->active = 0;
+	t->priority_id = 0;
+	t->paused = 0;
+	t->next_file_time = 0;
+	t->next_bytes_time = 0;
+	t->disk_activity = NULL;
+	t->next_idle_check = 0;
+	t->system_busy = 0;
+	t->wait_time = 0;
+
+	t->limits.bytes_per_second = 0;
+	t->limits.files_per_second = 0;
+	t->limits.io_class = OS_IO_CLASS_NORMAL;
+	t->limits.nice = 0;
+	t->limits.idle_only = 0;
+	t->limits.max_load = 0;
+	t->limits.max_disk_busy = 0;
+
+	if (limits != NULL)
+		throttle_set_limits(t, limits);
+
+	return t;
+}
+
+void throttle_set_limits(struct throttle *t, const struct a6o_scan_limits *limits)
+{
+	g_mutex_lock(&t->lock);
+
+	if (limits->io_class != t->limits.io_class || limits->nice != t->limits.nice) {
+		G_LOCK(last_priority_id);
+		g_atomic_int_set(&t->priority_id, ++last_priority_id);
+		G_UNLOCK(last_priority_id);
+	}
+
+	t->limits = *limits;
+
+	if (t->limits.idle_only && t->disk_activity == NULL)
+		t->disk_activity = os_disk_activity_new();
+
+	update_active(t);
+
+	/* new rates apply from now on */
+	t->next_file_time = 0;
+	t->next_bytes_time = 0;
+	g_cond_broadcast(&t->cond);
+
+	g_mutex_unlock(&t->lock);
+}
+
+void throttle_pause(struct throttle *t, int paused)
+{
+	g_mutex_lock(&t->lock);
+
+	t->paused = paused;
+	update_active(t);
+	g_cond_broadcast(&t->cond);
+
+	g_mutex_unlock(&t->lock);
+}
+
+void throttle_apply_priority(struct throttle *t)
+{
+	gint id;
+	enum os_io_class io_class;
+	int nice;
+
+	/* a thread that never applied a priority has the default one, whose id is 0 */
+	if (GPOINTER_TO_INT(g_private_get(&applied_priority_key)) == g_atomic_int_get(&t->priority_id))
+		return;
+
+	/* id and priority are read together, so that a concurrent change is applied next time */
+	g_mutex_lock(&t->lock);
+	id = t->priority_id;
+	io_class = t->limits.io_class;
+	nice = t->limits.nice;
+	g_mutex_unlock(&t->lock);
+
+	/* on failure, do not try again for each file */
+	os_thread_set_priority(io_class, nice);
+
+	g_private_set(&applied_priority_key, GINT_TO_POINTER(id));
+}
+
+/* must be called with lock held */
+static int system_is_busy(struct throttle *t, gint64 now)
+{
+	int load, disk_busy;
+
+	if (now < t->next_idle_check)
+		return t->system_busy;
+
+	load = os_cpu_load();
+	disk_busy = t->disk_activity != NULL ? os_disk_activity_busy(t->disk_activity) : -1;
+
+	t->system_busy = (load >= 0 && t->limits.max_load > 0 && load > t->limits.max_load)
+		|| (disk_busy >= 0 && t->limits.max_disk_busy > 0 && disk_busy > t->limits.max_disk_busy);
+	t->next_idle_check = now + IDLE_CHECK_PERIOD;
+
+	if (t->system_busy)
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_DEBUG, "system is busy (load %d%%, disk %d%%), scan waits", load, disk_busy);
+
+	return t->system_busy;
+}
+
+static int is_cancelled(volatile int *cancelled)
+{
+	return cancelled != NULL && *cancelled;
+}
+
+/* must be called with lock held */
+static void wait_until(struct throttle *t, gint64 now, gint64 end_time)
+{
+	if (end_time == 0)
+		g_cond_wait(&t->cond, &t->lock);
+	else
+		g_cond_wait_until(&t->cond, &t->lock, end_time);
+
+	t->wait_time += g_get_monotonic_time() - now;
+}
+
+void throttle_wait_unpaused(struct throttle *t, volatile int *cancelled)
+{
+	if (!g_atomic_int_get(&t->active))
+		return;
+
+	g_mutex_lock(&t->lock);
+
+	while (t->paused && !is_cancelled(cancelled))
+		wait_until(t, g_get_monotonic_time(), 0);
+
+	g_mutex_unlock(&t->lock);
+}
+
+/* must be called with lock held */
+/* returns the time from which a file can be scanned, 0 if now, -1 if paused */
+static gint64 ready_time(struct throttle *t, gint64 now)
+{
+	gint64 end_time;
+
+	if (t->paused)
+		return -1;
+
+	end_time = MAX(t->next_file_time, t->next_bytes_time);
+
+	if (t->limits.idle_only && system_is_busy(t, now))
+		end_time = MAX(end_time, t->next_idle_check);
+
+	return end_time <= now ? 0 : end_time;
+}
+
+/* must be called with lock held */
+/* the file is charged when it starts, its bytes when it is done */
+static void charge_file(struct throttle *t)
+{
+	if (t->limits.files_per_second > 0)
+		t->next_file_time = MAX(t->next_file_time, g_get_monotonic_time()) + G_USEC_PER_SEC / t->limits.files_per_second;
+}
+
+void throttle_wait(struct throttle *t, volatile int *cancelled)
+{
+	gint64 now, end_time;
+
+	if (!g_atomic_int_get(&t->active))
+		return;
+
+	g_mutex_lock(&t->lock);
+
+	while (!is_cancelled(cancelled)) {
+		now = g_get_monotonic_time();
+
+		end_time = ready_time(t, now);
+		if (end_time == 0)
+			break;
+
+		wait_until(t, now, end_time == -1 ? 0 : end_time);
+	}
+
+	charge_file(t);
+
+	g_mutex_unlock(&t->lock);
+}
+
+gint64 throttle_try_acquire(struct throttle *t, volatile int *cancelled)
+{
+	gint64 end_time;
+
+	if (!g_atomic_int_get(&t->active) || is_cancelled(cancelled))
+		return 0;
+
+	g_mutex_lock(&t->lock);
+
+	end_time = ready_time(t, g_get_monotonic_time());
+	if (end_time == 0)
+		charge_file(t);
+
+	g_mutex_unlock(&t->lock);
+
+	return end_time;
+}
+
+void throttle_account(struct throttle *t, size_t bytes)
+{
+	if (!g_atomic_int_get(&t->active))
+		return;
+
+	g_mutex_lock(&t->lock);
+
+	if (t->limits.bytes_per_second > 0)
+		t->next_bytes_time = MAX(t->next_bytes_time, g_get_monotonic_time())
+			+ (gint64)((double)bytes * G_USEC_PER_SEC / t->limits.bytes_per_second);
+
+	g_mutex_unlock(&t->lock);
+}
+
+void throttle_wake(struct throttle *t)
+{
+	g_mutex_lock(&t->lock);
+	g_cond_broadcast(&t->cond);
+	g_mutex_unlock(&t->lock);
+}
+
+long long throttle_get_wait_time(struct throttle *t)
+{
+	long long wait_time;
+
+	g_mutex_lock(&t->lock);
+	wait_time = t->wait_time / 1000;
+	g_mutex_unlock(&t->lock);
+
+	return wait_time;
+}
+
+void throttle_free(struct throttle *t)
+{
+	if (t->disk_activity != NULL)
+		os_disk_activity_free(t->disk_activity);
+	g_mutex_clear(&t->lock);
+	g_cond_clear(&t->cond);
+	free(t);
+}
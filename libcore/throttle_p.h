@@ -0,0 +1,79 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#ifndef LIBCORE_THROTTLE_P_H
+#define LIBCORE_THROTTLE_P_H
+
+#include <glib.h>
+#include <stddef.h>
+
+#include "core/scanconf.h"
+
+/*
+ * Scan intensity control.
+ *
+ * A throttle limits the rate of a scan, in files and in bytes per second,
+ * can pause it, and, in idle only mode, makes it wait while the system load
+ * or the disk utilization is high. It also holds the I/O and CPU priority
+ * that the threads of the scan must run with.
+ *
+ * The scan threads call throttle_wait() before scanning a file and
+ * throttle_account() after, with the number of bytes read. Without limits
+ * and when not paused, throttle_wait() returns without taking any lock.
+ * Threads that are shared between scans must not block on one scan: they
+ * call throttle_try_acquire() instead of throttle_wait().
+ */
+
+struct throttle;
+
+struct throttle *throttle_new(const struct a6o_scan_limits *limits);
+
+void throttle_set_limits(struct throttle *t, const struct a6o_scan_limits *limits);
+
+void throttle_pause(struct throttle *t, int paused);
+
+/* applies the I/O and CPU priority to the calling thread, if not already done */
+void throttle_apply_priority(struct throttle *t);
+
+/* waits while paused */
+/* returns immediately if cancelled becomes set, after throttle_wake() */
+void throttle_wait_unpaused(struct throttle *t, volatile int *cancelled);
+
+/* waits until a file can be scanned: not paused, rates below limits and, in idle only mode, system not busy */
+/* returns immediately if cancelled becomes set, after throttle_wake() */
+void throttle_wait(struct throttle *t, volatile int *cancelled);
+
+/* does not wait: if a file can be scanned now, accounts it like throttle_wait() and returns 0, */
+/* otherwise returns the monotonic time, in microseconds, from which to try again, or -1 if paused */
+gint64 throttle_try_acquire(struct throttle *t, volatile int *cancelled);
+
+/* accounts the bytes read by a file scan */
+void throttle_account(struct throttle *t, size_t bytes);
+
+/* wakes up waiting threads, for instance after cancellation */
+void throttle_wake(struct throttle *t);
+
+/* total time spent by threads waiting, in milliseconds */
+long long throttle_get_wait_time(struct throttle *t);
+
+void throttle_free(struct throttle *t);
+
+#endif
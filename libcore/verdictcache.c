@@ -0,0 +1,330 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "verdictcache_p.h"
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+unsigned long long verdict_cache_hash(unsigned long long h, const void *p, size_t n)
+{
+	const unsigned char *b = (const unsigned char *)p;
+
+	while (n--) {
+		h ^= *b++;
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+unsigned long long verdict_cache_hash_str(unsigned long long h, const char *s)
+{
+	if (s == NULL)
+		return verdict_cache_hash(h, "", 1);
+
+	/* hash the terminating null byte too, so that ("ab", "c") and ("a", "bc") differ */
+	return verdict_cache_hash(h, s, strlen(s) + 1);
+}
+
+#ifdef HAVE_MMAP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define VC_MAGIC "A6OVCACH"
+#define VC_VERSION 1
+
+/* number of slots probed from the hash position */
+#define VC_PROBES 8
+
+struct vc_header {
+	char magic[8];
+	guint32 version;
+	guint32 record_size;
+	guint64 n_records;
+	guint64 reserved[5];
+};
+
+struct vc_record {
+	volatile gint seq;       /* odd while record is being written */
+	guint32 status;
+	guint64 dev;
+	guint64 inode;
+	guint64 size;
+	gint64 mtime;
+	gint64 ctime;
+	guint64 tag;
+	guint64 check;           /* checksum of the fields above, 0 if record is empty */
+};
+
+struct verdict_cache {
+	int fd;
+	size_t map_size;
+	void *map;
+	struct vc_record *records;
+	guint64 mask;
+	unsigned int victim;     /* rotating victim slot when all probed slots are used */
+	GMutex write_lock;       /* writers are serialized, readers are lock-free */
+};
+
+static guint64 record_check(const struct vc_record *r)
+{
+	guint64 h = VERDICT_CACHE_HASH_INIT;
+
+	h = verdict_cache_hash(h, &r->status, sizeof(r->status));
+	h = verdict_cache_hash(h, &r->dev, sizeof(r->dev));
+	h = verdict_cache_hash(h, &r->inode, sizeof(r->inode));
+	h = verdict_cache_hash(h, &r->size, sizeof(r->size));
+	h = verdict_cache_hash(h, &r->mtime, sizeof(r->mtime));
+	h = verdict_cache_hash(h, &r->ctime, sizeof(r->ctime));
+	h = verdict_cache_hash(h, &r->tag, sizeof(r->tag));
+
+	/* 0 means empty */
+	return h | 1;
+}
+
+static guint64 slot_hash(const struct os_file_stat *st)
+{
+	guint64 h = st->inode ^ (st->dev * 0x9e3779b97f4a7c15ULL);
+
+	/* splitmix64 finalizer, inode numbers are often sequential */
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+
+	return h;
+}
+
+static int header_is_valid(int fd, guint64 n_records)
+{
+	struct vc_header header;
+
+	if (pread(fd, &header, sizeof(header), 0) != sizeof(header))
+		return 0;
+
+	return !memcmp(header.magic, VC_MAGIC, sizeof(header.magic))
+		&& header.version == VC_VERSION
+		&& header.record_size == sizeof(struct vc_record)
+		&& header.n_records == n_records;
+}
+
+struct verdict_cache *verdict_cache_open(const char *path, unsigned int n_records)
+{
+	struct verdict_cache *vc;
+	struct stat sb;
+	guint64 n = 1;
+	size_t map_size;
+	int fd;
+
+	/* round up to a power of 2 */
+	while (n < n_records)
+		n <<= 1;
+
+	/* records are aligned on their size after the header */
+	map_size = sizeof(struct vc_header) + n * sizeof(struct vc_record);
+
+	fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (fd < 0) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot open verdict cache %s (%s)", path, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &sb) < 0 || (size_t)sb.st_size != map_size || !header_is_valid(fd, n)) {
+		struct vc_header header;
+
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_INFO, "initializing verdict cache %s with %lu records", path, (unsigned long)n);
+
+		/* truncating to 0 first makes sure that all records are empty */
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, VC_MAGIC, sizeof(header.magic));
+		header.version = VC_VERSION;
+		header.record_size = sizeof(struct vc_record);
+		header.n_records = n;
+
+		if (ftruncate(fd, 0) < 0 || ftruncate(fd, map_size) < 0
+			|| pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+			a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot initialize verdict cache %s (%s)", path, strerror(errno));
+			close(fd);
+			return NULL;
+		}
+	}
+
+	vc = malloc(sizeof(struct verdict_cache));
+
+	vc->map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (vc->map == MAP_FAILED) {
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "cannot map verdict cache %s (%s)", path, strerror(errno));
+		close(fd);
+		free(vc);
+		return NULL;
+	}
+
+	vc->fd = fd;
+	vc->map_size = map_size;
+	vc->records = (struct vc_record *)((char *)vc->map + sizeof(struct vc_header));
+	vc->mask = n - 1;
+	vc->victim = 0;
+	g_mutex_init(&vc->write_lock);
+
+	return vc;
+}
+
+static int key_match(const struct vc_record *r, const struct os_file_stat *st)
+{
+	return r->dev == st->dev && r->inode == st->inode;
+}
+
+int verdict_cache_lookup(struct verdict_cache *vc, const struct os_file_stat *st, unsigned long long tag, enum a6o_file_status *status)
+{
+	guint64 h = slot_hash(st);
+	int i;
+
+	/* without an inode number, there is no reliable file identity */
+	if (vc == NULL || st->inode == 0)
+		return 0;
+
+	for (i = 0; i < VC_PROBES; i++) {
+		struct vc_record *r = &vc->records[(h + i) & vc->mask];
+		struct vc_record copy;
+		gint seq;
+
+		seq = g_atomic_int_get(&r->seq);
+		if (seq & 1)
+			continue;
+
+		memcpy(&copy, r, sizeof(copy));
+
+		/* record was modified during copy */
+		if (g_atomic_int_get(&r->seq) != seq)
+			continue;
+
+		/* end of probe sequence */
+		if (copy.check == 0)
+			return 0;
+
+		if (copy.check != record_check(&copy) || !key_match(&copy, st))
+			continue;
+
+		if (copy.size != st->file_size || copy.mtime != st->mtime || copy.ctime != st->ctime || copy.tag != tag)
+			return 0;
+
+		*status = (enum a6o_file_status)copy.status;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+void verdict_cache_store(struct verdict_cache *vc, const struct os_file_stat *st, unsigned long long tag, enum a6o_file_status status)
+{
+	guint64 h = slot_hash(st);
+	struct vc_record *r = NULL;
+	gint seq;
+	int i;
+
+	if (vc == NULL || st->inode == 0)
+		return;
+
+	g_mutex_lock(&vc->write_lock);
+
+	/* slot for the same file, or first empty slot */
+	for (i = 0; i < VC_PROBES; i++) {
+		struct vc_record *p = &vc->records[(h + i) & vc->mask];
+
+		if (p->check == 0 || key_match(p, st)) {
+			r = p;
+			break;
+		}
+	}
+
+	/* all probed slots are used by other files: evict one */
+	if (r == NULL)
+		r = &vc->records[(h + (vc->victim++ % VC_PROBES)) & vc->mask];
+
+	seq = g_atomic_int_get(&r->seq);
+	/* a writer crashed while writing this record */
+	if (seq & 1)
+		seq++;
+
+	g_atomic_int_set(&r->seq, seq + 1);
+
+	r->status = status;
+	r->dev = st->dev;
+	r->inode = st->inode;
+	r->size = st->file_size;
+	r->mtime = st->mtime;
+	r->ctime = st->ctime;
+	r->tag = tag;
+	r->check = record_check(r);
+
+	g_atomic_int_set(&r->seq, seq + 2);
+
+	g_mutex_unlock(&vc->write_lock);
+}
+
+void verdict_cache_close(struct verdict_cache *vc)
+{
+	if (vc == NULL)
+		return;
+
+	if (munmap(vc->map, vc->map_size) < 0)
+		a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "error unmapping verdict cache (%s)", strerror(errno));
+
+	close(vc->fd);
+	g_mutex_clear(&vc->write_lock);
+	free(vc);
+}
+
+#else
+
+struct verdict_cache *verdict_cache_open(const char *path, unsigned int n_records)
+{
+	a6o_log(A6O_LOG_LIB, A6O_LOG_LEVEL_WARNING, "verdict cache %s not opened, memory-mapped files are not supported", path);
+
+	return NULL;
+}
+
+int verdict_cache_lookup(struct verdict_cache *vc, const struct os_file_stat *st, unsigned long long tag, enum a6o_file_status *status)
+{
+	return 0;
+}
+
+void verdict_cache_store(struct verdict_cache *vc, const struct os_file_stat *st, unsigned long long tag, enum a6o_file_status status)
+{
+}
+
+void verdict_cache_close(struct verdict_cache *vc)
+{
+}
+
+#endif
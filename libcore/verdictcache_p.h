@@ -0,0 +1,64 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#ifndef LIBCORE_VERDICTCACHE_P_H
+#define LIBCORE_VERDICTCACHE_P_H
+
+#include <libarmadito/armadito.h>
+#include "core/file.h"
+
+/*
+ * A persistent cache of scan verdicts.
+ *
+ * A verdict is stored for a file identity: device, inode, size, modification
+ * and status change times, and for a tag identifying the modules and their
+ * signature bases. If a file is modified or if bases are updated, the
+ * identity or the tag does not match anymore and the verdict is ignored.
+ *
+ * The cache is a fixed size hash table in a memory-mapped file. Lookups
+ * do not take any lock: each record has a sequence number and a checksum,
+ * and a record that is being written or is corrupted is considered missing.
+ */
+
+struct verdict_cache;
+
+#define VERDICT_CACHE_DEFAULT_SIZE (1 << 20)
+
+/* opens or creates the cache file */
+/* if the file exists but has a different size or format, it is reset */
+/* returns NULL if the cache cannot be opened or if memory-mapped files are not supported */
+struct verdict_cache *verdict_cache_open(const char *path, unsigned int n_records);
+
+/* returns 1 and fills status if a verdict was found for this file and tag, 0 otherwise */
+int verdict_cache_lookup(struct verdict_cache *vc, const struct os_file_stat *st, unsigned long long tag, enum a6o_file_status *status);
+
+void verdict_cache_store(struct verdict_cache *vc, const struct os_file_stat *st, unsigned long long tag, enum a6o_file_status status);
+
+void verdict_cache_close(struct verdict_cache *vc);
+
+/* helpers to compute tags, FNV-1a hash */
+#define VERDICT_CACHE_HASH_INIT 0xcbf29ce484222325ULL
+
+unsigned long long verdict_cache_hash(unsigned long long h, const void *p, size_t n);
+
+unsigned long long verdict_cache_hash_str(unsigned long long h, const char *s);
+
+#endif
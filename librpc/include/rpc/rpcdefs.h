@@ -62,6 +62,8 @@ JRPC_STRUCT(a6o_info)
 	JRPC_STRUCT_FIELD_STRING(antivirus_version)
 	JRPC_STRUCT_FIELD_ENUM(a6o_update_status, global_status)
 	JRPC_STRUCT_FIELD_INT(time_t, global_update_ts)
+	JRPC_STRUCT_FIELD_INT(int, stage_threads)
+	JRPC_STRUCT_FIELD_INT(int, stage_busy_threads)
 	JRPC_STRUCT_FIELD_PTR_ARRAY(a6o_module_info, module_infos)
 JRPC_STRUCT_END
 
@@ -100,6 +102,7 @@ JRPC_STRUCT(a6o_detection_event)
 	JRPC_STRUCT_FIELD_ENUM(a6o_action, scan_action)
 	JRPC_STRUCT_FIELD_STRING(module_name)
 	JRPC_STRUCT_FIELD_STRING(module_report)
+	JRPC_STRUCT_FIELD_STRING(digest)
 JRPC_STRUCT_END
 
 JRPC_STRUCT(a6o_on_demand_start_event)
@@ -110,6 +113,8 @@ JRPC_STRUCT_END
 JRPC_STRUCT(a6o_on_demand_completed_event)
 	JRPC_STRUCT_FIELD_INT(unsigned int, scan_id)
 	JRPC_STRUCT_FIELD_INT(int, cancelled)
+	JRPC_STRUCT_FIELD_INT(int, budget_exhausted)
+	JRPC_STRUCT_FIELD_INT(int, coverage)
 	JRPC_STRUCT_FIELD_INT(size_t, total_malware_count)
 	JRPC_STRUCT_FIELD_INT(size_t, total_suspicious_count)
 	JRPC_STRUCT_FIELD_INT(size_t, total_scanned_count)
@@ -123,6 +128,15 @@ JRPC_STRUCT(a6o_on_demand_progress_event)
 	JRPC_STRUCT_FIELD_INT(size_t, malware_count)
 	JRPC_STRUCT_FIELD_INT(size_t, suspicious_count)
 	JRPC_STRUCT_FIELD_INT(size_t, scanned_count)
+	JRPC_STRUCT_FIELD_INT(size_t, queued_count)
+	JRPC_STRUCT_FIELD_INT(size_t, queued_bytes)
+	JRPC_STRUCT_FIELD_INT(int, thread_share)
+	JRPC_STRUCT_FIELD_INT(int, module_stage_utilization)
+	JRPC_STRUCT_FIELD_INT(size_t, module_stage_queued)
+	JRPC_STRUCT_FIELD_INT(size_t, module_stage_inline)
+	JRPC_STRUCT_FIELD_INT(int, report_stage_utilization)
+	JRPC_STRUCT_FIELD_INT(size_t, report_stage_queued)
+	JRPC_STRUCT_FIELD_INT(size_t, report_stage_inline)
 JRPC_STRUCT_END
 
 JRPC_STRUCT(a6o_quarantine_event)
@@ -155,12 +169,52 @@ JRPC_STRUCT(a6o_event)
 	JRPC_STRUCT_FIELD_UNION(a6o_event_union, u, type)
 JRPC_STRUCT_END
 
+JRPC_ENUM(os_io_class)
+	JRPC_ENUM_VALUE(OS_IO_CLASS_NORMAL)
+	JRPC_ENUM_VALUE(OS_IO_CLASS_BACKGROUND)
+	JRPC_ENUM_VALUE(OS_IO_CLASS_IDLE)
+JRPC_ENUM_END
+
+JRPC_STRUCT(a6o_rpc_scan_limits)
+	JRPC_STRUCT_FIELD_INT(int, limited)
+	JRPC_STRUCT_FIELD_INT(size_t, bytes_per_second)
+	JRPC_STRUCT_FIELD_INT(int, files_per_second)
+	JRPC_STRUCT_FIELD_ENUM(os_io_class, io_class)
+	JRPC_STRUCT_FIELD_INT(int, nice)
+	JRPC_STRUCT_FIELD_INT(int, idle_only)
+JRPC_STRUCT_END
+
 JRPC_STRUCT(a6o_rpc_scan_param)
 	JRPC_STRUCT_FIELD_STRING(root_path)
 	JRPC_STRUCT_FIELD_INT(int, send_progress)
 	JRPC_STRUCT_FIELD_INT(int, recursive)
 	JRPC_STRUCT_FIELD_INT(int, threaded)
 	JRPC_STRUCT_FIELD_INT(time_t, scan_id)
+	JRPC_STRUCT_FIELD_STRUCT(a6o_rpc_scan_limits, limits)
+JRPC_STRUCT_END
+
+JRPC_STRUCT(a6o_rpc_cancel_param)
+	JRPC_STRUCT_FIELD_INT(time_t, scan_id)
+JRPC_STRUCT_END
+
+JRPC_STRUCT(a6o_rpc_resume_param)
+	JRPC_STRUCT_FIELD_INT(time_t, scan_id)
+	JRPC_STRUCT_FIELD_INT(int, send_progress)
+	JRPC_STRUCT_FIELD_STRUCT(a6o_rpc_scan_limits, limits)
+JRPC_STRUCT_END
+
+JRPC_STRUCT(a6o_rpc_pause_param)
+	JRPC_STRUCT_FIELD_INT(time_t, scan_id)
+	JRPC_STRUCT_FIELD_INT(int, paused)
+JRPC_STRUCT_END
+
+JRPC_STRUCT(a6o_rpc_limit_param)
+	JRPC_STRUCT_FIELD_INT(time_t, scan_id)
+	JRPC_STRUCT_FIELD_INT(size_t, bytes_per_second)
+	JRPC_STRUCT_FIELD_INT(int, files_per_second)
+	JRPC_STRUCT_FIELD_ENUM(os_io_class, io_class)
+	JRPC_STRUCT_FIELD_INT(int, nice)
+	JRPC_STRUCT_FIELD_INT(int, idle_only)
 JRPC_STRUCT_END
 
 JRPC_STRUCT(a6o_rpc_listen_param)
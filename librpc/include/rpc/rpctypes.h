@@ -24,6 +24,18 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #include "core/action.h"
 #include "core/event.h"
 #include "core/info.h"
+#include "core/priority.h"
+
+/* limits given with a scan request apply from its first file */
+/* if limited is not set, the scan has the limits of the on-demand scan configuration */
+struct a6o_rpc_scan_limits {
+	int limited;
+	size_t bytes_per_second;
+	int files_per_second;
+	enum os_io_class io_class;
+	int nice;
+	int idle_only;
+};
 
 struct a6o_rpc_scan_param {
 	const char *root_path;
@@ -31,6 +43,31 @@ struct a6o_rpc_scan_param {
 	int recursive;
 	int threaded;
 	time_t scan_id;
+	struct a6o_rpc_scan_limits limits;
+};
+
+struct a6o_rpc_cancel_param {
+	time_t scan_id;
+};
+
+struct a6o_rpc_resume_param {
+	time_t scan_id;
+	int send_progress;
+	struct a6o_rpc_scan_limits limits;
+};
+
+struct a6o_rpc_pause_param {
+	time_t scan_id;
+	int paused;
+};
+
+struct a6o_rpc_limit_param {
+	time_t scan_id;
+	size_t bytes_per_second;
+	int files_per_second;
+	enum os_io_class io_class;
+	int nice;
+	int idle_only;
 };
 
 struct a6o_rpc_listen_param {
@@ -26,20 +26,91 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #include "core/handle.h"
 #include "core/info.h"
 #include "core/ondemand.h"
+#include "core/scanconf.h"
 #include "rpc/rpctypes.h"
 
 #include <glib.h>
 
+/* method specific error codes */
+#define ERR_SCAN_NOT_FOUND ((unsigned char)1)
+#define ERR_NO_CHECKPOINT ((unsigned char)2)
+#define ERR_RELOAD_FAILED ((unsigned char)3)
+
 struct scan_event_data {
 	struct jrpc_connection *conn;
 	struct a6o_on_demand *on_demand;
+	/* the on-demand scan is freed before the event callback is removed, so keep a copy of its id */
+	time_t scan_id;
 };
 
+/* running on-demand scans, by scan id, so that they can be cancelled */
+static GHashTable *running_scans = NULL;
+G_LOCK_DEFINE_STATIC(running_scans);
+
+static void running_scans_add(time_t scan_id, struct a6o_on_demand *on_demand)
+{
+	gint64 *key = malloc(sizeof(gint64));
+
+	*key = scan_id;
+
+	G_LOCK(running_scans);
+	if (running_scans == NULL)
+		running_scans = g_hash_table_new_full(g_int64_hash, g_int64_equal, free, NULL);
+	g_hash_table_replace(running_scans, key, on_demand);
+	G_UNLOCK(running_scans);
+}
+
+static void running_scans_remove(time_t scan_id, struct a6o_on_demand *on_demand)
+{
+	gint64 key = scan_id;
+
+	G_LOCK(running_scans);
+	/* another scan may have been started with the same id */
+	if (g_hash_table_lookup(running_scans, &key) == on_demand)
+		g_hash_table_remove(running_scans, &key);
+	G_UNLOCK(running_scans);
+}
+
+typedef void (*running_scan_fun_t)(struct a6o_on_demand *on_demand, void *data);
+
+/* applies fun to the running scan with this id */
+/* returns 0 if a scan with this id was found */
+static int running_scans_apply(time_t scan_id, running_scan_fun_t fun, void *data)
+{
+	gint64 key = scan_id;
+	struct a6o_on_demand *on_demand = NULL;
+
+	/* the lock is kept while fun runs, so that the scan cannot be freed meanwhile */
+	G_LOCK(running_scans);
+	if (running_scans != NULL)
+		on_demand = g_hash_table_lookup(running_scans, &key);
+	if (on_demand != NULL)
+		(*fun)(on_demand, data);
+	G_UNLOCK(running_scans);
+
+	return on_demand == NULL;
+}
+
+static void cancel_scan(struct a6o_on_demand *on_demand, void *data)
+{
+	a6o_on_demand_cancel(on_demand);
+}
+
+static void pause_scan(struct a6o_on_demand *on_demand, void *data)
+{
+	a6o_on_demand_pause(on_demand, *(int *)data);
+}
+
+static void limit_scan(struct a6o_on_demand *on_demand, void *data)
+{
+	a6o_on_demand_set_limits(on_demand, (struct a6o_scan_limits *)data);
+}
+
 static void scan_event_cb(struct a6o_event *ev, void *data)
 {
 	struct scan_event_data *ev_data = (struct scan_event_data *)data;
 	json_t *j_ev;
-	time_t expected_scan_id = a6o_on_demand_get_id(ev_data->on_demand);
+	time_t expected_scan_id = ev_data->scan_id;
 	int ret;
 
 	switch(ev->type) {
@@ -65,23 +136,73 @@ static void scan_event_cb(struct a6o_event *ev, void *data)
 
 static gpointer scan_thread_fun(gpointer data)
 {
-	struct a6o_on_demand *on_demand = (struct a6o_on_demand *)data;
+	struct scan_event_data *ev_data = (struct scan_event_data *)data;
+	struct a6o_on_demand *on_demand = ev_data->on_demand;
 
 	a6o_on_demand_run(on_demand);
 
+	running_scans_remove(ev_data->scan_id, on_demand);
+
+	/* ev_data is not freed: the event callback stays registered, because the event source */
+	/* callback list is not locked against concurrent event firing */
 	a6o_on_demand_free(on_demand);
 
 	return NULL;
 }
 
+/* the limits that are not given by the client are those of the on-demand scan configuration */
+static void get_limits(struct a6o_scan_limits *limits, size_t bytes_per_second, int files_per_second, enum os_io_class io_class, int nice, int idle_only)
+{
+	struct a6o_scan_conf *scan_conf;
+
+	scan_conf = a6o_scan_conf_acquire_on_demand();
+	a6o_scan_conf_get_limits(scan_conf, limits);
+	a6o_scan_conf_release(scan_conf);
+	limits->bytes_per_second = bytes_per_second;
+	limits->files_per_second = files_per_second;
+	limits->io_class = io_class;
+	limits->nice = nice;
+	limits->idle_only = idle_only;
+}
+
+/* runs the scan in a new thread, sending its events to the connection */
+/* the limits are set before the scan thread starts, so that they apply to the first files */
+static void start_scan(struct jrpc_connection *conn, struct a6o_on_demand *on_demand, time_t scan_id, int send_progress,
+		const struct a6o_rpc_scan_limits *scan_limits)
+{
+	struct armadito *armadito = (struct armadito *)jrpc_connection_get_data(conn);
+	struct scan_event_data *ev_data;
+	struct a6o_scan_limits limits;
+	int event_mask;
+
+	if (scan_limits->limited) {
+		get_limits(&limits, scan_limits->bytes_per_second, scan_limits->files_per_second,
+			scan_limits->io_class, scan_limits->nice, scan_limits->idle_only);
+		a6o_on_demand_set_limits(on_demand, &limits);
+	}
+
+	event_mask = EVENT_DETECTION | EVENT_ON_DEMAND_COMPLETED;
+	if (send_progress)
+		event_mask |= EVENT_ON_DEMAND_PROGRESS;
+
+	ev_data = malloc(sizeof(struct scan_event_data));
+	ev_data->conn = conn;
+	ev_data->on_demand = on_demand;
+	ev_data->scan_id = scan_id;
+
+	a6o_event_source_add_cb(a6o_get_event_source(armadito), event_mask, scan_event_cb, ev_data);
+
+	running_scans_add(scan_id, on_demand);
+
+	g_thread_new("scan thread", scan_thread_fun, ev_data);
+}
+
 static int scan_method(struct jrpc_connection *conn, json_t *params, json_t **result)
 {
 	struct armadito *armadito = (struct armadito *)jrpc_connection_get_data(conn);
 	int ret;
-	int event_mask;
 	struct a6o_rpc_scan_param *s_param;
 	struct a6o_on_demand *on_demand;
-	struct scan_event_data *ev_data;
 	enum a6o_scan_flags flags = 0;
 
 	if ((ret = JRPC_JSON2STRUCT(a6o_rpc_scan_param, params, &s_param)))
@@ -89,23 +210,118 @@ static int scan_method(struct jrpc_connection *conn, json_t *params, json_t **re
 
 	a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_DEBUG, "scan path %s id %ld", s_param->root_path, s_param->scan_id);
 
+	if (s_param->limits.limited && (s_param->limits.nice < 0 || s_param->limits.nice > 19))
+		return JRPC_ERR_INVALID_PARAMS;
+
 	if (s_param->threaded)
 		flags |= A6O_SCAN_THREADED;
 	if (s_param->recursive)
 		flags |= A6O_SCAN_RECURSE;
 	on_demand = a6o_on_demand_new(armadito, s_param->root_path, s_param->scan_id, flags, s_param->send_progress);
+	if (on_demand == NULL)
+		return JRPC_ERR_INVALID_PARAMS;
 
-	event_mask = EVENT_DETECTION | EVENT_ON_DEMAND_COMPLETED;
-	if (s_param->send_progress)
-		event_mask |= EVENT_ON_DEMAND_PROGRESS;
+	start_scan(conn, on_demand, s_param->scan_id, s_param->send_progress, &s_param->limits);
 
-	ev_data = malloc(sizeof(struct scan_event_data));
-	ev_data->conn = conn;
-	ev_data->on_demand = on_demand;
+	return JRPC_OK;
+}
 
-	a6o_event_source_add_cb(a6o_get_event_source(armadito), event_mask, scan_event_cb, ev_data);
+/* resumes a scan that was interrupted by a daemon stop, from its last checkpoint */
+static int resume_method(struct jrpc_connection *conn, json_t *params, json_t **result)
+{
+	struct armadito *armadito = (struct armadito *)jrpc_connection_get_data(conn);
+	struct a6o_rpc_resume_param *r_param;
+	struct a6o_on_demand *on_demand;
+	int ret;
+
+	if ((ret = JRPC_JSON2STRUCT(a6o_rpc_resume_param, params, &r_param)))
+		return ret;
+
+	a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_DEBUG, "resume scan id %ld", r_param->scan_id);
+
+	if (r_param->limits.limited && (r_param->limits.nice < 0 || r_param->limits.nice > 19))
+		return JRPC_ERR_INVALID_PARAMS;
+
+	on_demand = a6o_on_demand_resume(armadito, r_param->scan_id, r_param->send_progress);
+	if (on_demand == NULL)
+		return ERR_NO_CHECKPOINT;
+
+	start_scan(conn, on_demand, r_param->scan_id, r_param->send_progress, &r_param->limits);
+
+	return JRPC_OK;
+}
+
+/* cancellation is asynchronous: the scan will send its completion event with 'cancelled' set when it has stopped */
+static int cancel_method(struct jrpc_connection *conn, json_t *params, json_t **result)
+{
+	struct a6o_rpc_cancel_param *c_param;
+	int ret;
+
+	if ((ret = JRPC_JSON2STRUCT(a6o_rpc_cancel_param, params, &c_param)))
+		return ret;
+
+	a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_DEBUG, "cancel scan id %ld", c_param->scan_id);
+
+	if (running_scans_apply(c_param->scan_id, cancel_scan, NULL))
+		return ERR_SCAN_NOT_FOUND;
+
+	return JRPC_OK;
+}
+
+/* a paused scan keeps its threads and open files, and does not read anything until continued */
+static int pause_method(struct jrpc_connection *conn, json_t *params, json_t **result)
+{
+	struct a6o_rpc_pause_param *p_param;
+	int ret;
+
+	if ((ret = JRPC_JSON2STRUCT(a6o_rpc_pause_param, params, &p_param)))
+		return ret;
+
+	a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_DEBUG, "%s scan id %ld", p_param->paused ? "pause" : "continue", p_param->scan_id);
+
+	if (running_scans_apply(p_param->scan_id, pause_scan, &p_param->paused))
+		return ERR_SCAN_NOT_FOUND;
+
+	/* an empty result, so that the caller knows the scan was found */
+	*result = json_null();
+
+	return JRPC_OK;
+}
+
+/* idle only mode thresholds are not part of the request, they come from the configuration */
+static int limit_method(struct jrpc_connection *conn, json_t *params, json_t **result)
+{
+	struct a6o_rpc_limit_param *l_param;
+	struct a6o_scan_limits limits;
+	int ret;
+
+	if ((ret = JRPC_JSON2STRUCT(a6o_rpc_limit_param, params, &l_param)))
+		return ret;
 
-	g_thread_new("scan thread", scan_thread_fun, on_demand);
+	a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_DEBUG, "limit scan id %ld", l_param->scan_id);
+
+	if (l_param->nice < 0 || l_param->nice > 19)
+		return JRPC_ERR_INVALID_PARAMS;
+
+	get_limits(&limits, l_param->bytes_per_second, l_param->files_per_second, l_param->io_class, l_param->nice, l_param->idle_only);
+
+	if (running_scans_apply(l_param->scan_id, limit_scan, &limits))
+		return ERR_SCAN_NOT_FOUND;
+
+	return JRPC_OK;
+}
+
+/* running scans keep the configuration they started with */
+static int reload_method(struct jrpc_connection *conn, json_t *params, json_t **result)
+{
+	struct armadito *armadito = (struct armadito *)jrpc_connection_get_data(conn);
+
+	a6o_log(A6O_LOG_SERVICE, A6O_LOG_LEVEL_DEBUG, "reload configuration");
+
+	if (a6o_reload_conf(armadito))
+		return ERR_RELOAD_FAILED;
+
+	*result = json_null();
 
 	return JRPC_OK;
 }
@@ -118,6 +334,9 @@ static int status_method(struct jrpc_connection *conn, json_t *params, json_t **
 
 	info = a6o_info_new(armadito);
 
+	/* status is polled by the user interface: a bases update is noticed here at the latest */
+	a6o_scan_conf_update_verdict_tags(info);
+
 	if ((ret = JRPC_STRUCT2JSON(a6o_info, info, result)))
 		return ret;
 
@@ -172,8 +391,17 @@ static void create_rpcbe_mapper(void)
 {
 	rpcbe_mapper = jrpc_mapper_new();
 	jrpc_mapper_add(rpcbe_mapper, "scan", scan_method);
+	jrpc_mapper_add(rpcbe_mapper, "cancel", cancel_method);
+	jrpc_mapper_add(rpcbe_mapper, "resume", resume_method);
+	jrpc_mapper_add(rpcbe_mapper, "pause", pause_method);
+	jrpc_mapper_add(rpcbe_mapper, "limit", limit_method);
+	jrpc_mapper_add(rpcbe_mapper, "reload", reload_method);
 	jrpc_mapper_add(rpcbe_mapper, "status", status_method);
 	jrpc_mapper_add(rpcbe_mapper, "listen", listen_method);
+
+	jrpc_mapper_add_error_message(rpcbe_mapper, ERR_SCAN_NOT_FOUND, "no running scan with this id");
+	jrpc_mapper_add_error_message(rpcbe_mapper, ERR_NO_CHECKPOINT, "no checkpoint for this scan id");
+	jrpc_mapper_add_error_message(rpcbe_mapper, ERR_RELOAD_FAILED, "configuration cannot be loaded, previous configuration kept");
 }
 
 struct jrpc_mapper *a6o_get_rpcbe_mapper(void)
@@ -0,0 +1,162 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+
+#include "checkpoint_p.h"
+#include "dirwalk_p.h"
+
+#include <assert.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* paths with the characters that the text format must escape */
+static const char *paths[] = {
+	"/home/user/plain",
+	"/home/user/with space",
+	"/home/user/with\nnewline",
+	"/home/user/with\\backslash",
+	"/home/user/with\"quote",
+	"/home/user/with\ttab and \r return",
+	"/home/user/\xc3\xa9t\xc3\xa9",
+	"/home/user/\x01\x7f\xff",
+	NULL,
+};
+
+static struct dir_walker_dir *dir_new(const char *path, int files_only, int n_skip)
+{
+	struct dir_walker_dir *d = malloc(sizeof(struct dir_walker_dir));
+	int i;
+
+	d->path = strdup(path);
+	d->files_only = files_only;
+	d->skip = NULL;
+
+	if (n_skip > 0) {
+		d->skip = g_ptr_array_new_with_free_func(free);
+		for (i = 0; i < n_skip; i++)
+			g_ptr_array_add(d->skip, g_strdup_printf("%s/%s", path, paths[i]));
+	}
+
+	return d;
+}
+
+static void check_dir(struct dir_walker_dir *expected, struct dir_walker_dir *loaded)
+{
+	guint i;
+
+	assert(!strcmp(expected->path, loaded->path));
+	assert(expected->files_only == loaded->files_only);
+	assert((expected->skip == NULL) == (loaded->skip == NULL));
+
+	if (expected->skip == NULL)
+		return;
+
+	assert(expected->skip->len == loaded->skip->len);
+	for (i = 0; i < expected->skip->len; i++)
+		assert(!strcmp(g_ptr_array_index(expected->skip, i), g_ptr_array_index(loaded->skip, i)));
+}
+
+static void test_round_trip(const char *file)
+{
+	char root_path[] = "/home/user/with\nnewline";
+	struct checkpoint c, *l;
+	guint i;
+	int n;
+
+	c.root_path = root_path;
+	c.flags = 3;
+	c.scanned_count = 12345;
+	c.malware_count = 2;
+	c.suspicious_count = 1;
+	c.cached_count = 100;
+	c.too_big_count = 7;
+	c.frontier = g_ptr_array_new_with_free_func((GDestroyNotify)dir_walker_dir_free);
+
+	for (n = 0; paths[n] != NULL; n++) {
+		g_ptr_array_add(c.frontier, dir_new(paths[n], 0, 0));
+		g_ptr_array_add(c.frontier, dir_new(paths[n], 1, 0));
+		g_ptr_array_add(c.frontier, dir_new(paths[n], 0, n + 1));
+	}
+
+	assert(checkpoint_save(&c, file) == 0);
+
+	l = checkpoint_load(file);
+	assert(l != NULL);
+
+	assert(!strcmp(c.root_path, l->root_path));
+	assert(c.flags == l->flags);
+	assert(c.scanned_count == l->scanned_count);
+	assert(c.malware_count == l->malware_count);
+	assert(c.suspicious_count == l->suspicious_count);
+	assert(c.cached_count == l->cached_count);
+	assert(c.too_big_count == l->too_big_count);
+
+	assert(c.frontier->len == l->frontier->len);
+	for (i = 0; i < c.frontier->len; i++)
+		check_dir(g_ptr_array_index(c.frontier, i), g_ptr_array_index(l->frontier, i));
+
+	checkpoint_free(l);
+	g_ptr_array_free(c.frontier, TRUE);
+}
+
+static void test_invalid(const char *file)
+{
+	static const char *contents[] = {
+		"",
+		"not a checkpoint\nroot /\n",
+		"armadito-checkpoint 1\nflags 0\n",
+		"armadito-checkpoint 1\nroot /\ncounters 1 2\n",
+		"armadito-checkpoint 1\nroot /\nskip /tmp\n",
+		"armadito-checkpoint 1\nroot /\nwalk /tmp\nskip /tmp/a\n",
+		"armadito-checkpoint 1\nroot /\nunknown line\n",
+		NULL,
+	};
+	int i;
+
+	for (i = 0; contents[i] != NULL; i++) {
+		assert(g_file_set_contents(file, contents[i], -1, NULL));
+		assert(checkpoint_load(file) == NULL);
+	}
+
+	unlink(file);
+	assert(checkpoint_load(file) == NULL);
+}
+
+int main(int argc, char **argv)
+{
+	char dir[] = "/tmp/testcheckpoint1.XXXXXX";
+	char *file;
+
+	assert(mkdtemp(dir) != NULL);
+	file = checkpoint_file_path(dir, 42);
+
+	test_round_trip(file);
+	test_invalid(file);
+
+	g_free(file);
+	rmdir(dir);
+
+	return 0;
+}
@@ -51,5 +51,5 @@ int main(int argc, char **argv)
 {
 	assert(argc >= 2);
 
-	os_dir_map(argv[1], 1, test_dirent_cb, NULL);
+	os_dir_map(argv[1], test_dirent_cb, NULL);
 }
@@ -0,0 +1,365 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#define _GNU_SOURCE
+#include <libarmadito/armadito.h>
+
+#include "dirwalk_p.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* test tree: DEPTH levels of WIDTH sub-directories, FILES files in each directory */
+#define DEPTH 3
+#define WIDTH 4
+#define FILES 5
+
+#define N_THREADS 4
+
+struct walk_test {
+	GMutex lock;
+	GHashTable *all;           /* paths of all the files of the tree */
+	GHashTable *seen;          /* paths of the files given to the callback and done */
+	GPtrArray *in_flight;      /* directories of the files given to the callback and not done */
+	GPtrArray *frontier;
+	struct dir_walker *walker;
+	int n_calls;
+	int n_errors;
+	int n_late;                /* calls after traversal was stopped */
+	int hold;                  /* keep every other file in flight */
+	int stop_after;            /* stop traversal after this number of files, 0 for none */
+	int stopped;
+	int use_stop;              /* stop with dir_walker_stop() instead of the return value */
+	int snapshot;              /* save the frontier when stopping */
+};
+
+static int make_tree(GHashTable *all, const char *path, int depth)
+{
+	char *p;
+	int i, fd, n_dirs = 1;
+
+	for (i = 0; i < FILES; i++) {
+		p = g_strdup_printf("%s/file %d", path, i);
+		fd = open(p, O_WRONLY | O_CREAT, 0600);
+		assert(fd >= 0);
+		close(fd);
+		g_hash_table_insert(all, p, p);
+	}
+
+	if (depth == 0)
+		return n_dirs;
+
+	for (i = 0; i < WIDTH; i++) {
+		p = g_strdup_printf("%s/dir%d", path, i);
+		assert(mkdir(p, 0700) == 0);
+		n_dirs += make_tree(all, p, depth - 1);
+		g_free(p);
+	}
+
+	return n_dirs;
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftwbuf)
+{
+	return remove(path);
+}
+
+static void walk_test_init(struct walk_test *wt, GHashTable *all)
+{
+	memset(wt, 0, sizeof(struct walk_test));
+	g_mutex_init(&wt->lock);
+	wt->all = all;
+	wt->seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	wt->in_flight = g_ptr_array_new();
+}
+
+static void walk_test_destroy(struct walk_test *wt)
+{
+	guint i;
+
+	for (i = 0; i < wt->in_flight->len; i++) {
+		struct walk_dir *d = g_ptr_array_index(wt->in_flight, i);
+
+		walk_dir_file_done(d);
+		walk_dir_unref(d);
+	}
+
+	g_ptr_array_free(wt->in_flight, TRUE);
+	g_hash_table_destroy(wt->seen);
+	if (wt->frontier != NULL)
+		g_ptr_array_free(wt->frontier, TRUE);
+	g_mutex_clear(&wt->lock);
+}
+
+/* callbacks are serialized, so that the frontier is saved between two files */
+static int walk_cb(const char *full_path, enum os_file_flag flags, int entry_errno, struct walk_dir *dir, int mark, void *data)
+{
+	struct walk_test *wt = data;
+	int ret = 0;
+
+	g_mutex_lock(&wt->lock);
+
+	if (flags & FILE_FLAG_IS_ERROR) {
+		assert(dir == NULL);
+		wt->n_errors++;
+		goto out;
+	}
+
+	assert(dir != NULL);
+	assert(flags & FILE_FLAG_IS_PLAIN_FILE);
+	assert(g_hash_table_lookup(wt->all, full_path) != NULL);
+
+	/* a thread may have checked that traversal was not stopped just before it was */
+	if (wt->stopped) {
+		wt->n_late++;
+		goto out;
+	}
+
+	wt->n_calls++;
+
+	/* every other file stays in flight, so that its directory stays in the frontier */
+	if (wt->hold && wt->n_calls % 2 == 0) {
+		walk_dir_file_add(dir);
+		g_ptr_array_add(wt->in_flight, walk_dir_ref(dir));
+	} else {
+		/* each file is given once */
+		assert(g_hash_table_lookup(wt->seen, full_path) == NULL);
+		g_hash_table_insert(wt->seen, g_strdup(full_path), wt);
+	}
+
+	if (wt->stop_after == 0 || wt->n_calls < wt->stop_after)
+		goto out;
+
+	wt->stopped = 1;
+
+	if (wt->snapshot)
+		wt->frontier = dir_walker_get_frontier(wt->walker);
+
+	if (wt->use_stop)
+		dir_walker_stop(wt->walker);
+	else
+		ret = 1;
+
+out:
+	g_mutex_unlock(&wt->lock);
+
+	return ret;
+}
+
+static int walk_test_run(struct walk_test *wt, int n_threads, const char *root, GPtrArray *frontier)
+{
+	struct dir_walker_stats stats;
+	guint i;
+	int ret;
+
+	wt->walker = dir_walker_new(n_threads, walk_cb, wt);
+
+	if (frontier == NULL)
+		dir_walker_add(wt->walker, root, 0, NULL);
+	else
+		for (i = 0; i < frontier->len; i++) {
+			struct dir_walker_dir *d = g_ptr_array_index(frontier, i);
+
+			dir_walker_add(wt->walker, d->path, d->files_only, d->skip);
+		}
+
+	ret = dir_walker_run(wt->walker);
+
+	dir_walker_get_stats(wt->walker, &stats);
+	assert(ret || stats.pending_dirs == 0);
+
+	return ret;
+}
+
+static void walk_test_free_walker(struct walk_test *wt)
+{
+	guint i;
+
+	/* the references to the directories must be released before the walker is freed */
+	for (i = 0; i < wt->in_flight->len; i++) {
+		struct walk_dir *d = g_ptr_array_index(wt->in_flight, i);
+
+		walk_dir_file_done(d);
+		walk_dir_unref(d);
+	}
+	g_ptr_array_set_size(wt->in_flight, 0);
+
+	dir_walker_free(wt->walker);
+	wt->walker = NULL;
+}
+
+/* an empty directory is listed and traversal completes without calling the callback */
+static void test_empty_root(const char *root)
+{
+	struct walk_test wt;
+	struct dir_walker_stats stats;
+	GHashTable *all = g_hash_table_new(g_str_hash, g_str_equal);
+	GPtrArray *frontier;
+
+	walk_test_init(&wt, all);
+
+	assert(walk_test_run(&wt, N_THREADS, root, NULL) == 0);
+	assert(wt.n_calls == 0 && wt.n_errors == 0);
+
+	dir_walker_get_stats(wt.walker, &stats);
+	assert(stats.listed_dirs == 1);
+
+	frontier = dir_walker_get_frontier(wt.walker);
+	assert(frontier->len == 0);
+	g_ptr_array_free(frontier, TRUE);
+
+	walk_test_free_walker(&wt);
+	walk_test_destroy(&wt);
+	g_hash_table_destroy(all);
+}
+
+/* a root that does not exist is reported to the callback as an error */
+static void test_missing_root(const char *root)
+{
+	struct walk_test wt;
+	GHashTable *all = g_hash_table_new(g_str_hash, g_str_equal);
+	char *path = g_strdup_printf("%s/does not exist", root);
+
+	walk_test_init(&wt, all);
+
+	assert(walk_test_run(&wt, N_THREADS, path, NULL) == 0);
+	assert(wt.n_calls == 0 && wt.n_errors == 1);
+
+	walk_test_free_walker(&wt);
+	walk_test_destroy(&wt);
+	g_hash_table_destroy(all);
+	g_free(path);
+}
+
+/* all the files are given, and work stealing terminates with all directories listed */
+static void test_full(const char *root, GHashTable *all, int n_dirs, int n_threads)
+{
+	struct walk_test wt;
+	struct dir_walker_stats stats;
+	GPtrArray *frontier;
+
+	guint i;
+
+	walk_test_init(&wt, all);
+	wt.hold = 1;
+
+	assert(walk_test_run(&wt, n_threads, root, NULL) == 0);
+	assert(wt.n_calls == (int)g_hash_table_size(all));
+
+	dir_walker_get_stats(wt.walker, &stats);
+	assert(stats.listed_dirs == n_dirs);
+
+	/* only the files of the directories with files in flight remain */
+	frontier = dir_walker_get_frontier(wt.walker);
+	assert(frontier->len > 0 && frontier->len <= (guint)n_dirs);
+	for (i = 0; i < frontier->len; i++)
+		assert(((struct dir_walker_dir *)g_ptr_array_index(frontier, i))->files_only);
+	g_ptr_array_free(frontier, TRUE);
+
+	walk_test_free_walker(&wt);
+	walk_test_destroy(&wt);
+}
+
+/* returning nonzero from the callback or calling dir_walker_stop() from it stops the traversal */
+static void test_stop(const char *root, GHashTable *all, int use_stop)
+{
+	struct walk_test wt;
+
+	walk_test_init(&wt, all);
+	wt.stop_after = 10;
+	wt.use_stop = use_stop;
+
+	assert(walk_test_run(&wt, N_THREADS, root, NULL) != 0);
+	assert(wt.n_calls == wt.stop_after);
+	assert(wt.n_late < N_THREADS);
+
+	walk_test_free_walker(&wt);
+	walk_test_destroy(&wt);
+}
+
+/* resuming from the frontier saved during traversal gives all the files that were not done */
+static void test_frontier(const char *root, GHashTable *all, int stop_after, int n_threads)
+{
+	struct walk_test wt, resumed;
+	GHashTableIter iter;
+	gpointer key;
+
+	walk_test_init(&wt, all);
+	wt.hold = 1;
+	wt.stop_after = stop_after;
+	wt.snapshot = 1;
+
+	assert(walk_test_run(&wt, n_threads, root, NULL) != 0);
+	assert(wt.frontier != NULL);
+	walk_test_free_walker(&wt);
+
+	walk_test_init(&resumed, all);
+	assert(walk_test_run(&resumed, n_threads, NULL, wt.frontier) == 0);
+
+	g_hash_table_iter_init(&iter, all);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		assert(g_hash_table_lookup(wt.seen, key) != NULL || g_hash_table_lookup(resumed.seen, key) != NULL);
+
+	walk_test_free_walker(&resumed);
+	walk_test_destroy(&resumed);
+	walk_test_destroy(&wt);
+}
+
+int main(int argc, char **argv)
+{
+	char root[] = "/tmp/testdirwalk1.XXXXXX";
+	GHashTable *all = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	char *empty, *tree;
+	int n_dirs;
+
+	assert(mkdtemp(root) != NULL);
+
+	empty = g_strdup_printf("%s/empty", root);
+	assert(mkdir(empty, 0700) == 0);
+	tree = g_strdup_printf("%s/tree", root);
+	assert(mkdir(tree, 0700) == 0);
+	n_dirs = make_tree(all, tree, DEPTH);
+
+	test_empty_root(empty);
+	test_missing_root(root);
+	test_full(tree, all, n_dirs, 1);
+	test_full(tree, all, n_dirs, N_THREADS);
+	test_stop(tree, all, 0);
+	test_stop(tree, all, 1);
+	test_frontier(tree, all, 1, N_THREADS);
+	test_frontier(tree, all, 50, 1);
+	test_frontier(tree, all, 50, N_THREADS);
+	test_frontier(tree, all, g_hash_table_size(all) - 1, N_THREADS);
+
+	g_free(empty);
+	g_free(tree);
+	g_hash_table_destroy(all);
+	nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+	return 0;
+}
@@ -0,0 +1,150 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+
+#include "inodeset_p.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEV 2049
+
+/* devices that fit in the 10 bits of the device index, see inodeset.c */
+#define MAX_DEVICES 1023
+
+/* 64 shards of 1024 slots when the set is created, see inodeset.c */
+#define INITIAL_SLOTS (64 * 1024)
+
+/* enough inodes for every shard to grow several times */
+#define N_INODES 300000
+
+static void test_add(struct inode_set *s)
+{
+	/* inodes that cannot be recorded are always reported as added */
+	assert(inode_set_add(s, DEV, 0) == INODE_SET_ADDED);
+	assert(inode_set_add(s, DEV, 0) == INODE_SET_ADDED);
+	assert(inode_set_add(s, DEV, 1ULL << 48) == INODE_SET_ADDED);
+	assert(inode_set_add(s, DEV, 1ULL << 48) == INODE_SET_ADDED);
+
+	assert(inode_set_add(s, DEV, (1ULL << 48) - 1) == INODE_SET_ADDED);
+	assert(inode_set_add(s, DEV, (1ULL << 48) - 1) == 0);
+
+	/* same inode number on another device */
+	assert(inode_set_add(s, DEV, 1) == INODE_SET_ADDED);
+	assert(inode_set_add(s, DEV + 1, 1) == INODE_SET_ADDED);
+	assert(inode_set_add(s, DEV, 1) == 0);
+	assert(inode_set_add(s, DEV + 1, 1) == 0);
+}
+
+static void test_value(struct inode_set *s)
+{
+	assert(inode_set_add(s, DEV, 10) == INODE_SET_ADDED);
+
+	inode_set_set_value(s, DEV, 10, INODE_SET_MAX_VALUE);
+	assert(inode_set_add(s, DEV, 10) == INODE_SET_MAX_VALUE);
+
+	inode_set_set_value(s, DEV, 10, 5);
+	assert(inode_set_add(s, DEV, 10) == 5);
+
+	/* out of range values are ignored */
+	inode_set_set_value(s, DEV, 10, INODE_SET_MAX_VALUE + 1);
+	inode_set_set_value(s, DEV, 10, -1);
+	assert(inode_set_add(s, DEV, 10) == 5);
+
+	/* setting the value of an inode not in the set does not add it */
+	inode_set_set_value(s, DEV, 11, 7);
+	assert(inode_set_add(s, DEV, 11) == INODE_SET_ADDED);
+	assert(inode_set_add(s, DEV, 11) == 0);
+}
+
+static void test_grow(void)
+{
+	struct inode_set *s = inode_set_new();
+	size_t count, initial_bytes, bytes;
+	unsigned long long inode;
+
+	inode_set_get_stats(s, &count, &initial_bytes);
+	assert(count == 0);
+
+	/* sequential inode numbers, as on most file systems */
+	for (inode = 1; inode <= N_INODES; inode++) {
+		assert(inode_set_add(s, DEV, inode) == INODE_SET_ADDED);
+		inode_set_set_value(s, DEV, inode, inode % (INODE_SET_MAX_VALUE + 1));
+	}
+
+	inode_set_get_stats(s, &count, &bytes);
+	assert(count == N_INODES);
+	assert(bytes > initial_bytes);
+	/* load factor stays under 70% */
+	assert(((bytes - initial_bytes) / sizeof(unsigned long long) + INITIAL_SLOTS) * 7 >= count * 10);
+
+	/* nothing was lost or moved to another value by the growths */
+	for (inode = 1; inode <= N_INODES; inode++)
+		assert(inode_set_add(s, DEV, inode) == (int)(inode % (INODE_SET_MAX_VALUE + 1)));
+
+	inode_set_get_stats(s, &count, &bytes);
+	assert(count == N_INODES);
+
+	inode_set_free(s);
+}
+
+static void test_devices(void)
+{
+	struct inode_set *s = inode_set_new();
+	unsigned long long dev;
+	size_t count, bytes;
+
+	for (dev = 0; dev < MAX_DEVICES; dev++)
+		assert(inode_set_add(s, dev, 42) == INODE_SET_ADDED);
+
+	/* inodes of the devices over the limit are not recorded */
+	for (dev = MAX_DEVICES; dev < MAX_DEVICES + 10; dev++) {
+		assert(inode_set_add(s, dev, 42) == INODE_SET_ADDED);
+		assert(inode_set_add(s, dev, 42) == INODE_SET_ADDED);
+	}
+
+	inode_set_get_stats(s, &count, &bytes);
+	assert(count == MAX_DEVICES);
+
+	/* the devices that fit are still recorded, in any order */
+	for (dev = MAX_DEVICES; dev-- > 0;) {
+		assert(inode_set_add(s, dev, 42) == 0);
+		assert(inode_set_add(s, dev, 43) == INODE_SET_ADDED);
+	}
+
+	inode_set_free(s);
+}
+
+int main(int argc, char **argv)
+{
+	struct inode_set *s = inode_set_new();
+
+	test_add(s);
+	test_value(s);
+	inode_set_free(s);
+
+	test_grow();
+	test_devices();
+
+	return 0;
+}
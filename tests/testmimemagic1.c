@@ -0,0 +1,341 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include "mimemagic_p.h"
+
+#include <assert.h>
+#include <glib.h>
+#include <magic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Headers of small files of each type, cut to the shortest prefix that
+ * libmagic classifies as it classifies the whole file. The bytes after
+ * the string, up to size, are zeros.
+ */
+struct fixture {
+	const char *name;
+	size_t size;
+	const char bytes[1024];
+};
+
+static const struct fixture fixtures[] = {
+	{ "elf111", 18,
+		"\177ELF\001\001\001\000\000\000\000\000\000\000\000\000\001" },
+	{ "elf122", 18,
+		"\177ELF\001\002\001\000\000\000\000\000\000\000\000\000\000"
+		"\002" },
+	{ "elf213", 18,
+		"\177ELF\002\001\001\000\000\000\000\000\000\000\000\000\003" },
+	{ "elf224", 18,
+		"\177ELF\002\002\001\000\000\000\000\000\000\000\000\000\000"
+		"\004" },
+	{ "ld-linux-x86-64.so.2", 568,
+		"\177ELF\002\001\001\003\000\000\000\000\000\000\000\000\003"
+		"\000>\000\001\000\000\000 \253\001\000\000\000\000\000@\000"
+		"\000\000\000\000\000\000\030B\003\000\000\000\000\000\000"
+		"\000\000\000@\0008\000\011\000@\000\027\000\026\000\001\000"
+		"\000\000\004\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"X\015\000\000\000\000\000\000X\015\000\000\000\000\000\000"
+		"\000\020\000\000\000\000\000\000\001\000\000\000\005\000\000"
+		"\000\000\020\000\000\000\000\000\000\000\020\000\000\000\000"
+		"\000\000\000\020\000\000\000\000\000\0001P\002\000\000\000"
+		"\000\0001P\002\000\000\000\000\000\000\020\000\000\000\000"
+		"\000\000\001\000\000\000\004\000\000\000\000p\002\000\000"
+		"\000\000\000\000p\002\000\000\000\000\000\000p\002\000\000"
+		"\000\000\000\024\234\000\000\000\000\000\000\024\234\000\000"
+		"\000\000\000\000\000\020\000\000\000\000\000\000\001\000\000"
+		"\000\006\000\000\000\000\031\003\000\000\000\000\000\000\031"
+		"\003\000\000\000\000\000\000\031\003\000\000\000\000\000\020"
+		"(\000\000\000\000\000\000\330)\000\000\000\000\000\000\000"
+		"\020\000\000\000\000\000\000\002\000\000\000\006\000\000\000"
+		"@.\003\000\000\000\000\000@.\003\000\000\000\000\000@.\003"
+		"\000\000\000\000\000\240\001\000\000\000\000\000\000\240\001"
+		"\000\000\000\000\000\000\010\000\000\000\000\000\000\000\004"
+		"\000\000\000\004\000\000\0008\002\000\000\000\000\000\0008"
+		"\002\000\000\000\000\000\0008\002\000\000\000\000\000\000$"
+		"\000\000\000\000\000\000\000$\000\000\000\000\000\000\000"
+		"\004\000\000\000\000\000\000\000P\345td\004\000\000\000\370"
+		"\317\002\000\000\000\000\000\370\317\002\000\000\000\000\000"
+		"\370\317\002\000\000\000\000\000,\011\000\000\000\000\000"
+		"\000,\011\000\000\000\000\000\000\004\000\000\000\000\000"
+		"\000\000Q\345td\006\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\020\000\000\000\000\000\000\000R\345td\004\000"
+		"\000\000\000\031\003\000\000\000\000\000\000\031\003\000\000"
+		"\000\000\000\000\031\003\000\000\000\000\000\000\027\000\000"
+		"\000\000\000\000\000\027\000\000\000\000\000\000\001" },
+	{ "pe32.exe", 132,
+		"MZ\220\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000@\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\200"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000PE" },
+	{ "pe64.exe", 132,
+		"MZ\220\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000@\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\200"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000PE" },
+	{ "dos.exe", 4,
+		"MZ\220" },
+	{ "z1.zip", 50,
+		"PK\003\004\024\000\000\000\000\000L\017P]wG\337\216\012\000"
+		"\000\000\012\000\000\000\005\000\000\000a.txtxxxxxxxxxxPK"
+		"\003\004\024" },
+	{ "z2.docx", 145,
+		"PK\003\004\024\000\000\000\000\000L\017P]wG\337\216\012\000"
+		"\000\000\012\000\000\000\023\000\000\000[Content_Types].xmlx"
+		"xxxxxxxxxPK\003\004\024\000\000\000\000\000L\017P]wG\337\216"
+		"\012\000\000\000\012\000\000\000\013\000\000\000_rels/.relsx"
+		"xxxxxxxxxPK\003\004\024\000\000\000\000\000L\017P]wG\337\216"
+		"\012\000\000\000\012\000\000\000\021\000\000\000word/" },
+	{ "z3.xlsx", 143,
+		"PK\003\004\024\000\000\000\000\000L\017P]wG\337\216\012\000"
+		"\000\000\012\000\000\000\023\000\000\000[Content_Types].xmlx"
+		"xxxxxxxxxPK\003\004\024\000\000\000\000\000L\017P]wG\337\216"
+		"\012\000\000\000\012\000\000\000\013\000\000\000_rels/.relsx"
+		"xxxxxxxxxPK\003\004\024\000\000\000\000\000L\017P]wG\337\216"
+		"\012\000\000\000\012\000\000\000\017\000\000\000xl/" },
+	{ "z4.pptx", 144,
+		"PK\003\004\024\000\000\000\000\000L\017P]wG\337\216\012\000"
+		"\000\000\012\000\000\000\023\000\000\000[Content_Types].xmlx"
+		"xxxxxxxxxPK\003\004\024\000\000\000\000\000L\017P]wG\337\216"
+		"\012\000\000\000\012\000\000\000\013\000\000\000_rels/.relsx"
+		"xxxxxxxxxPK\003\004\024\000\000\000\000\000L\017P]wG\337\216"
+		"\012\000\000\000\012\000\000\000\024\000\000\000ppt/" },
+	{ "z7.jar", 52,
+		"PK\003\004\024\000\000\000\000\000L\017P]wG\337\216\012\000"
+		"\000\000\012\000\000\000\024\000\000\000META-INF/MANIFEST.MF"
+		"xx" },
+	{ "rar5", 8,
+		"Rar!\032\007\001" },
+	{ "webm", 28,
+		"\032E\337\243\237B\206\201\001B\367\201\001B\362\201\004B"
+		"\363\201\010B\202\204webm" },
+	{ "machofeedface", 4,
+		"\376\355\372\316" },
+	{ "machofeedfacf", 4,
+		"\376\355\372\317" },
+	{ "machocefaedfe", 4,
+		"\316\372\355\376" },
+	{ "machocffaedfe", 4,
+		"\317\372\355\376" },
+	{ "a.pdf", 5,
+		"%PDF-" },
+	{ "a.gz", 4,
+		"\037\213\010" },
+	{ "bz2", 3,
+		"BZh" },
+	{ "xz", 6,
+		"\3757zXZ" },
+	{ "7z", 8,
+		"7z\274\257'\034\000\004" },
+	{ "rar", 7,
+		"Rar!\032\007" },
+	{ "deb", 21,
+		"!<arch>\012debian-binary" },
+	{ "ar", 8,
+		"!<arch>\012" },
+	{ "tar", 512,
+		"hello.txt\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\0000000644\0000000000\0000000000\00000000000006"
+		"\00015264305435\000011423\000 0\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000ustar  \000root\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000root" },
+	{ "#!/bin/sh", 10,
+		"#!/bin/sh\012" },
+	{ "#! /bin/sh", 10,
+		"#! /bin/sh" },
+	{ "#!/bin/bash", 12,
+		"#!/bin/bash\012" },
+	{ "#!/usr/bin/bash", 16,
+		"#!/usr/bin/bash\012" },
+	{ "#!/usr/bin/env bash", 20,
+		"#!/usr/bin/env bash\012" },
+	{ "#!/bin/ash", 11,
+		"#!/bin/ash\012" },
+	{ "#!/bin/ksh", 11,
+		"#!/bin/ksh\012" },
+	{ "#!/bin/zsh", 11,
+		"#!/bin/zsh\012" },
+	{ "#!/usr/bin/zsh", 15,
+		"#!/usr/bin/zsh\012" },
+	{ "#!/bin/csh", 11,
+		"#!/bin/csh\012" },
+	{ "#!/bin/tcsh", 12,
+		"#!/bin/tcsh\012" },
+	{ "#!/usr/bin/perl", 16,
+		"#!/usr/bin/perl\012" },
+	{ "#!/usr/local/bin/perl", 22,
+		"#!/usr/local/bin/perl\012" },
+	{ "#!/usr/bin/env perl", 19,
+		"#!/usr/bin/env perl" },
+	{ "#!/usr/bin/python3", 18,
+		"#!/usr/bin/python3" },
+	{ "#!/usr/local/bin/python3", 24,
+		"#!/usr/local/bin/python3" },
+	{ "#!/usr/bin/env python3", 22,
+		"#!/usr/bin/env python3" },
+	{ "#! /usr/bin/env python", 22,
+		"#! /usr/bin/env python" },
+	{ "#!/usr/bin/ruby", 16,
+		"#!/usr/bin/ruby\012" },
+	{ "#!/usr/local/bin/ruby", 22,
+		"#!/usr/local/bin/ruby\012" },
+	{ "#!/usr/bin/env ruby", 19,
+		"#!/usr/bin/env ruby" },
+	{ "#!/usr/bin/node", 15,
+		"#!/usr/bin/node" },
+	{ "#!/usr/bin/nodejs", 17,
+		"#!/usr/bin/nodejs" },
+	{ "#!/usr/bin/env node", 19,
+		"#!/usr/bin/env node" },
+	{ "#!/usr/bin/php", 15,
+		"#!/usr/bin/php\012" },
+	{ "#!/usr/bin/tclsh", 16,
+		"#!/usr/bin/tclsh" },
+	{ "#!/usr/bin/env tclsh", 20,
+		"#!/usr/bin/env tclsh" },
+	{ "#!/usr/bin/lua", 15,
+		"#!/usr/bin/lua\012" },
+	{ "#!/usr/bin/env lua", 18,
+		"#!/usr/bin/env lua" },
+	{ "png", 16,
+		"\211PNG\015\012\032\012\000\000\000\015IHDR" },
+	{ "gif7", 6,
+		"GIF87a" },
+	{ "a.gif", 6,
+		"GIF89a" },
+	{ "a.jpg", 4,
+		"\377\330\377\340" },
+	{ "tif1", 4,
+		"II*" },
+	{ "tif2", 4,
+		"MM\000*" },
+	{ "webp", 12,
+		"RIFF \000\000\000WEBP" },
+	{ "heic", 12,
+		"\000\000\000\030ftypheic" },
+	{ "flac", 4,
+		"fLaC" },
+	{ "wav", 12,
+		"RIFF \000\000\000WAVE" },
+	{ "avi", 12,
+		"RIFF \000\000\000AVI " },
+	{ "ogg", 35,
+		"OggS\000\002\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\001vorbis" },
+	{ "oggt", 35,
+		"OggS\000\002\000\000\000\000\000\000\000\000\000\000\000\000"
+		"\000\000\000\000\000\000\000\000\000\000\200theora" },
+	{ "mp4", 12,
+		"\000\000\000\030ftypisom" },
+	{ "mp42", 12,
+		"\000\000\000\030ftypmp42" },
+	{ "m4a", 12,
+		"\000\000\000\030ftypM4A " },
+	{ "mov", 12,
+		"\000\000\000\024ftypqt  " },
+	{ "mkv", 32,
+		"\032E\337\243\237B\206\201\001B\367\201\001B\362\201\004B"
+		"\363\201\010B\202\210matroska" },
+};
+
+#define N_FIXTURES (sizeof(fixtures) / sizeof(fixtures[0]))
+
+int main(int argc, char **argv)
+{
+	magic_t m;
+	int *hits;
+	size_t i;
+	int r;
+
+	if (magic_version() < MIME_MAGIC_LIBMAGIC_VERSION) {
+		fprintf(stderr, "libmagic %d is older than %d, skipping\n", magic_version(), MIME_MAGIC_LIBMAGIC_VERSION);
+		return 77;
+	}
+
+	m = magic_open(MAGIC_MIME_TYPE);
+	assert(m != NULL);
+	assert(magic_load(m, NULL) == 0);
+
+	mime_magic_init();
+
+	hits = calloc(mime_magic_n_rules(), sizeof(int));
+
+	for (i = 0; i < N_FIXTURES; i++) {
+		const struct fixture *f = &fixtures[i];
+		const char *guess = mime_magic_guess(f->bytes, f->size);
+		const char *expected = magic_buffer(m, f->bytes, f->size);
+
+		r = mime_magic_rule(f->bytes, f->size);
+		if (r < 0) {
+			fprintf(stderr, "%s: no rule matches\n", f->name);
+			abort();
+		}
+		hits[r]++;
+
+		/* NULL: the rule leaves the file to libmagic */
+		if (guess != NULL && strcmp(guess, expected)) {
+			fprintf(stderr, "%s: rule %d gives %s, libmagic gives %s\n", f->name, r, guess, expected);
+			abort();
+		}
+
+		assert(guess == NULL || guess == g_intern_string(expected));
+	}
+
+	for (r = 0; r < mime_magic_n_rules(); r++) {
+		if (!hits[r]) {
+			fprintf(stderr, "rule %d has no fixture\n", r);
+			abort();
+		}
+	}
+
+	free(hits);
+	magic_close(m);
+
+	return 0;
+}
@@ -0,0 +1,163 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+
+#include "pathtrie_p.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void check(struct path_trie *t, const char **matching, const char **not_matching)
+{
+	const char **p;
+
+	for (p = matching; *p != NULL; p++)
+		if (!path_trie_match(t, *p)) {
+			fprintf(stderr, "'%s' should match\n", *p);
+			assert(0);
+		}
+
+	for (p = not_matching; *p != NULL; p++)
+		if (path_trie_match(t, *p)) {
+			fprintf(stderr, "'%s' should not match\n", *p);
+			assert(0);
+		}
+}
+
+static void test_empty(void)
+{
+	struct path_trie *t = path_trie_new();
+	const char *matching[] = { NULL };
+	const char *not_matching[] = { "", "/", "//", "/home", "home", NULL };
+
+	check(t, matching, not_matching);
+
+	/* an empty path is not a directory */
+	path_trie_add(t, "");
+	check(t, matching, not_matching);
+
+	path_trie_free(t);
+}
+
+static void test_root(void)
+{
+	struct path_trie *t = path_trie_new();
+	const char *matching[] = { "/", "//", "/home", "/home/user/file", "\\", "\\Windows", NULL };
+	const char *not_matching[] = { "", "home", "home/user", NULL };
+
+	path_trie_add(t, "/");
+	check(t, matching, not_matching);
+
+	path_trie_free(t);
+}
+
+static void test_separators(void)
+{
+	struct path_trie *t = path_trie_new();
+	const char *matching[] = {
+		"/home/user",
+		"/home/user/",
+		"/home/user//",
+		"//home//user",
+		"/home/user/file",
+		"/home/user/dir/file",
+		"\\home\\user\\file",
+		"/var/tmp",
+		"/var/tmp/file",
+		"/var//tmp/",
+		"C:\\Windows\\System32",
+		"C:/Windows",
+		"relative/dir/file",
+		NULL,
+	};
+	const char *not_matching[] = {
+		"/",
+		"/home",
+		"/home/",
+		"/home/use",
+		"/home/username",
+		"/home/other/user",
+		"home/user",
+		"/var",
+		"/var/tmpfile",
+		"C:\\Win",
+		"C:",
+		"/relative/dir",
+		"relative",
+		NULL,
+	};
+
+	/* trailing and consecutive separators are ignored */
+	path_trie_add(t, "/home/user/");
+	path_trie_add(t, "/var//tmp");
+	path_trie_add(t, "C:\\Windows\\");
+	path_trie_add(t, "relative/dir");
+	check(t, matching, not_matching);
+
+	path_trie_free(t);
+}
+
+static void test_prefix(void)
+{
+	struct path_trie *t = path_trie_new();
+	const char *matching[] = { "/usr", "/usr/local/bin", "/usr/lib", NULL };
+	const char *not_matching[] = { "/", "/us", "/usrlocal", NULL };
+
+	/* the shortest directory wins, whatever the order in which they are added */
+	path_trie_add(t, "/usr/local/bin");
+	path_trie_add(t, "/usr");
+	path_trie_add(t, "/usr/local");
+	check(t, matching, not_matching);
+
+	path_trie_free(t);
+}
+
+static void test_siblings(void)
+{
+	struct path_trie *t = path_trie_new();
+	char path[64];
+	int i;
+
+	for (i = 0; i < 1000; i += 2) {
+		sprintf(path, "/data/%d", i);
+		path_trie_add(t, path);
+	}
+
+	for (i = 0; i < 1000; i++) {
+		sprintf(path, "/data/%d/file", i);
+		assert(path_trie_match(t, path) == !(i % 2));
+	}
+
+	path_trie_free(t);
+}
+
+int main(int argc, char **argv)
+{
+	test_empty();
+	test_root();
+	test_separators();
+	test_prefix();
+	test_siblings();
+
+	return 0;
+}
@@ -0,0 +1,255 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+#include "armadito-config.h"
+
+#include "scanqueue_p.h"
+
+#include <assert.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* bigger than the chunks of the queue, see scanqueue.c */
+#define BIG_PATH_LEN (100 * 1024)
+
+static int n_notified;
+
+static void notify(void *data)
+{
+	n_notified++;
+}
+
+static GThread *thread_start(GThreadFunc fun, gpointer data)
+{
+#if defined(HAVE_GTHREAD_NEW)
+	return g_thread_new("test thread", fun, data);
+#elif defined(HAVE_GTHREAD_CREATE)
+	return g_thread_create(fun, data, TRUE, NULL);
+#endif
+}
+
+static void test_order(void)
+{
+	struct scan_queue *q = scan_queue_new(0, 0);
+	struct scan_queue_stats stats;
+	char path[64], **popped;
+	int i, n = 20000;
+
+	popped = malloc(n * sizeof(char *));
+
+	assert(scan_queue_try_pop(q) == NULL);
+
+	/* enough entries to fill several chunks */
+	for (i = 0; i < n; i++) {
+		sprintf(path, "/home/user/dir/file-%d", i);
+		assert(scan_queue_push(q, path, NULL) == 0);
+	}
+
+	scan_queue_get_stats(q, &stats);
+	assert(stats.count == n && stats.max_count == n && stats.waits == 0);
+
+	/* popped paths stay valid until they are released, in any order */
+	for (i = 0; i < n; i++) {
+		popped[i] = scan_queue_try_pop(q);
+		assert(popped[i] != NULL);
+		sprintf(path, "/home/user/dir/file-%d", i);
+		assert(!strcmp(popped[i], path));
+		assert(scan_queue_get_serial(popped[i]) == (unsigned long)i);
+		assert(scan_queue_get_dir(popped[i]) == NULL);
+
+		if (i % 3 == 0)
+			scan_queue_release(q, popped[i]);
+	}
+
+	assert(scan_queue_try_pop(q) == NULL);
+
+	for (i = 0; i < n; i++) {
+		sprintf(path, "/home/user/dir/file-%d", i);
+		if (i % 3 != 0) {
+			assert(!strcmp(popped[i], path));
+			scan_queue_release(q, popped[i]);
+		}
+	}
+
+	scan_queue_get_stats(q, &stats);
+	assert(stats.count == 0 && stats.bytes == 0 && stats.pops == (unsigned long)n);
+
+	/* the queue is reused once empty */
+	assert(scan_queue_push(q, "/again", NULL) == 0);
+	popped[0] = scan_queue_pop(q);
+	assert(!strcmp(popped[0], "/again") && scan_queue_get_serial(popped[0]) == (unsigned long)n);
+	scan_queue_release(q, popped[0]);
+
+	free(popped);
+	scan_queue_free(q);
+}
+
+static void test_try_push(void)
+{
+	struct scan_queue *q = scan_queue_new(3, 0);
+	struct scan_queue_stats stats;
+	char *big, *path;
+
+	assert(scan_queue_try_push(q, "/a", NULL) == 0);
+	assert(scan_queue_try_push(q, "/b", NULL) == 0);
+	assert(scan_queue_try_push(q, "/c", NULL) == 0);
+	assert(scan_queue_try_push(q, "/d", NULL) == -1);
+
+	path = scan_queue_try_pop(q);
+	assert(!strcmp(path, "/a"));
+	assert(scan_queue_try_push(q, "/d", NULL) == 0);
+	assert(scan_queue_try_push(q, "/e", NULL) == -1);
+	scan_queue_release(q, path);
+
+	/* a failed try_push is not a wait */
+	scan_queue_get_stats(q, &stats);
+	assert(stats.count == 3 && stats.waits == 0);
+
+	while ((path = scan_queue_try_pop(q)) != NULL)
+		scan_queue_release(q, path);
+	scan_queue_free(q);
+
+	/* memory bound, an entry being accepted by an empty queue even if it is bigger */
+	big = malloc(BIG_PATH_LEN + 1);
+	memset(big, 'x', BIG_PATH_LEN);
+	big[BIG_PATH_LEN] = '\0';
+
+	q = scan_queue_new(0, 1024);
+	assert(scan_queue_try_push(q, big, NULL) == 0);
+	assert(scan_queue_try_push(q, "/small", NULL) == -1);
+
+	path = scan_queue_try_pop(q);
+	assert(!strcmp(path, big));
+	assert(scan_queue_try_push(q, "/small", NULL) == 0);
+	scan_queue_release(q, path);
+
+	path = scan_queue_try_pop(q);
+	assert(!strcmp(path, "/small"));
+	scan_queue_release(q, path);
+
+	scan_queue_free(q);
+	free(big);
+}
+
+static gpointer push_thread_fun(gpointer data)
+{
+	return GINT_TO_POINTER(scan_queue_push((struct scan_queue *)data, "/blocked", NULL));
+}
+
+static void test_discard(void)
+{
+	struct scan_queue *q = scan_queue_new(2, 0);
+	struct scan_queue_stats stats;
+	GThread *producer;
+	char *path;
+
+	n_notified = 0;
+	scan_queue_set_notify(q, notify, NULL);
+
+	assert(scan_queue_push(q, "/a", NULL) == 0);
+	assert(scan_queue_push(q, "/b", NULL) == 0);
+	assert(n_notified == 2);
+
+	path = scan_queue_pop(q);
+	assert(!strcmp(path, "/a"));
+	assert(scan_queue_push(q, "/c", NULL) == 0);
+
+	/* a producer blocked on a full queue is woken up by the discard */
+	producer = thread_start(push_thread_fun, q);
+	do {
+		g_usleep(1000);
+		scan_queue_get_stats(q, &stats);
+	} while (stats.waits == 0);
+
+	scan_queue_discard(q);
+	assert(GPOINTER_TO_INT(g_thread_join(producer)) == -1);
+	assert(n_notified == 4);
+
+	scan_queue_get_stats(q, &stats);
+	assert(stats.count == 0 && stats.bytes == 0);
+	assert(scan_queue_is_drained(q));
+	assert(scan_queue_try_pop(q) == NULL);
+	assert(scan_queue_pop(q) == NULL);
+	assert(scan_queue_push(q, "/d", NULL) == -1);
+	assert(scan_queue_try_push(q, "/d", NULL) == -1);
+
+	/* the path popped before the discard is still valid */
+	assert(!strcmp(path, "/a"));
+	scan_queue_release(q, path);
+
+	scan_queue_free(q);
+}
+
+static gpointer pop_thread_fun(gpointer data)
+{
+	return scan_queue_pop((struct scan_queue *)data);
+}
+
+static void test_drain(void)
+{
+	struct scan_queue *q = scan_queue_new(0, 0);
+	GThread *consumer;
+	char *path;
+
+	assert(scan_queue_push(q, "/a", NULL) == 0);
+	assert(scan_queue_push(q, "/b", NULL) == 0);
+	assert(!scan_queue_is_drained(q));
+
+	/* a closed queue gives its entries until it is empty */
+	scan_queue_close(q);
+	assert(scan_queue_push(q, "/c", NULL) == -1);
+	assert(!scan_queue_is_drained(q));
+
+	path = scan_queue_pop(q);
+	assert(!strcmp(path, "/a"));
+	scan_queue_release(q, path);
+	assert(!scan_queue_is_drained(q));
+
+	path = scan_queue_pop(q);
+	assert(!strcmp(path, "/b"));
+	scan_queue_release(q, path);
+	assert(scan_queue_is_drained(q));
+
+	assert(scan_queue_pop(q) == NULL);
+	scan_queue_free(q);
+
+	/* a consumer blocked on an empty queue is woken up by the close */
+	q = scan_queue_new(0, 0);
+	consumer = thread_start(pop_thread_fun, q);
+	g_usleep(10000);
+	scan_queue_close(q);
+	assert(g_thread_join(consumer) == NULL);
+	assert(scan_queue_is_drained(q));
+	scan_queue_free(q);
+}
+
+int main(int argc, char **argv)
+{
+	test_order();
+	test_try_push();
+	test_discard();
+	test_drain();
+
+	return 0;
+}
@@ -0,0 +1,210 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+#include <libarmadito/armadito.h>
+
+#include "verdictcache_p.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TAG 0x1234567890abcdefULL
+
+/* size of the file header and of a record, see verdictcache.c */
+#define HEADER_SIZE 64
+#define RECORD_SIZE 64
+
+static void file_stat_init(struct os_file_stat *st, unsigned long long inode)
+{
+	st->flags = FILE_FLAG_IS_PLAIN_FILE;
+	st->file_size = 4096;
+	st->dev = 2049;
+	st->inode = inode;
+	st->mtime = 1500000000000000000LL;
+	st->ctime = 1500000001000000000LL;
+}
+
+static int lookup(struct verdict_cache *vc, const struct os_file_stat *st, unsigned long long tag, enum a6o_file_status *status)
+{
+	*status = A6O_FILE_UNDECIDED;
+
+	return verdict_cache_lookup(vc, st, tag, status);
+}
+
+static void test_store_lookup(struct verdict_cache *vc)
+{
+	struct os_file_stat st;
+	enum a6o_file_status status;
+	unsigned long long inode;
+
+	for (inode = 1; inode <= 100; inode++) {
+		file_stat_init(&st, inode);
+		assert(!lookup(vc, &st, TAG, &status));
+		verdict_cache_store(vc, &st, TAG, (inode % 2) ? A6O_FILE_CLEAN : A6O_FILE_MALWARE);
+	}
+
+	for (inode = 1; inode <= 100; inode++) {
+		file_stat_init(&st, inode);
+		assert(lookup(vc, &st, TAG, &status));
+		assert(status == ((inode % 2) ? A6O_FILE_CLEAN : A6O_FILE_MALWARE));
+	}
+
+	/* storing again the same file replaces its verdict */
+	file_stat_init(&st, 1);
+	verdict_cache_store(vc, &st, TAG, A6O_FILE_SUSPICIOUS);
+	assert(lookup(vc, &st, TAG, &status) && status == A6O_FILE_SUSPICIOUS);
+
+	/* no inode number, no identity: nothing is stored */
+	file_stat_init(&st, 0);
+	verdict_cache_store(vc, &st, TAG, A6O_FILE_CLEAN);
+	assert(!lookup(vc, &st, TAG, &status));
+}
+
+static void test_mismatch(struct verdict_cache *vc)
+{
+	struct os_file_stat stored, st;
+	enum a6o_file_status status;
+
+	file_stat_init(&stored, 1000);
+	verdict_cache_store(vc, &stored, TAG, A6O_FILE_CLEAN);
+	assert(lookup(vc, &stored, TAG, &status) && status == A6O_FILE_CLEAN);
+
+	st = stored;
+	st.file_size++;
+	assert(!lookup(vc, &st, TAG, &status));
+
+	st = stored;
+	st.mtime++;
+	assert(!lookup(vc, &st, TAG, &status));
+
+	st = stored;
+	st.ctime++;
+	assert(!lookup(vc, &st, TAG, &status));
+
+	/* same file scanned by other modules or bases */
+	assert(!lookup(vc, &stored, TAG + 1, &status));
+
+	/* another file on another device */
+	st = stored;
+	st.dev++;
+	assert(!lookup(vc, &st, TAG, &status));
+
+	/* mismatches do not remove the stored verdict */
+	assert(lookup(vc, &stored, TAG, &status) && status == A6O_FILE_CLEAN);
+}
+
+static void test_reopen(const char *file)
+{
+	struct verdict_cache *vc;
+	struct os_file_stat st;
+	enum a6o_file_status status;
+
+	file_stat_init(&st, 1000);
+
+	/* same size: the verdicts are kept */
+	vc = verdict_cache_open(file, 1024);
+	assert(vc != NULL);
+	assert(lookup(vc, &st, TAG, &status) && status == A6O_FILE_CLEAN);
+	verdict_cache_close(vc);
+
+	/* other size: the cache is reset */
+	vc = verdict_cache_open(file, 2048);
+	assert(vc != NULL);
+	assert(!lookup(vc, &st, TAG, &status));
+	verdict_cache_close(vc);
+}
+
+static void test_corrupted(const char *file)
+{
+	struct verdict_cache *vc;
+	struct os_file_stat st;
+	enum a6o_file_status status;
+	unsigned char byte;
+	int fd;
+
+	/* with one record, the file of the test is in the record following the header */
+	vc = verdict_cache_open(file, 1);
+	assert(vc != NULL);
+	file_stat_init(&st, 42);
+	verdict_cache_store(vc, &st, TAG, A6O_FILE_MALWARE);
+	verdict_cache_close(vc);
+
+	/* flip a bit of the stored status, after the sequence number */
+	fd = open(file, O_RDWR);
+	assert(fd >= 0);
+	assert(pread(fd, &byte, 1, HEADER_SIZE + 4) == 1);
+	byte ^= 1;
+	assert(pwrite(fd, &byte, 1, HEADER_SIZE + 4) == 1);
+	close(fd);
+
+	vc = verdict_cache_open(file, 1);
+	assert(vc != NULL);
+	assert(!lookup(vc, &st, TAG, &status));
+
+	/* the record can be written again */
+	verdict_cache_store(vc, &st, TAG, A6O_FILE_CLEAN);
+	assert(lookup(vc, &st, TAG, &status) && status == A6O_FILE_CLEAN);
+	verdict_cache_close(vc);
+
+	/* a truncated file is reset */
+	assert(truncate(file, HEADER_SIZE + RECORD_SIZE / 2) == 0);
+	vc = verdict_cache_open(file, 1);
+	assert(vc != NULL);
+	assert(!lookup(vc, &st, TAG, &status));
+	verdict_cache_close(vc);
+}
+
+int main(int argc, char **argv)
+{
+	char dir[] = "/tmp/testverdictcache1.XXXXXX";
+	struct verdict_cache *vc;
+	char *file;
+
+	assert(mkdtemp(dir) != NULL);
+	file = g_strdup_printf("%s/verdicts", dir);
+
+	vc = verdict_cache_open(file, 1024);
+	/* memory-mapped files are not supported */
+	if (vc == NULL) {
+		g_free(file);
+		rmdir(dir);
+		return 77;
+	}
+
+	test_store_lookup(vc);
+	test_mismatch(vc);
+	verdict_cache_close(vc);
+
+	test_reopen(file);
+	test_corrupted(file);
+
+	unlink(file);
+	g_free(file);
+	rmdir(dir);
+
+	return 0;
+}
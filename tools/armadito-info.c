@@ -130,6 +130,7 @@ static void info_print(struct a6o_info *info)
 	printf("global status : %s\n", a6o_update_status_str(info->global_status));
 	time_2_date(info->global_update_ts, buf, sizeof(buf));
 	printf("global update date : %s\n", buf);
+	printf("scan stage threads : %d, %d busy\n", info->stage_threads, info->stage_busy_threads);
 
 	for (p_mod_info = info->module_infos; *p_mod_info != NULL; p_mod_info++) {
 		struct a6o_module_info *mod_info = *p_mod_info;
@@ -36,6 +36,7 @@ along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <time.h>
 
@@ -49,6 +50,12 @@ struct scan_options {
 	int threaded;
 	int no_summary;
 	int print_clean;
+	time_t resume_id;
+	time_t pause_id;
+	int paused;
+	long long limit_rate;
+	int limit_files;
+	int idle;
 	const char *path_to_scan;
 };
 
@@ -60,6 +67,12 @@ static struct option scan_option_defs[] = {
 	{"recursive",    no_argument,        0, 'r'},
 	{"threaded",     no_argument,        0, 't'},
 	{"no-summary",   no_argument,        0, 'n'},
+	{"resume",       required_argument,  0, 'R'},
+	{"pause",        required_argument,  0, 'P'},
+	{"continue",     required_argument,  0, 'C'},
+	{"limit-rate",   required_argument,  0, 'L'},
+	{"limit-files",  required_argument,  0, 'F'},
+	{"idle",         no_argument,        0, 'i'},
 #if O
 	{"print-clean",  no_argument,        0, 'c'},
 #endif
@@ -75,6 +88,8 @@ static void version(void)
 static void usage(void)
 {
 	fprintf(stderr, "usage: " PROGRAM_NAME " [options] FILE|DIR\n");
+	fprintf(stderr, "       " PROGRAM_NAME " [options] --resume=ID\n");
+	fprintf(stderr, "       " PROGRAM_NAME " [options] --pause=ID|--continue=ID\n");
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Armadito antivirus scanner\n");
 	fprintf(stderr, "\n");
@@ -88,6 +103,12 @@ static void usage(void)
 	fprintf(stderr, "  --recursive  -r               scan directories recursively\n");
 	fprintf(stderr, "  --threaded -t                 scan using multiple threads\n");
 	fprintf(stderr, "  --no-summary -n               disable summary at end of scanning\n");
+	fprintf(stderr, "  --resume=ID | -R ID           resume the recursive scan ID, interrupted by a daemon restart\n");
+	fprintf(stderr, "  --pause=ID | -P ID            pause the running scan ID\n");
+	fprintf(stderr, "  --continue=ID | -C ID         continue the paused scan ID\n");
+	fprintf(stderr, "  --limit-rate=BYTES | -L BYTES scan at most BYTES bytes per second\n");
+	fprintf(stderr, "  --limit-files=N | -F N        scan at most N files per second\n");
+	fprintf(stderr, "  --idle -i                     scan with lowest priority, only when system is not busy\n");
 #if O
 	/* yet not available with rpc api */
 	fprintf(stderr, "  --print-clean -c              print also clean files as they are scanned\n");
@@ -105,12 +126,18 @@ static void parse_options(int argc, char **argv, struct scan_options *opts)
 	opts->threaded = 0;
 	opts->no_summary = 0;
 	opts->print_clean = 0;
+	opts->resume_id = 0;
+	opts->pause_id = 0;
+	opts->paused = 0;
+	opts->limit_rate = -1;
+	opts->limit_files = -1;
+	opts->idle = 0;
 	opts->path_to_scan = NULL;
 
 	while (1) {
 		int c;
 
-		c = getopt_long(argc, argv, "hVva:jrtn", scan_option_defs, NULL);
+		c = getopt_long(argc, argv, "hVva:jrtnR:P:C:L:F:i", scan_option_defs, NULL);
 
 		if (c == -1)
 			break;
@@ -140,6 +167,31 @@ static void parse_options(int argc, char **argv, struct scan_options *opts)
 		case 'n': /* no-summary */
 			opts->no_summary = 1;
 			break;
+		case 'R': /* resume */
+			opts->resume_id = strtoul(optarg, NULL, 10);
+			if (opts->resume_id == 0)
+				usage();
+			break;
+		case 'P': /* pause */
+		case 'C': /* continue */
+			opts->pause_id = strtoul(optarg, NULL, 10);
+			opts->paused = (c == 'P');
+			if (opts->pause_id == 0)
+				usage();
+			break;
+		case 'L': /* limit-rate */
+			opts->limit_rate = strtoll(optarg, NULL, 10);
+			if (opts->limit_rate < 0)
+				usage();
+			break;
+		case 'F': /* limit-files */
+			opts->limit_files = strtol(optarg, NULL, 10);
+			if (opts->limit_files < 0)
+				usage();
+			break;
+		case 'i': /* idle */
+			opts->idle = 1;
+			break;
 #if 0
 		case 'c': /* print-clean */
 			opts->print_clean = 1;
@@ -150,6 +202,10 @@ static void parse_options(int argc, char **argv, struct scan_options *opts)
 		}
 	}
 
+	/* a resumed scan gets its path from the daemon */
+	if ((opts->resume_id != 0 || opts->pause_id != 0) && optind == argc)
+		return;
+
 	if (optind != argc - 1)
 		usage();
 
@@ -169,6 +225,12 @@ static void detection_event_print(struct a6o_detection_event *ev)
 static void on_demand_completed_event_print(struct a6o_on_demand_completed_event *ev)
 {
 	printf("\nSCAN SUMMARY:\n");
+	if (ev->cancelled)
+		printf("scan cancelled\n");
+	if (ev->budget_exhausted)
+		printf("scan stopped      : time budget spent\n");
+	if (ev->cancelled || ev->budget_exhausted)
+		printf("coverage          : %d%%\n", ev->coverage);
 	printf("scanned files     : %ld\n", ev->total_scanned_count);
 	printf("malware files     : %ld\n", ev->total_malware_count);
 	printf("suspicious files  : %ld\n", ev->total_suspicious_count);
@@ -195,6 +257,7 @@ static void event_print_json(json_t *j_ev)
 
 struct scan_data {
 	int done;
+	int failed;
 	int format_json;
 	int no_summary;
 };
@@ -231,6 +294,16 @@ static int notify_event_method(struct jrpc_connection *conn, json_t *params, jso
 	return JRPC_OK;
 }
 
+/* for instance, resuming a scan that has no checkpoint: no event will come, so stop waiting */
+static void scan_error_handler(struct jrpc_connection *conn, size_t id, int code, const char *message, json_t *data)
+{
+	struct scan_data *sc_data = (struct scan_data *)jrpc_connection_get_data(conn);
+
+	fprintf(stderr, PROGRAM_NAME ": %s\n", message != NULL ? message : "error");
+	sc_data->done = 1;
+	sc_data->failed = 1;
+}
+
 static struct jrpc_mapper *create_rpcfe_mapper(void)
 {
 	struct jrpc_mapper *rpcfe_mapper;
@@ -255,14 +328,121 @@ static unsigned int create_scan_id()
 	return random();
 }
 
+/* set by SIGINT handler, so that the scan is cancelled in the daemon and not only in this process */
+static volatile sig_atomic_t cancel_requested = 0;
+
+static void sigint_handler(int sig)
+{
+	cancel_requested = 1;
+}
+
+static void catch_sigint(void)
+{
+	struct sigaction sa;
+
+	/* no SA_RESTART: blocking read must return so that the cancel request is sent */
+	sa.sa_handler = sigint_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	sigaction(SIGINT, &sa, NULL);
+}
+
+static int send_cancel(struct jrpc_connection *conn, time_t scan_id)
+{
+	struct a6o_rpc_cancel_param param;
+	json_t *j_param;
+	int ret;
+
+	/* a second interrupt will terminate the program */
+	signal(SIGINT, SIG_DFL);
+
+	param.scan_id = scan_id;
+	if ((ret = JRPC_STRUCT2JSON(a6o_rpc_cancel_param, &param, &j_param)))
+		return ret;
+
+	return jrpc_call(conn, "cancel", j_param, NULL, NULL);
+}
+
+/* limits are part of the scan request, so that they apply to the first files scanned */
+static void get_limits(struct scan_options *opts, struct a6o_rpc_scan_limits *limits)
+{
+	limits->limited = opts->limit_rate >= 0 || opts->limit_files >= 0 || opts->idle;
+	limits->bytes_per_second = opts->limit_rate > 0 ? opts->limit_rate : 0;
+	limits->files_per_second = opts->limit_files > 0 ? opts->limit_files : 0;
+	limits->io_class = opts->idle ? OS_IO_CLASS_IDLE : OS_IO_CLASS_NORMAL;
+	limits->nice = opts->idle ? 19 : 0;
+	limits->idle_only = opts->idle;
+}
+
+static int send_scan(struct jrpc_connection *conn, struct scan_options *opts, time_t *p_scan_id)
+{
+	struct a6o_rpc_scan_param param;
+	json_t *j_param;
+	int ret;
+
+	param.root_path = opts->path_to_scan;
+	param.recursive = opts->recursive;
+	param.threaded = opts->threaded;
+	param.send_progress = 1;
+	param.scan_id = create_scan_id();
+	get_limits(opts, &param.limits);
+	if ((ret = JRPC_STRUCT2JSON(a6o_rpc_scan_param, &param, &j_param)))
+		return ret;
+
+	/* the id allows to resume the scan if the daemon is restarted */
+	if (opts->recursive && !opts->format_json)
+		fprintf(stderr, "scan id %ld\n", (long)param.scan_id);
+
+	*p_scan_id = param.scan_id;
+
+	return jrpc_call(conn, "scan", j_param, NULL, NULL);
+}
+
+static int send_resume(struct jrpc_connection *conn, struct scan_options *opts, time_t *p_scan_id)
+{
+	struct a6o_rpc_resume_param param;
+	json_t *j_param;
+	int ret;
+
+	param.scan_id = opts->resume_id;
+	param.send_progress = 1;
+	get_limits(opts, &param.limits);
+	if ((ret = JRPC_STRUCT2JSON(a6o_rpc_resume_param, &param, &j_param)))
+		return ret;
+
+	*p_scan_id = param.scan_id;
+
+	return jrpc_call(conn, "resume", j_param, NULL, NULL);
+}
+
+static void pause_done_cb(json_t *result, void *user_data)
+{
+	struct scan_data *sc_data = (struct scan_data *)user_data;
+
+	sc_data->done = 1;
+}
+
+static int send_pause(struct jrpc_connection *conn, struct scan_options *opts, struct scan_data *sc_data)
+{
+	struct a6o_rpc_pause_param param;
+	json_t *j_param;
+	int ret;
+
+	param.scan_id = opts->pause_id;
+	param.paused = opts->paused;
+	if ((ret = JRPC_STRUCT2JSON(a6o_rpc_pause_param, &param, &j_param)))
+		return ret;
+
+	return jrpc_call(conn, "pause", j_param, pause_done_cb, sc_data);
+}
+
 static int do_scan(struct scan_options *opts)
 {
 	struct jrpc_connection *conn;
 	int client_sock;
 	int *p_client_sock;
 	int ret;
-	struct a6o_rpc_scan_param param;
-	json_t *j_param;
+	time_t scan_id;
 	struct scan_data sc_data;
 
 	client_sock = unix_client_connect(opts->unix_socket_path, 10);
@@ -274,6 +454,7 @@ static int do_scan(struct scan_options *opts)
 	}
 
 	sc_data.done = 0;
+	sc_data.failed = 0;
 	sc_data.format_json = opts->format_json;
 	sc_data.no_summary = opts->no_summary;
 
@@ -285,43 +466,59 @@ static int do_scan(struct scan_options *opts)
 	jrpc_connection_set_read_cb(conn, unix_fd_read_cb, p_client_sock);
 	jrpc_connection_set_write_cb(conn, unix_fd_write_cb, p_client_sock);
 
-	/* jrpc_connection_set_error_handler(conn, client_error_handler); */
+	jrpc_connection_set_error_handler(conn, scan_error_handler);
 
-	param.root_path = opts->path_to_scan;
-	param.recursive = opts->recursive;
-	param.threaded = opts->threaded;
-	param.send_progress = 1;
-	param.scan_id = create_scan_id();
-	if ((ret = JRPC_STRUCT2JSON(a6o_rpc_scan_param, &param, &j_param))) {
+	if (opts->pause_id != 0) {
+		/* no scan events: wait only for the answer */
+		if ((ret = send_pause(conn, opts, &sc_data)) == 0)
+			while (jrpc_process(conn) != JRPC_EOF && !sc_data.done)
+				;
+		close(client_sock);
 		jrpc_connection_free(conn);
-		return ret;
+		return ret != 0 || sc_data.failed;
 	}
 
-	if ((ret = jrpc_call(conn, "scan", j_param, NULL, NULL))) {
+	if (opts->resume_id != 0)
+		ret = send_resume(conn, opts, &scan_id);
+	else
+		ret = send_scan(conn, opts, &scan_id);
+
+	if (ret) {
 		jrpc_connection_free(conn);
 		return ret;
 	}
 
-	while ((ret = jrpc_process(conn)) != JRPC_EOF && !sc_data.done)
-		;
+	catch_sigint();
+
+	while ((ret = jrpc_process(conn)) != JRPC_EOF && !sc_data.done) {
+		if (cancel_requested == 1) {
+			cancel_requested = 2;
+			send_cancel(conn, scan_id);
+		}
+	}
 
 	if (close(client_sock) < 0)
 		perror("closing connection");
 
 	jrpc_connection_free(conn);
 
-	return 0;
+	/* the connection was closed before the end of the scan, for instance because the daemon exited */
+	if (!sc_data.done)
+		return 1;
+
+	return sc_data.failed;
 }
 
 int main(int argc, char **argv)
 {
 	struct scan_options *opts = (struct scan_options *)malloc(sizeof(struct scan_options));
+	int ret;
 
 	parse_options(argc, argv, opts);
 
-	do_scan(opts);
+	ret = do_scan(opts);
 
 	free(opts);
 
-	return 0;
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,168 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+/*
+ * Measures the throughput of the parallel directory walker (see
+ * libcore/dirwalk.c) for increasing numbers of walker threads, on the
+ * trees under the given directories.
+ *
+ * Usage: bench-dirwalk [-o] [-n ROUNDS] [-t THREADS,...] DIR...
+ *
+ * A first traversal warms up the file system caches, so that traversal
+ * itself is measured and not the disk. With -o, each file is also opened
+ * and closed relative to its directory, as the on-demand scan does.
+ */
+
+#include "armadito-config.h"
+
+#include <libarmadito/armadito.h>
+#include "core/file.h"
+#include "core/io.h"
+#include "dirwalk_p.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PROGRAM_NAME "bench-dirwalk"
+
+struct bench {
+	int open_files;
+	volatile gint n_files;
+	volatile gint n_errors;
+};
+
+static int count_entry(const char *full_path, enum os_file_flag flags, int entry_errno, struct walk_dir *dir, int mark, void *data)
+{
+	struct bench *b = data;
+	int fd;
+
+	if (flags & FILE_FLAG_IS_ERROR) {
+		g_atomic_int_inc(&b->n_errors);
+		return 0;
+	}
+
+	if (!(flags & FILE_FLAG_IS_PLAIN_FILE))
+		return 0;
+
+	g_atomic_int_inc(&b->n_files);
+
+	if (b->open_files && (fd = os_file_open_at(walk_dir_get_fd(dir), full_path, 1)) >= 0)
+		os_close(fd);
+
+	return 0;
+}
+
+/* returns the number of files found */
+static int walk(struct bench *b, int n_threads, int n_dirs, char **dirs)
+{
+	struct dir_walker *w;
+	int i;
+
+	b->n_files = 0;
+	b->n_errors = 0;
+
+	w = dir_walker_new(n_threads, count_entry, b);
+	for (i = 0; i < n_dirs; i++)
+		dir_walker_add(w, dirs[i], 0, NULL);
+
+	dir_walker_run(w);
+	dir_walker_free(w);
+
+	return b->n_files;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: " PROGRAM_NAME " [-o] [-n ROUNDS] [-t THREADS,...] DIR...\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench b;
+	const char *threads = "1,2,4,8,16";
+	gchar **counts;
+	int n_rounds = 5, round, n_files, n_threads, c, i;
+	double rate, base_rate = 0;
+	gint64 start, elapsed;
+
+	b.open_files = 0;
+
+	while ((c = getopt(argc, argv, "on:t:")) != -1) {
+		switch (c) {
+		case 'o':
+			b.open_files = 1;
+			break;
+		case 'n':
+			n_rounds = atoi(optarg);
+			if (n_rounds <= 0)
+				usage();
+			break;
+		case 't':
+			threads = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind >= argc)
+		usage();
+
+	n_files = walk(&b, 1, argc - optind, argv + optind);
+	if (n_files == 0) {
+		fprintf(stderr, PROGRAM_NAME ": no file found\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("files:   %d (%d errors)\n", n_files, b.n_errors);
+	printf("threads  files/s    speedup\n");
+
+	counts = g_strsplit(threads, ",", -1);
+	for (i = 0; counts[i] != NULL; i++) {
+		if ((n_threads = atoi(counts[i])) <= 0)
+			usage();
+
+		/* best of n_rounds, to filter out the noise of other processes */
+		rate = 0;
+		for (round = 0; round < n_rounds; round++) {
+			start = g_get_monotonic_time();
+			n_files = walk(&b, n_threads, argc - optind, argv + optind);
+			elapsed = g_get_monotonic_time() - start;
+
+			if (elapsed > 0 && n_files * 1000000.0 / elapsed > rate)
+				rate = n_files * 1000000.0 / elapsed;
+		}
+
+		if (base_rate == 0)
+			base_rate = rate;
+
+		printf("%-8d %-10.0f x%.2f\n", n_threads, rate, base_rate > 0 ? rate / base_rate : 0);
+	}
+
+	g_strfreev(counts);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,204 @@
+/***
+
+Copyright (C) 2015, 2016 Teclib'
+
+This file is part of Armadito core.
+
+Armadito core is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Armadito core is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Armadito core.  If not, see <http://www.gnu.org/licenses/>.
+
+***/
+
+
+/*
+ * Compares the built-in recognition of file types (see libcore/mimemagic.c)
+ * with libmagic: throughput of both on the headers of the files found in
+ * the given directories, and how often they agree.
+ *
+ * Usage: bench-mimetype [-v] [-n ROUNDS] FILE|DIR...
+ *
+ * File headers are read once before timing, so that only classification
+ * is measured. With -v, the files on which the built-in recognition and
+ * libmagic disagree are listed.
+ */
+
+#define _GNU_SOURCE
+#include "armadito-config.h"
+
+#include "mimemagic_p.h"
+
+#include <glib.h>
+#include <magic.h>
+#include <ftw.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PROGRAM_NAME "bench-mimetype"
+
+/* same as os_mime_type_guess_fd() */
+#define HEADER_SIZE 1024
+
+struct header {
+	char *path;
+	size_t size;
+	unsigned char buffer[HEADER_SIZE];
+};
+
+static GPtrArray *headers;
+
+static int add_header(const char *path, const struct stat *sb, int flag, struct FTW *ftwbuf)
+{
+	struct header *h;
+	ssize_t n_read;
+	int fd;
+
+	if (flag != FTW_F || !S_ISREG(sb->st_mode))
+		return 0;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return 0;
+
+	h = malloc(sizeof(struct header));
+	n_read = read(fd, h->buffer, HEADER_SIZE);
+	close(fd);
+
+	if (n_read < 0) {
+		free(h);
+		return 0;
+	}
+
+	h->path = strdup(path);
+	h->size = n_read;
+	g_ptr_array_add(headers, h);
+
+	return 0;
+}
+
+static double files_per_second(guint n_files, gint64 start, gint64 end)
+{
+	return end > start ? n_files * 1000000.0 / (end - start) : 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: " PROGRAM_NAME " [-v] [-n ROUNDS] FILE|DIR...\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	int verbose = 0, n_rounds = 10, round, c;
+	guint i, n_builtin = 0, n_agree = 0;
+	const char **libmagic_mimes;
+	const char *mime_type;
+	gint64 start;
+	double builtin_rate, libmagic_rate, combined_rate;
+	magic_t m;
+
+	while ((c = getopt(argc, argv, "vn:")) != -1) {
+		switch (c) {
+		case 'v':
+			verbose = 1;
+			break;
+		case 'n':
+			n_rounds = atoi(optarg);
+			if (n_rounds <= 0)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind >= argc)
+		usage();
+
+	headers = g_ptr_array_new();
+	for (; optind < argc; optind++)
+		if (nftw(argv[optind], add_header, 32, FTW_PHYS) != 0)
+			perror(argv[optind]);
+
+	if (headers->len == 0) {
+		fprintf(stderr, PROGRAM_NAME ": no file to classify\n");
+		return EXIT_FAILURE;
+	}
+
+	m = magic_open(MAGIC_MIME_TYPE);
+	magic_load(m, NULL);
+	mime_magic_init();
+
+	if (magic_version() < MIME_MAGIC_LIBMAGIC_VERSION)
+		fprintf(stderr, PROGRAM_NAME ": libmagic version %d is older than %d, types are named differently\n", magic_version(), MIME_MAGIC_LIBMAGIC_VERSION);
+
+	/* agreement */
+	libmagic_mimes = malloc(headers->len * sizeof(const char *));
+	for (i = 0; i < headers->len; i++) {
+		struct header *h = g_ptr_array_index(headers, i);
+
+		mime_type = magic_buffer(m, h->buffer, h->size);
+		libmagic_mimes[i] = mime_type != NULL ? g_intern_string(mime_type) : NULL;
+
+		if ((mime_type = mime_magic_guess(h->buffer, h->size)) == NULL)
+			continue;
+
+		n_builtin++;
+		if (mime_type == libmagic_mimes[i])
+			n_agree++;
+		else if (verbose)
+			printf("%s: built-in %s, libmagic %s\n", h->path, mime_type, libmagic_mimes[i] != NULL ? libmagic_mimes[i] : "none");
+	}
+
+	/* throughput */
+	start = g_get_monotonic_time();
+	for (round = 0; round < n_rounds; round++)
+		for (i = 0; i < headers->len; i++) {
+			struct header *h = g_ptr_array_index(headers, i);
+
+			mime_magic_guess(h->buffer, h->size);
+		}
+	builtin_rate = files_per_second(n_rounds * headers->len, start, g_get_monotonic_time());
+
+	start = g_get_monotonic_time();
+	for (round = 0; round < n_rounds; round++)
+		for (i = 0; i < headers->len; i++) {
+			struct header *h = g_ptr_array_index(headers, i);
+
+			g_intern_string(magic_buffer(m, h->buffer, h->size));
+		}
+	libmagic_rate = files_per_second(n_rounds * headers->len, start, g_get_monotonic_time());
+
+	start = g_get_monotonic_time();
+	for (round = 0; round < n_rounds; round++)
+		for (i = 0; i < headers->len; i++) {
+			struct header *h = g_ptr_array_index(headers, i);
+
+			if (mime_magic_guess(h->buffer, h->size) == NULL)
+				g_intern_string(magic_buffer(m, h->buffer, h->size));
+		}
+	combined_rate = files_per_second(n_rounds * headers->len, start, g_get_monotonic_time());
+
+	printf("files:                %u\n", headers->len);
+	printf("recognized built-in:  %u (%.1f%%)\n", n_builtin, 100.0 * n_builtin / headers->len);
+	printf("agreeing with magic:  %u (%.1f%% of recognized)\n", n_agree, n_builtin ? 100.0 * n_agree / n_builtin : 100.0);
+	printf("built-in only:        %.0f files/s\n", builtin_rate);
+	printf("libmagic only:        %.0f files/s\n", libmagic_rate);
+	printf("built-in + libmagic:  %.0f files/s (x%.2f)\n", combined_rate, libmagic_rate > 0 ? combined_rate / libmagic_rate : 0);
+
+	magic_close(m);
+	free(libmagic_mimes);
+
+	return n_agree == n_builtin ? EXIT_SUCCESS : EXIT_FAILURE;
+}